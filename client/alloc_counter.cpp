@@ -0,0 +1,85 @@
+#include "alloc_counter.h"
+
+#ifdef BOOK_TENNIS_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<qint64> g_allocations{ 0 };
+
+	void* CountedAlloc(std::size_t size)
+	{
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+		return std::malloc(size ? size : 1);
+	}
+}
+
+void* operator new(std::size_t size)
+{
+	if (void* ptr = CountedAlloc(size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+#endif
+
+namespace alloc_counter
+{
+	bool IsEnabled()
+	{
+#ifdef BOOK_TENNIS_COUNT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	qint64 Count()
+	{
+#ifdef BOOK_TENNIS_COUNT_ALLOCATIONS
+		return g_allocations.load(std::memory_order_relaxed);
+#else
+		return -1;
+#endif
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Счетчик выделений памяти через operator new.
+// Работает при сборке с BOOK_TENNIS_COUNT_ALLOCATIONS (опция cmake), иначе Count() == -1
+namespace alloc_counter
+{
+	bool IsEnabled();
+
+	qint64 Count();
+}
@@ -0,0 +1,263 @@
+#include "async_image_finder.h"
+
+#include <QDebug>
+#include <QThread>
+
+#include "input_simulator.h"
+#include "monotonic_clock.h"
+#include "opencl_context.h"
+
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+
+	// Ожидание порциями: новые запросы и отмена будят поток сразу, это лишь верхняя граница
+	const qint64 kMaxSleepSliceNs = 50 * kNsInMs;
+}
+
+FindFuture::FindFuture()
+	: FindFuture(CancellationToken())
+{
+}
+
+FindFuture::FindFuture(const CancellationToken& token)
+	: state_(new State)
+{
+	state_->token = token;
+}
+
+bool FindFuture::IsFinished() const
+{
+	QMutexLocker locker(&state_->mutex);
+	return state_->finished;
+}
+
+FindResult FindFuture::Result() const
+{
+	QMutexLocker locker(&state_->mutex);
+	return state_->result;
+}
+
+bool FindFuture::WaitForFinished(unsigned long timeout_ms) const
+{
+	QMutexLocker locker(&state_->mutex);
+	while (!state_->finished)
+	{
+		if (!state_->finished_condition.wait(&state_->mutex, timeout_ms))
+		{
+			return state_->finished;
+		}
+	}
+	return true;
+}
+
+void FindFuture::Cancel()
+{
+	state_->token.Cancel();
+}
+
+CancellationToken FindFuture::Token() const
+{
+	return state_->token;
+}
+
+void FindFuture::Finish(const FindResult& result)
+{
+	QMutexLocker locker(&state_->mutex);
+	state_->result = result;
+	state_->finished = true;
+	state_->finished_condition.wakeAll();
+}
+
+AsyncImageFinder::AsyncImageFinder(QObject* parent)
+	: QObject(parent)
+{
+	thread_ = QThread::create([this]() { Run(); });
+	thread_->start();
+}
+
+AsyncImageFinder::~AsyncImageFinder()
+{
+	{
+		QMutexLocker locker(&mutex_);
+		stop_ = true;
+		wake_.wakeAll();
+	}
+
+	thread_->wait();
+	delete thread_;
+}
+
+FindFuture AsyncImageFinder::Find(const FindRequest& request, const CancellationToken& token,
+	const Callback& callback, QObject* receiver)
+{
+	std::unique_ptr<Job> job(new Job);
+	job->request = request;
+	job->future = FindFuture(token);
+	job->callback = callback;
+	job->receiver = receiver ? receiver : this;
+	const FindFuture future = job->future;
+
+	QMutexLocker locker(&mutex_);
+	incoming_.push_back(std::move(job));
+	wake_.wakeAll();
+	return future;
+}
+
+void AsyncImageFinder::Wake()
+{
+	QMutexLocker locker(&mutex_);
+	wake_.wakeAll();
+}
+
+bool AsyncImageFinder::StartJob(Job& job)
+{
+	if (!context_)
+	{
+		context_.reset(new OpenCLContext);
+	}
+
+	// Отмена будит фоновый поток, даже если он спит между опросами
+	job.wake_subscription = job.future.Token().Subscribe([this]() { Wake(); });
+
+	job.finder.reset(new OpenCLImageFinder);
+	job.finder->SetContext(context_);
+	job.finder->SetParams(job.request.detect_area, job.request.monitor_number);
+	job.finder->SetPipelineFile(job.request.pipeline_file);
+	job.finder->SetTemplatePack(job.request.template_pack);
+	job.finder->SetRecordFile(job.request.record_file);
+	job.finder->SetFrameSource(job.request.frame_source);
+	job.finder->SetPollingConfig(job.request.polling_config);
+	job.finder->SetBookingOpenTime(job.request.booking_open_time);
+	job.finder->SetInputSimulator(job.request.input_simulator);
+	job.finder->SetTrackedGeometry(job.request.tracked_geometry);
+	job.finder->SetCancellationToken(job.future.Token());
+	return job.finder->BeginRun();
+}
+
+void AsyncImageFinder::Complete(Job& job, FindResult::Status status)
+{
+	if (job.wake_subscription >= 0)
+	{
+		job.future.Token().Unsubscribe(job.wake_subscription);
+		job.wake_subscription = -1;
+	}
+
+	FindResult result;
+	result.status = status;
+	if (job.finder)
+	{
+		job.finder->EndRun();
+		result.match = job.finder->LastMatch();
+		result.stats = job.finder->Stats();
+	}
+
+	job.future.Finish(result);
+
+	if (job.callback && job.receiver)
+	{
+		const Callback callback = job.callback;
+		QMetaObject::invokeMethod(job.receiver.data(), [callback, result]() { callback(result); }, Qt::QueuedConnection);
+	}
+}
+
+void AsyncImageFinder::Run()
+{
+	std::vector<std::unique_ptr<Job>> jobs;
+	for (;;)
+	{
+		std::vector<std::unique_ptr<Job>> started;
+		{
+			QMutexLocker locker(&mutex_);
+			if (stop_)
+			{
+				break;
+			}
+			started.swap(incoming_);
+		}
+
+		for (std::unique_ptr<Job>& job : started)
+		{
+			if (!StartJob(*job))
+			{
+				Complete(*job, job->future.Token().IsCancelled() ? FindResult::Status::Cancelled : FindResult::Status::Failed);
+				continue;
+			}
+			jobs.push_back(std::move(job));
+		}
+
+		// Поиск, которому пора и который дольше всех ждал; отмененные завершаются сразу
+		Job* next = nullptr;
+		qint64 wait_ns = kMaxSleepSliceNs;
+		for (auto it = jobs.begin(); it != jobs.end();)
+		{
+			Job& job = **it;
+			if (job.future.Token().IsCancelled())
+			{
+				Complete(job, FindResult::Status::Cancelled);
+				it = jobs.erase(it);
+				continue;
+			}
+
+			const qint64 job_wait_ns = job.finder->NextTickInNs();
+			if (job_wait_ns > 0)
+			{
+				wait_ns = qMin(wait_ns, job_wait_ns);
+			}
+			else if (!next || job.last_served_ns < next->last_served_ns)
+			{
+				next = &job;
+			}
+			++it;
+		}
+
+		if (!next)
+		{
+			// Отмена проверяется под тем же мьютексом, под которым ее сигнализирует Wake, чтобы не потерять пробуждение
+			QMutexLocker locker(&mutex_);
+			bool cancelled = false;
+			for (const std::unique_ptr<Job>& job : jobs)
+			{
+				cancelled = cancelled || job->future.Token().IsCancelled();
+			}
+			if (!stop_ && !cancelled && incoming_.empty())
+			{
+				wake_.wait(&mutex_, static_cast<unsigned long>(qMax<qint64>(wait_ns / kNsInMs, 1)));
+			}
+			continue;
+		}
+
+		next->last_served_ns = MonotonicNs();
+		const OpenCLImageFinder::TickResult result = next->finder->Tick();
+		if (result == OpenCLImageFinder::TickResult::Pending)
+		{
+			continue;
+		}
+
+		Complete(*next, result == OpenCLImageFinder::TickResult::Succeed ? FindResult::Status::Found
+			: result == OpenCLImageFinder::TickResult::Cancelled ? FindResult::Status::Cancelled
+			: FindResult::Status::Failed);
+		for (auto it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			if (it->get() == next)
+			{
+				jobs.erase(it);
+				break;
+			}
+		}
+	}
+
+	// Остановка: незавершенные поиски считаются отмененными
+	for (std::unique_ptr<Job>& job : jobs)
+	{
+		job->future.Cancel();
+		Complete(*job, FindResult::Status::Cancelled);
+	}
+	for (std::unique_ptr<Job>& job : incoming_)
+	{
+		Complete(*job, FindResult::Status::Cancelled);
+	}
+	incoming_.clear();
+	jobs.clear();
+	context_.reset();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QWaitCondition>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "detection_stats.h"
+#include "geometry_area.h"
+#include "opencl_image_finder.h"
+#include "polling_scheduler.h"
+
+class FrameSource;
+class InputSimulator;
+class OpenCLContext;
+class QThread;
+
+// Параметры одного поиска
+struct FindRequest
+{
+	geometry_area detect_area;
+	int monitor_number = 0;
+	QString pipeline_file;
+	QString record_file;
+	QSharedPointer<FrameSource> frame_source;
+	PollingConfig polling_config;
+	QDateTime booking_open_time;
+	QSharedPointer<InputSimulator> input_simulator;
+	// Необязательно: detect_area и точка щелчка, которые обновляются во время поиска
+	QSharedPointer<TrackedGeometry> tracked_geometry;
+	// Необязательно: шаблоны стадий из пакета вместо изображений из описания
+	QSharedPointer<const TemplatePack> template_pack;
+};
+
+// Итог поиска: где и с какой точностью сработало, сколько времени заняло
+struct FindResult
+{
+	enum class Status
+	{
+		Found,
+		Failed,
+		Cancelled
+	};
+
+	Status status = Status::Failed;
+	OpenCLImageFinder::StageMatch match;
+	DetectionStats stats;
+};
+
+// Описатель запущенного поиска. Копии разделяют одно состояние
+class FindFuture final
+{
+public:
+	FindFuture();
+
+	bool IsFinished() const;
+
+	// Итог. Имеет смысл после IsFinished
+	FindResult Result() const;
+
+	// Блокирующее ожидание, не для потока интерфейса. false - не дождались
+	bool WaitForFinished(unsigned long timeout_ms = std::numeric_limits<unsigned long>::max()) const;
+
+	void Cancel();
+
+	CancellationToken Token() const;
+
+private:
+	friend class AsyncImageFinder;
+
+	explicit FindFuture(const CancellationToken& token);
+
+	void Finish(const FindResult& result);
+
+private:
+	struct State
+	{
+		mutable QMutex mutex;
+		QWaitCondition finished_condition;
+		bool finished = false;
+		FindResult result;
+		CancellationToken token;
+	};
+
+	QSharedPointer<State> state_;
+};
+
+// Асинхронный поиск: запросы выполняются в одном фоновом потоке с общим контекстом OpenCL,
+// несколько поисков чередуются так же, как сессии SessionManager. Вызывающий поток не блокируется
+class AsyncImageFinder final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	using Callback = std::function<void(const FindResult&)>;
+
+	explicit AsyncImageFinder(QObject* parent = nullptr);
+	~AsyncImageFinder() override;
+
+	// Запуск поиска. callback вызывается в потоке receiver (по умолчанию - в потоке этого объекта),
+	// если receiver к тому времени еще существует
+	FindFuture Find(const FindRequest& request, const CancellationToken& token = CancellationToken(),
+		const Callback& callback = Callback(), QObject* receiver = nullptr);
+
+private:
+	struct Job
+	{
+		FindRequest request;
+		FindFuture future;
+		Callback callback;
+		QPointer<QObject> receiver;
+		std::unique_ptr<OpenCLImageFinder> finder;
+		int wake_subscription = -1;
+		qint64 last_served_ns = 0;
+	};
+
+	void Run();
+
+	bool StartJob(Job& job);
+
+	void Complete(Job& job, FindResult::Status status);
+
+	void Wake();
+
+private:
+	QThread* thread_ = nullptr;
+
+	QMutex mutex_;
+	QWaitCondition wake_;
+	std::vector<std::unique_ptr<Job>> incoming_;
+	bool stop_ = false;
+
+	// Используется только фоновым потоком
+	QSharedPointer<OpenCLContext> context_;
+};
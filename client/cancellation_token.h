@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <functional>
+
+// Токен отмены: копии разделяют одно состояние. Cancel можно вызывать из любого потока,
+// подписчики вызываются в потоке, вызвавшем Cancel
+class CancellationToken final
+{
+public:
+	CancellationToken()
+		: state_(new State)
+	{
+	}
+
+	void Cancel()
+	{
+		QMutexLocker locker(&state_->mutex);
+		if (state_->cancelled.fetchAndStoreOrdered(1) != 0)
+		{
+			return;
+		}
+
+		for (const std::function<void()>& callback : state_->callbacks)
+		{
+			callback();
+		}
+	}
+
+	bool IsCancelled() const
+	{
+		return state_->cancelled.loadAcquire() != 0;
+	}
+
+	// Подписка на отмену. Если токен уже отменен, callback вызывается сразу.
+	// Unsubscribe дожидается выполняющегося callback, поэтому после него callback уже не вызовется
+	int Subscribe(const std::function<void()>& callback)
+	{
+		QMutexLocker locker(&state_->mutex);
+		const int id = ++state_->last_id;
+		state_->callbacks.insert(id, callback);
+		if (IsCancelled())
+		{
+			callback();
+		}
+		return id;
+	}
+
+	void Unsubscribe(int id)
+	{
+		QMutexLocker locker(&state_->mutex);
+		state_->callbacks.remove(id);
+	}
+
+private:
+	struct State
+	{
+		QAtomicInt cancelled;
+		QMutex mutex;
+		QMap<int, std::function<void()>> callbacks;
+		int last_id = 0;
+	};
+
+	QSharedPointer<State> state_;
+};
@@ -0,0 +1,77 @@
+#include "clock_sync.h"
+
+namespace
+{
+	// Окно фильтра: последние обмены
+	const int kWindowSamples = 8;
+
+	// Меньше обменов - оценка еще ненадежна
+	const int kMinSamples = 4;
+
+	const qint64 kNsInMs = 1000000;
+}
+
+void ClockSync::Reset()
+{
+	samples_.clear();
+	next_sample_ = 0;
+	best_ = Sample();
+}
+
+void ClockSync::AddSample(qint64 t0, qint64 t1, qint64 t2, qint64 t3)
+{
+	Sample sample;
+	sample.offset_ns = ((t1 - t0) + (t2 - t3)) / 2;
+	sample.delay_ns = (t3 - t0) - (t2 - t1);
+
+	// Отрицательная задержка - часы клиента переставили во время обмена
+	if (sample.delay_ns < 0)
+	{
+		return;
+	}
+
+	if (samples_.size() < kWindowSamples)
+	{
+		samples_.append(sample);
+	}
+	else
+	{
+		samples_[next_sample_] = sample;
+		next_sample_ = (next_sample_ + 1) % kWindowSamples;
+	}
+	UpdateBest();
+}
+
+void ClockSync::UpdateBest()
+{
+	best_ = samples_.first();
+	for (const Sample& sample : samples_)
+	{
+		if (sample.delay_ns < best_.delay_ns)
+		{
+			best_ = sample;
+		}
+	}
+}
+
+bool ClockSync::IsSynchronized() const
+{
+	return samples_.size() >= kMinSamples;
+}
+
+qint64 ClockSync::OffsetNs() const
+{
+	return best_.offset_ns;
+}
+
+qint64 ClockSync::DelayNs() const
+{
+	return best_.delay_ns;
+}
+
+QDateTime ClockSync::ServerToLocal(const QDateTime& server_time) const
+{
+	// Округление к ближайшей мс: QDateTime точнее не хранит
+	const qint64 offset_ms = (best_.offset_ns + (best_.offset_ns >= 0 ? kNsInMs / 2 : -kNsInMs / 2)) / kNsInMs;
+	return server_time.addMSecs(-offset_ms);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QDateTime>
+#include <QVector>
+
+// Оценка сдвига часов клиента относительно сервера по обменам с четырьмя отметками (как в NTP):
+// сдвиг = ((t1 - t0) + (t2 - t3)) / 2, задержка = (t3 - t0) - (t2 - t1).
+// Из последних обменов берется тот, у которого задержка минимальна: его сдвиг меньше всего искажен очередями
+class ClockSync final
+{
+public:
+	void Reset();
+
+	void AddSample(qint64 t0, qint64 t1, qint64 t2, qint64 t3);
+
+	// Достаточно обменов для оценки
+	bool IsSynchronized() const;
+
+	// Часы сервера минус часы клиента, нс
+	qint64 OffsetNs() const;
+
+	// Круговая задержка лучшего обмена, нс. Погрешность сдвига не больше ее половины
+	qint64 DelayNs() const;
+
+	// Момент по часам сервера -> момент по часам клиента
+	QDateTime ServerToLocal(const QDateTime& server_time) const;
+
+private:
+	struct Sample
+	{
+		qint64 offset_ns = 0;
+		qint64 delay_ns = 0;
+	};
+
+	void UpdateBest();
+
+private:
+	QVector<Sample> samples_;
+	int next_sample_ = 0;
+	Sample best_;
+};
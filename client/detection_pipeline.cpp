@@ -0,0 +1,158 @@
+#include "detection_pipeline.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+const QString DetectionPipeline::kDefaultPath = QString::fromUtf8(":/resources/default_pipeline.json");
+
+bool DetectionPipeline::LoadFromFile(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open pipeline file : ") << path << file.errorString();
+		return false;
+	}
+
+	return Parse(file.readAll(), QFileInfo(path).absolutePath());
+}
+
+const QVector<DetectionStage>& DetectionPipeline::Stages() const
+{
+	return stages_;
+}
+
+int DetectionPipeline::IndexOf(const QString& name) const
+{
+	for (int i = 0; i < stages_.size(); ++i)
+	{
+		if (stages_[i].name == name)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+QRect DetectionPipeline::ResolveRegion(const DetectionStage& stage, const QSize& frame_size, const geometry_area& detect_area)
+{
+	QRect region = stage.use_detect_area
+		? QRect(detect_area.x, detect_area.y, detect_area.width, detect_area.height)
+		: stage.region;
+
+	if (region.x() < 0)
+	{
+		region.moveLeft(frame_size.width() + region.x());
+	}
+	if (region.y() < 0)
+	{
+		region.moveTop(frame_size.height() + region.y());
+	}
+
+	return region.intersected(QRect(QPoint(0, 0), frame_size));
+}
+
+bool DetectionPipeline::Parse(const QByteArray& json, const QString& base_dir)
+{
+	QJsonParseError error;
+	const QJsonDocument document = QJsonDocument::fromJson(json, &error);
+	if (document.isNull())
+	{
+		qWarning() << QString::fromUtf8("Pipeline parse error : ") << error.errorString();
+		return false;
+	}
+
+	QVector<DetectionStage> stages;
+	const QJsonArray stages_json = document.object().value(QStringLiteral("stages")).toArray();
+	for (const QJsonValue& value : stages_json)
+	{
+		const QJsonObject object = value.toObject();
+
+		DetectionStage stage;
+		stage.name = object.value(QStringLiteral("name")).toString();
+		stage.after = object.value(QStringLiteral("after")).toString();
+		stage.threshold = object.value(QStringLiteral("threshold")).toDouble(stage.threshold);
+		stage.timeout_ms = object.value(QStringLiteral("timeout_ms")).toInt(stage.timeout_ms);
+		stage.poll_interval_ms = object.value(QStringLiteral("poll_interval_ms")).toInt(stage.poll_interval_ms);
+
+		const QString action = object.value(QStringLiteral("action")).toString(QStringLiteral("none"));
+		if (action == QStringLiteral("click"))
+		{
+			stage.action = DetectionStage::Action::Click;
+		}
+		else if (action != QStringLiteral("none"))
+		{
+			qWarning() << QString::fromUtf8("Unknown stage action : ") << action;
+			return false;
+		}
+
+		const QJsonValue region = object.value(QStringLiteral("region"));
+		if (region.isString() && region.toString() == QStringLiteral("detect_area"))
+		{
+			stage.use_detect_area = true;
+		}
+		else
+		{
+			const QJsonObject rect = region.toObject();
+			stage.region = QRect(rect.value(QStringLiteral("x")).toInt(), rect.value(QStringLiteral("y")).toInt(),
+				rect.value(QStringLiteral("width")).toInt(), rect.value(QStringLiteral("height")).toInt());
+		}
+
+		// Относительные пути считаем от каталога файла конфигурации
+		stage.template_path = object.value(QStringLiteral("template")).toString();
+		if (!stage.template_path.startsWith(':') && QFileInfo(stage.template_path).isRelative())
+		{
+			stage.template_path = QDir(base_dir).filePath(stage.template_path);
+		}
+
+		stage.template_image = QImage(stage.template_path);
+		if (stage.template_image.isNull())
+		{
+			qWarning() << QString::fromUtf8("Не удалось загрузить изображение") << stage.template_path;
+			return false;
+		}
+
+		stages.append(stage);
+	}
+
+	stages_.swap(stages);
+	return Validate();
+}
+
+bool DetectionPipeline::Validate() const
+{
+	if (stages_.isEmpty())
+	{
+		qWarning() << QString::fromUtf8("Pipeline has no stages");
+		return false;
+	}
+
+	for (int i = 0; i < stages_.size(); ++i)
+	{
+		const DetectionStage& stage = stages_[i];
+		if (stage.name.isEmpty() || IndexOf(stage.name) != i)
+		{
+			qWarning() << QString::fromUtf8("Stage name is empty or duplicated : ") << stage.name;
+			return false;
+		}
+
+		if (!stage.after.isEmpty() && IndexOf(stage.after) < 0)
+		{
+			qWarning() << QString::fromUtf8("Unknown stage dependency : ") << stage.after;
+			return false;
+		}
+
+		if (!stage.use_detect_area && stage.region.isEmpty())
+		{
+			qWarning() << QString::fromUtf8("Stage region is empty : ") << stage.name;
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "geometry_area.h"
+
+// Стадия детекции: что ищем, где, с каким порогом и что делаем при срабатывании
+struct DetectionStage
+{
+	enum class Action
+	{
+		None,   // только отметить срабатывание и активировать зависимые стадии
+		Click   // щелчок и отправка '+', конец работы
+	};
+
+	QString name;
+	QString template_path;
+	QImage template_image;
+
+	// Отрицательные x/y отсчитываются от правого/нижнего края кадра
+	QRect region;
+	bool use_detect_area = false;
+
+	double threshold = 0.95;
+	int timeout_ms = 0;        // 0 - без ограничения
+	int poll_interval_ms = 0;  // 0 - каждый кадр
+
+	// Стадия становится активной после срабатывания стадии after (пусто - сразу)
+	QString after;
+
+	Action action = Action::None;
+};
+
+// Набор стадий детекции, загружаемый из json
+class DetectionPipeline final
+{
+public:
+	// Две стадии: поле ввода внизу экрана, затем сообщение о старте записи в detect_area
+	static const QString kDefaultPath;
+
+	bool LoadFromFile(const QString& path);
+
+	const QVector<DetectionStage>& Stages() const;
+
+	int IndexOf(const QString& name) const;
+
+	// Область поиска стадии в координатах кадра
+	static QRect ResolveRegion(const DetectionStage& stage, const QSize& frame_size, const geometry_area& detect_area);
+
+private:
+	bool Parse(const QByteArray& json, const QString& base_dir);
+
+	bool Validate() const;
+
+private:
+	QVector<DetectionStage> stages_;
+};
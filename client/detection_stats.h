@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QString>
+#include <limits>
+
+// Статистика цикла детекции
+struct DetectionStats
+{
+	int frames = 0;
+	qint64 grab_ns = 0;
+	qint64 detect_ns = 0;
+	qint64 detect_min_ns = std::numeric_limits<qint64>::max();
+	qint64 detect_max_ns = 0;
+	qint64 total_ns = 0;   // от старта до срабатывания
+	qint64 action_ns = 0;  // отправка подготовленного ввода
+	qint64 allocations = -1; // выделения памяти в детекции после первого кадра, -1 - не считались
+
+	void Reset()
+	{
+		*this = DetectionStats();
+	}
+
+	void AddFrame(qint64 frame_grab_ns, qint64 frame_detect_ns)
+	{
+		++frames;
+		grab_ns += frame_grab_ns;
+		detect_ns += frame_detect_ns;
+		detect_min_ns = qMin(detect_min_ns, frame_detect_ns);
+		detect_max_ns = qMax(detect_max_ns, frame_detect_ns);
+	}
+
+	void AddAllocations(qint64 count)
+	{
+		allocations = qMax<qint64>(allocations, 0) + count;
+	}
+
+	QString ToString() const
+	{
+		if (frames == 0)
+		{
+			return QString::fromUtf8("frames: 0");
+		}
+
+		const double to_ms = 1.0 / 1000000.0;
+		return QString::fromUtf8("frames: %1; grab avg: %2 ms; detect avg: %3 ms, min: %4 ms, max: %5 ms; total: %6 ms; action: %7 ms")
+			.arg(frames)
+			.arg(grab_ns * to_ms / frames, 0, 'f', 3)
+			.arg(detect_ns * to_ms / frames, 0, 'f', 3)
+			.arg(detect_min_ns * to_ms, 0, 'f', 3)
+			.arg(detect_max_ns * to_ms, 0, 'f', 3)
+			.arg(total_ns * to_ms, 0, 'f', 3)
+			.arg(action_ns * to_ms, 0, 'f', 3)
+			+ (allocations >= 0 ? QString::fromUtf8("; allocs: %1").arg(allocations) : QString());
+	}
+};
@@ -0,0 +1,62 @@
+#include "frame_arena.h"
+
+#include <QDebug>
+
+FrameArena::~FrameArena()
+{
+	Release();
+}
+
+bool FrameArena::Reserve(cl_context context, const QSize& size)
+{
+	if (device_ && size == size_)
+	{
+		return true;
+	}
+
+	Release();
+
+	const size_t count = static_cast<size_t>(size.width()) * size.height();
+	host_.resize(count);
+
+	cl_int err;
+	device_ = clCreateBuffer(context, CL_MEM_READ_ONLY, count * sizeof(float), nullptr, &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Create arena buffer error : ") << err;
+		device_ = nullptr;
+		host_.clear();
+		return false;
+	}
+
+	size_ = size;
+	return true;
+}
+
+void FrameArena::Release()
+{
+	if (device_)
+	{
+		clReleaseMemObject(device_);
+		device_ = nullptr;
+	}
+
+	host_.clear();
+	host_.shrink_to_fit();
+	size_ = QSize();
+}
+
+float* FrameArena::HostData()
+{
+	return host_.data();
+}
+
+size_t FrameArena::ByteSize() const
+{
+	return host_.size() * sizeof(float);
+}
+
+cl_mem FrameArena::DeviceBuffer() const
+{
+	return device_;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QSize>
+#include <QVector>
+#include <vector>
+#include <CL/opencl.h>
+
+// Переиспользуемые буферы (на хосте и на устройстве) под одну геометрию области поиска.
+// После первого кадра цикл детекции не выделяет память
+class FrameArena final
+{
+public:
+	FrameArena() = default;
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	bool Reserve(cl_context context, const QSize& size);
+
+	void Release();
+
+	float* HostData();
+	size_t ByteSize() const;
+	cl_mem DeviceBuffer() const;
+
+private:
+	QSize size_;
+	std::vector<float> host_;
+	cl_mem device_ = nullptr;
+};
+
+// Шаблон, один раз переведенный во float и загруженный на устройство.
+// buffer содержит все масштабированные варианты подряд, variants - их таблицу [offset, width, height, 0],
+// а width/height - размеры наименьшего варианта
+struct PreparedTemplate
+{
+	int width = 0;
+	int height = 0;
+	cl_mem buffer = nullptr;
+
+	QVector<qreal> scales;
+	cl_mem variants = nullptr;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Формат файла записи кадров (порядок байт - как на машине, где велась запись):
+//   FileHeader
+//   { FrameHeader, пиксели height * bytes_per_line, выравнивание до kAlignment } * N
+namespace frame_container
+{
+	const char kMagic[4] = { 'B', 'T', 'F', 'R' };
+	const quint32 kVersion = 1;
+
+	// Данные кадров выровнены, чтобы QImage поверх mmap читал строки без копирования
+	const qint64 kAlignment = 64;
+
+	struct FileHeader
+	{
+		char magic[4];
+		quint32 version;
+		quint32 header_size;
+		quint32 reserved;
+	};
+
+	struct FrameHeader
+	{
+		qint64 timestamp_ns;
+		quint32 width;
+		quint32 height;
+		quint32 bytes_per_line;
+		quint32 format; // QImage::Format
+		qint64 data_size;
+	};
+
+	inline qint64 AlignedSize(qint64 size)
+	{
+		return (size + kAlignment - 1) / kAlignment * kAlignment;
+	}
+}
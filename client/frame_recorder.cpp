@@ -0,0 +1,97 @@
+#include "frame_recorder.h"
+#include "frame_container.h"
+
+#include <QDebug>
+#include <cstring>
+
+FrameRecorder::~FrameRecorder()
+{
+	Close();
+}
+
+bool FrameRecorder::Open(const QString& path)
+{
+	Close();
+
+	file_.setFileName(path);
+	if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		qWarning() << QString::fromUtf8("Unable to open record file : ") << path << file_.errorString();
+		return false;
+	}
+
+	frame_container::FileHeader header = {};
+	std::memcpy(header.magic, frame_container::kMagic, sizeof(header.magic));
+	header.version = frame_container::kVersion;
+	header.header_size = sizeof(frame_container::FileHeader);
+
+	if (file_.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)
+		|| !WritePadding(sizeof(header)))
+	{
+		qWarning() << QString::fromUtf8("Write record header error : ") << file_.errorString();
+		file_.close();
+		return false;
+	}
+
+	frames_written_ = 0;
+	return true;
+}
+
+void FrameRecorder::Close()
+{
+	if (file_.isOpen())
+	{
+		file_.close();
+		qDebug() << QString::fromUtf8("Frames recorded : ") << frames_written_;
+	}
+}
+
+bool FrameRecorder::IsOpen() const
+{
+	return file_.isOpen();
+}
+
+bool FrameRecorder::Write(const QImage& frame, qint64 timestamp_ns)
+{
+	if (!file_.isOpen() || frame.isNull())
+	{
+		return false;
+	}
+
+	frame_container::FrameHeader header = {};
+	header.timestamp_ns = timestamp_ns;
+	header.width = frame.width();
+	header.height = frame.height();
+	header.bytes_per_line = frame.bytesPerLine();
+	header.format = frame.format();
+	header.data_size = static_cast<qint64>(frame.bytesPerLine()) * frame.height();
+
+	if (file_.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)
+		|| !WritePadding(sizeof(header)))
+	{
+		qWarning() << QString::fromUtf8("Write frame header error : ") << file_.errorString();
+		return false;
+	}
+
+	if (file_.write(reinterpret_cast<const char*>(frame.constBits()), header.data_size) != header.data_size
+		|| !WritePadding(header.data_size))
+	{
+		qWarning() << QString::fromUtf8("Write frame data error : ") << file_.errorString();
+		return false;
+	}
+
+	++frames_written_;
+	return true;
+}
+
+int FrameRecorder::FramesWritten() const
+{
+	return frames_written_;
+}
+
+bool FrameRecorder::WritePadding(qint64 size)
+{
+	static const char zeros[frame_container::kAlignment] = {};
+	const qint64 padding = frame_container::AlignedSize(size) - size;
+	return padding == 0 || file_.write(zeros, padding) == padding;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QFile>
+#include <QImage>
+
+// Запись захваченных кадров в файл для последующего воспроизведения
+class FrameRecorder final
+{
+public:
+	FrameRecorder() = default;
+	~FrameRecorder();
+
+	bool Open(const QString& path);
+	void Close();
+
+	bool IsOpen() const;
+
+	bool Write(const QImage& frame, qint64 timestamp_ns);
+
+	int FramesWritten() const;
+
+private:
+	bool WritePadding(qint64 size);
+
+private:
+	QFile file_;
+	int frames_written_ = 0;
+};
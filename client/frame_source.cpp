@@ -0,0 +1,22 @@
+#include "frame_source.h"
+
+#include <QScreen>
+#include <QPixmap>
+
+ScreenFrameSource::ScreenFrameSource(QScreen* screen)
+	: screen_(screen)
+{
+	clock_.start();
+}
+
+bool ScreenFrameSource::NextFrame(QImage& frame, qint64& timestamp_ns)
+{
+	if (!screen_)
+	{
+		return false;
+	}
+
+	timestamp_ns = clock_.nsecsElapsed();
+	frame = screen_->grabWindow(0).toImage();
+	return !frame.isNull();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QImage>
+#include <QElapsedTimer>
+
+class QScreen;
+
+// Источник кадров для цикла детекции
+class FrameSource
+{
+public:
+	virtual ~FrameSource() = default;
+
+	// Следующий кадр и время его захвата в наносекундах. false - кадров больше нет
+	virtual bool NextFrame(QImage& frame, qint64& timestamp_ns) = 0;
+};
+
+// Захват кадров с экрана через QScreen::grabWindow
+class ScreenFrameSource final
+	: public FrameSource
+{
+public:
+	explicit ScreenFrameSource(QScreen* screen);
+
+	bool NextFrame(QImage& frame, qint64& timestamp_ns) override;
+
+private:
+	QScreen* screen_ = nullptr;
+	QElapsedTimer clock_;
+};
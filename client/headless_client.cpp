@@ -0,0 +1,537 @@
+#include "headless_client.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QSettings>
+#include <QTextStream>
+#include <QTimer>
+#include <QDebug>
+
+#include "input_simulator.h"
+#include "settings_keys.h"
+#include "replay_frame_source.h"
+#include "latency_harness.h"
+#include "session_manager.h"
+
+namespace
+{
+	// Уровни собираемого пакета: распространенные масштабы интерфейса
+	const QVector<qreal> kTemplatePackScales = { 1.0, 1.25, 1.5, 2.0 };
+
+	bool ParseIntList(const QString& text, int count, QVector<int>& values)
+	{
+		const QStringList parts = text.split(',');
+		if (parts.size() != count)
+		{
+			return false;
+		}
+
+		values.clear();
+		for (const QString& part : parts)
+		{
+			bool ok = false;
+			values.append(part.trimmed().toInt(&ok));
+			if (!ok)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+HeadlessClient::HeadlessClient(QObject* parent)
+	: QObject(parent)
+{
+	ReadSettings();
+
+	bool connection = true;
+	connection = connect(&worker_, &QThread::started, &finder_, &OpenCLImageFinder::OnStartClicked); Q_ASSERT(connection);
+	connection = connect(&finder_, &OpenCLImageFinder::Failed, this, &HeadlessClient::OnFinderFailed); Q_ASSERT(connection);
+	connection = connect(&finder_, &OpenCLImageFinder::Succeed, this, &HeadlessClient::OnFinderSucceed); Q_ASSERT(connection);
+	connection = connect(&worker_, &QThread::finished, &finder_, &OpenCLImageFinder::OnStopClicked); Q_ASSERT(connection);
+	connection = connect(&window_tracker_, &WindowTracker::ClientAreaChanged, this, &HeadlessClient::OnWindowAreaChanged); Q_ASSERT(connection);
+	connection = connect(&window_tracker_, &WindowTracker::WindowLost, this, &HeadlessClient::OnWindowLost); Q_ASSERT(connection);
+	finder_.moveToThread(&worker_);
+}
+
+HeadlessClient::~HeadlessClient()
+{
+	worker_.requestInterruption();
+	worker_.quit();
+	worker_.wait();
+
+	harness_thread_.requestInterruption();
+	harness_thread_.quit();
+	harness_thread_.wait();
+
+	sessions_thread_.requestInterruption();
+	sessions_thread_.quit();
+	sessions_thread_.wait();
+}
+
+void HeadlessClient::ReadSettings()
+{
+	using namespace helpers::settings;
+	QSettings settings;
+	monitor_number_ = settings.value(keys::monitor_number, default_values::monitor_number).toInt();
+	detect_area_.x = settings.value(keys::detect_area_x, default_values::detect_area_x).toInt();
+	detect_area_.y = settings.value(keys::detect_area_y, default_values::detect_area_y).toInt();
+	detect_area_.width = settings.value(keys::detect_area_width, default_values::detect_area_width).toInt();
+	detect_area_.height = settings.value(keys::detect_area_height, default_values::detect_area_height).toInt();
+	mouse_click_point_.rx() = settings.value(keys::mouse_click_x, default_values::mouse_click_x).toInt();
+	mouse_click_point_.ry() = settings.value(keys::mouse_click_y, default_values::mouse_click_y).toInt();
+	record_file_ = settings.value(keys::record_file).toString();
+	replay_file_ = settings.value(keys::replay_file).toString();
+	replay_as_fast_as_possible_ = settings.value(keys::replay_as_fast_as_possible, default_values::replay_as_fast_as_possible).toBool();
+	pipeline_file_ = settings.value(keys::pipeline_file).toString();
+	input_backend_ = settings.value(keys::input_backend).toString();
+	window_title_ = settings.value(keys::window_title).toString();
+	booking_open_time_ = QDateTime::fromString(settings.value(keys::booking_open_time).toString(), Qt::ISODate);
+	polling_config_.idle_interval_ms = settings.value(keys::poll_idle_interval_ms, default_values::poll_idle_interval_ms).toInt();
+	polling_config_.ramp_ms = settings.value(keys::poll_ramp_ms, default_values::poll_ramp_ms).toInt();
+	polling_config_.align_to_refresh = settings.value(keys::poll_align_to_refresh, default_values::poll_align_to_refresh).toBool();
+}
+
+bool HeadlessClient::ParseArguments(const QCoreApplication& app, int& exit_code)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QString::fromUtf8("book_tennis_client headless mode"));
+	parser.addHelpOption();
+
+	const QCommandLineOption headless_option("headless", QString::fromUtf8("Run without widgets."));
+	const QCommandLineOption monitor_option("monitor", QString::fromUtf8("Monitor number or \"all\" to search every screen in parallel."), "number");
+	const QCommandLineOption area_option("area", QString::fromUtf8("Detect area: x,y,width,height."), "area");
+	const QCommandLineOption click_option("click", QString::fromUtf8("Click point: x,y."), "point");
+	const QCommandLineOption no_click_option("no-click", QString::fromUtf8("Do not click when the message is detected."));
+	const QCommandLineOption timeout_option("timeout", QString::fromUtf8("Give up after the given milliseconds."), "msecs");
+	const QCommandLineOption record_option("record", QString::fromUtf8("Record captured frames to file."), "file");
+	const QCommandLineOption replay_option("replay", QString::fromUtf8("Replay frames from file instead of the screen."), "file");
+	const QCommandLineOption replay_fast_option("replay-fast", QString::fromUtf8("Replay frames as fast as possible."));
+	const QCommandLineOption replay_loop_option("replay-loop", QString::fromUtf8("Start the replay over after the last frame."));
+	const QCommandLineOption pipeline_option("pipeline", QString::fromUtf8("Detection stages description (json)."), "file");
+	const QCommandLineOption booking_open_option("booking-open", QString::fromUtf8("Booking open time (ISO 8601)."), "time");
+	const QCommandLineOption idle_interval_option("idle-interval", QString::fromUtf8("Polling interval far from the booking open time."), "msecs");
+	parser.addOptions({ headless_option, monitor_option, area_option, click_option, no_click_option,
+		timeout_option, record_option, replay_option, replay_fast_option, replay_loop_option, pipeline_option,
+		booking_open_option, idle_interval_option });
+	const QCommandLineOption input_backend_option("input-backend", QString::fromUtf8("Input backend: default or mock."), "name");
+	parser.addOption(input_backend_option);
+	const QCommandLineOption latency_trials_option("latency-trials",
+		QString::fromUtf8("Measure trigger-to-click latency on a synthetic screen with the given number of trials."), "count");
+	const QCommandLineOption latency_backends_option("latency-backends",
+		QString::fromUtf8("Comma separated input backends for the latency measurement (mock, default)."), "names");
+	parser.addOptions({ latency_trials_option, latency_backends_option });
+	const QCommandLineOption sessions_option("sessions",
+		QString::fromUtf8("Watch several sessions described in the file (json) with one shared OpenCL context."), "file");
+	parser.addOption(sessions_option);
+	const QCommandLineOption window_title_option("window-title",
+		QString::fromUtf8("Track the window whose title contains the text; area and click are relative to its client area."), "title");
+	parser.addOption(window_title_option);
+	const QCommandLineOption template_pack_option("template-pack",
+		QString::fromUtf8("Take stage templates from the template pack file."), "file");
+	const QCommandLineOption build_template_pack_option("build-template-pack",
+		QString::fromUtf8("Build a template pack from the pipeline stages into the file and exit."), "file");
+	const QCommandLineOption template_pack_version_option("template-pack-version",
+		QString::fromUtf8("Version of the built template pack, the current time by default."), "number");
+	parser.addOptions({ template_pack_option, build_template_pack_option, template_pack_version_option });
+
+	if (!parser.parse(app.arguments()))
+	{
+		QTextStream(stderr) << parser.errorText() << '\n';
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	if (parser.isSet(QStringLiteral("help")))
+	{
+		QTextStream(stdout) << parser.helpText();
+		exit_code = Succeed;
+		return false;
+	}
+
+	bool ok = true;
+	if (parser.isSet(monitor_option))
+	{
+		const QString monitor = parser.value(monitor_option);
+		monitor_number_ = monitor == QStringLiteral("all")
+			? OpenCLImageFinder::kAllMonitors
+			: monitor.toInt(&ok);
+	}
+
+	QVector<int> values;
+	if (ok && parser.isSet(area_option))
+	{
+		ok = ParseIntList(parser.value(area_option), 4, values);
+		if (ok)
+		{
+			detect_area_ = { values[0], values[1], values[2], values[3] };
+		}
+	}
+
+	if (ok && parser.isSet(click_option))
+	{
+		ok = ParseIntList(parser.value(click_option), 2, values);
+		if (ok)
+		{
+			mouse_click_point_ = QPoint(values[0], values[1]);
+		}
+	}
+
+	if (ok && parser.isSet(timeout_option))
+	{
+		timeout_ms_ = parser.value(timeout_option).toInt(&ok);
+	}
+
+	if (ok && parser.isSet(idle_interval_option))
+	{
+		polling_config_.idle_interval_ms = parser.value(idle_interval_option).toInt(&ok);
+	}
+
+	if (ok && parser.isSet(latency_trials_option))
+	{
+		latency_trials_ = parser.value(latency_trials_option).toInt(&ok);
+	}
+
+	if (ok && parser.isSet(booking_open_option))
+	{
+		booking_open_time_ = QDateTime::fromString(parser.value(booking_open_option), Qt::ISODate);
+		ok = booking_open_time_.isValid();
+	}
+
+	// Версия растет с каждой сборкой: по умолчанию - время сборки
+	quint32 template_pack_version = static_cast<quint32>(QDateTime::currentSecsSinceEpoch());
+	if (ok && parser.isSet(template_pack_version_option))
+	{
+		template_pack_version = parser.value(template_pack_version_option).toUInt(&ok);
+		ok = ok && template_pack_version > 0;
+	}
+
+	if (!ok)
+	{
+		QTextStream(stderr) << QString::fromUtf8("Invalid arguments\n") << parser.helpText();
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	click_enabled_ = !parser.isSet(no_click_option);
+	if (parser.isSet(record_option))
+	{
+		record_file_ = parser.value(record_option);
+	}
+	if (parser.isSet(replay_option))
+	{
+		replay_file_ = parser.value(replay_option);
+	}
+	if (parser.isSet(replay_fast_option))
+	{
+		replay_as_fast_as_possible_ = true;
+	}
+	replay_loop_ = parser.isSet(replay_loop_option);
+	if (parser.isSet(pipeline_option))
+	{
+		pipeline_file_ = parser.value(pipeline_option);
+	}
+	if (parser.isSet(input_backend_option))
+	{
+		input_backend_ = parser.value(input_backend_option);
+	}
+	if (parser.isSet(sessions_option))
+	{
+		sessions_file_ = parser.value(sessions_option);
+	}
+	if (parser.isSet(window_title_option))
+	{
+		window_title_ = parser.value(window_title_option);
+	}
+	latency_backends_ = parser.isSet(latency_backends_option)
+		? parser.value(latency_backends_option).split(',', Qt::SkipEmptyParts)
+		: QStringList{ QStringLiteral("mock") };
+
+	if (parser.isSet(build_template_pack_option))
+	{
+		exit_code = BuildTemplatePack(parser.value(build_template_pack_option), template_pack_version) ? Succeed : Failed;
+		return false;
+	}
+
+	if (parser.isSet(template_pack_option))
+	{
+		QSharedPointer<TemplatePack> template_pack(new TemplatePack);
+		if (!template_pack->Open(parser.value(template_pack_option)))
+		{
+			exit_code = Failed;
+			return false;
+		}
+		template_pack_ = template_pack;
+	}
+
+	return true;
+}
+
+bool HeadlessClient::BuildTemplatePack(const QString& path, quint32 version) const
+{
+	DetectionPipeline pipeline;
+	if (!pipeline.LoadFromFile(pipeline_file_.isEmpty() ? DetectionPipeline::kDefaultPath : pipeline_file_))
+	{
+		return false;
+	}
+
+	const QByteArray pack = TemplatePack::Build(pipeline.Stages(), kTemplatePackScales, version);
+	if (pack.isEmpty())
+	{
+		return false;
+	}
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly) || file.write(pack) != pack.size() || !file.commit())
+	{
+		qWarning() << QString::fromUtf8("Unable to write template pack : ") << path << file.errorString();
+		return false;
+	}
+
+	QTextStream(stdout) << QString::fromUtf8("Template pack version %1, %2 bytes : %3\n").arg(version).arg(pack.size()).arg(path);
+	return true;
+}
+
+void HeadlessClient::Start()
+{
+	if (latency_trials_ > 0)
+	{
+		StartLatencyHarness();
+		return;
+	}
+
+	if (!sessions_file_.isEmpty())
+	{
+		StartSessions();
+		return;
+	}
+
+	if (timeout_ms_ > 0)
+	{
+		QTimer::singleShot(timeout_ms_, this, &HeadlessClient::OnTimeout);
+	}
+
+	run_timer_.start();
+	if (window_title_.isEmpty())
+	{
+		StartFinder();
+		return;
+	}
+
+	// Поиск начнется, как только окно будет найдено (OnWindowAreaChanged)
+	window_detect_area_ = detect_area_;
+	window_click_point_ = mouse_click_point_;
+	if (!window_tracker_.Start(window_title_))
+	{
+		Finish(Failed);
+	}
+}
+
+void HeadlessClient::OnWindowAreaChanged(const QRect& client_area)
+{
+	int monitor_number = 0;
+	geometry_area area;
+	QPoint click_point;
+	if (!window_tracker_.Resolve(window_detect_area_, window_click_point_, monitor_number, area, click_point))
+	{
+		return;
+	}
+
+	if (!finder_started_)
+	{
+		detect_area_ = area;
+		mouse_click_point_ = click_point;
+		monitor_number_ = monitor_number;
+		tracked_monitor_number_ = monitor_number;
+		tracked_geometry_.reset(new TrackedGeometry);
+		tracked_geometry_->Set(area, click_point);
+		finder_.SetTrackedGeometry(tracked_geometry_);
+		StartFinder();
+		return;
+	}
+
+	// Захват идет с экрана, выбранного при старте
+	if (monitor_number != tracked_monitor_number_)
+	{
+		qWarning() << QString::fromUtf8("Window moved to another monitor, area is not updated : ") << client_area;
+		return;
+	}
+	tracked_geometry_->Set(area, click_point);
+}
+
+void HeadlessClient::OnWindowLost()
+{
+	// До первого обнаружения окна поиск еще ждет его. После старта щелчок по прежним координатам попал бы мимо окна
+	if (!finder_started_)
+	{
+		return;
+	}
+	qWarning() << QString::fromUtf8("Window is lost : ") << window_title_;
+	Finish(Failed);
+}
+
+void HeadlessClient::StartFinder()
+{
+	finder_started_ = true;
+	finder_.SetParams(detect_area_, monitor_number_);
+	finder_.SetRecordFile(record_file_);
+	finder_.SetPipelineFile(pipeline_file_);
+	finder_.SetTemplatePack(template_pack_);
+	finder_.SetPollingConfig(polling_config_);
+	finder_.SetBookingOpenTime(booking_open_time_);
+
+	if (click_enabled_)
+	{
+		const QSharedPointer<InputBackend> backend = InputBackend::Create(input_backend_);
+		if (!backend)
+		{
+			Finish(Failed);
+			return;
+		}
+		input_simulator_.reset(new InputSimulator(backend));
+		const bool armed = monitor_number_ == OpenCLImageFinder::kAllMonitors
+			? input_simulator_->armFullSequenceOnScreens(mouse_click_point_)
+			: input_simulator_->armFullSequence(mouse_click_point_);
+		if (!armed)
+		{
+			qWarning() << QString::fromUtf8("Unable to prepare the click sequence : ") << mouse_click_point_;
+			Finish(Failed);
+			return;
+		}
+		finder_.SetInputSimulator(input_simulator_);
+	}
+
+	if (!replay_file_.isEmpty())
+	{
+		QSharedPointer<ReplayFrameSource> replay(new ReplayFrameSource);
+		if (!replay->Open(replay_file_))
+		{
+			Finish(Failed);
+			return;
+		}
+
+		replay->SetPacing(replay_as_fast_as_possible_
+			? ReplayFrameSource::Pacing::AsFastAsPossible
+			: ReplayFrameSource::Pacing::Original);
+		replay->SetLoop(replay_loop_);
+		qDebug() << QString::fromUtf8("Replay frames : ") << replay->FrameCount() << replay_file_;
+		finder_.SetFrameSource(replay);
+	}
+
+	worker_.start();
+}
+
+void HeadlessClient::StartLatencyHarness()
+{
+	LatencyHarnessConfig config;
+	config.trials = latency_trials_;
+	config.backends = latency_backends_;
+	config.detect_area = detect_area_;
+	config.click_point = mouse_click_point_;
+	config.pipeline_file = pipeline_file_;
+
+	LatencyHarness* harness = new LatencyHarness(config);
+	harness->moveToThread(&harness_thread_);
+
+	bool connection = true;
+	connection = connect(&harness_thread_, &QThread::started, harness, &LatencyHarness::Run); Q_ASSERT(connection);
+	connection = connect(harness, &LatencyHarness::Finished, this, &HeadlessClient::OnLatencyHarnessFinished); Q_ASSERT(connection);
+	connection = connect(&harness_thread_, &QThread::finished, harness, &QObject::deleteLater); Q_ASSERT(connection);
+
+	if (timeout_ms_ > 0)
+	{
+		QTimer::singleShot(timeout_ms_, this, &HeadlessClient::OnTimeout);
+	}
+
+	run_timer_.start();
+	harness_thread_.start();
+}
+
+void HeadlessClient::StartSessions()
+{
+	SessionManager* sessions = new SessionManager;
+	if (!sessions->LoadFromFile(sessions_file_))
+	{
+		delete sessions;
+		Finish(InvalidArguments);
+		return;
+	}
+
+	sessions->SetPollingConfig(polling_config_);
+	sessions->SetInputBackend(input_backend_);
+	sessions->SetClickEnabled(click_enabled_);
+	sessions->moveToThread(&sessions_thread_);
+
+	bool connection = true;
+	connection = connect(&sessions_thread_, &QThread::started, sessions, &SessionManager::OnStartClicked); Q_ASSERT(connection);
+	connection = connect(sessions, &SessionManager::Finished, this, &HeadlessClient::OnSessionsFinished); Q_ASSERT(connection);
+	connection = connect(&sessions_thread_, &QThread::finished, sessions, &QObject::deleteLater); Q_ASSERT(connection);
+
+	if (timeout_ms_ > 0)
+	{
+		QTimer::singleShot(timeout_ms_, this, &HeadlessClient::OnTimeout);
+	}
+
+	run_timer_.start();
+	sessions_thread_.start();
+}
+
+void HeadlessClient::OnSessionsFinished(const QString& report, bool ok)
+{
+	QTextStream(stdout) << report;
+	Finish(ok ? Succeed : Failed);
+}
+
+void HeadlessClient::OnLatencyHarnessFinished(const QString& report, bool ok)
+{
+	QTextStream(stdout) << report;
+	Finish(ok ? Succeed : Failed);
+}
+
+void HeadlessClient::OnFinderSucceed()
+{
+	// Щелчок уже отправлен из потока поиска, время отправки - в статистике
+	Finish(Succeed);
+}
+
+void HeadlessClient::OnFinderFailed()
+{
+	Finish(Failed);
+}
+
+void HeadlessClient::OnTimeout()
+{
+	qWarning() << QString::fromUtf8("Detection timeout");
+	Finish(Timeout);
+}
+
+void HeadlessClient::Finish(int exit_code)
+{
+	if (finished_)
+	{
+		return;
+	}
+	finished_ = true;
+
+	worker_.requestInterruption();
+	worker_.quit();
+	worker_.wait();
+
+	harness_thread_.requestInterruption();
+	harness_thread_.quit();
+	harness_thread_.wait();
+
+	sessions_thread_.requestInterruption();
+	sessions_thread_.quit();
+	sessions_thread_.wait();
+
+	QTextStream(stdout) << QString::fromUtf8("result: %1; elapsed: %2 ms; %3\n")
+		.arg(exit_code)
+		.arg(run_timer_.isValid() ? run_timer_.elapsed() : 0)
+		.arg(finder_.Stats().ToString());
+
+	QCoreApplication::exit(exit_code);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QPoint>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include "geometry_area.h"
+#include "opencl_image_finder.h"
+#include "tracked_geometry.h"
+#include "window_tracker.h"
+
+class InputSimulator;
+
+class QCoreApplication;
+
+// Клиент без виджетов: параметры из командной строки (по умолчанию из QSettings),
+// запуск цикла детекции, щелчок и выход с кодом завершения
+class HeadlessClient final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	enum ExitCode
+	{
+		Succeed = 0,
+		Failed = 1,
+		Timeout = 2,
+		InvalidArguments = 3
+	};
+
+	explicit HeadlessClient(QObject* parent = nullptr);
+	~HeadlessClient() override;
+
+	// Разбор аргументов. false - продолжать не нужно, код в exit_code
+	bool ParseArguments(const QCoreApplication& app, int& exit_code);
+
+	void Start();
+
+private Q_SLOTS:
+
+	void OnFinderSucceed();
+
+	void OnFinderFailed();
+
+	void OnTimeout();
+
+	void OnLatencyHarnessFinished(const QString& report, bool ok);
+
+	void OnSessionsFinished(const QString& report, bool ok);
+
+	void OnWindowAreaChanged(const QRect& client_area);
+
+	void OnWindowLost();
+
+private:
+
+	void Finish(int exit_code);
+
+	void ReadSettings();
+
+	void StartLatencyHarness();
+
+	void StartSessions();
+
+	void StartFinder();
+
+	// Пакет шаблонов из стадий описания детекции
+	bool BuildTemplatePack(const QString& path, quint32 version) const;
+
+private:
+
+	OpenCLImageFinder finder_;
+
+	QThread worker_;
+
+	int monitor_number_ = 0;
+
+	geometry_area detect_area_;
+
+	QPoint mouse_click_point_;
+
+	bool click_enabled_ = true;
+
+	int timeout_ms_ = 0;
+
+	QString record_file_;
+
+	QString replay_file_;
+
+	bool replay_as_fast_as_possible_ = false;
+
+	bool replay_loop_ = false;
+
+	QString pipeline_file_;
+
+	QSharedPointer<const TemplatePack> template_pack_;
+
+	QDateTime booking_open_time_;
+
+	PollingConfig polling_config_;
+
+	QString input_backend_;
+
+	QSharedPointer<InputSimulator> input_simulator_;
+
+	// Прогон замера задержки вместо обычной работы (число попыток > 0)
+	int latency_trials_ = 0;
+
+	QStringList latency_backends_;
+
+	QThread harness_thread_;
+
+	// Файл с несколькими сессиями наблюдения вместо одной
+	QString sessions_file_;
+
+	QThread sessions_thread_;
+
+	// Непустой заголовок - область поиска и точка щелчка задаются относительно клиентской области окна
+	QString window_title_;
+
+	WindowTracker window_tracker_;
+
+	// Область поиска и точка щелчка относительно клиентской области окна. detect_area_ и mouse_click_point_
+	// после появления окна становятся абсолютными
+	geometry_area window_detect_area_;
+	QPoint window_click_point_;
+
+	QSharedPointer<TrackedGeometry> tracked_geometry_;
+
+	// Поиск ждет появления окна
+	bool finder_started_ = false;
+
+	int tracked_monitor_number_ = 0;
+
+	QElapsedTimer run_timer_;
+
+	bool finished_ = false;
+};
@@ -0,0 +1,102 @@
+#include "image_packing.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOOK_TENNIS_SSE2 1
+#else
+#define BOOK_TENNIS_SSE2 0
+#endif
+
+namespace
+{
+	const float kScale = 1.0f / 255.0f;
+}
+
+namespace image_packing
+{
+	bool IsPackable(QImage::Format format)
+	{
+		return format == QImage::Format_RGB32
+			|| format == QImage::Format_ARGB32
+			|| format == QImage::Format_ARGB32_Premultiplied
+			|| format == QImage::Format_Grayscale8;
+	}
+
+	void PackRgb32Line(const quint32* src, int width, float* dst)
+	{
+		int x = 0;
+#if BOOK_TENNIS_SSE2 && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+		// В памяти байты пикселя B, G, R, A. gray = (r * 11 + g * 16 + b * 5) >> 5, как у qGray
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i weights = _mm_setr_epi16(5, 16, 11, 0, 5, 16, 11, 0);
+		const __m128 scale = _mm_set1_ps(kScale);
+		for (; x + 4 <= width; x += 4)
+		{
+			const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+			const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+			const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+
+			// lo = [b0*5+g0*16, r0*11, b1*5+g1*16, r1*11], hi - то же для пикселей 2 и 3
+			const __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1));
+			const __m128i gray = _mm_srli_epi32(_mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd)), 5);
+
+			_mm_storeu_ps(dst + x, _mm_mul_ps(_mm_cvtepi32_ps(gray), scale));
+		}
+#endif
+		for (; x < width; ++x)
+		{
+			dst[x] = static_cast<float>(qGray(src[x])) * kScale;
+		}
+	}
+
+	void PackGray8Line(const uchar* src, int width, float* dst)
+	{
+		int x = 0;
+#if BOOK_TENNIS_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps(kScale);
+		for (; x + 16 <= width; x += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+			const __m128i words_lo = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i words_hi = _mm_unpackhi_epi8(bytes, zero);
+
+			_mm_storeu_ps(dst + x, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words_lo, zero)), scale));
+			_mm_storeu_ps(dst + x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words_lo, zero)), scale));
+			_mm_storeu_ps(dst + x + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words_hi, zero)), scale));
+			_mm_storeu_ps(dst + x + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words_hi, zero)), scale));
+		}
+#endif
+		for (; x < width; ++x)
+		{
+			dst[x] = static_cast<float>(src[x]) * kScale;
+		}
+	}
+
+	bool PackGrayscaleFloat(const QImage& image, const QRect& region, float* dst)
+	{
+		if (region.isEmpty() || !image.rect().contains(region) || !IsPackable(image.format()))
+		{
+			return false;
+		}
+
+		const int width = region.width();
+		const bool is_gray = image.format() == QImage::Format_Grayscale8;
+		for (int y = 0; y < region.height(); ++y)
+		{
+			const uchar* line = image.constScanLine(region.y() + y);
+			float* dst_line = dst + static_cast<size_t>(y) * width;
+			if (is_gray)
+			{
+				PackGray8Line(line + region.x(), width, dst_line);
+			}
+			else
+			{
+				PackRgb32Line(reinterpret_cast<const quint32*>(line) + region.x(), width, dst_line);
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+
+namespace image_packing
+{
+	// Вырезка области, перевод в оттенки серого (qGray) и упаковка в float [0..1] за один проход.
+	// dst - не меньше region.width() * region.height() элементов.
+	// Поддерживаются RGB32/ARGB32/ARGB32_Premultiplied и Grayscale8, иначе false
+	bool PackGrayscaleFloat(const QImage& image, const QRect& region, float* dst);
+
+	bool IsPackable(QImage::Format format);
+
+	// Строка пикселей 0xAARRGGBB
+	void PackRgb32Line(const quint32* src, int width, float* dst);
+
+	void PackGray8Line(const uchar* src, int width, float* dst);
+}
@@ -0,0 +1,68 @@
+#include "input_backend.h"
+#include "recording_input_backend.h"
+
+#include <QDebug>
+#include <QGuiApplication>
+#include <QScreen>
+
+#if defined(Q_OS_WIN)
+#include "input_backend_win.h"
+#elif defined(Q_OS_LINUX)
+#include "input_backend_linux.h"
+#endif
+
+QVector<InputEvent> InputBackend::ClickSequence(const QPoint& point)
+{
+	using Type = InputEvent::Type;
+	return {
+		InputEvent::Move(point),
+		InputEvent::Mouse(Type::MouseDown),
+		InputEvent::Mouse(Type::MouseUp)
+	};
+}
+
+QVector<InputEvent> InputBackend::ClickAndSendPlusSequence(const QPoint& point)
+{
+	using Type = InputEvent::Type;
+	using Key = InputEvent::Key;
+
+	QVector<InputEvent> events = ClickSequence(point);
+	events.append(InputEvent::Keyboard(Type::KeyDown, Key::Shift));
+	events.append(InputEvent::Keyboard(Type::KeyDown, Key::Plus));
+	events.append(InputEvent::Keyboard(Type::KeyUp, Key::Plus));
+	events.append(InputEvent::Keyboard(Type::KeyUp, Key::Shift));
+	events.append(InputEvent::Keyboard(Type::KeyDown, Key::Enter));
+	events.append(InputEvent::Keyboard(Type::KeyUp, Key::Enter));
+	return events;
+}
+
+QSharedPointer<InputBackend> InputBackend::Create(const QString& name)
+{
+	if (name == QStringLiteral("mock"))
+	{
+		return QSharedPointer<InputBackend>(new RecordingInputBackend);
+	}
+
+	if (!name.isEmpty() && name != QStringLiteral("default"))
+	{
+		qWarning() << QString::fromUtf8("Unknown input backend : ") << name;
+		return {};
+	}
+
+#if defined(Q_OS_WIN)
+	return QSharedPointer<InputBackend>(new WindowsInputBackend);
+#elif defined(Q_OS_LINUX)
+	QScreen* screen = QGuiApplication::primaryScreen();
+	const QRect desktop = screen ? screen->virtualGeometry() : QRect();
+	QSharedPointer<UinputBackend> backend(new UinputBackend(desktop));
+	if (!backend->IsOpen())
+	{
+		qWarning() << QString::fromUtf8("uinput is not available (no access to /dev/uinput?), use --input-backend mock to only record input");
+		return {};
+	}
+	return backend;
+#else
+	qWarning() << QString::fromUtf8("No input backend for this platform");
+	return {};
+#endif
+}
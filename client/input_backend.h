@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QPoint>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+// Платформенно-независимое событие ввода
+struct InputEvent
+{
+	enum class Type
+	{
+		MouseMove,
+		MouseDown,
+		MouseUp,
+		KeyDown,
+		KeyUp
+	};
+
+	enum class Key
+	{
+		None,
+		Shift,
+		Plus,   // клавиша '=/+'
+		Enter
+	};
+
+	Type type = Type::MouseMove;
+	QPoint position;   // для MouseMove, глобальные координаты
+	Key key = Key::None;
+
+	static InputEvent Move(const QPoint& position)
+	{
+		InputEvent event;
+		event.type = Type::MouseMove;
+		event.position = position;
+		return event;
+	}
+
+	static InputEvent Mouse(Type type)
+	{
+		InputEvent event;
+		event.type = type;
+		return event;
+	}
+
+	static InputEvent Keyboard(Type type, Key key)
+	{
+		InputEvent event;
+		event.type = type;
+		event.key = key;
+		return event;
+	}
+};
+
+// Способ отправки событий ввода в систему.
+// Arm заранее переводит пакет событий в платформенный формат, Fire отправляет его одним системным вызовом.
+// Подготовленных пакетов может быть несколько (slot - номер пакета, с 0), каждый отправляется без перевода
+class InputBackend
+{
+public:
+	virtual ~InputBackend() = default;
+
+	virtual QString Name() const = 0;
+
+	virtual bool Arm(const QVector<InputEvent>& events, int slot) = 0;
+
+	virtual bool IsArmed(int slot) const = 0;
+
+	// Отправка подготовленного пакета. Пакет остается подготовленным для повторной отправки
+	virtual bool Fire(int slot) = 0;
+
+	// Щелчок в точке, '+' и Enter
+	static QVector<InputEvent> ClickAndSendPlusSequence(const QPoint& point);
+
+	// Щелчок в точке
+	static QVector<InputEvent> ClickSequence(const QPoint& point);
+
+	// name: "mock" - запись без отправки, пусто или "default" - платформенный.
+	// nullptr - платформенный способ недоступен или имя неизвестно: запись вместо ввода только по явному "mock"
+	static QSharedPointer<InputBackend> Create(const QString& name = QString());
+};
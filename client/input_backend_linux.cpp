@@ -0,0 +1,171 @@
+#include "input_backend_linux.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+namespace
+{
+	quint16 KeyCode(InputEvent::Key key)
+	{
+		switch (key)
+		{
+		case InputEvent::Key::Shift: return KEY_LEFTSHIFT;
+		case InputEvent::Key::Plus: return KEY_EQUAL;
+		case InputEvent::Key::Enter: return KEY_ENTER;
+		default: return KEY_RESERVED;
+		}
+	}
+}
+
+UinputBackend::UinputBackend(const QRect& desktop)
+	: desktop_(desktop)
+{
+	Open();
+}
+
+UinputBackend::~UinputBackend()
+{
+	if (fd_ >= 0)
+	{
+		ioctl(fd_, UI_DEV_DESTROY);
+		close(fd_);
+	}
+}
+
+bool UinputBackend::IsOpen() const
+{
+	return fd_ >= 0;
+}
+
+QString UinputBackend::Name() const
+{
+	return QStringLiteral("uinput");
+}
+
+bool UinputBackend::Open()
+{
+	if (desktop_.isEmpty())
+	{
+		qWarning() << QString::fromUtf8("uinput: desktop geometry is unknown");
+		return false;
+	}
+
+	fd_ = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd_ < 0)
+	{
+		qWarning() << QString::fromUtf8("uinput open error : ") << std::strerror(errno);
+		return false;
+	}
+
+	bool ok = ioctl(fd_, UI_SET_EVBIT, EV_KEY) == 0
+		&& ioctl(fd_, UI_SET_EVBIT, EV_ABS) == 0
+		&& ioctl(fd_, UI_SET_EVBIT, EV_SYN) == 0
+		&& ioctl(fd_, UI_SET_KEYBIT, BTN_LEFT) == 0
+		&& ioctl(fd_, UI_SET_KEYBIT, KEY_LEFTSHIFT) == 0
+		&& ioctl(fd_, UI_SET_KEYBIT, KEY_EQUAL) == 0
+		&& ioctl(fd_, UI_SET_KEYBIT, KEY_ENTER) == 0
+		&& ioctl(fd_, UI_SET_ABSBIT, ABS_X) == 0
+		&& ioctl(fd_, UI_SET_ABSBIT, ABS_Y) == 0;
+
+	uinput_abs_setup abs_x = {};
+	abs_x.code = ABS_X;
+	abs_x.absinfo.minimum = 0;
+	abs_x.absinfo.maximum = desktop_.width() - 1;
+	uinput_abs_setup abs_y = {};
+	abs_y.code = ABS_Y;
+	abs_y.absinfo.minimum = 0;
+	abs_y.absinfo.maximum = desktop_.height() - 1;
+	ok = ok && ioctl(fd_, UI_ABS_SETUP, &abs_x) == 0 && ioctl(fd_, UI_ABS_SETUP, &abs_y) == 0;
+
+	uinput_setup setup = {};
+	setup.id.bustype = BUS_VIRTUAL;
+	setup.id.vendor = 0x1209;
+	setup.id.product = 0x7e17;
+	std::strncpy(setup.name, "book_tennis_client input", UINPUT_MAX_NAME_SIZE - 1);
+	ok = ok && ioctl(fd_, UI_DEV_SETUP, &setup) == 0 && ioctl(fd_, UI_DEV_CREATE) == 0;
+
+	if (!ok)
+	{
+		qWarning() << QString::fromUtf8("uinput setup error : ") << std::strerror(errno);
+		close(fd_);
+		fd_ = -1;
+		return false;
+	}
+
+	return true;
+}
+
+void UinputBackend::Append(std::vector<input_event>& batch, quint16 type, quint16 code, qint32 value)
+{
+	input_event event = {};
+	event.type = type;
+	event.code = code;
+	event.value = value;
+	batch.push_back(event);
+}
+
+bool UinputBackend::Arm(const QVector<InputEvent>& events, int slot)
+{
+	if (slot < 0)
+	{
+		return false;
+	}
+	if (static_cast<size_t>(slot) >= armed_.size())
+	{
+		armed_.resize(slot + 1);
+	}
+
+	std::vector<input_event>& batch = armed_[slot];
+	batch.clear();
+	batch.reserve(events.size() * 3);
+	for (const InputEvent& event : events)
+	{
+		switch (event.type)
+		{
+		case InputEvent::Type::MouseMove:
+			Append(batch, EV_ABS, ABS_X, event.position.x() - desktop_.x());
+			Append(batch, EV_ABS, ABS_Y, event.position.y() - desktop_.y());
+			break;
+		case InputEvent::Type::MouseDown:
+		case InputEvent::Type::MouseUp:
+			Append(batch, EV_KEY, BTN_LEFT, event.type == InputEvent::Type::MouseDown ? 1 : 0);
+			break;
+		case InputEvent::Type::KeyDown:
+		case InputEvent::Type::KeyUp:
+			Append(batch, EV_KEY, KeyCode(event.key), event.type == InputEvent::Type::KeyDown ? 1 : 0);
+			break;
+		}
+
+		// Каждый шаг - отдельный отчет, иначе нажатие и отпускание сольются
+		Append(batch, EV_SYN, SYN_REPORT, 0);
+	}
+
+	return !batch.empty();
+}
+
+bool UinputBackend::IsArmed(int slot) const
+{
+	return slot >= 0 && static_cast<size_t>(slot) < armed_.size() && !armed_[slot].empty();
+}
+
+bool UinputBackend::Fire(int slot)
+{
+	if (fd_ < 0 || !IsArmed(slot))
+	{
+		return false;
+	}
+
+	const std::vector<input_event>& batch = armed_[slot];
+	const ssize_t size = static_cast<ssize_t>(batch.size() * sizeof(input_event));
+	return write(fd_, batch.data(), size) == size;
+}
+
+#endif
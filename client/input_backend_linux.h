@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+
+#include <QRect>
+#include <vector>
+#include <linux/input.h>
+
+#include "input_backend.h"
+
+// Виртуальное устройство uinput (мышь с абсолютными координатами + клавиатура).
+// Пакет отправляется одним write() в /dev/uinput
+class UinputBackend final
+	: public InputBackend
+{
+public:
+	// desktop - геометрия виртуального рабочего стола, на нее отображается диапазон ABS_X/ABS_Y
+	explicit UinputBackend(const QRect& desktop);
+	~UinputBackend() override;
+
+	bool IsOpen() const;
+
+	QString Name() const override;
+
+	bool Arm(const QVector<InputEvent>& events, int slot) override;
+
+	bool IsArmed(int slot) const override;
+
+	bool Fire(int slot) override;
+
+private:
+	bool Open();
+
+	static void Append(std::vector<input_event>& batch, quint16 type, quint16 code, qint32 value);
+
+private:
+	QRect desktop_;
+	int fd_ = -1;
+	// Пакеты по номерам, готовые для write()
+	std::vector<std::vector<input_event>> armed_;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "input_backend_win.h"
+
+#ifdef Q_OS_WIN
+
+namespace
+{
+	WORD VirtualKey(InputEvent::Key key)
+	{
+		switch (key)
+		{
+		case InputEvent::Key::Shift: return VK_SHIFT;
+		case InputEvent::Key::Plus: return VK_OEM_PLUS;
+		case InputEvent::Key::Enter: return VK_RETURN;
+		default: return 0;
+		}
+	}
+
+	// Абсолютные координаты SendInput нормированы на 0..65535 по виртуальному рабочему столу
+	LONG Normalize(int value, int origin, int size)
+	{
+		return size > 1 ? static_cast<LONG>((static_cast<qint64>(value - origin) * 65535) / (size - 1)) : 0;
+	}
+}
+
+QString WindowsInputBackend::Name() const
+{
+	return QStringLiteral("sendinput");
+}
+
+bool WindowsInputBackend::Arm(const QVector<InputEvent>& events, int slot)
+{
+	if (slot < 0)
+	{
+		return false;
+	}
+	if (slot >= inputs_.size())
+	{
+		inputs_.resize(slot + 1);
+	}
+
+	const int desktop_x = GetSystemMetrics(SM_XVIRTUALSCREEN);
+	const int desktop_y = GetSystemMetrics(SM_YVIRTUALSCREEN);
+	const int desktop_width = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+	const int desktop_height = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+
+	QVector<INPUT>& inputs = inputs_[slot];
+	inputs.clear();
+	inputs.reserve(events.size());
+	for (const InputEvent& event : events)
+	{
+		INPUT input = {};
+		switch (event.type)
+		{
+		case InputEvent::Type::MouseMove:
+			input.type = INPUT_MOUSE;
+			input.mi.dx = Normalize(event.position.x(), desktop_x, desktop_width);
+			input.mi.dy = Normalize(event.position.y(), desktop_y, desktop_height);
+			input.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+			break;
+		case InputEvent::Type::MouseDown:
+			input.type = INPUT_MOUSE;
+			input.mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
+			break;
+		case InputEvent::Type::MouseUp:
+			input.type = INPUT_MOUSE;
+			input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
+			break;
+		case InputEvent::Type::KeyDown:
+			input.type = INPUT_KEYBOARD;
+			input.ki.wVk = VirtualKey(event.key);
+			break;
+		case InputEvent::Type::KeyUp:
+			input.type = INPUT_KEYBOARD;
+			input.ki.wVk = VirtualKey(event.key);
+			input.ki.dwFlags = KEYEVENTF_KEYUP;
+			break;
+		}
+		inputs.append(input);
+	}
+
+	return !inputs.isEmpty();
+}
+
+bool WindowsInputBackend::IsArmed(int slot) const
+{
+	return slot >= 0 && slot < inputs_.size() && !inputs_[slot].isEmpty();
+}
+
+bool WindowsInputBackend::Fire(int slot)
+{
+	if (!IsArmed(slot))
+	{
+		return false;
+	}
+
+	// Пакет не изменяется при отправке: data() у константного вектора не отделяет копию
+	const QVector<INPUT>& inputs = inputs_[slot];
+	const UINT sent = SendInput(static_cast<UINT>(inputs.size()), const_cast<INPUT*>(inputs.constData()), sizeof(INPUT));
+	return sent == static_cast<UINT>(inputs.size());
+}
+
+#endif
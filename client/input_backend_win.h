@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtGlobal>
+
+#ifdef Q_OS_WIN
+
+#include <windows.h>
+
+#include "input_backend.h"
+
+// SendInput: весь пакет одним вызовом
+class WindowsInputBackend final
+	: public InputBackend
+{
+public:
+	WindowsInputBackend() = default;
+
+	QString Name() const override;
+
+	bool Arm(const QVector<InputEvent>& events, int slot) override;
+
+	bool IsArmed(int slot) const override;
+
+	bool Fire(int slot) override;
+
+private:
+	// Пакеты по номерам, готовые для SendInput
+	QVector<QVector<INPUT>> inputs_;
+};
+
+#endif
@@ -1,31 +1,116 @@
-#include <QApplication>
+#pragma once
+
+#include <QObject>
 #include <QPoint>
+#include <QVector>
+#include <QGuiApplication>
+#include <QScreen>
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
 #include <QThread>
-#include <windows.h>
 
+#include "input_backend.h"
+
+// Подготовка и отправка пакетов ввода. Общий для потока интерфейса (пробный щелчок) и потока поиска
+// (срабатывание): подготовка и отправка идут под одной блокировкой, без ожидания она стоит одну атомарную операцию.
+// group - независимый набор подготовленных пакетов: сессии наблюдения делят один симулятор и одно устройство ввода
 class InputSimulator : public QObject
 {
     Q_OBJECT
 public:
-    explicit InputSimulator(QObject *parent = nullptr) : QObject(parent) {}
-    
+    // backend не пустой: недоступный способ ввода проверяется при создании (InputBackend::Create)
+    explicit InputSimulator(const QSharedPointer<InputBackend>& backend, QObject *parent = nullptr)
+        : QObject(parent)
+        , backend_(backend)
+    {
+    }
+
+    QSharedPointer<InputBackend> backend() const
+    {
+        return backend_;
+    }
+
+    // Заранее подготовить щелчок, '+' и Enter для точки
+    bool armFullSequence(const QPoint &point, int group = 0)
+    {
+        QMutexLocker locker(&mutex_);
+        armed_counts_.remove(group);
+        if (group < 0 || !backend_->Arm(InputBackend::ClickAndSendPlusSequence(point), armedSlot(group, 0)))
+        {
+            return false;
+        }
+        armed_counts_.insert(group, 1);
+        return true;
+    }
+
+    // Заранее подготовить щелчок, '+' и Enter для каждого экрана (порядок QGuiApplication::screens).
+    // point - в координатах экрана. Каждый экран получает свой готовый платформенный пакет
+    bool armFullSequenceOnScreens(const QPoint &point, int group = 0)
+    {
+        QMutexLocker locker(&mutex_);
+        armed_counts_.remove(group);
+        const QList<QScreen*> screens = QGuiApplication::screens();
+        if (group < 0 || screens.isEmpty() || screens.size() > kSlotsPerGroup)
+        {
+            return false;
+        }
+        for (int i = 0; i < screens.size(); ++i)
+        {
+            if (!backend_->Arm(InputBackend::ClickAndSendPlusSequence(screens[i]->geometry().topLeft() + point), armedSlot(group, i)))
+            {
+                return false;
+            }
+        }
+        armed_counts_.insert(group, static_cast<int>(screens.size()));
+        return true;
+    }
+
+    // Отправка пакета, подготовленного для экрана: без перевода и выделения памяти в момент срабатывания
+    bool fireArmedOnScreen(int screen, int group = 0)
+    {
+        QMutexLocker locker(&mutex_);
+        if (screen < 0 || screen >= armed_counts_.value(group))
+        {
+            return false;
+        }
+        return backend_->Fire(armedSlot(group, screen));
+    }
+
+    bool isArmed(int group = 0) const
+    {
+        QMutexLocker locker(&mutex_);
+        return armed_counts_.value(group) > 0 && backend_->IsArmed(armedSlot(group, 0));
+    }
+
+    // Отправка подготовленной последовательности (первого экрана) одним системным вызовом, без логирования
+    bool fireArmed(int group = 0)
+    {
+        QMutexLocker locker(&mutex_);
+        return armed_counts_.value(group) > 0 && backend_->Fire(armedSlot(group, 0));
+    }
+
     // Перемещение мыши и клик
     bool moveAndClick(const QPoint &point, int delay_ms = 0)
     {
-        MoveMouse(point);
-        
-        if (delay_ms)
+        using Type = InputEvent::Type;
+
+        if (!delay_ms)
         {
-            QThread::msleep(delay_ms);
+            return sendNow(InputBackend::ClickSequence(point));
         }
 
-        LeftClick();
-        
-        if (delay_ms)
+        if (!sendNow({ InputEvent::Move(point) }))
         {
-            QThread::msleep(delay_ms);
+            return false;
         }
+        QThread::msleep(delay_ms);
+
+        if (!sendNow({ InputEvent::Mouse(Type::MouseDown), InputEvent::Mouse(Type::MouseUp) }))
+        {
+            return false;
+        }
+        QThread::msleep(delay_ms);
 
         return true;
     }
@@ -33,7 +118,11 @@ public:
     // Отправка символа и Enter
     bool sendPlusAndEnter(int delayMs = 0)
     {
-        if (!sendKeyPlus())
+        using Type = InputEvent::Type;
+        using Key = InputEvent::Key;
+
+        if (!sendNow({ InputEvent::Keyboard(Type::KeyDown, Key::Shift), InputEvent::Keyboard(Type::KeyDown, Key::Plus),
+            InputEvent::Keyboard(Type::KeyUp, Key::Plus), InputEvent::Keyboard(Type::KeyUp, Key::Shift) }))
         {
             qWarning() << QString::fromUtf8("Не удалось отправить '+'");
             return false;
@@ -43,7 +132,7 @@ public:
         {
             QThread::msleep(delayMs);
         }
-        if (!sendEnter())
+        if (!sendNow({ InputEvent::Keyboard(Type::KeyDown, Key::Enter), InputEvent::Keyboard(Type::KeyUp, Key::Enter) }))
         {
             qWarning() << QString::fromUtf8("Не удалось отправить Enter");
             return false;
@@ -56,8 +145,11 @@ public:
     // Полная последовательность действий
     bool executeFullSequence(const QPoint &point, int delayBetweenSteps = 0)
     {
-        qDebug() << QString::fromUtf8("Запуск полной последовательности...");
-        
+        if (!delayBetweenSteps)
+        {
+            return sendNow(InputBackend::ClickAndSendPlusSequence(point));
+        }
+
         if (!moveAndClick(point, delayBetweenSteps)) {
             return false;
         }
@@ -66,100 +158,30 @@ public:
             return false;
         }
         
-        qDebug() << QString::fromUtf8("Последовательность выполнена успешно!");
         return true;
     }
 
 private:
-    // Перемещение мыши
-    void MoveMouse(const QPoint &point)
-    {
-        QCursor::setPos(point);
-    }
-    
-    // Левый клик мыши
-    void LeftClick()
-    {
-        INPUT inputs[2] = {};
-        ZeroMemory(inputs, sizeof(inputs));
-        
-        // Нажатие левой кнопки
-        inputs[0].type = INPUT_MOUSE;
-        inputs[0].mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
-        
-        // Отпускание левой кнопки
-        inputs[1].type = INPUT_MOUSE;
-        inputs[1].mi.dwFlags = MOUSEEVENTF_LEFTUP;
-        
-        UINT sent = SendInput(2, inputs, sizeof(INPUT));
-        if (sent == 2)
-        {
-            qDebug() << QString::fromUtf8("Левый клик выполнен");
-        }
-    }
-    
-    // Отправка символа
-    bool sendKeyPlus()
+    static int armedSlot(int group, int screen)
     {
-		QVector<INPUT> inputs;
-
-		// Shift down
-		INPUT shiftDown = {};
-		shiftDown.type = INPUT_KEYBOARD;
-		shiftDown.ki.wVk = VK_SHIFT;
-		inputs.append(shiftDown);
-
-		// Key down (клавиша =/+)
-		INPUT keyDown = {};
-		keyDown.type = INPUT_KEYBOARD;
-		keyDown.ki.wVk = VK_OEM_PLUS;
-		inputs.append(keyDown);
-
-		// Key up
-		INPUT keyUp = {};
-		keyUp.type = INPUT_KEYBOARD;
-		keyUp.ki.wVk = VK_OEM_PLUS;
-		keyUp.ki.dwFlags = KEYEVENTF_KEYUP;
-		inputs.append(keyUp);
-
-		// Shift up
-		INPUT shiftUp = {};
-		shiftUp.type = INPUT_KEYBOARD;
-		shiftUp.ki.wVk = VK_SHIFT;
-		shiftUp.ki.dwFlags = KEYEVENTF_KEYUP;
-		inputs.append(shiftUp);
-
-		UINT sent = SendInput(inputs.size(), inputs.data(), sizeof(INPUT));
-		if (sent == inputs.size()) {
-			qDebug() << QString::fromUtf8("Отправлен символ '+'");
-			return true;
-		}
+        return kFirstArmedSlot + group * kSlotsPerGroup + screen;
     }
-    
-    // Отправка Enter
-    bool sendEnter()
+
+    // Немедленная отправка через свой пакет: подготовленные заранее не затрагиваются
+    bool sendNow(const QVector<InputEvent> &events)
     {
-        #ifdef Q_OS_WIN
-        INPUT inputs[2] = {};
-        ZeroMemory(inputs, sizeof(inputs));
-        
-        // Нажатие Enter
-        inputs[0].type = INPUT_KEYBOARD;
-        inputs[0].ki.wVk = VK_RETURN;
-        
-        // Отпускание Enter
-        inputs[1].type = INPUT_KEYBOARD;
-        inputs[1].ki.wVk = VK_RETURN;
-        inputs[1].ki.dwFlags = KEYEVENTF_KEYUP;
-        
-        UINT sent = SendInput(2, inputs, sizeof(INPUT));
-        if (sent == 2) {
-            qDebug() << QString::fromUtf8("Отправлен Enter");
-            return true;
-        }
-        #else
-        qDebug() << QString::fromUtf8("Отправка Enter поддерживается только на Windows");
-        #endif
-        return false;
+        // Пробный щелчок не может вклиниться между подготовкой и отправкой срабатывания
+        QMutexLocker locker(&mutex_);
+        return backend_->Arm(events, kImmediateSlot) && backend_->Fire(kImmediateSlot);
     }
-};
\ No newline at end of file
+
+private:
+    QSharedPointer<InputBackend> backend_;
+    mutable QMutex mutex_;
+    // Пакет немедленной отправки и подготовленные: в каждой группе один или по одному на экран
+    static const int kImmediateSlot = 0;
+    static const int kFirstArmedSlot = 1;
+    static const int kSlotsPerGroup = 16;
+    // Число подготовленных пакетов группы
+    QHash<int, int> armed_counts_;
+};
@@ -0,0 +1,235 @@
+#include "latency_harness.h"
+
+#include <QDebug>
+#include <QPainter>
+#include <QThread>
+#include <algorithm>
+#include <random>
+
+#include "detection_pipeline.h"
+#include "input_simulator.h"
+#include "monotonic_clock.h"
+#include "opencl_image_finder.h"
+
+namespace
+{
+	// Фон чуть больше области поиска, чтобы все стадии поместились
+	const QSize kMinFrameSize(1920, 1200);
+
+	// Сколько ждать срабатывания после появления шаблона, прежде чем считать попытку неудачной
+	const qint64 kTrialTimeoutNs = 2000LL * 1000000;
+
+	// Обертка над бэкендом: фиксирует момент, когда пакет ввода передается в систему
+	class TimedInputBackend final
+		: public InputBackend
+	{
+	public:
+		explicit TimedInputBackend(const QSharedPointer<InputBackend>& backend)
+			: backend_(backend)
+		{
+		}
+
+		QString Name() const override { return backend_->Name(); }
+		bool Arm(const QVector<InputEvent>& events, int slot) override { return backend_->Arm(events, slot); }
+		bool IsArmed(int slot) const override { return backend_->IsArmed(slot); }
+
+		bool Fire(int slot) override
+		{
+			fired_ns_ = MonotonicNs();
+			return backend_->Fire(slot);
+		}
+
+		qint64 FiredNs() const { return fired_ns_; }
+		void Reset() { fired_ns_ = 0; }
+
+	private:
+		QSharedPointer<InputBackend> backend_;
+		qint64 fired_ns_ = 0;
+	};
+
+	// Источник, который заканчивается, если шаблон давно показан, а срабатывания нет
+	class BoundedSyntheticSource final
+		: public FrameSource
+	{
+	public:
+		explicit BoundedSyntheticSource(SyntheticFrameSource* source)
+			: source_(source)
+		{
+		}
+
+		bool NextFrame(QImage& frame, qint64& timestamp_ns) override
+		{
+			if (source_->InjectedAtNs() != 0 && MonotonicNs() - source_->InjectedAtNs() > kTrialTimeoutNs)
+			{
+				return false;
+			}
+			return source_->NextFrame(frame, timestamp_ns);
+		}
+
+	private:
+		SyntheticFrameSource* source_;
+	};
+
+	double Percentile(const QVector<qint64>& sorted, double p)
+	{
+		const int index = qBound(0, static_cast<int>(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+		return sorted[index] / 1000000.0;
+	}
+}
+
+LatencyHarness::LatencyHarness(const LatencyHarnessConfig& config, QObject* parent)
+	: QObject(parent)
+	, config_(config)
+{
+}
+
+bool LatencyHarness::BuildScene()
+{
+	DetectionPipeline pipeline;
+	if (!pipeline.LoadFromFile(config_.pipeline_file.isEmpty() ? DetectionPipeline::kDefaultPath : config_.pipeline_file))
+	{
+		return false;
+	}
+
+	const geometry_area& area = config_.detect_area;
+	const QSize frame_size(qMax(kMinFrameSize.width(), area.x + area.width),
+		qMax(kMinFrameSize.height(), area.y + area.height));
+
+	background_ = QImage(frame_size, QImage::Format_RGB32);
+	background_.fill(Qt::white);
+
+	// Шаблоны стадий без щелчка видны сразу, шаблон стадии со щелчком появляется в момент вставки
+	QPainter painter(&background_);
+	bool has_click_stage = false;
+	for (const DetectionStage& stage : pipeline.Stages())
+	{
+		const QRect region = DetectionPipeline::ResolveRegion(stage, frame_size, area);
+		const QPoint pos = region.center() - QPoint(stage.template_image.width() / 2, stage.template_image.height() / 2);
+		if (stage.action == DetectionStage::Action::Click)
+		{
+			pattern_ = stage.template_image;
+			pattern_pos_ = pos;
+			has_click_stage = true;
+		}
+		else
+		{
+			painter.drawImage(pos, stage.template_image);
+		}
+	}
+
+	if (!has_click_stage)
+	{
+		qWarning() << QString::fromUtf8("Pipeline has no click stage");
+		return false;
+	}
+
+	return true;
+}
+
+bool LatencyHarness::RunSeries(const QString& backend_name, SyntheticFrameSource::Pacing pacing,
+	QVector<qint64>& latencies, int& failures)
+{
+	const QSharedPointer<InputBackend> platform_backend = InputBackend::Create(backend_name);
+	if (!platform_backend)
+	{
+		return false;
+	}
+
+	QSharedPointer<TimedInputBackend> backend(new TimedInputBackend(platform_backend));
+	QSharedPointer<InputSimulator> simulator(new InputSimulator(backend));
+	simulator->armFullSequence(config_.click_point);
+
+	OpenCLImageFinder finder;
+	finder.SetParams(config_.detect_area, 0);
+	finder.SetPipelineFile(config_.pipeline_file);
+	finder.SetInputSimulator(simulator);
+
+	std::mt19937 random(12345);
+	std::uniform_int_distribution<int> inject_ms(config_.inject_min_ms, qMax(config_.inject_min_ms, config_.inject_max_ms));
+
+	latencies.clear();
+	latencies.reserve(config_.trials);
+	failures = 0;
+	for (int trial = 0; trial < config_.trials; ++trial)
+	{
+		if (QThread::currentThread()->isInterruptionRequested())
+		{
+			return false;
+		}
+
+		SyntheticFrameSource source(background_, pattern_, pattern_pos_, inject_ms(random) * 1000000LL, pacing);
+		finder.SetFrameSource(QSharedPointer<FrameSource>(new BoundedSyntheticSource(&source)));
+		backend->Reset();
+
+		finder.OnStartClicked();
+
+		if (backend->FiredNs() == 0 || source.InjectedAtNs() == 0)
+		{
+			++failures;
+			continue;
+		}
+		latencies.append(backend->FiredNs() - source.InjectedAtNs());
+	}
+
+	finder.SetFrameSource({});
+	return true;
+}
+
+QString LatencyHarness::FormatRow(const QString& backend_name, SyntheticFrameSource::Pacing pacing,
+	QVector<qint64>& latencies, int failures)
+{
+	const QString mode = pacing == SyntheticFrameSource::Pacing::Display
+		? QStringLiteral("display")
+		: QStringLiteral("free");
+	if (latencies.isEmpty())
+	{
+		return QString::fromUtf8("%1\t%2\t0\t%3\n").arg(backend_name, mode).arg(failures);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double sum = 0.0;
+	for (qint64 latency : latencies)
+	{
+		sum += latency;
+	}
+
+	return QString::fromUtf8("%1\t%2\t%3\t%4\t%5\t%6\t%7\t%8\t%9\n")
+		.arg(backend_name, mode)
+		.arg(latencies.size())
+		.arg(failures)
+		.arg(sum / latencies.size() / 1000000.0, 0, 'f', 3)
+		.arg(Percentile(latencies, 0.5), 0, 'f', 3)
+		.arg(Percentile(latencies, 0.9), 0, 'f', 3)
+		.arg(Percentile(latencies, 0.99), 0, 'f', 3)
+		.arg(latencies.last() / 1000000.0, 0, 'f', 3);
+}
+
+void LatencyHarness::Run()
+{
+	if (!BuildScene())
+	{
+		emit Finished(QString(), false);
+		return;
+	}
+
+	QString report = QString::fromUtf8("backend\tmode\ttrials\tfailed\tmean ms\tp50 ms\tp90 ms\tp99 ms\tmax ms\n");
+	bool ok = true;
+	for (const QString& backend_name : config_.backends)
+	{
+		for (SyntheticFrameSource::Pacing pacing : config_.modes)
+		{
+			QVector<qint64> latencies;
+			int failures = 0;
+			if (!RunSeries(backend_name, pacing, latencies, failures))
+			{
+				emit Finished(report, false);
+				return;
+			}
+
+			ok = ok && failures == 0;
+			report += FormatRow(backend_name, pacing, latencies, failures);
+		}
+	}
+
+	emit Finished(report, ok);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QObject>
+#include <QPoint>
+#include <QStringList>
+#include <QVector>
+
+#include "geometry_area.h"
+#include "synthetic_frame_source.h"
+
+struct LatencyHarnessConfig
+{
+	int trials = 1000;
+	QStringList backends = { QStringLiteral("mock") };
+	QVector<SyntheticFrameSource::Pacing> modes = { SyntheticFrameSource::Pacing::Display, SyntheticFrameSource::Pacing::FreeRunning };
+
+	geometry_area detect_area;
+	QPoint click_point;
+	QString pipeline_file;
+
+	// Шаблон появляется через случайное время из этого диапазона, чтобы не попадать в фазу опроса
+	int inject_min_ms = 5;
+	int inject_max_ms = 30;
+};
+
+// Замер задержки "сообщение появилось на экране -> пакет щелчка и '+' отправлен".
+// Настоящий цикл детекции работает с искусственным экраном, время отправки фиксирует обертка над бэкендом ввода
+class LatencyHarness final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit LatencyHarness(const LatencyHarnessConfig& config, QObject* parent = nullptr);
+
+public Q_SLOTS:
+
+	// Блокирующий прогон всех серий. Вызывать в отдельном потоке
+	void Run();
+
+Q_SIGNALS:
+
+	void Finished(const QString& report, bool ok);
+
+private:
+	bool BuildScene();
+
+	// Задержки одной серии, нс. failures - попытки без срабатывания
+	bool RunSeries(const QString& backend_name, SyntheticFrameSource::Pacing pacing,
+		QVector<qint64>& latencies, int& failures);
+
+	static QString FormatRow(const QString& backend_name, SyntheticFrameSource::Pacing pacing,
+		QVector<qint64>& latencies, int failures);
+
+private:
+	LatencyHarnessConfig config_;
+
+	QImage background_;
+	QImage pattern_;
+	QPoint pattern_pos_;
+};
@@ -1,11 +1,53 @@
 #include "mainwidget.h"
+#include "headless_client.h"
 
 #include <iostream>
+#include <cstring>
 #include <QApplication>
+#include <QTimer>
+
+namespace
+{
+	bool IsHeadless(int argc, char* argv[])
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (std::strcmp(argv[i], "--headless") == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Без виджетов: QGuiApplication нужен только для QScreen (работает и под Xvfb)
+	int RunHeadless(int argc, char* argv[])
+	{
+		QGuiApplication app(argc, argv);
+
+		app.setOrganizationName(QString::fromUtf8("Ssipta"));
+		app.setApplicationName(QString::fromUtf8("book_tennis_client"));
+
+		HeadlessClient client;
+		int exit_code = HeadlessClient::Succeed;
+		if (!client.ParseArguments(app, exit_code))
+		{
+			return exit_code;
+		}
+
+		QTimer::singleShot(0, &client, &HeadlessClient::Start);
+		return app.exec();
+	}
+}
 
 int main(int argc, char *argv[])
 {
     setlocale(LC_ALL, "Russian");
+    if (IsHeadless(argc, argv))
+    {
+        return RunHeadless(argc, argv);
+    }
+
     QApplication app(argc, argv);
 
     app.setOrganizationName(QString::fromUtf8("Ssipta"));
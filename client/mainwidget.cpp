@@ -11,51 +11,50 @@
 #include <QScreen>
 #include <QDebug>
 #include <QSpinBox>
+#include <QLineEdit>
 #include <QElapsedTimer>
 #include <QSettings>
+#include <QHash>
 
-#include "input_simulator.h"
+#include <limits>
 
-namespace helpers
-{
-	namespace settings
-	{
-		namespace keys
-		{
-			const QString monitor_number = "monitor_number";
-			const QString detect_area_x = "detect_area_x";
-			const QString detect_area_y = "detect_area_y";
-			const QString detect_area_width = "detect_area_width";
-			const QString detect_area_height = "detect_area_height";
-			const QString mouse_click_x = "mouse_click_x";
-			const QString mouse_click_y = "mouse_click_y";
-		}
-
-		namespace default_values
-		{
-			const int monitor_number = 0;
-			const int detect_area_x = 375;
-			const int detect_area_y = 160;
-			const int detect_area_width = 550;
-			const int detect_area_height = 950;
-			const int mouse_click_x = 2500;
-			const int mouse_click_y = 1100;
-		}
-	}
-}
+#include "input_simulator.h"
+#include "settings_keys.h"
+#include "replay_frame_source.h"
 
 MainWidget::MainWidget(QWidget *parent)
     : QWidget(parent)
 {
 	ReadSettings();
+	// Без способа ввода поиск не запускается: щелчок не ушел бы в систему
+	const QSharedPointer<InputBackend> input_backend = InputBackend::Create(input_backend_);
+	if (input_backend)
+	{
+		input_simulator_.reset(new InputSimulator(input_backend));
+	}
+	tracked_geometry_.reset(new TrackedGeometry);
     CreateUi();
 
-	bool connection = true;
-	connection = connect(&worker_, &QThread::started, &finder_, &OpenCLImageFinder::OnStartClicked); Q_ASSERT(connection);
-	connection = connect(&finder_, &OpenCLImageFinder::Failed, &worker_, &QThread::quit); Q_ASSERT(connection);
-	connection = connect(&finder_, &OpenCLImageFinder::Succeed, this, &MainWidget::OnPixmapFound); Q_ASSERT(connection);
-	connection = connect(&worker_, &QThread::finished, &finder_, &OpenCLImageFinder::OnStopClicked); Q_ASSERT(connection);
-	finder_.moveToThread(&worker_);
+	bool connection = connect(&window_tracker_, &WindowTracker::ClientAreaChanged, this, &MainWidget::OnWindowAreaChanged); Q_ASSERT(connection);
+	connection = connect(&window_tracker_, &WindowTracker::WindowLost, this, &MainWidget::OnWindowLost); Q_ASSERT(connection);
+	if (!window_title_.isEmpty())
+	{
+		window_tracker_.Start(window_title_);
+	}
+
+	connection = connect(&server_connection_, &ServerConnection::SettingsReceived, this, &MainWidget::OnServerSettingsReceived); Q_ASSERT(connection);
+	connection = connect(&server_connection_, &ServerConnection::BookingOpenReceived, this, &MainWidget::OnBookingOpenReceived); Q_ASSERT(connection);
+	connection = connect(&server_connection_, &ServerConnection::ClockSynchronized, this, [](qint64 offset_ns, qint64 delay_ns) {
+		qDebug() << QString::fromUtf8("Clock synchronized with the server. Offset ns : ") << offset_ns << QString::fromUtf8(" delay ns : ") << delay_ns;
+		}); Q_ASSERT(connection);
+
+	auto_start_timer_.setSingleShot(true);
+	auto_start_timer_.setTimerType(Qt::PreciseTimer);
+	connection = connect(&auto_start_timer_, &QTimer::timeout, this, &MainWidget::OnAutoStartTimer); Q_ASSERT(connection);
+	if (!server_host_.isEmpty())
+	{
+		server_connection_.ConnectToServer(server_host_, static_cast<quint16>(server_port_), user_name_, user_key_.toUtf8());
+	}
 }
 
 void MainWidget::ReadSettings()
@@ -69,6 +68,21 @@ void MainWidget::ReadSettings()
 	detect_area_.height = settings.value(keys::detect_area_height, default_values::detect_area_height).toInt();
 	mouse_click_point_.rx() = settings.value(keys::mouse_click_x, default_values::mouse_click_x).toInt();
 	mouse_click_point_.ry() = settings.value(keys::mouse_click_y, default_values::mouse_click_y).toInt();
+	record_file_ = settings.value(keys::record_file).toString();
+	replay_file_ = settings.value(keys::replay_file).toString();
+	replay_as_fast_as_possible_ = settings.value(keys::replay_as_fast_as_possible, default_values::replay_as_fast_as_possible).toBool();
+	pipeline_file_ = settings.value(keys::pipeline_file).toString();
+	input_backend_ = settings.value(keys::input_backend).toString();
+	window_title_ = settings.value(keys::window_title).toString();
+	server_host_ = settings.value(keys::server_host).toString();
+	server_port_ = settings.value(keys::server_port, default_values::server_port).toInt();
+	user_name_ = settings.value(keys::user_name).toString();
+	user_key_ = settings.value(keys::user_key).toString();
+	auto_start_lead_ms_ = settings.value(keys::auto_start_lead_ms, default_values::auto_start_lead_ms).toInt();
+	booking_open_time_ = QDateTime::fromString(settings.value(keys::booking_open_time).toString(), Qt::ISODate);
+	polling_config_.idle_interval_ms = settings.value(keys::poll_idle_interval_ms, default_values::poll_idle_interval_ms).toInt();
+	polling_config_.ramp_ms = settings.value(keys::poll_ramp_ms, default_values::poll_ramp_ms).toInt();
+	polling_config_.align_to_refresh = settings.value(keys::poll_align_to_refresh, default_values::poll_align_to_refresh).toBool();
 }
 
 void MainWidget::SaveSettings()
@@ -82,6 +96,21 @@ void MainWidget::SaveSettings()
 	settings.setValue(keys::detect_area_height, detect_area_.height);
 	settings.setValue(keys::mouse_click_x, mouse_click_point_.x());
 	settings.setValue(keys::mouse_click_y, mouse_click_point_.y());
+	settings.setValue(keys::record_file, record_file_);
+	settings.setValue(keys::replay_file, replay_file_);
+	settings.setValue(keys::replay_as_fast_as_possible, replay_as_fast_as_possible_);
+	settings.setValue(keys::pipeline_file, pipeline_file_);
+	settings.setValue(keys::input_backend, input_backend_);
+	settings.setValue(keys::window_title, window_title_);
+	settings.setValue(keys::server_host, server_host_);
+	settings.setValue(keys::server_port, server_port_);
+	settings.setValue(keys::user_name, user_name_);
+	settings.setValue(keys::user_key, user_key_);
+	settings.setValue(keys::auto_start_lead_ms, auto_start_lead_ms_);
+	settings.setValue(keys::booking_open_time, booking_open_time_.toString(Qt::ISODateWithMs));
+	settings.setValue(keys::poll_idle_interval_ms, polling_config_.idle_interval_ms);
+	settings.setValue(keys::poll_ramp_ms, polling_config_.ramp_ms);
+	settings.setValue(keys::poll_align_to_refresh, polling_config_.align_to_refresh);
 	settings.sync();
 }
 
@@ -95,6 +124,7 @@ void MainWidget::CreateUi()
 	main_lay->addLayout(CreateMonitorControl());
 	main_lay->addLayout(CreateGeometryParamControl());
 	main_lay->addLayout(CreateClickControl());
+	main_lay->addLayout(CreateWindowControl());
 	
 	QPushButton* start_button = new QPushButton("start");
 	QPushButton* stop_button = new QPushButton("stop");
@@ -113,8 +143,10 @@ QLayout* MainWidget::CreateMonitorControl()
 	QLabel* lbl = new QLabel;
 	lbl->setText(QString::fromUtf8("Монитор"));
 	QSpinBox* monitor_number_spin = new QSpinBox;
-	monitor_number_spin->setMinimum(0);
-	monitor_number_spin->setMaximum(screen_list.size());
+	// Минимальное значение - поиск на всех экранах сразу
+	monitor_number_spin->setMinimum(OpenCLImageFinder::kAllMonitors);
+	monitor_number_spin->setMaximum(screen_list.size() - 1);
+	monitor_number_spin->setSpecialValueText(QString::fromUtf8("все"));
 	monitor_number_spin->setValue(monitor_number_);
 	QPushButton* test_image = new QPushButton;
 	test_image->setText(QString::fromUtf8("Тест"));
@@ -196,25 +228,160 @@ QLayout* MainWidget::CreateClickControl()
 
 	QPushButton* test_click = new QPushButton(QString::fromUtf8("Переместить мышь"));
 	grid_lay->addWidget(test_click, 2, 0, 1, 2);
+	test_click->setEnabled(!input_simulator_.isNull());
 	connection = connect(test_click, &QPushButton::clicked, this, [&]() {
-		InputSimulator simulator;
-		simulator.moveAndClick(mouse_click_point_, 0);
+		input_simulator_->moveAndClick(mouse_click_point_, 0);
 		}); Q_ASSERT(connection);
 
 	return grid_lay;
 }
 
+QLayout* MainWidget::CreateWindowControl()
+{
+	QLabel* lbl = new QLabel(QString::fromUtf8("Окно"));
+	QLineEdit* title_edit = new QLineEdit;
+	title_edit->setPlaceholderText(QString::fromUtf8("часть заголовка, пусто - координаты экрана"));
+	title_edit->setText(window_title_);
+	title_edit->setEnabled(WindowTracker::IsSupported());
+	bool connection = connect(title_edit, &QLineEdit::editingFinished, this, [this, title_edit]() {
+		OnWindowTitleChanged(title_edit->text().trimmed());
+		}); Q_ASSERT(connection);
+
+	QHBoxLayout* window_lay = new QHBoxLayout;
+	window_lay->addWidget(lbl);
+	window_lay->addWidget(title_edit);
+	return window_lay;
+}
+
+bool MainWidget::ResolveTrackedGeometry(int& monitor_number, geometry_area& area, QPoint& click_point) const
+{
+	if (window_title_.isEmpty())
+	{
+		monitor_number = monitor_number_;
+		area = detect_area_;
+		click_point = mouse_click_point_;
+		return true;
+	}
+
+	return window_tracker_.Resolve(detect_area_, mouse_click_point_, monitor_number, area, click_point);
+}
+
+void MainWidget::OnWindowTitleChanged(const QString& window_title)
+{
+	if (window_title == window_title_)
+	{
+		return;
+	}
+
+	window_title_ = window_title;
+	if (window_title_.isEmpty())
+	{
+		window_tracker_.Stop();
+		return;
+	}
+	window_tracker_.Start(window_title_);
+}
+
+void MainWidget::OnWindowAreaChanged(const QRect& client_area)
+{
+	int monitor_number = 0;
+	geometry_area area;
+	QPoint click_point;
+	if (!ResolveTrackedGeometry(monitor_number, area, click_point))
+	{
+		return;
+	}
+
+	// Захват идет с экрана, выбранного при старте: переход окна на другой экран требует перезапуска
+	if (!search_.IsFinished() && monitor_number != tracked_monitor_number_)
+	{
+		qWarning() << QString::fromUtf8("Window moved to another monitor, restart the search : ") << client_area;
+		return;
+	}
+	tracked_geometry_->Set(area, click_point);
+}
+
+void MainWidget::OnWindowLost()
+{
+	// Щелчок по прежним координатам попал бы мимо окна: поиск останавливается, итог придет в OnPixmapFound
+	if (!search_.IsFinished())
+	{
+		qWarning() << QString::fromUtf8("Window is lost, the search is cancelled : ") << window_title_;
+		search_.Cancel();
+	}
+}
+
 void MainWidget::OnStartButtonClicked()
 {
-	finder_.SetParams(detect_area_, monitor_number_);
-	worker_.start();
+	// Повторный старт заменяет предыдущий поиск
+	search_.Cancel();
+
+	if (!input_simulator_)
+	{
+		qWarning() << QString::fromUtf8("No input backend, the search is not started : ") << input_backend_;
+		return;
+	}
+
+	int monitor_number = 0;
+	geometry_area area;
+	QPoint click_point;
+	if (!ResolveTrackedGeometry(monitor_number, area, click_point))
+	{
+		qWarning() << QString::fromUtf8("Window is not found : ") << window_title_;
+		return;
+	}
+	tracked_monitor_number_ = monitor_number;
+
+	const bool armed = monitor_number == OpenCLImageFinder::kAllMonitors
+		? input_simulator_->armFullSequenceOnScreens(click_point)
+		: input_simulator_->armFullSequence(click_point);
+	if (!armed)
+	{
+		qWarning() << QString::fromUtf8("Unable to prepare the click sequence, the search is not started : ") << click_point;
+		return;
+	}
+
+	FindRequest request;
+	request.detect_area = area;
+	request.monitor_number = monitor_number;
+	if (!window_title_.isEmpty())
+	{
+		request.tracked_geometry = tracked_geometry_;
+	}
+	request.record_file = record_file_;
+	request.pipeline_file = pipeline_file_;
+	request.template_pack = server_connection_.CurrentTemplatePack();
+	request.polling_config = polling_config_;
+	request.booking_open_time = booking_open_time_;
+	request.input_simulator = input_simulator_;
+	request.frame_source = CreateReplaySource();
+	search_ = finder_.Find(request, CancellationToken(), [this](const FindResult& result) { OnPixmapFound(result); }, this);
+}
+
+QSharedPointer<FrameSource> MainWidget::CreateReplaySource() const
+{
+	if (replay_file_.isEmpty())
+	{
+		return {};
+	}
+
+	QSharedPointer<ReplayFrameSource> replay(new ReplayFrameSource);
+	if (!replay->Open(replay_file_))
+	{
+		return {};
+	}
+
+	replay->SetPacing(replay_as_fast_as_possible_
+		? ReplayFrameSource::Pacing::AsFastAsPossible
+		: ReplayFrameSource::Pacing::Original);
+	qDebug() << QString::fromUtf8("Replay frames : ") << replay->FrameCount() << replay_file_;
+	return replay;
 }
 
 void MainWidget::OnStopButtonClicked()
 {
-	worker_.requestInterruption();
-	worker_.exit();
-	worker_.wait();
+	// Отмена без ожидания: итог придет в OnPixmapFound
+	search_.Cancel();
 }
 
 
@@ -226,7 +393,9 @@ void MainWidget::OnMonitorNumberChanged(int monitor_number) //автоматиз
 void MainWidget::OnTestMonitorImageButtonClicked() // автоматизировать в дальнейшем
 {
 	QList<QScreen*> screen_list = QGuiApplication::screens();
-	QScreen* screen = screen_list[monitor_number_];
+	QScreen* screen = monitor_number_ == OpenCLImageFinder::kAllMonitors
+		? QGuiApplication::primaryScreen()
+		: screen_list.value(monitor_number_, QGuiApplication::primaryScreen());
 	const QPixmap screenshot = screen->grabWindow(0);
 	QImage source_image = screenshot.toImage();
 	source_image = source_image.copy(detect_area_.x, detect_area_.y, detect_area_.width, detect_area_.height);
@@ -237,20 +406,124 @@ void MainWidget::OnTestMonitorImageButtonClicked() // автоматизиров
 	lbl->show();
 }
 
-void MainWidget::OnPixmapFound()
+void MainWidget::OnPixmapFound(const FindResult& result)
+{
+	if (result.status != FindResult::Status::Found)
+	{
+		qDebug() << QString::fromUtf8("Search %1. %2")
+			.arg(result.status == FindResult::Status::Cancelled ? QString::fromUtf8("cancelled") : QString::fromUtf8("failed"))
+			.arg(result.stats.ToString());
+		return;
+	}
+
+	// Щелчок и '+' уже отправлены из потока поиска подготовленным пакетом
+	qDebug() << QString::fromUtf8("Clicked and sent plus. Stage %1 at (%2, %3), score %4. %5")
+		.arg(result.match.stage).arg(result.match.global_position.x()).arg(result.match.global_position.y())
+		.arg(result.match.score, 0, 'f', 3).arg(result.stats.ToString());
+}
+
+void MainWidget::OnServerSettingsReceived(const QVector<QPair<QString, QString>>& values)
+{
+	// Принятые значения меняют только свои поля и применяются к следующему поиску: несохраненные локальные
+	// правки, окно и способ ввода не перечитываются. Поля интерфейса показывают прежние значения до перезапуска
+	using namespace helpers::settings;
+	const QHash<QString, int*> int_fields = {
+		{ keys::detect_area_x, &detect_area_.x },
+		{ keys::detect_area_y, &detect_area_.y },
+		{ keys::detect_area_width, &detect_area_.width },
+		{ keys::detect_area_height, &detect_area_.height },
+		{ keys::mouse_click_x, &mouse_click_point_.rx() },
+		{ keys::mouse_click_y, &mouse_click_point_.ry() },
+		{ keys::poll_idle_interval_ms, &polling_config_.idle_interval_ms },
+		{ keys::poll_ramp_ms, &polling_config_.ramp_ms },
+		{ keys::auto_start_lead_ms, &auto_start_lead_ms_ },
+	};
+
+	const int auto_start_lead_ms = auto_start_lead_ms_;
+	int applied = 0;
+	QSettings settings;
+	for (const QPair<QString, QString>& value : values)
+	{
+		if (!IsServerShared(value.first))
+		{
+			qWarning() << QString::fromUtf8("Local setting from the server is ignored : ") << value.first;
+			continue;
+		}
+
+		if (value.first == keys::poll_align_to_refresh)
+		{
+			polling_config_.align_to_refresh = QVariant(value.second).toBool();
+		}
+		else
+		{
+			bool ok = false;
+			const int number = value.second.toInt(&ok);
+			int* field = int_fields.value(value.first);
+			if (!ok || !field)
+			{
+				qWarning() << QString::fromUtf8("Invalid setting from the server : ") << value.first << value.second;
+				continue;
+			}
+			*field = number;
+		}
+		settings.setValue(value.first, value.second);
+		++applied;
+	}
+
+	if (auto_start_lead_ms != auto_start_lead_ms_)
+	{
+		ScheduleAutoStart();
+	}
+	qDebug() << QString::fromUtf8("Settings received from the server : ") << applied;
+}
+
+void MainWidget::OnBookingOpenReceived(const QDateTime& open_time, quint32 court_id)
+{
+	qDebug() << QString::fromUtf8("Booking open time from the server : ") << open_time << court_id;
+	booking_open_time_ = open_time;
+	QSettings().setValue(helpers::settings::keys::booking_open_time, booking_open_time_.toString(Qt::ISODateWithMs));
+	ScheduleAutoStart();
+}
+
+void MainWidget::ScheduleAutoStart()
 {
-	QElapsedTimer timer;
-	timer.start();
-	ClickAndSendPlusSymbol(mouse_click_point_);
-	qDebug() << QString::fromUtf8("Clicked and sent plus. Duration : %1 msecs").arg(timer.elapsed());
-	worker_.exit();
-	worker_.wait();
+	auto_start_timer_.stop();
+	if (auto_start_lead_ms_ <= 0 || !booking_open_time_.isValid())
+	{
+		return;
+	}
+
+	const qint64 until_open_ms = QDateTime::currentDateTimeUtc().msecsTo(booking_open_time_);
+	if (until_open_ms < 0)
+	{
+		qWarning() << QString::fromUtf8("Booking open time has passed, auto start skipped : ") << booking_open_time_;
+		return;
+	}
+
+	// Уже внутри окна разгона - старт сразу. Идущий поиск перезапускается, чтобы подхватить новое время
+	const qint64 until_start_ms = until_open_ms - auto_start_lead_ms_;
+	if (until_start_ms <= 0)
+	{
+		OnAutoStartTimer();
+		return;
+	}
+
+	// Интервал QTimer - int: дальний старт переназначается по ходу
+	auto_start_timer_.start(static_cast<int>(qMin<qint64>(until_start_ms, std::numeric_limits<int>::max())));
+	qDebug() << QString::fromUtf8("Search auto start in ms : ") << until_start_ms;
 }
 
-void MainWidget::ClickAndSendPlusSymbol(const QPoint& point_to_click)
+void MainWidget::OnAutoStartTimer()
 {
-	InputSimulator simulator;
-	simulator.executeFullSequence(point_to_click, 0);
+	// Таймер ограничен int - до старта еще далеко
+	if (QDateTime::currentDateTimeUtc().msecsTo(booking_open_time_) > auto_start_lead_ms_)
+	{
+		ScheduleAutoStart();
+		return;
+	}
+
+	qDebug() << QString::fromUtf8("Search auto start before booking open : ") << booking_open_time_;
+	OnStartButtonClicked();
 }
 
 void MainWidget::closeEvent(QCloseEvent* event)
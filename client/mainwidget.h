@@ -1,9 +1,14 @@
 #pragma once
 
+#include <QTimer>
 #include <QWidget>
-#include <QThread>
 #include "geometry_area.h"
-#include "opencl_image_finder.h"
+#include "async_image_finder.h"
+#include "tracked_geometry.h"
+#include "window_tracker.h"
+#include "server_connection.h"
+
+class InputSimulator;
 
 class QLabel;
 
@@ -26,7 +31,19 @@ private Q_SLOTS:
 
     void OnTestMonitorImageButtonClicked();
 
-    void OnPixmapFound();
+    void OnPixmapFound(const FindResult& result);
+
+    void OnWindowTitleChanged(const QString& window_title);
+
+    void OnWindowAreaChanged(const QRect& client_area);
+
+    void OnWindowLost();
+
+    void OnServerSettingsReceived(const QVector<QPair<QString, QString>>& values);
+
+    void OnBookingOpenReceived(const QDateTime& open_time, quint32 court_id);
+
+    void OnAutoStartTimer();
 
 protected:
 
@@ -38,8 +55,8 @@ protected:
 
     QLayout* CreateClickControl();
 
+    QLayout* CreateWindowControl();
 
-    void ClickAndSendPlusSymbol(const QPoint& point_to_click);
 
     void closeEvent(QCloseEvent* event) override;
 
@@ -49,9 +66,20 @@ private:
 
     void SaveSettings();
 
+    QSharedPointer<FrameSource> CreateReplaySource() const;
+
+    // Монитор, область поиска и точка щелчка для запуска: из настроек или от отслеживаемого окна
+    bool ResolveTrackedGeometry(int& monitor_number, geometry_area& area, QPoint& click_point) const;
+
+    // Старт поиска за auto_start_lead_ms_ до открытия записи
+    void ScheduleAutoStart();
+
 private:
 
-    OpenCLImageFinder finder_;
+    // Поиск идет в фоне, поток интерфейса его никогда не ждет
+    AsyncImageFinder finder_;
+
+    FindFuture search_;
 
     int monitor_number_ = 0;
 
@@ -59,5 +87,45 @@ private:
 
     QPoint mouse_click_point_{2500,1100};
 
-    QThread worker_;
+    QString record_file_;
+
+    QString replay_file_;
+
+    bool replay_as_fast_as_possible_ = false;
+
+    QString pipeline_file_;
+
+    QDateTime booking_open_time_;
+
+    PollingConfig polling_config_;
+
+    QString input_backend_;
+
+    QSharedPointer<InputSimulator> input_simulator_;
+
+    // Непустой заголовок - область поиска и точка щелчка задаются относительно клиентской области окна
+    QString window_title_;
+
+    WindowTracker window_tracker_;
+
+    QSharedPointer<TrackedGeometry> tracked_geometry_;
+
+    // Пустой адрес - работа без сервера
+    QString server_host_;
+
+    int server_port_ = 0;
+
+    QString user_name_;
+
+    QString user_key_;
+
+    ServerConnection server_connection_;
+
+    // 0 - поиск запускается только кнопкой
+    int auto_start_lead_ms_ = 0;
+
+    QTimer auto_start_timer_;
+
+    // Экран окна на момент старта: кадры текущего поиска захватываются с него
+    int tracked_monitor_number_ = 0;
 };
@@ -0,0 +1,136 @@
+#include "multi_screen_grabber.h"
+
+#include <QScreen>
+#include <QThread>
+
+#include "image_packing.h"
+
+MultiScreenGrabber::MultiScreenGrabber(const QList<QScreen*>& screens)
+	: slots_(screens.size())
+{
+	for (int i = 0; i < screens.size(); ++i)
+	{
+		Slot& slot = slots_[i];
+		slot.source.reset(new ScreenFrameSource(screens[i]));
+		slot.geometry = screens[i]->geometry();
+		slot.device_pixel_ratio = screens[i]->devicePixelRatio();
+
+		// Первый экран захватывает сам вызывающий поток
+		if (i > 0)
+		{
+			slot.thread = QThread::create([this, i]() { RunSlot(i); });
+			slot.thread->start();
+		}
+	}
+}
+
+MultiScreenGrabber::~MultiScreenGrabber()
+{
+	{
+		QMutexLocker locker(&mutex_);
+		stop_ = true;
+		start_.wakeAll();
+	}
+
+	for (Slot& slot : slots_)
+	{
+		if (slot.thread)
+		{
+			slot.thread->wait();
+			delete slot.thread;
+		}
+	}
+}
+
+int MultiScreenGrabber::ScreenCount() const
+{
+	return static_cast<int>(slots_.size());
+}
+
+QRect MultiScreenGrabber::ScreenGeometry(int index) const
+{
+	return slots_[index].geometry;
+}
+
+qreal MultiScreenGrabber::DevicePixelRatio(int index) const
+{
+	return slots_[index].device_pixel_ratio;
+}
+
+QPoint MultiScreenGrabber::ToGlobal(int index, const QPoint& frame_pos) const
+{
+	const Slot& slot = slots_[index];
+	return slot.geometry.topLeft() + frame_pos / slot.device_pixel_ratio;
+}
+
+void MultiScreenGrabber::GrabSlot(Slot& slot)
+{
+	qint64 timestamp_ns = 0;
+	slot.ok = slot.source->NextFrame(slot.frame, timestamp_ns);
+	if (slot.ok && !image_packing::IsPackable(slot.frame.format()))
+	{
+		slot.frame = slot.frame.convertToFormat(QImage::Format_RGB32);
+	}
+}
+
+void MultiScreenGrabber::RunSlot(int index)
+{
+	quint64 seen_generation = 0;
+	for (;;)
+	{
+		{
+			QMutexLocker locker(&mutex_);
+			while (!stop_ && generation_ == seen_generation)
+			{
+				start_.wait(&mutex_);
+			}
+			if (stop_)
+			{
+				return;
+			}
+			seen_generation = generation_;
+		}
+
+		GrabSlot(slots_[index]);
+
+		QMutexLocker locker(&mutex_);
+		if (--pending_ == 0)
+		{
+			done_.wakeAll();
+		}
+	}
+}
+
+bool MultiScreenGrabber::GrabAll(QVector<QImage>& frames)
+{
+	if (slots_.empty())
+	{
+		return false;
+	}
+
+	{
+		QMutexLocker locker(&mutex_);
+		pending_ = static_cast<int>(slots_.size()) - 1;
+		++generation_;
+		start_.wakeAll();
+	}
+
+	GrabSlot(slots_[0]);
+
+	{
+		QMutexLocker locker(&mutex_);
+		while (pending_ > 0)
+		{
+			done_.wait(&mutex_);
+		}
+	}
+
+	bool ok = true;
+	frames.resize(ScreenCount());
+	for (int i = 0; i < ScreenCount(); ++i)
+	{
+		frames[i] = slots_[i].frame;
+		ok = ok && slots_[i].ok;
+	}
+	return ok;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QRect>
+#include <QVector>
+#include <QWaitCondition>
+#include <memory>
+#include <vector>
+
+#include "frame_source.h"
+
+class QScreen;
+class QThread;
+
+// Одновременный захват всех экранов: у каждого экрана свой поток и свой буфер кадра.
+// Первый экран захватывается в вызывающем потоке, остальные - параллельно в своих
+class MultiScreenGrabber final
+{
+public:
+	explicit MultiScreenGrabber(const QList<QScreen*>& screens);
+	~MultiScreenGrabber();
+
+	MultiScreenGrabber(const MultiScreenGrabber&) = delete;
+	MultiScreenGrabber& operator=(const MultiScreenGrabber&) = delete;
+
+	int ScreenCount() const;
+
+	// Геометрия экрана в глобальных логических координатах и масштаб кадра относительно нее
+	QRect ScreenGeometry(int index) const;
+	qreal DevicePixelRatio(int index) const;
+
+	// Перевод точки кадра экрана index в глобальные координаты для щелчка
+	QPoint ToGlobal(int index, const QPoint& frame_pos) const;
+
+	// Захват всех экранов. Кадры уже в формате, который умеет упаковка. false - хотя бы один экран не захвачен
+	bool GrabAll(QVector<QImage>& frames);
+
+private:
+	struct Slot
+	{
+		std::unique_ptr<ScreenFrameSource> source;
+		QRect geometry;
+		qreal device_pixel_ratio = 1.0;
+		QImage frame;
+		bool ok = false;
+		QThread* thread = nullptr;
+	};
+
+	void GrabSlot(Slot& slot);
+	void RunSlot(int index);
+
+private:
+	std::vector<Slot> slots_;
+
+	QMutex mutex_;
+	QWaitCondition start_;
+	QWaitCondition done_;
+	quint64 generation_ = 0;
+	int pending_ = 0;
+	bool stop_ = false;
+};
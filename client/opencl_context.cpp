@@ -0,0 +1,705 @@
+#include "opencl_context.h"
+#include "image_packing.h"
+
+#include <QDebug>
+#include <QVector>
+#include <limits>
+
+#define CL_TARGET_OPENCL_VERSION 120
+
+OpenCLContext::~OpenCLContext()
+{
+	Cleanup();
+}
+
+void OpenCLContext::Cleanup()
+{
+	for (auto& item : templates_)
+	{
+		ReleaseTemplate(item.second);
+	}
+	templates_.clear();
+	pack_users_.clear();
+
+	if (kernel_)
+	{
+		clReleaseKernel(kernel_);
+	}
+
+	if (scaled_kernel_)
+	{
+		clReleaseKernel(scaled_kernel_);
+	}
+
+	if (persistent_kernel_)
+	{
+		clReleaseKernel(persistent_kernel_);
+	}
+
+	if (program_)
+	{
+		clReleaseProgram(program_);
+	}
+
+	if (queue_)
+	{
+		clReleaseCommandQueue(queue_);
+	}
+
+	if (control_queue_)
+	{
+		clReleaseCommandQueue(control_queue_);
+	}
+
+	if (context_)
+	{
+		clReleaseContext(context_);
+	}
+
+	kernel_ = nullptr;
+	scaled_kernel_ = nullptr;
+	persistent_kernel_ = nullptr;
+	program_ = nullptr;
+	queue_ = nullptr;
+	control_queue_ = nullptr;
+	context_ = nullptr;
+	is_initialized_ = false;
+}
+
+bool OpenCLContext::Initialize()
+{
+	if (is_initialized_)
+	{
+		return true;
+	}
+
+	cl_int err;
+	cl_platform_id platform;
+
+	err = clGetPlatformIDs(1, &platform, nullptr);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Ошибка получения платформы OpenCL : ") << err;
+		return false;
+	}
+
+	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	err = clGetDeviceIDs(platform, deviceType, 1, &device_, nullptr);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("GPU не найден, пробуем CPU...");
+		deviceType = CL_DEVICE_TYPE_CPU;
+		err = clGetDeviceIDs(platform, deviceType, 1, &device_, nullptr);
+		if (err != CL_SUCCESS)
+		{
+			qWarning() << QString::fromUtf8("Ошибка получения устройства OpenCL:") << err;
+			return false;
+		}
+	}
+
+	context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Ошибка создания контекста:") << err;
+		return false;
+	}
+
+	queue_ = clCreateCommandQueue(context_, device_, 0, &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Ошибка создания очереди команд:") << err;
+		Cleanup();
+		return false;
+	}
+
+	// Отдельная очередь для флага отмены: в основной запись встала бы после выполняющегося ядра
+	control_queue_ = clCreateCommandQueue(context_, device_, 0, &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Ошибка создания очереди команд:") << err;
+		Cleanup();
+		return false;
+	}
+
+	// Размеры рабочих групп определяем один раз, до сборки: постоянное ядро уточняет свой по ограничениям ядра
+	size_t maxWorkGroupSize;
+	clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr);
+	local_work_size_[0] = local_work_size_[1] = maxWorkGroupSize < 256 ? 8 : 16;
+	persistent_group_size_ = local_work_size_[0] * local_work_size_[1];
+
+	if (!CompileKernel())
+	{
+		Cleanup();
+		return false;
+	}
+
+	PrintDeviceInfo();
+	is_initialized_ = true;
+	return true;
+}
+
+bool OpenCLContext::IsInitialized() const
+{
+	return is_initialized_;
+}
+
+bool OpenCLContext::CompileKernel()
+{
+	const char* kernel_source = R"(
+    __kernel void findFirstMatchMinimal(
+        __global const float* source,
+        __global const float* target,
+        volatile __global int* output,          // [found, x, y, variant, similarity * 1e6]
+        const int sourceWidth,
+        const int sourceHeight,
+        const int targetWidth,
+        const int targetHeight,
+        const float requiredSimilarity,
+        volatile __global int* cancel)          // не 0 - поиск отменен с хоста
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        
+        // Проверяем, не найден ли уже результат (правильный atomic load)
+        int found = atomic_add(&output[0], 0) | atomic_add(&cancel[0], 0); // Atomic read
+        if (found != 0) {
+            return;
+        }
+        
+        if (x >= sourceWidth - targetWidth || y >= sourceHeight - targetHeight) {
+            return;
+        }
+        
+        float match = 0.0f;
+        int totalPixels = targetWidth * targetHeight;
+        
+        for (int ty = 0; ty < targetHeight; ty++) {
+            for (int tx = 0; tx < targetWidth; tx++) {
+                float sourceVal = source[(y + ty) * sourceWidth + (x + tx)];
+                float targetVal = target[ty * targetWidth + tx];
+                
+				//printf("source: %f ; target: %f \n", sourceVal, targetVal);
+
+                // Быстрое сравнение с допуском
+                if (fabs(sourceVal - targetVal) < 0.03f) {
+					//printf("x: %d y: %d ; f: %f\n", x, y, fabs(sourceVal - targetVal));
+                    match += 1.0f;
+                }
+            }
+            
+            // Проверяем флаги после каждой строки
+            found = atomic_add(&output[0], 0) | atomic_add(&cancel[0], 0); // Atomic read
+            if (found != 0) return;
+            
+            // Ранний выход если уже не можем достичь requiredSimilarity
+            float currentSimilarity = match / ((ty + 1) * targetWidth);
+            float maxPossible = currentSimilarity + (float)(targetHeight - ty - 1) * targetWidth / totalPixels;
+            if (maxPossible < requiredSimilarity) {
+                break;
+            }
+        }
+        
+        float finalSimilarity = match / (float)(totalPixels);
+		//printf("x: %d y: %d ; final: %f ; required: %f\n", x, y, finalSimilarity, requiredSimilarity);
+        if (finalSimilarity >= requiredSimilarity) {
+            int oldValue = atomic_cmpxchg(&output[0], 0, 1);
+            if (oldValue == 0) {
+                // Первый поток, который нашел - сохраняет координаты
+                atomic_xchg(&output[1], x);
+                atomic_xchg(&output[2], y);
+                atomic_xchg(&output[4], (int)(finalSimilarity * 1000000.0f));
+            }
+        }
+    }
+
+    // Все масштабированные варианты шаблона за один запуск: третье измерение - номер варианта.
+    // Кадр упаковывается и загружается один раз, флаг найденного общий для всех вариантов
+    __kernel void findFirstMatchScaled(
+        __global const float* targets,          // варианты шаблона подряд
+        __global const int4* variants,          // [offset, width, height, 0]
+        __global const float* source,
+        volatile __global int* output,          // [found, x, y, variant, similarity * 1e6]
+        const int sourceWidth,
+        const int sourceHeight,
+        const float requiredSimilarity,
+        volatile __global int* cancel)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        int v = get_global_id(2);
+
+        if ((atomic_add(&output[0], 0) | atomic_add(&cancel[0], 0)) != 0) {
+            return;
+        }
+
+        const int4 variant = variants[v];
+        __global const float* target = targets + variant.x;
+        const int targetWidth = variant.y;
+        const int targetHeight = variant.z;
+
+        if (x >= sourceWidth - targetWidth || y >= sourceHeight - targetHeight) {
+            return;
+        }
+
+        float match = 0.0f;
+        int totalPixels = targetWidth * targetHeight;
+
+        for (int ty = 0; ty < targetHeight; ty++) {
+            for (int tx = 0; tx < targetWidth; tx++) {
+                float sourceVal = source[(y + ty) * sourceWidth + (x + tx)];
+                float targetVal = target[ty * targetWidth + tx];
+                if (fabs(sourceVal - targetVal) < 0.03f) {
+                    match += 1.0f;
+                }
+            }
+
+            if ((atomic_add(&output[0], 0) | atomic_add(&cancel[0], 0)) != 0) return;
+
+            float currentSimilarity = match / ((ty + 1) * targetWidth);
+            float maxPossible = currentSimilarity + (float)(targetHeight - ty - 1) * targetWidth / totalPixels;
+            if (maxPossible < requiredSimilarity) {
+                break;
+            }
+        }
+
+        float finalSimilarity = match / (float)(totalPixels);
+        if (finalSimilarity >= requiredSimilarity) {
+            int oldValue = atomic_cmpxchg(&output[0], 0, 1);
+            if (oldValue == 0) {
+                atomic_xchg(&output[1], x);
+                atomic_xchg(&output[2], y);
+                atomic_xchg(&output[3], v);
+                atomic_xchg(&output[4], (int)(finalSimilarity * 1000000.0f));
+            }
+        }
+    }
+
+    // Постоянные потоки: рабочих групп ровно столько, чтобы занять устройство. Группа берет из счетчика
+    // следующий блок строк в порядке растра (варианты шаблона одной строки подряд) и проверяет флаги
+    // один раз на блок. Совпадение вверху области находится раньше, чем пройдена вся сетка
+    __kernel void findFirstMatchPersistent(
+        __global const float* targets,          // варианты шаблона подряд
+        __global const int4* variants,          // [offset, width, height, 0]
+        const int variantCount,
+        __global const float* source,
+        volatile __global int* output,          // [found, x, y, variant, similarity * 1e6]
+        const int sourceWidth,
+        const int sourceHeight,
+        const int resultHeight,                 // строк-кандидатов у наименьшего варианта
+        const int rowsPerBlock,
+        const float requiredSimilarity,
+        volatile __global int* cancel,
+        volatile __global int* nextBlock)       // счетчик выданных блоков, обнуляется перед запуском
+    {
+        __local int block;
+
+        const int lid = get_local_id(0);
+        const int groupSize = get_local_size(0);
+        const int blockCount = ((resultHeight + rowsPerBlock - 1) / rowsPerBlock) * variantCount;
+
+        for (;;) {
+            // Номер блока один на группу, поэтому выход ниже одинаков для всех ее потоков
+            if (lid == 0) {
+                int stop = atomic_add(&output[0], 0) | atomic_add(&cancel[0], 0);
+                block = stop != 0 ? blockCount : atomic_inc(nextBlock);
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+            const int b = block;
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            if (b >= blockCount) {
+                return;
+            }
+
+            const int v = b % variantCount;
+            const int4 variant = variants[v];
+            __global const float* target = targets + variant.x;
+            const int targetWidth = variant.y;
+            const int targetHeight = variant.z;
+            const int totalPixels = targetWidth * targetHeight;
+
+            const int firstY = (b / variantCount) * rowsPerBlock;
+            const int endY = min(firstY + rowsPerBlock, sourceHeight - targetHeight);
+            const int endX = sourceWidth - targetWidth;
+
+            for (int y = firstY; y < endY; y++) {
+                for (int x = lid; x < endX; x += groupSize) {
+                    float match = 0.0f;
+
+                    for (int ty = 0; ty < targetHeight; ty++) {
+                        for (int tx = 0; tx < targetWidth; tx++) {
+                            float sourceVal = source[(y + ty) * sourceWidth + (x + tx)];
+                            float targetVal = target[ty * targetWidth + tx];
+                            if (fabs(sourceVal - targetVal) < 0.03f) {
+                                match += 1.0f;
+                            }
+                        }
+
+                        float currentSimilarity = match / ((ty + 1) * targetWidth);
+                        float maxPossible = currentSimilarity + (float)(targetHeight - ty - 1) * targetWidth / totalPixels;
+                        if (maxPossible < requiredSimilarity) {
+                            break;
+                        }
+                    }
+
+                    float finalSimilarity = match / (float)(totalPixels);
+                    if (finalSimilarity >= requiredSimilarity) {
+                        int oldValue = atomic_cmpxchg(&output[0], 0, 1);
+                        if (oldValue == 0) {
+                            atomic_xchg(&output[1], x);
+                            atomic_xchg(&output[2], y);
+                            atomic_xchg(&output[3], v);
+                            atomic_xchg(&output[4], (int)(finalSimilarity * 1000000.0f));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    )";
+
+	cl_int err;
+	program_ = clCreateProgramWithSource(context_, 1, &kernel_source, nullptr, &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Create program error : ") << err;
+		return false;
+	}
+
+	err = clBuildProgram(program_, 1, &device_, nullptr, nullptr, nullptr);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Compile program error. kernel : ") << err;
+
+		size_t logSize;
+		clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+		QVector<char> log(logSize);
+		clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, logSize, log.data(), nullptr);
+		qWarning() << QString::fromUtf8("Compilation log : ") << log.data();
+
+		return false;
+	}
+
+	kernel_ = clCreateKernel(program_, "findFirstMatchMinimal", &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Creation error. kernel : ") << err;
+		return false;
+	}
+
+	scaled_kernel_ = clCreateKernel(program_, "findFirstMatchScaled", &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Creation error. scaled kernel : ") << err;
+		return false;
+	}
+
+	// Без постоянного ядра поиск идет исходными, поэтому ошибка здесь не фатальна
+	persistent_kernel_ = clCreateKernel(program_, "findFirstMatchPersistent", &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Creation error. persistent kernel : ") << err;
+		persistent_kernel_ = nullptr;
+		return true;
+	}
+
+	size_t kernelWorkGroupSize = 0;
+	clGetKernelWorkGroupInfo(persistent_kernel_, device_, CL_KERNEL_WORK_GROUP_SIZE,
+		sizeof(kernelWorkGroupSize), &kernelWorkGroupSize, nullptr);
+	while (persistent_group_size_ > 1 && persistent_group_size_ > kernelWorkGroupSize)
+	{
+		persistent_group_size_ /= 2;
+	}
+
+	// Несколько групп на вычислительный блок, чтобы скрыть задержки памяти
+	cl_uint computeUnits = 1;
+	clGetDeviceInfo(device_, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, nullptr);
+	persistent_group_count_ = qMax<size_t>(computeUnits, 1) * kPersistentGroupsPerComputeUnit;
+
+	return true;
+}
+
+void OpenCLContext::PrintDeviceInfo() const
+{
+	if (!device_) return;
+
+	char deviceName[128] = { 0 };
+	clGetDeviceInfo(device_, CL_DEVICE_NAME, sizeof(deviceName), deviceName, nullptr);
+
+	cl_ulong globalMemSize;
+	clGetDeviceInfo(device_, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, nullptr);
+
+	size_t maxWorkGroupSize;
+	clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr);
+
+	qDebug() << QString::fromUtf8("OpenCL Device : ") << deviceName;
+	qDebug() << QString::fromUtf8("Global Memory : ") << globalMemSize / (1024 * 1024) << QString::fromUtf8(" MB");
+	qDebug() << QString::fromUtf8("Max Work Group Size : ") << maxWorkGroupSize;
+}
+
+QString OpenCLContext::GetDeviceInfo() const
+{
+	if (!device_)
+	{
+		return QString::fromUtf8("Device is not initialized.");
+	}
+
+	char device_name[128] = { 0 };
+	clGetDeviceInfo(device_, CL_DEVICE_NAME, sizeof(device_name), device_name, nullptr);
+
+	cl_device_type device_type;
+	clGetDeviceInfo(device_, CL_DEVICE_TYPE, sizeof(device_type), &device_type, nullptr);
+
+	QString type_str;
+	if (device_type & CL_DEVICE_TYPE_GPU)
+	{
+		type_str = QString::fromUtf8("GPU");
+	}
+	else if (device_type & CL_DEVICE_TYPE_CPU)
+	{
+		type_str = QString::fromUtf8("CPU");
+	}
+	else
+	{
+		type_str = QString::fromUtf8("Unknown");
+	}
+
+	return QString::fromUtf8("Device: %1 (%2)").arg(device_name).arg(type_str);
+}
+
+cl_context OpenCLContext::Context() const
+{
+	return context_;
+}
+
+cl_device_id OpenCLContext::Device() const
+{
+	return device_;
+}
+
+cl_command_queue OpenCLContext::Queue() const
+{
+	return queue_;
+}
+
+cl_command_queue OpenCLContext::ControlQueue() const
+{
+	return control_queue_;
+}
+
+cl_kernel OpenCLContext::Kernel() const
+{
+	return kernel_;
+}
+
+cl_kernel OpenCLContext::ScaledKernel() const
+{
+	return scaled_kernel_;
+}
+
+const size_t* OpenCLContext::LocalWorkSize() const
+{
+	return local_work_size_;
+}
+
+cl_kernel OpenCLContext::PersistentKernel() const
+{
+	return persistent_kernel_;
+}
+
+size_t OpenCLContext::PersistentGroupSize() const
+{
+	return persistent_group_size_;
+}
+
+size_t OpenCLContext::PersistentGroupCount() const
+{
+	return persistent_group_count_;
+}
+
+QString OpenCLContext::FullKey(const QString& key, const QVector<qreal>& scales)
+{
+	QString full_key = key;
+	for (qreal scale : scales)
+	{
+		full_key += QString::fromUtf8("@%1").arg(scale);
+	}
+	return full_key;
+}
+
+const PreparedTemplate* OpenCLContext::CachedTemplate(const QString& key, const QImage& image,
+	const QVector<qreal>& scales)
+{
+	const QString full_key = FullKey(key, scales);
+	auto it = templates_.find(full_key);
+	if (it != templates_.end())
+	{
+		return &it->second;
+	}
+
+	PreparedTemplate prepared;
+	if (!PrepareTemplate(image, prepared, scales))
+	{
+		return nullptr;
+	}
+
+	return &templates_.emplace(full_key, prepared).first->second;
+}
+
+const PreparedTemplate* OpenCLContext::CachedTemplate(const QString& key, const QVector<QImage>& variants,
+	const QVector<qreal>& scales)
+{
+	const QString full_key = FullKey(key, scales);
+	auto it = templates_.find(full_key);
+	if (it != templates_.end())
+	{
+		return &it->second;
+	}
+
+	PreparedTemplate prepared;
+	if (!PrepareTemplate(variants, scales, prepared))
+	{
+		return nullptr;
+	}
+
+	return &templates_.emplace(full_key, prepared).first->second;
+}
+
+QString OpenCLContext::PackTemplateKey(const QByteArray& pack_id, const QString& name)
+{
+	return QString::fromUtf8("pack:%1:%2").arg(QString::fromLatin1(pack_id.toHex())).arg(name);
+}
+
+void OpenCLContext::AcquirePack(const QByteArray& pack_id)
+{
+	++pack_users_[pack_id];
+	for (auto it = pack_users_.begin(); it != pack_users_.end();)
+	{
+		if (it->second > 0)
+		{
+			++it;
+			continue;
+		}
+		ReleasePackTemplates(it->first);
+		it = pack_users_.erase(it);
+	}
+}
+
+void OpenCLContext::ReleasePack(const QByteArray& pack_id)
+{
+	const auto it = pack_users_.find(pack_id);
+	if (it != pack_users_.end() && it->second > 0)
+	{
+		--it->second;
+	}
+}
+
+void OpenCLContext::ReleasePackTemplates(const QByteArray& pack_id)
+{
+	// Ключи шаблонов пакета начинаются одинаково и в std::map идут подряд
+	const QString prefix = PackTemplateKey(pack_id, QString());
+	auto it = templates_.lower_bound(prefix);
+	while (it != templates_.end() && it->first.startsWith(prefix))
+	{
+		ReleaseTemplate(it->second);
+		it = templates_.erase(it);
+	}
+}
+
+bool OpenCLContext::PrepareTemplate(const QImage& image, PreparedTemplate& prepared, const QVector<qreal>& scales)
+{
+	ReleaseTemplate(prepared);
+
+	if (image.isNull() || scales.isEmpty())
+	{
+		qWarning() << QString::fromUtf8("images not loaded.");
+		return false;
+	}
+
+	// Шаблон готовится один раз, поэтому допустимо привести его к формату, который умеет упаковка
+	const QImage packable = image_packing::IsPackable(image.format())
+		? image
+		: image.convertToFormat(QImage::Format_RGB32);
+
+	// Варианты масштабируются при регистрации шаблона, в цикле поиска масштабирования нет
+	QVector<QImage> variants;
+	for (qreal scale : scales)
+	{
+		const QSize size = (QSizeF(packable.size()) * scale).toSize();
+		variants.append(qFuzzyCompare(scale, 1.0)
+			? packable
+			: packable.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+	}
+	return PrepareTemplate(variants, scales, prepared);
+}
+
+bool OpenCLContext::PrepareTemplate(const QVector<QImage>& variants, const QVector<qreal>& scales, PreparedTemplate& prepared)
+{
+	ReleaseTemplate(prepared);
+
+	if (variants.isEmpty() || variants.size() != scales.size())
+	{
+		qWarning() << QString::fromUtf8("images not loaded.");
+		return false;
+	}
+
+	QVector<float> data;
+	QVector<cl_int> table;
+	prepared.width = std::numeric_limits<int>::max();
+	prepared.height = std::numeric_limits<int>::max();
+	for (const QImage& variant : variants)
+	{
+		const QImage scaled = image_packing::IsPackable(variant.format())
+			? variant
+			: variant.convertToFormat(QImage::Format_RGB32);
+
+		const int offset = data.size();
+		data.resize(offset + scaled.width() * scaled.height());
+		if (scaled.isNull() || !image_packing::PackGrayscaleFloat(scaled, scaled.rect(), data.data() + offset))
+		{
+			qWarning() << QString::fromUtf8("Convert float arrays ERROR!");
+			prepared = PreparedTemplate();
+			return false;
+		}
+
+		table << offset << scaled.width() << scaled.height() << 0;
+		prepared.width = qMin(prepared.width, scaled.width());
+		prepared.height = qMin(prepared.height, scaled.height());
+	}
+	prepared.scales = scales;
+
+	cl_int err;
+	prepared.buffer = clCreateBuffer(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		data.size() * sizeof(float), data.data(), &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Create target buffer error : ") << err;
+		prepared = PreparedTemplate();
+		return false;
+	}
+
+	// Таблица нужна и для одного варианта: постоянное ядро берет размеры шаблона из нее
+	prepared.variants = clCreateBuffer(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		table.size() * sizeof(cl_int), table.data(), &err);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Create template variants buffer error : ") << err;
+		ReleaseTemplate(prepared);
+		return false;
+	}
+
+	return true;
+}
+
+void OpenCLContext::ReleaseTemplate(PreparedTemplate& prepared)
+{
+	if (prepared.buffer)
+	{
+		clReleaseMemObject(prepared.buffer);
+	}
+	if (prepared.variants)
+	{
+		clReleaseMemObject(prepared.variants);
+	}
+	prepared = PreparedTemplate();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <map>
+#include <CL/opencl.h>
+
+#include "frame_arena.h"
+
+// Контекст OpenCL, очередь, скомпилированная программа и кэш шаблонов.
+// Может разделяться несколькими поисковиками, работающими в одном потоке
+class OpenCLContext final
+{
+public:
+	OpenCLContext() = default;
+	~OpenCLContext();
+
+	OpenCLContext(const OpenCLContext&) = delete;
+	OpenCLContext& operator=(const OpenCLContext&) = delete;
+
+	bool Initialize();
+	bool IsInitialized() const;
+
+	QString GetDeviceInfo() const;
+
+	cl_context Context() const;
+	cl_device_id Device() const;
+	cl_command_queue Queue() const;
+
+	// Очередь для записей, которые должны дойти до устройства, пока основная очередь занята ядром
+	cl_command_queue ControlQueue() const;
+	cl_kernel Kernel() const;
+	const size_t* LocalWorkSize() const;
+
+	// Ядро, проверяющее все масштабированные варианты шаблона за один запуск
+	cl_kernel ScaledKernel() const;
+
+	// Ядро с постоянными потоками: PersistentGroupCount групп по PersistentGroupSize потоков
+	// разбирают блоки строк по порядку растра. nullptr - устройство его не поддерживает
+	cl_kernel PersistentKernel() const;
+	size_t PersistentGroupSize() const;
+	size_t PersistentGroupCount() const;
+
+	// Шаблон из кэша по ключу (обычно путь к файлу), при первом обращении готовится из image
+	const PreparedTemplate* CachedTemplate(const QString& key, const QImage& image,
+		const QVector<qreal>& scales = { 1.0 });
+
+	// То же для готовых вариантов (уровни пакета шаблонов): variants[i] соответствует scales[i]
+	const PreparedTemplate* CachedTemplate(const QString& key, const QVector<QImage>& variants,
+		const QVector<qreal>& scales);
+
+	// Ключ кэша шаблона name из пакета pack_id (TemplatePack::Sha256)
+	static QString PackTemplateKey(const QByteArray& pack_id, const QString& name);
+
+	// Учет поисковиков, работающих на пакете. Шаблоны пакета без поисковиков выгружаются, когда
+	// начинается запуск на другом пакете; последний пакет остается в кэше до следующего запуска
+	void AcquirePack(const QByteArray& pack_id);
+	void ReleasePack(const QByteArray& pack_id);
+
+	// scales - масштабы вариантов шаблона относительно исходного изображения
+	bool PrepareTemplate(const QImage& image, PreparedTemplate& prepared, const QVector<qreal>& scales = { 1.0 });
+	bool PrepareTemplate(const QVector<QImage>& variants, const QVector<qreal>& scales, PreparedTemplate& prepared);
+	static void ReleaseTemplate(PreparedTemplate& prepared);
+
+private:
+	static QString FullKey(const QString& key, const QVector<qreal>& scales);
+
+	void ReleasePackTemplates(const QByteArray& pack_id);
+
+	bool CompileKernel();
+	void Cleanup();
+	void PrintDeviceInfo() const;
+
+private:
+	cl_context context_ = nullptr;
+	cl_device_id device_ = nullptr;
+	cl_command_queue queue_ = nullptr;
+	cl_command_queue control_queue_ = nullptr;
+	cl_program program_ = nullptr;
+	cl_kernel kernel_ = nullptr;
+	cl_kernel scaled_kernel_ = nullptr;
+	cl_kernel persistent_kernel_ = nullptr;
+	bool is_initialized_ = false;
+
+	size_t local_work_size_[2] = { 16, 16 };
+
+	static const size_t kPersistentGroupsPerComputeUnit = 4;
+	size_t persistent_group_size_ = 256;
+	size_t persistent_group_count_ = 0;
+
+	// std::map: указатели на элементы, выданные поисковикам, не меняются при добавлении новых
+	std::map<QString, PreparedTemplate> templates_;
+	// Число поисковиков, работающих на пакете
+	std::map<QByteArray, int> pack_users_;
+};
@@ -1,586 +1,1088 @@
 #include "opencl_image_finder.h"
+#include "input_simulator.h"
+#include "image_packing.h"
+#include "alloc_counter.h"
+#include "multi_screen_grabber.h"
 #include <QDebug>
-#include <QElapsedTimer>
 #include <QThread>
 #include <cmath>
+#include <limits>
 
 #include <QScreen>
 #include <QGuiApplication>
 #include <QPixmap>
 
-#if DEBUG_GRAYSCALE
-#include <QLabel>
-#endif
-
 #define CL_TARGET_OPENCL_VERSION 120
 
-#define DEBUG_GRAYSCALE 0
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+
+	// Сон порциями, чтобы ожидание не мешало остановке
+	const qint64 kMaxSleepSliceNs = 50 * kNsInMs;
+
+	// Больше вариантов шаблона не готовим: каждый добавляет работу в ядре
+	const int kMaxTemplateScales = 4;
+
+	// Позиций в блоке постоянного ядра: несколько проходов группы на одну проверку флагов,
+	// но блок достаточно мал, чтобы совпадение вверху области не ждало остальных строк
+	const int kPositionsPerBlock = 2048;
+
+#ifdef Q_OS_MACOS
+	const qreal kBaseDpi = 72.0;
+#else
+	const qreal kBaseDpi = 96.0;
+#endif
+
+	// Масштабы интерфейса экранов относительно 100%, на котором сняты шаблоны.
+	// Исходный масштаб есть всегда, остальные округляются до 5% и не повторяются
+	QVector<qreal> TemplateScales(const QList<QScreen*>& screens)
+	{
+		QVector<qreal> scales = { 1.0 };
+		for (QScreen* screen : screens)
+		{
+			const qreal scale = qRound(screen->devicePixelRatio() * screen->logicalDotsPerInch() / kBaseDpi * 20.0) / 20.0;
+			if (scale > 0.0 && !scales.contains(scale) && scales.size() < kMaxTemplateScales)
+			{
+				scales.append(scale);
+			}
+		}
+		return scales;
+	}
+}
 
 OpenCLImageFinder::OpenCLImageFinder(QObject* parent)
 	: QObject(parent)
-	, context_(nullptr)
-	, device_(nullptr)
-	, queue_(nullptr)
-	, program_(nullptr)
-	, kernel_(nullptr)
-	, is_initialized_(false)
 {
 }
 
 OpenCLImageFinder::~OpenCLImageFinder()
 {
-	CleanupOpenCL();
+	EndRun();
+	ReleaseBuffers();
 }
 
-void OpenCLImageFinder::CleanupOpenCL()
+void OpenCLImageFinder::ReleaseBuffers()
 {
-	if (kernel_)
+	stage_templates_.clear();
+	arenas_.clear();
+
+	for (SearchSlot& search : search_slots_)
+	{
+		if (search.output_buffer)
+		{
+			clReleaseMemObject(search.output_buffer);
+		}
+		if (search.block_counter)
+		{
+			clReleaseMemObject(search.block_counter);
+		}
+	}
+	search_slots_.clear();
+
+	if (cancel_buffer_)
 	{
-		clReleaseKernel(kernel_);
+		clReleaseMemObject(cancel_buffer_);
+		cancel_buffer_ = nullptr;
 	}
+}
 
-	if (program_)
+void OpenCLImageFinder::SetContext(const QSharedPointer<OpenCLContext>& context)
+{
+	if (context_ == context)
 	{
-		clReleaseProgram(program_);
+		return;
 	}
 
-	if (queue_)
+	// Буферы принадлежат старому контексту
+	ReleaseBuffers();
+	context_ = context;
+}
+
+bool OpenCLImageFinder::InitializeOpenCL()
+{
+	if (!context_)
 	{
-		clReleaseCommandQueue(queue_);
+		context_.reset(new OpenCLContext);
 	}
 
-	if (context_)
+	return context_->Initialize();
+}
+
+FrameArena* OpenCLImageFinder::ArenaFor(int slot, const QSize& size)
+{
+	// Свой буфер на каждый слот: области разных экранов одного размера ставятся в очередь одновременно
+	const quint64 key = (static_cast<quint64>(slot) << 48) | (static_cast<quint64>(size.width()) << 24)
+		| static_cast<quint32>(size.height());
+	std::unique_ptr<FrameArena>& arena = arenas_[key];
+	if (!arena)
 	{
-		clReleaseContext(context_);
+		arena.reset(new FrameArena);
 	}
 
-	kernel_ = nullptr;
-	program_ = nullptr;
-	queue_ = nullptr;
-	context_ = nullptr;
-	is_initialized_ = false;
+	return arena->Reserve(context_->Context(), size) ? arena.get() : nullptr;
 }
 
-bool OpenCLImageFinder::InitializeOpenCL()
+QPoint OpenCLImageFinder::FindFirstMatchMinimal(const QImage& source, const QImage& target,
+	double requiredSimilarity)
 {
-	if (is_initialized_)
+	if (!InitializeOpenCL())
 	{
-		return true;
+		qWarning() << QString::fromUtf8("OpenCL is not initialized.");
+		return QPoint(-1, -1);
+	}
+
+	if (source.isNull())
+	{
+		qWarning() << QString::fromUtf8("images not loaded.");
+		return QPoint(-1, -1);
 	}
 
-	cl_int err;
-	cl_platform_id platform;
+	PreparedTemplate prepared;
+	if (!context_->PrepareTemplate(target, prepared))
+	{
+		return QPoint(-1, -1);
+	}
 
-	err = clGetPlatformIDs(1, &platform, nullptr);
-	if (err != CL_SUCCESS)
+	const QImage packable = image_packing::IsPackable(source.format())
+		? source
+		: source.convertToFormat(QImage::Format_RGB32);
+	const QPoint found_pos = FindInRegion(packable, packable.rect(), prepared, requiredSimilarity);
+	OpenCLContext::ReleaseTemplate(prepared);
+	return found_pos;
+}
+
+QPoint OpenCLImageFinder::FindInRegion(const QImage& frame, const QRect& region, const PreparedTemplate& target,
+	double requiredSimilarity)
+{
+	if (!EnqueueSearch(0, frame, region, target, requiredSimilarity) || !FinishSearches())
+	{
+		return QPoint(-1, -1);
+	}
+
+	return SearchResult(0);
+}
+
+OpenCLImageFinder::SearchSlot* OpenCLImageFinder::SlotFor(int slot)
+{
+	if (slot >= static_cast<int>(search_slots_.size()))
+	{
+		// Стоящие в очереди чтения пишут в буферы слотов, перед перемещением их нужно дождаться
+		FinishSearches();
+		search_slots_.resize(slot + 1);
+	}
+
+	SearchSlot& search = search_slots_[slot];
+	if (!search.output_buffer)
+	{
+		cl_int err = CL_SUCCESS;
+		search.output_buffer = clCreateBuffer(context_->Context(), CL_MEM_READ_WRITE, sizeof(search.result), nullptr, &err);
+		if (err != CL_SUCCESS)
+		{
+			qWarning() << QString::fromUtf8("Create output buffer error : ") << err;
+			search.output_buffer = nullptr;
+			return nullptr;
+		}
+	}
+
+	if (!search.block_counter && context_->PersistentKernel())
+	{
+		cl_int err = CL_SUCCESS;
+		search.block_counter = clCreateBuffer(context_->Context(), CL_MEM_READ_WRITE, sizeof(cl_int), nullptr, &err);
+		if (err != CL_SUCCESS)
+		{
+			qWarning() << QString::fromUtf8("Create block counter error : ") << err;
+			search.block_counter = nullptr;
+			return nullptr;
+		}
+	}
+
+	return &search;
+}
+
+bool OpenCLImageFinder::EnqueueSearch(int slot, const QImage& frame, const QRect& region, const PreparedTemplate& target,
+	double requiredSimilarity)
+{
+	if (!InitializeOpenCL())
+	{
+		qWarning() << QString::fromUtf8("OpenCL is not initialized.");
+		return false;
+	}
+
+	SearchSlot* search = SlotFor(slot);
+	if (!search || !PrepareCancelBuffer())
+	{
+		return false;
+	}
+	search->pending = false;
+
+	const int sourceWidth = region.width();
+	const int sourceHeight = region.height();
+	const int targetWidth = target.width;
+	const int targetHeight = target.height;
+
+	const int resultWidth = sourceWidth - targetWidth;
+	const int resultHeight = sourceHeight - targetHeight;
+
+	if (!target.buffer || resultWidth <= 0 || resultHeight <= 0)
+	{
+		qWarning() << QString::fromUtf8("Invalid size");
+		return false;
+	}
+
+	FrameArena* arena = ArenaFor(slot, region.size());
+	if (!arena)
 	{
-		qWarning() << QString::fromUtf8("Ошибка получения платформы OpenCL : ") << err;
 		return false;
 	}
 
-	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
-	err = clGetDeviceIDs(platform, deviceType, 1, &device_, nullptr);
+	// Вырезка, grayscale и float за один проход прямо в буфер арены
+	if (!image_packing::PackGrayscaleFloat(frame, region, arena->HostData()))
+	{
+		qWarning() << QString::fromUtf8("Convert float arrays ERROR!");
+		return false;
+	}
+
+	cl_command_queue queue = context_->Queue();
+	const size_t* local_work_size = context_->LocalWorkSize();
+
+	// Буфер для результата: [found, x, y, variant, similarity * 1e6]
+	static const int initial_output[5] = { 0, -1, -1, 0, 0 };
+	cl_mem source_buffer = arena->DeviceBuffer();
+
+	// Очередь упорядоченная: запись, kernel и чтение идут друг за другом.
+	// Аргументы kernel фиксируются при постановке в очередь, поэтому поиски разных слотов не мешают друг другу
+	cl_int err = clEnqueueWriteBuffer(queue, source_buffer, CL_FALSE, 0, arena->ByteSize(), arena->HostData(), 0, nullptr, nullptr);
+	err |= clEnqueueWriteBuffer(queue, search->output_buffer, CL_FALSE, 0, sizeof(initial_output), initial_output, 0, nullptr, nullptr);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("GPU не найден, пробуем CPU...");
-		deviceType = CL_DEVICE_TYPE_CPU;
-		err = clGetDeviceIDs(platform, deviceType, 1, &device_, nullptr);
-		if (err != CL_SUCCESS)
+		qWarning() << QString::fromUtf8("Write buffers error : ") << err;
+		return false;
+	}
+
+	float req_sim = static_cast<float>(requiredSimilarity);
+	const int variantCount = qMax(static_cast<int>(target.scales.size()), 1);
+	if (context_->PersistentKernel() && search->block_counter)
+	{
+		if (!EnqueuePersistentSearch(*search, source_buffer, target, variantCount, sourceWidth, sourceHeight,
+			resultWidth, resultHeight, req_sim))
 		{
-			qWarning() << QString::fromUtf8("Ошибка получения устройства OpenCL:") << err;
 			return false;
 		}
+
+		search->pending = true;
+		return true;
+	}
+
+	cl_kernel kernel = nullptr;
+	if (variantCount > 1)
+	{
+		// Все масштабы шаблона одним запуском, размеры каждого варианта ядро берет из таблицы
+		kernel = context_->ScaledKernel();
+		err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &target.buffer);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &target.variants);
+		err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &source_buffer);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &search->output_buffer);
+		err |= clSetKernelArg(kernel, 4, sizeof(int), &sourceWidth);
+		err |= clSetKernelArg(kernel, 5, sizeof(int), &sourceHeight);
+		err |= clSetKernelArg(kernel, 6, sizeof(float), &req_sim);
+		err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &cancel_buffer_);
+	}
+	else
+	{
+		// Устанавливаем аргументы kernel
+		kernel = context_->Kernel();
+		err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &source_buffer);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &target.buffer);
+		err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &search->output_buffer);
+		err |= clSetKernelArg(kernel, 3, sizeof(int), &sourceWidth);
+		err |= clSetKernelArg(kernel, 4, sizeof(int), &sourceHeight);
+		err |= clSetKernelArg(kernel, 5, sizeof(int), &targetWidth);
+		err |= clSetKernelArg(kernel, 6, sizeof(int), &targetHeight);
+		err |= clSetKernelArg(kernel, 7, sizeof(float), &req_sim);
+		err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &cancel_buffer_);
 	}
 
-	context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("Ошибка создания контекста:") << err;
+		qWarning() << QString::fromUtf8("Set arguments error. kernel : ") << err;
 		return false;
 	}
 
-	queue_ = clCreateCommandQueue(context_, device_, 0, &err);
+	// Для вариантов размер сетки - по наименьшему, лишние позиции крупных вариантов отсекает ядро
+	const size_t globalWorkSize[3] = {
+		((resultWidth + local_work_size[0] - 1) / local_work_size[0]) * local_work_size[0],
+		((resultHeight + local_work_size[1] - 1) / local_work_size[1]) * local_work_size[1],
+		static_cast<size_t>(variantCount)
+	};
+	const size_t localWorkSize[3] = { local_work_size[0], local_work_size[1], 1 };
+
+	// Запускаем kernel
+	err = clEnqueueNDRangeKernel(queue, kernel, variantCount > 1 ? 3 : 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, nullptr);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("Ошибка создания очереди команд:") << err;
-		CleanupOpenCL();
+		qWarning() << QString::fromUtf8("Execution kernel error : d") << err;
 		return false;
 	}
-	PrintDeviceInfo();
 
-	if (!CompileKernel())
+	// Результат читается без ожидания, его дожидается FinishSearches
+	err = clEnqueueReadBuffer(queue, search->output_buffer, CL_FALSE, 0, sizeof(search->result), search->result, 0, nullptr, nullptr);
+	if (err != CL_SUCCESS)
 	{
-		CleanupOpenCL();
+		qWarning() << QString::fromUtf8("Read result error : ") << err;
 		return false;
 	}
 
-	PrintDeviceInfo();
-	is_initialized_ = true;
+	search->pending = true;
 	return true;
 }
 
-bool OpenCLImageFinder::CompileKernel()
-{
-	const char* kernel_source = R"(
-    __kernel void findFirstMatchMinimal(
-        __global const float* source,
-        __global const float* target,
-        volatile __global int* output,          // [found, x, y]
-        const int sourceWidth,
-        const int sourceHeight,
-        const int targetWidth,
-        const int targetHeight,
-        const float requiredSimilarity)
-    {
-        int x = get_global_id(0);
-        int y = get_global_id(1);
-        
-        // Проверяем, не найден ли уже результат (правильный atomic load)
-        int found = atomic_add(&output[0], 0); // Atomic read
-        if (found != 0) {
-            return;
-        }
-        
-        if (x >= sourceWidth - targetWidth || y >= sourceHeight - targetHeight) {
-            return;
-        }
-        
-        float match = 0.0f;
-        int totalPixels = targetWidth * targetHeight;
-        
-        for (int ty = 0; ty < targetHeight; ty++) {
-            for (int tx = 0; tx < targetWidth; tx++) {
-                float sourceVal = source[(y + ty) * sourceWidth + (x + tx)];
-                float targetVal = target[ty * targetWidth + tx];
-                
-				//printf("source: %f ; target: %f \n", sourceVal, targetVal);
-
-                // Быстрое сравнение с допуском
-                if (fabs(sourceVal - targetVal) < 0.03f) {
-					//printf("x: %d y: %d ; f: %f\n", x, y, fabs(sourceVal - targetVal));
-                    match += 1.0f;
-                }
-            }
-            
-            // Проверяем флаг после каждой строки
-            found = atomic_add(&output[0], 0); // Atomic read
-            if (found != 0) return;
-            
-            // Ранний выход если уже не можем достичь requiredSimilarity
-            float currentSimilarity = match / ((ty + 1) * targetWidth);
-            float maxPossible = currentSimilarity + (float)(targetHeight - ty - 1) * targetWidth / totalPixels;
-            if (maxPossible < requiredSimilarity) {
-                break;
-            }
-        }
-        
-        float finalSimilarity = match / (float)(totalPixels);
-		//printf("x: %d y: %d ; final: %f ; required: %f\n", x, y, finalSimilarity, requiredSimilarity);
-        if (finalSimilarity >= requiredSimilarity) {
-            int oldValue = atomic_cmpxchg(&output[0], 0, 1);
-            if (oldValue == 0) {
-                // Первый поток, который нашел - сохраняет координаты
-                atomic_xchg(&output[1], x);
-                atomic_xchg(&output[2], y);
-            }
-        }
-    }
-    )";
-
-	cl_int err;
-	program_ = clCreateProgramWithSource(context_, 1, &kernel_source, nullptr, &err);
+bool OpenCLImageFinder::EnqueuePersistentSearch(SearchSlot& search, cl_mem source_buffer, const PreparedTemplate& target,
+	int variantCount, int sourceWidth, int sourceHeight, int resultWidth, int resultHeight, float req_sim)
+{
+	cl_command_queue queue = context_->Queue();
+	cl_kernel kernel = context_->PersistentKernel();
+
+	static const cl_int first_block = 0;
+	cl_int err = clEnqueueWriteBuffer(queue, search.block_counter, CL_FALSE, 0, sizeof(first_block), &first_block, 0, nullptr, nullptr);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("Create program error : ") << err;
+		qWarning() << QString::fromUtf8("Write block counter error : ") << err;
 		return false;
 	}
 
-	err = clBuildProgram(program_, 1, &device_, nullptr, nullptr, nullptr);
+	const int rowsPerBlock = qMax(1, kPositionsPerBlock / resultWidth);
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &target.buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &target.variants);
+	err |= clSetKernelArg(kernel, 2, sizeof(int), &variantCount);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &source_buffer);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &search.output_buffer);
+	err |= clSetKernelArg(kernel, 5, sizeof(int), &sourceWidth);
+	err |= clSetKernelArg(kernel, 6, sizeof(int), &sourceHeight);
+	err |= clSetKernelArg(kernel, 7, sizeof(int), &resultHeight);
+	err |= clSetKernelArg(kernel, 8, sizeof(int), &rowsPerBlock);
+	err |= clSetKernelArg(kernel, 9, sizeof(float), &req_sim);
+	err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &cancel_buffer_);
+	err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &search.block_counter);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("Compile program error. kernel : ") << err;
+		qWarning() << QString::fromUtf8("Set arguments error. persistent kernel : ") << err;
+		return false;
+	}
 
-		size_t logSize;
-		clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
-		QVector<char> log(logSize);
-		clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, logSize, log.data(), nullptr);
-		qWarning() << QString::fromUtf8("Compilation log : ") << log.data();
+	// Групп не больше, чем блоков: на маленькой области лишние сразу вышли бы из ядра
+	const size_t blockCount = static_cast<size_t>((resultHeight + rowsPerBlock - 1) / rowsPerBlock) * variantCount;
+	const size_t groupSize = context_->PersistentGroupSize();
+	const size_t globalWorkSize = qMin(context_->PersistentGroupCount(), blockCount) * groupSize;
 
+	err = clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalWorkSize, &groupSize, 0, nullptr, nullptr);
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Execution persistent kernel error : ") << err;
 		return false;
 	}
 
-	kernel_ = clCreateKernel(program_, "findFirstMatchMinimal", &err);
+	err = clEnqueueReadBuffer(queue, search.output_buffer, CL_FALSE, 0, sizeof(search.result), search.result, 0, nullptr, nullptr);
 	if (err != CL_SUCCESS)
 	{
-		qWarning() << QString::fromUtf8("Creation error. kernel : ") << err;
+		qWarning() << QString::fromUtf8("Read result error : ") << err;
 		return false;
 	}
 
 	return true;
 }
 
-void OpenCLImageFinder::PrintDeviceInfo() const
+bool OpenCLImageFinder::FinishSearches()
 {
-	if (!device_) return;
-
-	char deviceName[128] = { 0 };
-	clGetDeviceInfo(device_, CL_DEVICE_NAME, sizeof(deviceName), deviceName, nullptr);
-
-	cl_ulong globalMemSize;
-	clGetDeviceInfo(device_, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, nullptr);
-
-	size_t maxWorkGroupSize;
-	clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr);
+	const cl_int err = clFinish(context_->Queue());
+	if (err != CL_SUCCESS)
+	{
+		qWarning() << QString::fromUtf8("Finish queue error : ") << err;
+		return false;
+	}
 
-	qDebug() << QString::fromUtf8("OpenCL Device : ") << deviceName;
-	qDebug() << QString::fromUtf8("Global Memory : ") << globalMemSize / (1024 * 1024) << QString::fromUtf8(" MB");
-	qDebug() << QString::fromUtf8("Max Work Group Size : ") << maxWorkGroupSize;
+	return true;
 }
 
-QImage OpenCLImageFinder::ConvertToGrayscale(const QImage& image)
+bool OpenCLImageFinder::PrepareCancelBuffer()
 {
-	if (image.isNull())
+	if (cancel_buffer_)
 	{
-		return QImage();
+		return true;
 	}
-	else if (image.format() == QImage::Format_Grayscale8)
+
+	static const int not_cancelled = 0;
+	cl_int err = CL_SUCCESS;
+	cancel_buffer_ = clCreateBuffer(context_->Context(), CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+		sizeof(not_cancelled), const_cast<int*>(&not_cancelled), &err);
+	if (err != CL_SUCCESS)
 	{
-		return image;
+		qWarning() << QString::fromUtf8("Create cancel buffer error : ") << err;
+		cancel_buffer_ = nullptr;
+		return false;
 	}
 
-	return image.convertToFormat(QImage::Format_Grayscale8);
+	return true;
 }
 
-QVector<float> OpenCLImageFinder::ConvertGrayscaleToFloatArray(const QImage& grayscaleImage)
+QPoint OpenCLImageFinder::SearchResult(int slot, int* variant, double* score)
 {
-	if (grayscaleImage.isNull() || grayscaleImage.format() != QImage::Format_Grayscale8)
+	if (slot >= static_cast<int>(search_slots_.size()))
 	{
-		return QVector<float>();
+		return QPoint(-1, -1);
 	}
 
-	const int width = grayscaleImage.width();
-	const int height = grayscaleImage.height();
-	QVector<float> array(width * height);
+	SearchSlot& search = search_slots_[slot];
+	if (!search.pending)
+	{
+		return QPoint(-1, -1);
+	}
+	search.pending = false;
 
-	for (int y = 0; y < height; y++)
+	if (search.result[0] != 0)
 	{
-		const uchar* scanLine = grayscaleImage.constScanLine(y);
-		for (int x = 0; x < width; x++)
+		if (variant)
+		{
+			*variant = search.result[3];
+		}
+		if (score)
 		{
-			float float_v = static_cast<float>(scanLine[x]);
-			array[y * width + x] = static_cast<float>(scanLine[x]) / 255.0f;
+			*score = search.result[4] / 1e6;
 		}
+		return QPoint(search.result[1], search.result[2]);
 	}
 
-	return array;
+	return QPoint(-1, -1);
 }
 
-QPoint OpenCLImageFinder::FindFirstMatchMinimal(const QImage& source, const QImage& target,
-	double requiredSimilarity)
+QString OpenCLImageFinder::GetDeviceInfo() const
 {
-	if (!is_initialized_ && !InitializeOpenCL())
+	if (!context_)
 	{
-		qWarning() << QString::fromUtf8("OpenCL is not initialized.");
-		return QPoint(-1, -1);
+		return QString::fromUtf8("Device is not initialized.");
 	}
 
-	if (source.isNull() || target.isNull())
+	return context_->GetDeviceInfo();
+}
+
+void OpenCLImageFinder::SetParams(const geometry_area& area, int monitor_number)
+{
+	detect_area_ = area;
+	monitor_number_ = monitor_number;
+}
+
+void OpenCLImageFinder::SetFrameSource(const QSharedPointer<FrameSource>& frame_source)
+{
+	frame_source_ = frame_source;
+}
+
+void OpenCLImageFinder::SetRecordFile(const QString& path)
+{
+	record_file_ = path;
+}
+
+void OpenCLImageFinder::SetPipelineFile(const QString& path)
+{
+	pipeline_file_ = path;
+}
+
+void OpenCLImageFinder::SetTemplatePack(const QSharedPointer<const TemplatePack>& template_pack)
+{
+	template_pack_ = template_pack;
+}
+
+void OpenCLImageFinder::SetInputSimulator(const QSharedPointer<InputSimulator>& input_simulator, int input_group)
+{
+	input_simulator_ = input_simulator;
+	input_group_ = input_group;
+}
+
+void OpenCLImageFinder::SetPollingConfig(const PollingConfig& config)
+{
+	polling_config_ = config;
+}
+
+void OpenCLImageFinder::SetBookingOpenTime(const QDateTime& open_time)
+{
+	booking_open_time_ = open_time;
+}
+
+const DetectionStats& OpenCLImageFinder::Stats() const
+{
+	return stats_;
+}
+
+const OpenCLImageFinder::StageMatch& OpenCLImageFinder::LastMatch() const
+{
+	return last_match_;
+}
+
+void OpenCLImageFinder::SetCancellationToken(const CancellationToken& token)
+{
+	cancellation_token_ = token;
+}
+
+void OpenCLImageFinder::SetTrackedGeometry(const QSharedPointer<TrackedGeometry>& tracked_geometry)
+{
+	tracked_geometry_ = tracked_geometry;
+	tracked_version_ = 0;
+}
+
+bool OpenCLImageFinder::ApplyTrackedGeometry()
+{
+	geometry_area area;
+	QPoint click_point;
+	if (!tracked_geometry_ || !tracked_geometry_->Get(tracked_version_, area, click_point))
 	{
-		qWarning() << QString::fromUtf8("images not loaded.");
-		return QPoint(-1, -1);
+		return true;
 	}
 
-	QElapsedTimer timer;
-	timer.start();
+	detect_area_ = area;
+	qDebug() << QString::fromUtf8("Tracked detect area : ") << area.x << area.y << area.width << area.height;
+
+	if (!frame_sizes_.isEmpty() && !RegionsFit(frame_sizes_))
+	{
+		return false;
+	}
 
-	// Конвертируем в grayscale
-	QImage source_grayscale_img = ConvertToGrayscale(source);
-	QImage target_grayscale_img = ConvertToGrayscale(target);
+	if (!input_simulator_ || !input_simulator_->isArmed(input_group_))
+	{
+		return true;
+	}
 
-	if (source_grayscale_img.isNull() || target_grayscale_img.isNull())
+	// В режиме всех мониторов последовательности подготовлены для каждого экрана относительно его угла
+	if (grabber_)
 	{
-		qWarning() << QString::fromUtf8("Convert to grayscale error!");
-		return QPoint(-1, -1);
+		qWarning() << QString::fromUtf8("Tracked click point is ignored for all monitors");
+		return true;
 	}
+	input_simulator_->armFullSequence(click_point, input_group_);
+	return true;
+}
 
-#if DEBUG_GRAYSCALE
-	auto display_image = [](const QString& text, const QImage& img)
+bool OpenCLImageFinder::RegionsFit(const QVector<QSize>& frame_sizes) const
+{
+	const QVector<DetectionStage>& stages = pipeline_.Stages();
+	for (int i = 0; i < stages.size(); ++i)
+	{
+		const PreparedTemplate& target = *stage_templates_[i];
+		for (int screen = 0; screen < frame_sizes.size(); ++screen)
 		{
-			QLabel* lbl = new QLabel;
-			lbl->setWindowTitle(text);
-			lbl->setPixmap(QPixmap::fromImage(img));
-			lbl->show();
-		};
-
-	display_image("sourceGray", source_grayscale_img);
-	display_image("targetGray", target_grayscale_img);
-	display_image("source", source);
-	display_image("target", target);
-#endif
+			// Ядру нужна хотя бы одна позиция шаблона внутри области, как и в EnqueueSearch
+			const QRect region = DetectionPipeline::ResolveRegion(stages[i], frame_sizes[screen], detect_area_);
+			if (region.width() <= target.width || region.height() <= target.height)
+			{
+				qWarning() << QString::fromUtf8("Search region is smaller than the template : ") << stages[i].name
+					<< screen << region << target.width << target.height;
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-	const int sourceWidth = source_grayscale_img.width();
-	const int sourceHeight = source_grayscale_img.height();
-	const int targetWidth = target_grayscale_img.width();
-	const int targetHeight = target_grayscale_img.height();
+bool OpenCLImageFinder::GrabFrames()
+{
+	if (grabber_)
+	{
+		return grabber_->GrabAll(frames_);
+	}
 
-	if (targetWidth > sourceWidth || targetHeight > sourceHeight)
+	frames_.resize(1);
+	QImage& frame = frames_[0];
+	qint64 timestamp_ns = 0;
+	if (!run_source_->NextFrame(frame, timestamp_ns))
 	{
-		qWarning() << QString::fromUtf8("Target image greater than source. Error.");
-		return QPoint(-1, -1);
+		return false;
 	}
 
-	const int resultWidth = sourceWidth - targetWidth;
-	const int resultHeight = sourceHeight - targetHeight;
+	if (recorder_.IsOpen())
+	{
+		recorder_.Write(frame, timestamp_ns);
+	}
 
-	if (resultWidth <= 0 || resultHeight <= 0) {
-		qWarning() << QString::fromUtf8("Invalid size");
-		return QPoint(-1, -1);
+	if (!image_packing::IsPackable(frame.format()))
+	{
+		frame = frame.convertToFormat(QImage::Format_RGB32);
 	}
 
-	//qDebug() << "Поиск изображения" << targetWidth << "x" << targetHeight
-	//	<< "в" << sourceWidth << "x" << sourceHeight
-	//	<< "порог:" << requiredSimilarity;
+	return true;
+}
 
-	// Конвертируем в float arrays
-	QVector<float> source_data = ConvertGrayscaleToFloatArray(source_grayscale_img);
-	QVector<float> target_data = ConvertGrayscaleToFloatArray(target_grayscale_img);
+QPoint OpenCLImageFinder::ToGlobal(int slot, const QPoint& frame_pos) const
+{
+	if (grabber_)
+	{
+		return grabber_->ToGlobal(slot, frame_pos);
+	}
 
-	if (source_data.isEmpty() || target_data.isEmpty())
+	if (run_screen_geometry_.isValid())
 	{
-		qWarning() << QString::fromUtf8("Convert float arrays ERROR!");
-		return QPoint(-1, -1);
+		return run_screen_geometry_.topLeft() + frame_pos / run_screen_pixel_ratio_;
 	}
 
-	// Буфер для результата: [found, x, y]
-	int outputData[3] = { 0, -1, -1 };
+	return frame_pos;
+}
 
-	cl_int err;
-	cl_mem sourceBuffer = nullptr;
-	cl_mem targetBuffer = nullptr;
-	cl_mem outputBuffer = nullptr;
+bool OpenCLImageFinder::BeginRun()
+{
+	EndRun();
 
-	// Создаем буферы
-	sourceBuffer = clCreateBuffer(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-		source_data.size() * sizeof(float), source_data.data(), &err);
-	if (err != CL_SUCCESS)
+	if (!pipeline_.LoadFromFile(pipeline_file_.isEmpty() ? DetectionPipeline::kDefaultPath : pipeline_file_))
 	{
-		qWarning() << QString::fromUtf8("Create source source buffer error : ") << err;
-		return QPoint(-1, -1);
+		return false;
 	}
 
-	targetBuffer = clCreateBuffer(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, target_data.size() * sizeof(float), target_data.data(), &err);
-	if (err != CL_SUCCESS)
+	if (!InitializeOpenCL())
 	{
-		qWarning() << QString::fromUtf8("Create target buffer error : ") << err;
-		clReleaseMemObject(sourceBuffer);
-		return QPoint(-1, -1);
+		qWarning() << QString::fromUtf8("OpenCL is not initialized.");
+		return false;
 	}
 
-	outputBuffer = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-		3 * sizeof(int), outputData, &err);
-	if (err != CL_SUCCESS) {
-		qWarning() << QString::fromUtf8("Create output buffer error : ") << err;
-		clReleaseMemObject(sourceBuffer);
-		clReleaseMemObject(targetBuffer);
-		return QPoint(-1, -1);
+	PollingConfig polling_config = polling_config_;
+	QList<QScreen*> run_screens;
+	run_source_ = frame_source_;
+	run_screen_geometry_ = QRect();
+	run_screen_pixel_ratio_ = 1.0;
+	if (!run_source_)
+	{
+		QList<QScreen*> screen_list = QGuiApplication::screens();
+		qDebug() << "screeens count = " << screen_list.size();
+		if (monitor_number_ == kAllMonitors)
+		{
+			// Все экраны сразу, опрос по самому быстрому из них
+			grabber_.reset(new MultiScreenGrabber(screen_list));
+			run_screens = screen_list;
+			for (QScreen* screen : screen_list)
+			{
+				polling_config.refresh_rate = qMax(polling_config.refresh_rate, screen->refreshRate());
+			}
+
+			if (!record_file_.isEmpty())
+			{
+				qWarning() << QString::fromUtf8("Recording is not supported for all monitors, frames are not recorded");
+			}
+		}
+		else
+		{
+			if (monitor_number_ < 0 || monitor_number_ >= screen_list.size())
+			{
+				qWarning() << QString::fromUtf8("Invalid monitor number : ") << monitor_number_;
+				return false;
+			}
+
+			QScreen* screen = screen_list[monitor_number_];
+			run_screens.append(screen);
+			run_source_.reset(new ScreenFrameSource(screen));
+			run_screen_geometry_ = screen->geometry();
+			run_screen_pixel_ratio_ = screen->devicePixelRatio();
+			polling_config.refresh_rate = screen->refreshRate();
+		}
 	}
 
-	// Устанавливаем аргументы kernel
-	err = clSetKernelArg(kernel_, 0, sizeof(cl_mem), &sourceBuffer);
-	err |= clSetKernelArg(kernel_, 1, sizeof(cl_mem), &targetBuffer);
-	err |= clSetKernelArg(kernel_, 2, sizeof(cl_mem), &outputBuffer);
-	err |= clSetKernelArg(kernel_, 3, sizeof(int), &sourceWidth);
-	err |= clSetKernelArg(kernel_, 4, sizeof(int), &sourceHeight);
-	err |= clSetKernelArg(kernel_, 5, sizeof(int), &targetWidth);
-	err |= clSetKernelArg(kernel_, 6, sizeof(int), &targetHeight);
-	float req_sim = static_cast<float>(requiredSimilarity);
-	err |= clSetKernelArg(kernel_, 7, sizeof(float), &req_sim);
-
-	if (err != CL_SUCCESS)
+	// Шаблоны стадий берутся из кэша контекста: одинаковые файлы загружаются на устройство один раз.
+	// Варианты под масштабы просматриваемых экранов готовятся здесь же, из пакета шаблонов - готовыми уровнями
+	// Шаблоны прежнего пакета, на котором больше никто не работает, при этом выгружаются с устройства
+	const QVector<qreal> scales = TemplateScales(run_screens);
+	if (template_pack_)
 	{
-		qWarning() << QString::fromUtf8("Set arguments error. kernel : ") << err;
-		clReleaseMemObject(sourceBuffer);
-		clReleaseMemObject(targetBuffer);
-		clReleaseMemObject(outputBuffer);
-		return QPoint(-1, -1);
+		run_pack_id_ = template_pack_->Sha256();
+		context_->AcquirePack(run_pack_id_);
 	}
-
-	// Определяем размеры рабочих групп
-	size_t maxWorkGroupSize;
-	clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr);
-
-	size_t localWorkSize[2] = { 16, 16 };
-	if (maxWorkGroupSize < 256)
+	const QVector<DetectionStage>& stages = pipeline_.Stages();
+	stage_templates_.resize(stages.size());
+	for (int i = 0; i < stages.size(); ++i)
 	{
-		localWorkSize[0] = 8;
-		localWorkSize[1] = 8;
+		const TemplatePack::Template* packed = template_pack_ ? template_pack_->Find(stages[i].name) : nullptr;
+		stage_templates_[i] = packed
+			? context_->CachedTemplate(OpenCLContext::PackTemplateKey(run_pack_id_, packed->name),
+				TemplatePack::Variants(*packed, scales), scales)
+			: context_->CachedTemplate(stages[i].template_path, stages[i].template_image, scales);
+		if (!stage_templates_[i])
+		{
+			return false;
+		}
 	}
 
-	size_t globalWorkSize[2] = {
-		((resultWidth + localWorkSize[0] - 1) / localWorkSize[0]) * localWorkSize[0],
-		((resultHeight + localWorkSize[1] - 1) / localWorkSize[1]) * localWorkSize[1]
-	};
+	// Размеры кадров экранов известны заранее, кадры записи проверяются по первому из них в Tick
+	frame_sizes_.clear();
+	for (QScreen* screen : run_screens)
+	{
+		frame_sizes_.append((QSizeF(screen->geometry().size()) * screen->devicePixelRatio()).toSize());
+	}
+	if (!frame_sizes_.isEmpty() && !RegionsFit(frame_sizes_))
+	{
+		return false;
+	}
 
-	// Запускаем kernel
-	err = clEnqueueNDRangeKernel(queue_, kernel_, 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, nullptr);
-	if (err != CL_SUCCESS)
+	// Флаг отмены сбрасывается в основной очереди, а выставляется из потока, вызвавшего Cancel,
+	// через управляющую: ядро, которое уже выполняется, увидит его после текущей строки шаблона
+	if (!PrepareCancelBuffer())
 	{
-		qWarning() << QString::fromUtf8("Execution kernel error : d") << err;
-		clReleaseMemObject(sourceBuffer);
-		clReleaseMemObject(targetBuffer);
-		clReleaseMemObject(outputBuffer);
-		return QPoint(-1, -1);
+		return false;
+	}
+	// Запись отмены прошлого запуска могла ещё не дойти до устройства. Управляющая очередь
+	// дожидается до сброса, иначе запоздавшая отмена легла бы поверх него и оборвала новый запуск
+	clFinish(context_->ControlQueue());
+	static const int not_cancelled = 0;
+	clEnqueueWriteBuffer(context_->Queue(), cancel_buffer_, CL_TRUE, 0, sizeof(not_cancelled), &not_cancelled, 0, nullptr, nullptr);
+	const QSharedPointer<OpenCLContext> context = context_;
+	cl_mem cancel_buffer = cancel_buffer_;
+	cancel_subscription_ = cancellation_token_.Subscribe([context, cancel_buffer]() {
+		static const int cancelled = 1;
+		clEnqueueWriteBuffer(context->ControlQueue(), cancel_buffer, CL_FALSE, 0, sizeof(cancelled), &cancelled, 0, nullptr, nullptr);
+		clFlush(context->ControlQueue());
+	});
+
+	scheduler_.SetConfig(polling_config);
+	scheduler_.SetBookingOpenTime(booking_open_time_);
+	scheduler_.Start();
+
+	if (!record_file_.isEmpty() && run_source_)
+	{
+		recorder_.Open(record_file_);
 	}
 
-	// Ждем завершения
-	clFinish(queue_);
+	stats_.Reset();
+	last_match_ = StageMatch();
+	run_timer_.start();
 
-	// Читаем результат
-	int finalResult[3];
-	err = clEnqueueReadBuffer(queue_, outputBuffer, CL_TRUE, 0, 3 * sizeof(int), finalResult, 0, nullptr, nullptr);
-	if (err != CL_SUCCESS)
+	stage_states_.fill(StageState(), stages.size());
+	for (int i = 0; i < stages.size(); ++i)
 	{
-		qWarning() << QString::fromUtf8("Read result error : ") << err;
+		stage_states_[i].active = stages[i].after.isEmpty();
 	}
+	stages_hit_ = 0;
+	return true;
+}
 
-	// Освобождаем ресурсы
-	clReleaseMemObject(sourceBuffer);
-	clReleaseMemObject(targetBuffer);
-	clReleaseMemObject(outputBuffer);
-
-	qDebug() << QString::fromUtf8("Detect duration : ") << timer.elapsed() << QString::fromUtf8(" ms");
+void OpenCLImageFinder::EndRun()
+{
+	if (cancel_subscription_ >= 0)
+	{
+		cancellation_token_.Unsubscribe(cancel_subscription_);
+		cancel_subscription_ = -1;
+	}
 
-	if (finalResult[0] != 0)
+	if (recorder_.IsOpen())
 	{
-		qDebug() << QString::fromUtf8("Found position : ") << finalResult[1] << finalResult[2] << QString::fromUtf8(", func ret ") << finalResult[0];
-		return QPoint(finalResult[1], finalResult[2]);
+		qDebug() << QString::fromUtf8("Recorded frames : ") << recorder_.FramesWritten() << record_file_;
 	}
-	else
+	recorder_.Close();
+	run_source_.reset();
+	grabber_.reset();
+	frames_.clear();
+	frame_sizes_.clear();
+
+	if (!run_pack_id_.isEmpty())
 	{
-		qDebug() << QString::fromUtf8("Position not found");
-		return QPoint(-1, -1);
+		context_->ReleasePack(run_pack_id_);
+		run_pack_id_.clear();
 	}
 }
 
-QString OpenCLImageFinder::GetDeviceInfo() const
+int OpenCLImageFinder::CheckStages(qint64 now_ms, qint64& next_poll_ms) const
 {
-	if (!device_)
+	const QVector<DetectionStage>& stages = pipeline_.Stages();
+	next_poll_ms = std::numeric_limits<qint64>::max();
+	for (int i = 0; i < stages.size(); ++i)
 	{
-		return QString::fromUtf8("Device is not initialized.");
-	}
+		const StageState& state = stage_states_[i];
+		if (!state.active || state.hit)
+		{
+			continue;
+		}
+
+		if (stages[i].timeout_ms > 0 && now_ms - state.activated_ms > stages[i].timeout_ms)
+		{
+			return i;
+		}
 
-	char device_name[128] = { 0 };
-	clGetDeviceInfo(device_, CL_DEVICE_NAME, sizeof(device_name), device_name, nullptr);
+		next_poll_ms = qMin(next_poll_ms, state.next_poll_ms);
+	}
 
-	cl_device_type device_type;
-	clGetDeviceInfo(device_, CL_DEVICE_TYPE, sizeof(device_type), &device_type, nullptr);
+	return -1;
+}
 
-	QString type_str;
-	if (device_type & CL_DEVICE_TYPE_GPU)
+qint64 OpenCLImageFinder::NextTickInNs() const
+{
+	if (!run_timer_.isValid())
 	{
-		type_str = QString::fromUtf8("GPU");
+		return 0;
 	}
-	else if (device_type & CL_DEVICE_TYPE_CPU)
+
+	const qint64 now_ms = run_timer_.elapsed();
+	qint64 next_poll_ms = 0;
+	if (CheckStages(now_ms, next_poll_ms) >= 0)
 	{
-		type_str = QString::fromUtf8("CPU");
+		// Таймаут обработает Tick
+		return 0;
 	}
-	else
+
+	if (next_poll_ms == std::numeric_limits<qint64>::max())
 	{
-		type_str = QString::fromUtf8("Unknown");
+		return scheduler_.NextTickInNs();
 	}
 
-	return QString::fromUtf8("Device: %1 (%2)").arg(device_name).arg(type_str);
+	const qint64 stage_wait_ns = qMax<qint64>(next_poll_ms - now_ms, 0) * kNsInMs;
+	return qMax(stage_wait_ns, scheduler_.NextTickInNs());
 }
 
-void OpenCLImageFinder::SetParams(const geometry_area& area, int monitor_number)
+bool OpenCLImageFinder::IsNearBookingOpen() const
 {
-	detect_area_ = area;
-	monitor_number_ = monitor_number;
+	return scheduler_.IsNearOpenTime();
 }
 
-void OpenCLImageFinder::OnStartClicked()
+OpenCLImageFinder::TickResult OpenCLImageFinder::Tick()
 {
-	qDebug() << "device_info = " << GetDeviceInfo();
-	//Тут добавить проверку на то, что список устройств не пуст
+	const QVector<DetectionStage>& stages = pipeline_.Stages();
+	if (cancellation_token_.IsCancelled())
+	{
+		stats_.total_ns = run_timer_.nsecsElapsed();
+		return TickResult::Cancelled;
+	}
 
-	QImage target_image("://resources/input_pix.bmp");//тут загрузить изображение из ресурсов
-	if (target_image.isNull())
+	if (stages_hit_ >= stages.size())
 	{
-		qWarning() << QString::fromUtf8("Не удалось загрузить изображение");
-		emit Failed();
-		return;
+		return TickResult::Succeed;
 	}
 
-	QImage message_image("://resources/start_pix.bmp");//тут загрузить изображение из ресурсов
-	if (message_image.isNull())
+	// Таймауты и ближайший опрос среди активных стадий
+	const qint64 now_ms = run_timer_.elapsed();
+	qint64 next_poll_ms = 0;
+	const int timed_out = CheckStages(now_ms, next_poll_ms);
+	if (timed_out >= 0)
 	{
-		qWarning() << QString::fromUtf8("Не удалось загрузить изображение");
-		emit Failed();
-		return;
+		qWarning() << QString::fromUtf8("Stage timeout : ") << stages[timed_out].name;
+		stats_.total_ns = run_timer_.nsecsElapsed();
+		return TickResult::Failed;
 	}
 
+	if (next_poll_ms > now_ms || scheduler_.NextTickInNs() > 0)
+	{
+		return TickResult::Pending;
+	}
+	scheduler_.OnTick();
 
-	bool image_detected = false;
-	QList<QScreen*> screen_list = QGuiApplication::screens();
-	qDebug() << "screeens count = " << screen_list.size();
-	QScreen* screen = screen_list[monitor_number_];
+	if (!ApplyTrackedGeometry())
+	{
+		stats_.total_ns = run_timer_.nsecsElapsed();
+		return TickResult::Failed;
+	}
 
-	int msec_duration = 0;
-	QPoint plus_point;
-	while (!image_detected)
+	// Один кадр (по одному на экран) на все стадии, которым пора
+	QElapsedTimer frame_timer;
+	frame_timer.start();
+	if (!GrabFrames())
 	{
-		if (QThread::currentThread()->isInterruptionRequested())
+		qWarning() << QString::fromUtf8("Frame source is exhausted");
+		stats_.total_ns = run_timer_.nsecsElapsed();
+		return TickResult::Failed;
+	}
+	const qint64 grab_ns = frame_timer.nsecsElapsed();
+
+	// Области проверяются заново, только когда размеры кадров отличаются от проверенных
+	bool sizes_changed = frames_.size() != frame_sizes_.size();
+	for (int screen = 0; !sizes_changed && screen < frames_.size(); ++screen)
+	{
+		sizes_changed = frames_[screen].size() != frame_sizes_[screen];
+	}
+	if (sizes_changed)
+	{
+		frame_sizes_.resize(frames_.size());
+		for (int screen = 0; screen < frames_.size(); ++screen)
 		{
-			qDebug() << "Interrupted!";
-			return;
+			frame_sizes_[screen] = frames_[screen].size();
+		}
+		if (!RegionsFit(frame_sizes_))
+		{
+			stats_.total_ns = run_timer_.nsecsElapsed();
+			return TickResult::Failed;
+		}
+	}
+
+	const qint64 allocations_before = alloc_counter::Count();
+	bool tick_matched = false;
+	qint64 detect_ns = 0;
+	for (int i = 0; i < stages.size(); ++i)
+	{
+		const DetectionStage& stage = stages[i];
+		StageState& state = stage_states_[i];
+		if (!state.active || state.hit || state.next_poll_ms > now_ms)
+		{
+			continue;
 		}
 
-		QPixmap screenshot = screen->grabWindow(0);
-		QImage source_image = screenshot.toImage();
-		source_image = source_image.copy(0, source_image.height() - 200, 400, 200); // В идеале от этого избавиться
+		state.next_poll_ms = now_ms + stage.poll_interval_ms;
 
+		// Поиски по всем экранам ставятся в очередь вместе и выполняются устройством за одно ожидание
 		QElapsedTimer timer;
 		timer.start();
-		QPoint found_pos = FindFirstMatchMinimal(source_image, target_image, 0.95); // 0.95 по-умолчанию. Выпилить эту константу в таком виде
-		if (found_pos.x() != -1)
+		for (int screen = 0; screen < frames_.size(); ++screen)
+		{
+			const QRect region = DetectionPipeline::ResolveRegion(stage, frames_[screen].size(), detect_area_);
+			if (!EnqueueSearch(screen, frames_[screen], region, *stage_templates_[i], stage.threshold))
+			{
+				// Уже поставленные поиски дожидаются, чтобы не оставить ядра на устройстве
+				FinishSearches();
+				stats_.total_ns = run_timer_.nsecsElapsed();
+				return TickResult::Failed;
+			}
+		}
+		FinishSearches();
+
+		int found_screen = -1;
+		int found_variant = 0;
+		double found_score = 0.0;
+		QPoint frame_pos;
+		for (int screen = 0; screen < frames_.size(); ++screen)
+		{
+			int variant = 0;
+			double score = 0.0;
+			const QPoint found_pos = SearchResult(screen, &variant, &score);
+			if (found_screen < 0 && found_pos.x() != -1)
+			{
+				found_screen = screen;
+				found_variant = variant;
+				found_score = score;
+				frame_pos = found_pos + DetectionPipeline::ResolveRegion(stage, frames_[screen].size(), detect_area_).topLeft();
+			}
+		}
+		detect_ns += timer.nsecsElapsed();
+		if (cancellation_token_.IsCancelled())
+		{
+			stats_.total_ns = run_timer_.nsecsElapsed();
+			return TickResult::Cancelled;
+		}
+
+		if (found_screen < 0)
+		{
+			continue;
+		}
+
+		state.hit = true;
+		tick_matched = true;
+		++stages_hit_;
+		const int matched_screen = grabber_ ? found_screen : monitor_number_;
+		const QPoint global_pos = ToGlobal(found_screen, frame_pos);
+		last_match_.stage = stage.name;
+		last_match_.position = frame_pos;
+		last_match_.screen = matched_screen;
+		last_match_.global_position = global_pos;
+		last_match_.score = found_score;
+		last_match_.scale = stage_templates_[i]->scales.value(found_variant, 1.0);
+		qDebug() << QString::fromUtf8("Stage %1 matched at (%2, %3) on screen %4, global (%5, %6), scale %7. Duration : %8 msecs")
+			.arg(stage.name).arg(frame_pos.x()).arg(frame_pos.y()).arg(matched_screen)
+			.arg(global_pos.x()).arg(global_pos.y())
+			.arg(last_match_.scale).arg(run_timer_.elapsed());
+		emit StageMatched(stage.name, frame_pos, matched_screen, global_pos);
+
+		for (int j = 0; j < stages.size(); ++j)
+		{
+			if (!stage_states_[j].active && stages[j].after == stage.name)
+			{
+				stage_states_[j].active = true;
+				stage_states_[j].activated_ms = now_ms;
+				stage_states_[j].next_poll_ms = now_ms;
+			}
+		}
+
+		if (stage.action == DetectionStage::Action::Click)
 		{
-			image_detected = true;
-			msec_duration = timer.elapsed();
-			plus_point = found_pos;
+			stats_.AddFrame(grab_ns, detect_ns);
+
+			// Успех - только когда ввод действительно ушел в систему. Без симулятора щелчок отключен намеренно
+			if (input_simulator_)
+			{
+				QElapsedTimer action_timer;
+				action_timer.start();
+				const bool sent = input_simulator_->isArmed(input_group_)
+					&& (grabber_ ? input_simulator_->fireArmedOnScreen(found_screen, input_group_) : input_simulator_->fireArmed(input_group_));
+				stats_.action_ns = action_timer.nsecsElapsed();
+				if (!sent)
+				{
+					qWarning() << QString::fromUtf8("Click is not sent, input is not armed or the backend failed : ") << stage.name;
+					stats_.total_ns = run_timer_.nsecsElapsed();
+					return TickResult::Failed;
+				}
+			}
+			else
+			{
+				qDebug() << QString::fromUtf8("Click is disabled : ") << stage.name;
+			}
+
+			stats_.total_ns = run_timer_.nsecsElapsed();
+			qDebug() << stats_.ToString() << scheduler_.Report();
+			return TickResult::Succeed;
 		}
 	}
 
-	qDebug() << QString::fromUtf8("Plus image found. Duration : %1 msecs").arg(msec_duration);
+	stats_.AddFrame(grab_ns, detect_ns);
+
+	// Первый кадр создает арены, дальше выделений в детекции быть не должно
+	if (alloc_counter::IsEnabled() && stats_.frames > 1 && !tick_matched)
+	{
+		stats_.AddAllocations(alloc_counter::Count() - allocations_before);
+	}
 
-	image_detected = false;
-	while (!image_detected)
+	if (stages_hit_ < stages.size())
+	{
+		return TickResult::Pending;
+	}
+
+	stats_.total_ns = run_timer_.nsecsElapsed();
+	qDebug() << stats_.ToString() << scheduler_.Report();
+	return TickResult::Succeed;
+}
+
+void OpenCLImageFinder::OnStartClicked()
+{
+	qDebug() << "device_info = " << GetDeviceInfo();
+	//Тут добавить проверку на то, что список устройств не пуст
+
+	if (!BeginRun())
+	{
+		EndRun();
+		emit Failed();
+		return;
+	}
+
+	TickResult result = TickResult::Pending;
+	while (result == TickResult::Pending)
 	{
 		if (QThread::currentThread()->isInterruptionRequested())
 		{
 			qDebug() << "Interrupted!";
+			EndRun();
 			return;
 		}
-		const QPixmap screenshot = screen->grabWindow(0);
-		QImage source_image = screenshot.toImage();
-		source_image = source_image.copy(detect_area_.x, detect_area_.y, detect_area_.width, detect_area_.height);
-
-		qDebug() << "h = " << source_image.height() << ", w = " << source_image.width();
 
-		QElapsedTimer timer;
-		timer.start();
-		QPoint found_pos = FindFirstMatchMinimal(source_image, message_image, 0.95);
-		if (found_pos.x() != -1)
+		const qint64 wait_ns = NextTickInNs();
+		if (wait_ns > 0)
 		{
-			image_detected = true;
-			msec_duration = timer.elapsed();
-			qDebug() << QString::fromUtf8("Image detected. Duration : %1 msecs").arg(msec_duration);
+			QThread::usleep(static_cast<unsigned long>(qMin(wait_ns, kMaxSleepSliceNs) / 1000));
+			continue;
 		}
+
+		result = Tick();
 	}
 
-	emit Succeed();
+	EndRun();
+	if (result == TickResult::Succeed)
+	{
+		emit Succeed();
+	}
+	else if (result == TickResult::Failed)
+	{
+		emit Failed();
+	}
+	else
+	{
+		qDebug() << "Cancelled!";
+	}
 }
 
 void OpenCLImageFinder::OnStopClicked()
 {
 	QThread::currentThread()->requestInterruption();
-}
\ No newline at end of file
+}
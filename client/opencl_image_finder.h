@@ -4,9 +4,27 @@
 #include <QImage>
 #include <QPoint>
 #include <QVector>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <CL/opencl.h>
 
 #include "geometry_area.h"
+#include "frame_source.h"
+#include "detection_stats.h"
+#include "detection_pipeline.h"
+#include "polling_scheduler.h"
+#include "frame_arena.h"
+#include "opencl_context.h"
+#include "frame_recorder.h"
+#include "cancellation_token.h"
+#include "tracked_geometry.h"
+#include "template_pack.h"
+
+class InputSimulator;
+class MultiScreenGrabber;
 
 class OpenCLImageFinder final
 	: public QObject
@@ -14,43 +32,206 @@ class OpenCLImageFinder final
 	Q_OBJECT
 
 public:
+	enum class TickResult
+	{
+		Pending,
+		Succeed,
+		Failed,
+		Cancelled
+	};
+
+	// Последнее срабатывание стадии
+	struct StageMatch
+	{
+		QString stage;
+		QPoint position;        // в координатах кадра экрана screen
+		int screen = -1;
+		QPoint global_position; // для щелчка
+		double score = 0.0;     // доля совпавших пикселей
+		qreal scale = 1.0;      // масштаб сработавшего варианта шаблона
+	};
+
+	// Номер монитора для поиска сразу на всех экранах
+	static const int kAllMonitors = -1;
+
 	explicit OpenCLImageFinder(QObject* parent = nullptr);
 	~OpenCLImageFinder() override;
 
+	// Общий контекст OpenCL. Без него поисковик создает собственный при первом использовании.
+	// Поисковики с общим контекстом должны работать в одном потоке
+	void SetContext(const QSharedPointer<OpenCLContext>& context);
+
 	bool InitializeOpenCL();
 	QPoint FindFirstMatchMinimal(const QImage& source, const QImage& target, double requiredSimilarity = 0.95);
 
 	QString GetDeviceInfo() const;
 
+	// monitor_number - kAllMonitors: все экраны захватываются и просматриваются параллельно
 	void SetParams(const geometry_area& area, int monitor_number);
 
+	// Источник кадров вместо экрана (например, воспроизведение записи)
+	void SetFrameSource(const QSharedPointer<FrameSource>& frame_source);
+
+	// Файл для записи захваченных кадров. Пустая строка - не записывать
+	void SetRecordFile(const QString& path);
+
+	// Файл с описанием стадий детекции. Пустая строка - стадии по умолчанию
+	void SetPipelineFile(const QString& path);
+
+	// Пакет шаблонов: шаблон стадии с тем же именем берется из пакета вместо изображения из описания.
+	// Применяется с очередного BeginRun
+	void SetTemplatePack(const QSharedPointer<const TemplatePack>& template_pack);
+
+	// Частота опроса экрана в зависимости от близости открытия записи
+	void SetPollingConfig(const PollingConfig& config);
+
+	// Время открытия записи. Невалидное - опрос на максимальной частоте
+	void SetBookingOpenTime(const QDateTime& open_time);
+
+	// Подготовленный заранее ввод, отправляется из потока поиска сразу при срабатывании стадии click.
+	// nullptr - щелчок отключен (--no-click). Неподготовленный ввод или ошибка отправки завершают запуск с Failed.
+	// input_group - группа пакетов симулятора, общего для нескольких поисковиков
+	void SetInputSimulator(const QSharedPointer<InputSimulator>& input_simulator, int input_group = 0);
+
+	// Статистика последнего запуска. Читать после Failed/Succeed
+	const DetectionStats& Stats() const;
+
+	// Последнее срабатывание стадии текущего или последнего запуска
+	const StageMatch& LastMatch() const;
+
+	// Токен отмены запуска. Отмена прерывает и выполняющееся на устройстве ядро
+	void SetCancellationToken(const CancellationToken& token);
+
+	// Область поиска и точка щелчка, которые меняются во время запуска (окно мессенджера перемещается).
+	// Новые значения подхватываются в начале очередного Tick
+	void SetTrackedGeometry(const QSharedPointer<TrackedGeometry>& tracked_geometry);
+
+	// Пошаговый запуск для планировщика нескольких сессий в одном потоке:
+	// BeginRun, затем Tick пока Pending, затем EndRun. OnStartClicked делает то же самое сам
+	bool BeginRun();
+	TickResult Tick();
+	void EndRun();
+
+	// Через сколько наносекунд следующему Tick будет что делать. 0 - уже пора
+	qint64 NextTickInNs() const;
+
+	// Запуск близок к открытию записи и опрашивает на повышенной частоте
+	bool IsNearBookingOpen() const;
+
 Q_SIGNALS:
 
 	void Failed();
 	void Succeed();
 
+	// Сработала стадия детекции. position - в координатах кадра экрана screen,
+	// global_position - в глобальных координатах для щелчка
+	void StageMatched(const QString& name, const QPoint& position, int screen, const QPoint& global_position);
+
 public Q_SLOT:
 
 	void OnStartClicked();
 	void OnStopClicked();
 
 private:
-	bool CompileKernel();
-	void CleanupOpenCL();
-	void PrintDeviceInfo() const;
+	// Состояние стадии детекции в рамках одного запуска
+	struct StageState
+	{
+		bool active = false;
+		bool hit = false;
+		qint64 activated_ms = 0;
+		qint64 next_poll_ms = 0;
+	};
 
-	QImage ConvertToGrayscale(const QImage& image);
-	QVector<float> ConvertGrayscaleToFloatArray(const QImage& grayscaleImage);
+	void ReleaseBuffers();
+
+	// Буфер результата одного поиска, стоящего в очереди устройства
+	struct SearchSlot
+	{
+		cl_mem output_buffer = nullptr;
+		cl_mem block_counter = nullptr; // следующий блок строк для постоянного ядра
+		int result[5] = { 0, -1, -1, 0, 0 };
+		bool pending = false;
+	};
+
+	// Поиск шаблона в области кадра без промежуточных копий и выделений памяти
+	QPoint FindInRegion(const QImage& frame, const QRect& region, const PreparedTemplate& target, double requiredSimilarity);
+
+	// Постановка поиска в очередь без ожидания. Поиски разных слотов выполняются вместе,
+	// результаты доступны через SearchResult после FinishSearches
+	bool EnqueueSearch(int slot, const QImage& frame, const QRect& region, const PreparedTemplate& target, double requiredSimilarity);
+	bool FinishSearches();
+
+	// Запуск постоянного ядра после записи кадра и сброса результата
+	bool EnqueuePersistentSearch(SearchSlot& search, cl_mem source_buffer, const PreparedTemplate& target, int variantCount,
+		int sourceWidth, int sourceHeight, int resultWidth, int resultHeight, float req_sim);
+	QPoint SearchResult(int slot, int* variant = nullptr, double* score = nullptr);
+
+	SearchSlot* SlotFor(int slot);
+
+	FrameArena* ArenaFor(int slot, const QSize& size);
+
+	bool GrabFrames();
+
+	// Подхватывает изменившиеся область поиска и точку щелчка. false - новая область меньше шаблона
+	bool ApplyTrackedGeometry();
+
+	// Области всех стадий на кадрах этих размеров больше своих шаблонов
+	bool RegionsFit(const QVector<QSize>& frame_sizes) const;
+
+	bool PrepareCancelBuffer();
+
+	QPoint ToGlobal(int slot, const QPoint& frame_pos) const;
+
+	// Ближайший опрос среди активных стадий. Результат - стадия, не уложившаяся в таймаут, или -1
+	int CheckStages(qint64 now_ms, qint64& next_poll_ms) const;
 
 private:
 
-	cl_context context_;
-	cl_device_id device_;
-	cl_command_queue queue_;
-	cl_program program_;
-	cl_kernel kernel_;
-	bool is_initialized_;
+	QSharedPointer<OpenCLContext> context_;
+
+	std::vector<SearchSlot> search_slots_;
+
+	// Флаг отмены на устройстве, его проверяют ядра
+	cl_mem cancel_buffer_ = nullptr;
+	CancellationToken cancellation_token_;
+	int cancel_subscription_ = -1;
+
+	QSharedPointer<TrackedGeometry> tracked_geometry_;
+	quint64 tracked_version_ = 0;
+	std::unordered_map<quint64, std::unique_ptr<FrameArena>> arenas_;
 
 	geometry_area detect_area_ = {};
 	int monitor_number_ = 0;
+
+	QSharedPointer<FrameSource> frame_source_;
+	QString record_file_;
+	QString pipeline_file_;
+	QSharedPointer<const TemplatePack> template_pack_;
+	// Пакет, на котором идет запуск (учтен в контексте до EndRun)
+	QByteArray run_pack_id_;
+
+	PollingConfig polling_config_;
+	QDateTime booking_open_time_;
+
+	QSharedPointer<InputSimulator> input_simulator_;
+	int input_group_ = 0;
+
+	DetectionStats stats_;
+
+	// Состояние текущего запуска
+	DetectionPipeline pipeline_;
+	QVector<const PreparedTemplate*> stage_templates_;
+	QVector<StageState> stage_states_;
+	int stages_hit_ = 0;
+	QSharedPointer<FrameSource> run_source_;
+	std::unique_ptr<MultiScreenGrabber> grabber_;
+	QRect run_screen_geometry_;
+	qreal run_screen_pixel_ratio_ = 1.0;
+	FrameRecorder recorder_;
+	PollingScheduler scheduler_;
+	QElapsedTimer run_timer_;
+	QVector<QImage> frames_;
+	// Размеры кадров, для которых проверены области стадий; пусто, пока кадры источника неизвестны
+	QVector<QSize> frame_sizes_;
+	StageMatch last_match_;
 };
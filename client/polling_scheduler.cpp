@@ -0,0 +1,150 @@
+#include "polling_scheduler.h"
+
+#include <QDebug>
+#include <cmath>
+
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+
+	const qint64 kReportWindowNs = 5000 * kNsInMs;
+}
+
+void PollingScheduler::SetConfig(const PollingConfig& config)
+{
+	config_ = config;
+}
+
+void PollingScheduler::SetBookingOpenTime(const QDateTime& open_time)
+{
+	open_time_ = open_time;
+}
+
+void PollingScheduler::Start()
+{
+	clock_.start();
+	last_tick_ns_ = -1;
+	window_start_ns_ = 0;
+	window_ticks_ = 0;
+	window_target_ns_ = 0;
+	achieved_fps_ = 0.0;
+	target_fps_ = 0.0;
+}
+
+qint64 PollingScheduler::MinIntervalNs() const
+{
+	return config_.align_to_refresh && config_.refresh_rate > 0.0
+		? static_cast<qint64>(1e9 / config_.refresh_rate)
+		: 0;
+}
+
+qint64 PollingScheduler::TargetIntervalNs() const
+{
+	const qint64 min_interval_ns = MinIntervalNs();
+	if (!open_time_.isValid())
+	{
+		return min_interval_ns;
+	}
+
+	const qint64 idle_interval_ns = qMax<qint64>(config_.idle_interval_ms * kNsInMs, min_interval_ns);
+	const qint64 to_open_ms = QDateTime::currentDateTimeUtc().msecsTo(open_time_);
+
+	if (to_open_ms < -config_.burst_after_ms)
+	{
+		return idle_interval_ns;
+	}
+
+	if (to_open_ms <= config_.burst_before_ms)
+	{
+		return min_interval_ns;
+	}
+
+	const qint64 ramp_length_ms = qMax(config_.ramp_ms - config_.burst_before_ms, 1);
+	const qint64 ramp_left_ms = to_open_ms - config_.burst_before_ms;
+	if (ramp_left_ms >= ramp_length_ms)
+	{
+		return idle_interval_ns;
+	}
+
+	// Геометрическая интерполяция: частота растет плавно на всем участке разгона
+	const double t = static_cast<double>(ramp_left_ms) / ramp_length_ms;
+	const double low = static_cast<double>(qMax<qint64>(min_interval_ns, kNsInMs));
+	const double high = static_cast<double>(idle_interval_ns);
+	const qint64 interval_ns = static_cast<qint64>(low * std::pow(high / low, t));
+	return qBound(min_interval_ns, interval_ns, idle_interval_ns);
+}
+
+qint64 PollingScheduler::AlignToRefresh(qint64 tick_ns) const
+{
+	const qint64 period_ns = MinIntervalNs();
+	if (period_ns <= 0)
+	{
+		return tick_ns;
+	}
+
+	// Сетка с шагом периода обновления экрана от старта планировщика
+	return (tick_ns + period_ns - 1) / period_ns * period_ns;
+}
+
+qint64 PollingScheduler::NextTickInNs() const
+{
+	if (!clock_.isValid() || last_tick_ns_ < 0)
+	{
+		return 0;
+	}
+
+	// Опоздавший захват выполняется сразу, а не на следующем обновлении экрана:
+	// иначе повторные запросы догоняли бы сетку бесконечно
+	const qint64 next_tick_ns = AlignToRefresh(last_tick_ns_ + TargetIntervalNs());
+	return qMax<qint64>(next_tick_ns - clock_.nsecsElapsed(), 0);
+}
+
+void PollingScheduler::OnTick()
+{
+	if (!clock_.isValid())
+	{
+		Start();
+	}
+
+	last_tick_ns_ = clock_.nsecsElapsed();
+	window_target_ns_ += TargetIntervalNs();
+	++window_ticks_;
+	UpdateRate(last_tick_ns_);
+}
+
+bool PollingScheduler::IsNearOpenTime() const
+{
+	if (!open_time_.isValid())
+	{
+		return false;
+	}
+
+	const qint64 to_open_ms = QDateTime::currentDateTimeUtc().msecsTo(open_time_);
+	return to_open_ms <= config_.ramp_ms && to_open_ms >= -config_.burst_after_ms;
+}
+
+void PollingScheduler::UpdateRate(qint64 now_ns)
+{
+	const qint64 window_ns = now_ns - window_start_ns_;
+	if (window_ns < kReportWindowNs)
+	{
+		return;
+	}
+
+	achieved_fps_ = window_ticks_ * 1e9 / window_ns;
+	const double mean_target_ns = static_cast<double>(window_target_ns_) / window_ticks_;
+	target_fps_ = mean_target_ns > 0.0 ? 1e9 / mean_target_ns : 0.0;
+	qDebug() << Report();
+
+	window_start_ns_ = now_ns;
+	window_ticks_ = 0;
+	window_target_ns_ = 0;
+}
+
+QString PollingScheduler::Report() const
+{
+	// Целевая частота 0 - опрос без ограничения
+	return QString::fromUtf8("polling fps: achieved %1, target %2")
+		.arg(achieved_fps_, 0, 'f', 1)
+		.arg(target_fps_ > 0.0 ? QString::number(target_fps_, 'f', 1) : QString::fromUtf8("max"));
+}
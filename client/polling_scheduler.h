@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QString>
+
+// Параметры частоты опроса экрана
+struct PollingConfig
+{
+	int idle_interval_ms = 1000;     // далеко от открытия записи
+	int ramp_ms = 5 * 60 * 1000;     // за сколько до открытия начинать разгон
+	int burst_before_ms = 5000;      // максимальная частота за это время до открытия...
+	int burst_after_ms = 10 * 60 * 1000; // ...и в течение этого времени после
+	bool align_to_refresh = true;    // выравнивать захват по частоте обновления экрана
+	double refresh_rate = 0.0;       // Гц, заполняется по экрану. 0 - не выравнивать
+};
+
+// Планировщик захвата кадров: редкий опрос вдали от открытия записи, максимальная частота рядом с ним.
+// Без известного времени открытия всегда работает на максимальной частоте
+class PollingScheduler final
+{
+public:
+	PollingScheduler() = default;
+
+	void SetConfig(const PollingConfig& config);
+
+	void SetBookingOpenTime(const QDateTime& open_time);
+
+	void Start();
+
+	// Интервал опроса для текущего момента, нс
+	qint64 TargetIntervalNs() const;
+
+	// Для общего потока, без блокировки: сколько осталось до захвата (0 - пора) и отметка о захвате
+	qint64 NextTickInNs() const;
+	void OnTick();
+
+	// До открытия записи осталось меньше времени разгона, или оно было недавно
+	bool IsNearOpenTime() const;
+
+	// Достигнутая и целевая частота за последнее окно отчета
+	QString Report() const;
+
+private:
+	qint64 MinIntervalNs() const;
+
+	qint64 AlignToRefresh(qint64 tick_ns) const;
+
+	void UpdateRate(qint64 now_ns);
+
+private:
+	PollingConfig config_;
+	QDateTime open_time_;
+
+	QElapsedTimer clock_;
+	qint64 last_tick_ns_ = -1;
+
+	// Окно для оценки достигнутой частоты
+	qint64 window_start_ns_ = 0;
+	int window_ticks_ = 0;
+	qint64 window_target_ns_ = 0;
+	double achieved_fps_ = 0.0;
+	double target_fps_ = 0.0;
+};
@@ -0,0 +1,64 @@
+#include "recording_input_backend.h"
+#include "monotonic_clock.h"
+
+RecordingInputBackend::RecordingInputBackend() = default;
+
+QString RecordingInputBackend::Name() const
+{
+	return QStringLiteral("mock");
+}
+
+bool RecordingInputBackend::Arm(const QVector<InputEvent>& events, int slot)
+{
+	QMutexLocker locker(&mutex_);
+	armed_.insert(slot, events);
+	return true;
+}
+
+bool RecordingInputBackend::IsArmed(int slot) const
+{
+	QMutexLocker locker(&mutex_);
+	return armed_.contains(slot);
+}
+
+bool RecordingInputBackend::Fire(int slot)
+{
+	const qint64 fired_ns = MonotonicNs();
+
+	FiredCallback callback;
+	{
+		QMutexLocker locker(&mutex_);
+		const auto armed = armed_.constFind(slot);
+		if (armed == armed_.cend())
+		{
+			return false;
+		}
+
+		batches_.append({ fired_ns, *armed });
+		callback = fired_callback_;
+	}
+
+	if (callback)
+	{
+		callback(fired_ns);
+	}
+	return true;
+}
+
+QVector<RecordingInputBackend::Batch> RecordingInputBackend::Batches() const
+{
+	QMutexLocker locker(&mutex_);
+	return batches_;
+}
+
+void RecordingInputBackend::Clear()
+{
+	QMutexLocker locker(&mutex_);
+	batches_.clear();
+}
+
+void RecordingInputBackend::SetFiredCallback(const FiredCallback& callback)
+{
+	QMutexLocker locker(&mutex_);
+	fired_callback_ = callback;
+}
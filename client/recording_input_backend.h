@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <functional>
+
+#include "input_backend.h"
+
+// Ничего не отправляет, только запоминает отправленные пакеты и время отправки
+class RecordingInputBackend final
+	: public InputBackend
+{
+public:
+	struct Batch
+	{
+		qint64 fired_ns = 0;   // MonotonicNs()
+		QVector<InputEvent> events;
+	};
+
+	using FiredCallback = std::function<void(qint64 fired_ns)>;
+
+	RecordingInputBackend();
+
+	QString Name() const override;
+
+	bool Arm(const QVector<InputEvent>& events, int slot) override;
+
+	bool IsArmed(int slot) const override;
+
+	bool Fire(int slot) override;
+
+	QVector<Batch> Batches() const;
+
+	void Clear();
+
+	// Вызывается из потока, в котором сработал Fire
+	void SetFiredCallback(const FiredCallback& callback);
+
+private:
+	mutable QMutex mutex_;
+	QHash<int, QVector<InputEvent>> armed_;
+	QVector<Batch> batches_;
+	FiredCallback fired_callback_;
+};
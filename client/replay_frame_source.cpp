@@ -0,0 +1,155 @@
+#include "replay_frame_source.h"
+#include "frame_container.h"
+
+#include <QDebug>
+#include <QThread>
+#include <cstring>
+
+ReplayFrameSource::~ReplayFrameSource()
+{
+	Close();
+}
+
+bool ReplayFrameSource::Open(const QString& path)
+{
+	Close();
+
+	file_.setFileName(path);
+	if (!file_.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open replay file : ") << path << file_.errorString();
+		return false;
+	}
+
+	const qint64 file_size = file_.size();
+	data_ = file_.map(0, file_size);
+	if (!data_)
+	{
+		qWarning() << QString::fromUtf8("Unable to map replay file : ") << file_.errorString();
+		Close();
+		return false;
+	}
+
+	if (!BuildIndex(file_size))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void ReplayFrameSource::Close()
+{
+	if (data_)
+	{
+		file_.unmap(const_cast<uchar*>(data_));
+		data_ = nullptr;
+	}
+
+	file_.close();
+	frame_offsets_.clear();
+	next_frame_ = 0;
+}
+
+bool ReplayFrameSource::BuildIndex(qint64 file_size)
+{
+	using namespace frame_container;
+
+	if (file_size < static_cast<qint64>(sizeof(FileHeader)))
+	{
+		qWarning() << QString::fromUtf8("Replay file is too small");
+		return false;
+	}
+
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(data_);
+	if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion)
+	{
+		qWarning() << QString::fromUtf8("Unknown replay file format");
+		return false;
+	}
+
+	qint64 offset = AlignedSize(header->header_size);
+	while (offset + static_cast<qint64>(sizeof(FrameHeader)) <= file_size)
+	{
+		const FrameHeader* frame = reinterpret_cast<const FrameHeader*>(data_ + offset);
+		const qint64 data_offset = offset + AlignedSize(sizeof(FrameHeader));
+		if (frame->data_size != static_cast<qint64>(frame->bytes_per_line) * frame->height
+			|| data_offset + frame->data_size > file_size)
+		{
+			// Обрезанный хвост (запись прервана) - используем то, что есть
+			qWarning() << QString::fromUtf8("Replay file truncated at frame ") << frame_offsets_.size();
+			break;
+		}
+
+		frame_offsets_.append(offset);
+		offset = data_offset + AlignedSize(frame->data_size);
+	}
+
+	return !frame_offsets_.isEmpty();
+}
+
+void ReplayFrameSource::SetPacing(Pacing pacing)
+{
+	pacing_ = pacing;
+}
+
+void ReplayFrameSource::SetLoop(bool loop)
+{
+	loop_ = loop;
+}
+
+int ReplayFrameSource::FrameCount() const
+{
+	return frame_offsets_.size();
+}
+
+bool ReplayFrameSource::NextFrame(QImage& frame, qint64& timestamp_ns)
+{
+	using namespace frame_container;
+
+	if (!data_ || frame_offsets_.isEmpty())
+	{
+		return false;
+	}
+
+	if (next_frame_ >= frame_offsets_.size())
+	{
+		if (!loop_)
+		{
+			return false;
+		}
+
+		const FrameHeader* last = reinterpret_cast<const FrameHeader*>(data_ + frame_offsets_.last());
+		loop_offset_ns_ += last->timestamp_ns - first_timestamp_ns_;
+		next_frame_ = 0;
+	}
+
+	const qint64 offset = frame_offsets_[next_frame_];
+	const FrameHeader* header = reinterpret_cast<const FrameHeader*>(data_ + offset);
+
+	if (next_frame_ == 0 && loop_offset_ns_ == 0)
+	{
+		first_timestamp_ns_ = header->timestamp_ns;
+		clock_.start();
+	}
+
+	timestamp_ns = header->timestamp_ns - first_timestamp_ns_ + loop_offset_ns_;
+
+	if (pacing_ == Pacing::Original)
+	{
+		const qint64 wait_ns = timestamp_ns - clock_.nsecsElapsed();
+		if (wait_ns > 0)
+		{
+			QThread::usleep(static_cast<unsigned long>(wait_ns / 1000));
+		}
+	}
+
+	// QImage над константными данными не копирует их
+	frame = QImage(data_ + offset + AlignedSize(sizeof(FrameHeader)),
+		header->width, header->height, header->bytes_per_line,
+		static_cast<QImage::Format>(header->format));
+
+	++next_frame_;
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QFile>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "frame_source.h"
+
+// Воспроизведение записанных кадров через отображение файла в память.
+// Кадры отдаются как QImage поверх отображенной памяти без копирования
+class ReplayFrameSource final
+	: public FrameSource
+{
+public:
+	enum class Pacing
+	{
+		Original,      // с исходными интервалами между кадрами
+		AsFastAsPossible
+	};
+
+	ReplayFrameSource() = default;
+	~ReplayFrameSource() override;
+
+	bool Open(const QString& path);
+	void Close();
+
+	void SetPacing(Pacing pacing);
+
+	// После последнего кадра воспроизведение начинается сначала, время кадров продолжает расти
+	void SetLoop(bool loop);
+
+	// Кадров в открытом файле без обрезанного хвоста
+	int FrameCount() const;
+
+	bool NextFrame(QImage& frame, qint64& timestamp_ns) override;
+
+private:
+	bool BuildIndex(qint64 file_size);
+
+private:
+	QFile file_;
+	const uchar* data_ = nullptr;
+	QVector<qint64> frame_offsets_;
+
+	Pacing pacing_ = Pacing::Original;
+	bool loop_ = false;
+
+	int next_frame_ = 0;
+	qint64 first_timestamp_ns_ = 0;
+	qint64 loop_offset_ns_ = 0;
+	QElapsedTimer clock_;
+};
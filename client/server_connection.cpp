@@ -0,0 +1,461 @@
+#include "server_connection.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QTcpSocket>
+
+#include "monotonic_clock.h"
+#include "template_pack.h"
+#include "template_pack_format.h"
+
+namespace
+{
+	const int kHeartbeatIntervalMs = 5000;
+	const int kReconnectIntervalMs = 3000;
+
+	// После подключения - серия обменов с небольшим интервалом, чтобы быстро набрать выборку,
+	// дальше редкие обмены следят за уходом часов
+	const int kTimeSyncBurstSamples = 8;
+	const int kTimeSyncBurstIntervalMs = 30;
+	const int kTimeSyncIntervalMs = 10000;
+}
+
+ServerConnection::ServerConnection(QObject* parent)
+	: QObject(parent)
+	, socket_(new QTcpSocket(this))
+{
+	heartbeat_timer_.setInterval(kHeartbeatIntervalMs);
+	reconnect_timer_.setInterval(kReconnectIntervalMs);
+	reconnect_timer_.setSingleShot(true);
+	time_sync_timer_.setInterval(kTimeSyncBurstIntervalMs);
+
+	// До ответа сервера (или без сервера вовсе) работаем с последним полученным пакетом
+	template_pack_ = template_pack_cache_.LoadLatest();
+
+	bool connection = true;
+	connection = connect(socket_, &QTcpSocket::connected, this, &ServerConnection::OnConnected); Q_ASSERT(connection);
+	connection = connect(socket_, &QTcpSocket::readyRead, this, &ServerConnection::OnReadyRead); Q_ASSERT(connection);
+	connection = connect(socket_, &QTcpSocket::disconnected, this, &ServerConnection::OnDisconnected); Q_ASSERT(connection);
+	connection = connect(socket_, &QTcpSocket::errorOccurred, this, [this]() {
+		qWarning() << QString::fromUtf8("Server connection error : ") << socket_->errorString();
+		if (socket_->state() == QAbstractSocket::UnconnectedState)
+		{
+			reconnect_timer_.start();
+		}
+		}); Q_ASSERT(connection);
+	connection = connect(&heartbeat_timer_, &QTimer::timeout, this, &ServerConnection::OnHeartbeatTimer); Q_ASSERT(connection);
+	connection = connect(&reconnect_timer_, &QTimer::timeout, this, &ServerConnection::OnReconnectTimer); Q_ASSERT(connection);
+	connection = connect(&time_sync_timer_, &QTimer::timeout, this, &ServerConnection::OnTimeSyncTimer); Q_ASSERT(connection);
+}
+
+ServerConnection::~ServerConnection()
+{
+	Disconnect();
+}
+
+void ServerConnection::ConnectToServer(const QString& host, quint16 port, const QString& user_name, const QByteArray& user_key)
+{
+	host_ = host;
+	port_ = port;
+	user_name_ = user_name;
+	user_key_ = FrameAuthenticator::DeriveUserKey(user_name, user_key);
+	OnReconnectTimer();
+}
+
+void ServerConnection::Disconnect()
+{
+	// Сначала сбрасываются host_ и ready_: abort вызовет OnDisconnected, переподключаться и сообщать не нужно
+	host_.clear();
+	ready_ = false;
+	reconnect_timer_.stop();
+	heartbeat_timer_.stop();
+	time_sync_timer_.stop();
+	socket_->abort();
+}
+
+bool ServerConnection::IsReady() const
+{
+	return ready_;
+}
+
+qint64 ServerConnection::RoundTripNs() const
+{
+	return round_trip_ns_;
+}
+
+const ClockSync& ServerConnection::Clock() const
+{
+	return clock_sync_;
+}
+
+QSharedPointer<const TemplatePack> ServerConnection::CurrentTemplatePack() const
+{
+	return template_pack_;
+}
+
+void ServerConnection::OnReconnectTimer()
+{
+	if (host_.isEmpty())
+	{
+		return;
+	}
+
+	socket_->abort();
+	parser_ = FrameParser();
+	authenticator_.Reset();
+	server_nonce_.clear();
+	// Незаконченная загрузка начнется заново по описанию пакета после приветствия
+	pending_pack_ = protocol::TemplatePackInfo();
+	pending_pack_data_.clear();
+	socket_->connectToHost(host_, port_);
+}
+
+void ServerConnection::OnConnected()
+{
+	// Мелкие сообщения не должны ждать алгоритма Нейгла. Приветствие уходит в ответ на вызов сервера (AuthChallenge)
+	socket_->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+}
+
+void ServerConnection::OnReadyRead()
+{
+	// Отметка прихода для синхронизации часов - до разбора, как можно ближе к получению
+	receive_ns_ = WallClockNs();
+
+	if (!parser_.ReadFrom(socket_))
+	{
+		Drop(parser_.ErrorString());
+		return;
+	}
+
+	protocol::FrameView frame;
+	FrameParser::Status status = parser_.Next(frame);
+	while (status == FrameParser::Status::Frame)
+	{
+		if (!HandleFrame(frame))
+		{
+			Drop(QString::fromUtf8("Malformed %1 message").arg(QString::fromLatin1(protocol::TypeName(frame.type))));
+			return;
+		}
+		status = parser_.Next(frame);
+	}
+
+	if (status == FrameParser::Status::Error)
+	{
+		Drop(parser_.ErrorString());
+	}
+}
+
+bool ServerConnection::HandleFrame(const protocol::FrameView& frame)
+{
+	switch (frame.type)
+	{
+	case protocol::MessageType::AuthChallenge:
+	{
+		// Вызов приходит один раз, первым сообщением
+		protocol::AuthChallenge challenge;
+		if (!protocol::Decode(frame, challenge) || challenge.server_nonce.isEmpty() || !server_nonce_.isEmpty())
+		{
+			return false;
+		}
+
+		server_nonce_ = challenge.server_nonce;
+		client_nonce_ = FrameAuthenticator::GenerateNonce();
+		session_user_key_ = challenge.registered ? user_key_ : QByteArray();
+
+		protocol::Hello hello;
+		hello.user_name = user_name_;
+		hello.client_nonce = client_nonce_;
+		hello.proof = FrameAuthenticator::HelloProof(session_user_key_, server_nonce_, client_nonce_, user_name_);
+		socket_->write(protocol::Encode(hello));
+		return true;
+	}
+	case protocol::MessageType::HelloAck:
+	{
+		protocol::HelloAck ack;
+		if (!protocol::Decode(frame, ack) || server_nonce_.isEmpty())
+		{
+			return false;
+		}
+
+		if (!ack.accepted)
+		{
+			qWarning() << QString::fromUtf8("Server rejected the client : ") << user_name_;
+			return true;
+		}
+
+		authenticator_.SetKey(FrameAuthenticator::DeriveSessionKey(session_user_key_, server_nonce_, client_nonce_));
+		ready_ = true;
+		heartbeat_timer_.start();
+		Send(protocol::Encode(protocol::SettingsRequest()));
+
+		// Сервер мог смениться - выборка собирается заново
+		clock_sync_.Reset();
+		time_sync_sent_ = 0;
+		time_sync_timer_.setInterval(kTimeSyncBurstIntervalMs);
+		time_sync_timer_.start();
+		OnTimeSyncTimer();
+
+		emit Ready(ack.client_id);
+		return true;
+	}
+	case protocol::MessageType::SettingsResponse:
+	{
+		protocol::SettingsResponse response;
+		if (!protocol::Decode(frame, response))
+		{
+			return false;
+		}
+
+		settings_version_ = response.version;
+		emit SettingsReceived(response.values);
+		return true;
+	}
+	case protocol::MessageType::SettingsDelta:
+	{
+		protocol::SettingsDelta delta;
+		if (!protocol::Decode(frame, delta))
+		{
+			return false;
+		}
+
+		// Пропущено изменение (например, при переподключении) - настройки целиком
+		if (delta.base_version != settings_version_)
+		{
+			Send(protocol::Encode(protocol::SettingsRequest()));
+			return true;
+		}
+
+		settings_version_ = delta.version;
+		emit SettingsReceived(delta.values);
+		return true;
+	}
+	case protocol::MessageType::Heartbeat:
+	{
+		protocol::Heartbeat heartbeat;
+		if (!protocol::Decode(frame, heartbeat))
+		{
+			return false;
+		}
+
+		// Эхо нашего heartbeat
+		if (heartbeat.sequence == heartbeat_sequence_)
+		{
+			round_trip_ns_ = MonotonicNs() - heartbeat.sent_ns;
+		}
+		return true;
+	}
+	case protocol::MessageType::BookingOpen:
+	{
+		protocol::BookingOpen booking_open;
+		if (!protocol::Decode(frame, booking_open))
+		{
+			return false;
+		}
+
+		pending_open_time_ = QDateTime::fromMSecsSinceEpoch(booking_open.open_time_ms, Qt::UTC);
+		pending_court_id_ = booking_open.court_id;
+		if (clock_sync_.IsSynchronized())
+		{
+			EmitBookingOpen();
+		}
+		return true;
+	}
+	case protocol::MessageType::SessionToken:
+	{
+		protocol::SessionToken token;
+		if (!protocol::Decode(frame, token) || token.nonce.isEmpty() || !authenticator_.HasKey())
+		{
+			return false;
+		}
+
+		// Следующие кадры - новым ключом
+		authenticator_.SetKey(FrameAuthenticator::DeriveSessionKey(session_user_key_, server_nonce_, client_nonce_, token.nonce));
+		return true;
+	}
+	case protocol::MessageType::TemplatePackInfo:
+	{
+		protocol::TemplatePackInfo info;
+		return protocol::Decode(frame, info) && OnTemplatePackInfo(info);
+	}
+	case protocol::MessageType::TemplatePackChunk:
+	{
+		protocol::TemplatePackChunk chunk;
+		return protocol::Decode(frame, chunk) && OnTemplatePackChunk(chunk);
+	}
+	case protocol::MessageType::TimeSyncResponse:
+	{
+		protocol::TimeSyncResponse response;
+		if (!protocol::Decode(frame, response))
+		{
+			return false;
+		}
+
+		// Ответ на запрос, которого не было
+		if (response.sequence == 0 || response.sequence > time_sync_sequence_)
+		{
+			return false;
+		}
+
+		const bool was_synchronized = clock_sync_.IsSynchronized();
+		clock_sync_.AddSample(response.client_send_ns, response.server_receive_ns, response.server_send_ns, receive_ns_);
+		if (!clock_sync_.IsSynchronized())
+		{
+			return true;
+		}
+
+		emit ClockSynchronized(clock_sync_.OffsetNs(), clock_sync_.DelayNs());
+		if (!was_synchronized && pending_open_time_.isValid())
+		{
+			EmitBookingOpen();
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool ServerConnection::OnTemplatePackInfo(const protocol::TemplatePackInfo& info)
+{
+	if (info.version == 0 || info.size == 0 || info.size > template_pack_format::kMaxPackSize || info.sha256.isEmpty())
+	{
+		return false;
+	}
+
+	pending_pack_ = protocol::TemplatePackInfo();
+	pending_pack_data_.clear();
+	if (template_pack_ && template_pack_->Version() == info.version)
+	{
+		return true;
+	}
+
+	// Эта версия уже загружалась раньше
+	const QSharedPointer<const TemplatePack> cached = template_pack_cache_.Load(info.version, info.size);
+	if (cached)
+	{
+		SetTemplatePack(cached);
+		return true;
+	}
+
+	pending_pack_ = info;
+	pending_pack_data_.reserve(static_cast<int>(info.size));
+	RequestTemplatePackChunk();
+	return true;
+}
+
+bool ServerConnection::OnTemplatePackChunk(const protocol::TemplatePackChunk& chunk)
+{
+	// Кусок прежней версии, пакет на сервере уже сменился
+	if (pending_pack_.version == 0 || chunk.version != pending_pack_.version)
+	{
+		return true;
+	}
+
+	if (chunk.offset != static_cast<quint32>(pending_pack_data_.size()) || chunk.data.isEmpty()
+		|| chunk.data.size() > static_cast<int>(pending_pack_.size - chunk.offset))
+	{
+		return false;
+	}
+
+	pending_pack_data_.append(chunk.data);
+	if (pending_pack_data_.size() < static_cast<int>(pending_pack_.size))
+	{
+		RequestTemplatePackChunk();
+		return true;
+	}
+
+	const protocol::TemplatePackInfo info = pending_pack_;
+	const QByteArray data = pending_pack_data_;
+	pending_pack_ = protocol::TemplatePackInfo();
+	pending_pack_data_.clear();
+
+	if (QCryptographicHash::hash(data, QCryptographicHash::Sha256) != info.sha256)
+	{
+		qWarning() << QString::fromUtf8("Template pack checksum mismatch, version : ") << info.version;
+		return true;
+	}
+
+	const QSharedPointer<const TemplatePack> pack = template_pack_cache_.Store(info.version, data);
+	if (pack)
+	{
+		SetTemplatePack(pack);
+	}
+	return true;
+}
+
+void ServerConnection::RequestTemplatePackChunk()
+{
+	protocol::TemplatePackRequest request;
+	request.version = pending_pack_.version;
+	request.offset = static_cast<quint32>(pending_pack_data_.size());
+	Send(protocol::Encode(request));
+}
+
+void ServerConnection::SetTemplatePack(const QSharedPointer<const TemplatePack>& pack)
+{
+	template_pack_ = pack;
+	qDebug() << QString::fromUtf8("Template pack version ") << pack->Version() << QString::fromUtf8(" : ")
+		<< pack->Templates().size() << QString::fromUtf8(" templates");
+	emit TemplatePackChanged(pack);
+}
+
+void ServerConnection::OnHeartbeatTimer()
+{
+	protocol::Heartbeat heartbeat;
+	heartbeat.sequence = ++heartbeat_sequence_;
+	heartbeat.sent_ns = MonotonicNs();
+	Send(protocol::Encode(heartbeat));
+}
+
+void ServerConnection::OnTimeSyncTimer()
+{
+	protocol::TimeSyncRequest request;
+	request.sequence = ++time_sync_sequence_;
+	request.client_send_ns = WallClockNs();
+	Send(protocol::Encode(request));
+	socket_->flush();
+
+	if (++time_sync_sent_ == kTimeSyncBurstSamples)
+	{
+		time_sync_timer_.setInterval(kTimeSyncIntervalMs);
+	}
+}
+
+void ServerConnection::EmitBookingOpen()
+{
+	const QDateTime local_open_time = clock_sync_.ServerToLocal(pending_open_time_);
+	qDebug() << QString::fromUtf8("Booking open : server ") << pending_open_time_.toString(Qt::ISODateWithMs)
+		<< QString::fromUtf8(" local ") << local_open_time.toString(Qt::ISODateWithMs)
+		<< QString::fromUtf8(" offset ns ") << clock_sync_.OffsetNs()
+		<< QString::fromUtf8(" delay ns ") << clock_sync_.DelayNs();
+	emit BookingOpenReceived(local_open_time, pending_court_id_);
+	pending_open_time_ = QDateTime();
+}
+
+void ServerConnection::OnDisconnected()
+{
+	heartbeat_timer_.stop();
+	time_sync_timer_.stop();
+	const bool was_ready = ready_;
+	ready_ = false;
+	if (was_ready)
+	{
+		emit Disconnected();
+	}
+
+	if (!host_.isEmpty())
+	{
+		reconnect_timer_.start();
+	}
+}
+
+void ServerConnection::Send(const QByteArray& frame)
+{
+	socket_->write(authenticator_.HasKey() ? authenticator_.Sign(frame) : frame);
+}
+
+void ServerConnection::Drop(const QString& reason)
+{
+	qWarning() << QString::fromUtf8("Server connection dropped : ") << reason;
+	socket_->abort();
+}
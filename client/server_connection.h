@@ -0,0 +1,122 @@
+#pragma once
+
+#include <QDateTime>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include "clock_sync.h"
+#include "frame_auth.h"
+#include "frame_parser.h"
+#include "template_pack_cache.h"
+
+class QTcpSocket;
+class TemplatePack;
+
+// Соединение клиента с book_tennis_server: приветствие, запрос настроек, heartbeat, синхронизация часов,
+// уведомление об открытии записи, пакет шаблонов. При разрыве переподключается сам
+class ServerConnection final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ServerConnection(QObject* parent = nullptr);
+	~ServerConnection() override;
+
+	// user_key - секрет пользователя. По сети не передается: из него вычисляется ключ для ответа на вызов сервера
+	void ConnectToServer(const QString& host, quint16 port, const QString& user_name, const QByteArray& user_key);
+	void Disconnect();
+
+	bool IsReady() const;
+
+	// Круговая задержка по последнему heartbeat, нс. 0 - еще не измерена
+	qint64 RoundTripNs() const;
+
+	// Оценка сдвига часов относительно сервера
+	const ClockSync& Clock() const;
+
+	// Пакет шаблонов: при старте последний из кэша, затем версия, которую раздает сервер. nullptr - пакета нет
+	QSharedPointer<const TemplatePack> CurrentTemplatePack() const;
+
+Q_SIGNALS:
+
+	void Ready(quint32 client_id);
+	// Все настройки (ответ на запрос) или только изменившиеся (рассылка сервера)
+	void SettingsReceived(const QVector<QPair<QString, QString>>& values);
+	void ClockSynchronized(qint64 offset_ns, qint64 delay_ns);
+	// Время открытия по часам клиента. Приходит только после синхронизации часов
+	void BookingOpenReceived(const QDateTime& open_time, quint32 court_id);
+	// Сервер раздает другую версию пакета шаблонов, она взята из кэша или загружена и проверена
+	void TemplatePackChanged(const QSharedPointer<const TemplatePack>& pack);
+	void Disconnected();
+
+private Q_SLOTS:
+
+	void OnConnected();
+	void OnReadyRead();
+	void OnDisconnected();
+	void OnHeartbeatTimer();
+	void OnReconnectTimer();
+	void OnTimeSyncTimer();
+
+private:
+	bool HandleFrame(const protocol::FrameView& frame);
+
+	void Drop(const QString& reason);
+
+	// После приветствия кадр уходит подписанным ключом сессии
+	void Send(const QByteArray& frame);
+
+	void EmitBookingOpen();
+
+	// false - описание пакета некорректно
+	bool OnTemplatePackInfo(const protocol::TemplatePackInfo& info);
+
+	// false - кусок не по порядку
+	bool OnTemplatePackChunk(const protocol::TemplatePackChunk& chunk);
+
+	void RequestTemplatePackChunk();
+
+	void SetTemplatePack(const QSharedPointer<const TemplatePack>& pack);
+
+private:
+	QTcpSocket* socket_ = nullptr;
+	FrameParser parser_;
+
+	QString host_;
+	quint16 port_ = 0;
+	QString user_name_;
+	// FrameAuthenticator::DeriveUserKey от секрета, вычисляется один раз при ConnectToServer
+	QByteArray user_key_;
+	// Ключ пользователя, которым отвечаем этому соединению (пустой для сервера без реестра), и nonce соединения
+	QByteArray session_user_key_;
+	QByteArray server_nonce_;
+	QByteArray client_nonce_;
+	FrameAuthenticator authenticator_;
+
+	bool ready_ = false;
+	quint32 settings_version_ = 0;
+	quint64 heartbeat_sequence_ = 0;
+	qint64 round_trip_ns_ = 0;
+
+	ClockSync clock_sync_;
+	quint64 time_sync_sequence_ = 0;
+	int time_sync_sent_ = 0;
+	// Отметка прихода данных по настенным часам (t3)
+	qint64 receive_ns_ = 0;
+
+	// Время открытия по часам сервера, ждет синхронизации часов
+	QDateTime pending_open_time_;
+	quint32 pending_court_id_ = 0;
+
+	TemplatePackCache template_pack_cache_;
+	QSharedPointer<const TemplatePack> template_pack_;
+	// Загружаемый пакет: описание от сервера и полученные по порядку куски. Версия 0 - загрузки нет
+	protocol::TemplatePackInfo pending_pack_;
+	QByteArray pending_pack_data_;
+
+	QTimer heartbeat_timer_;
+	QTimer reconnect_timer_;
+	QTimer time_sync_timer_;
+};
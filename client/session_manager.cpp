@@ -0,0 +1,330 @@
+#include "session_manager.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <limits>
+
+#include "input_simulator.h"
+#include "monotonic_clock.h"
+#include "opencl_context.h"
+#include "opencl_image_finder.h"
+
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+
+	// Сон порциями, чтобы ожидание не мешало остановке
+	const qint64 kMaxSleepSliceNs = 50 * kNsInMs;
+
+	// Сессия рядом с открытием записи считается ждущей дольше на это время.
+	// Остальные сессии не голодают: их задержка ограничена этой величиной
+	const qint64 kPriorityBoostNs = 100 * kNsInMs;
+}
+
+SessionManager::SessionManager(QObject* parent)
+	: QObject(parent)
+{
+}
+
+SessionManager::~SessionManager()
+{
+	// Буферы поисковиков освобождаются раньше общего контекста
+	sessions_.clear();
+	context_.reset();
+	input_simulator_.reset();
+}
+
+bool SessionManager::LoadFromFile(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open sessions file : ") << path << file.errorString();
+		return false;
+	}
+
+	QJsonParseError error;
+	const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+	if (document.isNull())
+	{
+		qWarning() << QString::fromUtf8("Sessions parse error : ") << error.errorString();
+		return false;
+	}
+
+	const QDir base_dir = QFileInfo(path).absoluteDir();
+	QVector<WatchSessionConfig> sessions;
+	const QJsonArray sessions_json = document.object().value(QStringLiteral("sessions")).toArray();
+	for (const QJsonValue& value : sessions_json)
+	{
+		const QJsonObject object = value.toObject();
+
+		WatchSessionConfig session;
+		session.name = object.value(QStringLiteral("name")).toString(QString::number(sessions.size()));
+		const QJsonValue monitor = object.value(QStringLiteral("monitor"));
+		session.monitor_number = monitor.toString() == QStringLiteral("all")
+			? OpenCLImageFinder::kAllMonitors
+			: monitor.toInt(session.monitor_number);
+
+		const QJsonArray area = object.value(QStringLiteral("area")).toArray();
+		if (area.size() == 4)
+		{
+			session.detect_area = { area[0].toInt(), area[1].toInt(), area[2].toInt(), area[3].toInt() };
+		}
+
+		const QJsonArray click = object.value(QStringLiteral("click")).toArray();
+		if (click.size() != 2)
+		{
+			qWarning() << QString::fromUtf8("Session click point is missing : ") << session.name;
+			return false;
+		}
+		session.click_point = QPoint(click[0].toInt(), click[1].toInt());
+
+		// Относительные пути считаем от каталога файла сессий
+		session.pipeline_file = object.value(QStringLiteral("pipeline")).toString();
+		if (!session.pipeline_file.isEmpty() && !session.pipeline_file.startsWith(':')
+			&& QFileInfo(session.pipeline_file).isRelative())
+		{
+			session.pipeline_file = base_dir.filePath(session.pipeline_file);
+		}
+
+		const QString booking_open = object.value(QStringLiteral("booking_open")).toString();
+		if (!booking_open.isEmpty())
+		{
+			session.booking_open_time = QDateTime::fromString(booking_open, Qt::ISODate);
+			if (!session.booking_open_time.isValid())
+			{
+				qWarning() << QString::fromUtf8("Invalid session booking open time : ") << booking_open;
+				return false;
+			}
+		}
+
+		sessions.append(session);
+	}
+
+	if (sessions.isEmpty())
+	{
+		qWarning() << QString::fromUtf8("Sessions file has no sessions : ") << path;
+		return false;
+	}
+
+	configs_.swap(sessions);
+	return true;
+}
+
+void SessionManager::SetSessions(const QVector<WatchSessionConfig>& sessions)
+{
+	configs_ = sessions;
+}
+
+const QVector<WatchSessionConfig>& SessionManager::Sessions() const
+{
+	return configs_;
+}
+
+void SessionManager::SetPollingConfig(const PollingConfig& config)
+{
+	polling_config_ = config;
+}
+
+void SessionManager::SetInputBackend(const QString& name)
+{
+	input_backend_ = name;
+}
+
+void SessionManager::SetClickEnabled(bool enabled)
+{
+	click_enabled_ = enabled;
+}
+
+bool SessionManager::StartSessions()
+{
+	sessions_.clear();
+
+	// Один контекст: программа компилируется один раз, одинаковые шаблоны загружаются на устройство один раз
+	if (!context_)
+	{
+		context_.reset(new OpenCLContext);
+	}
+	if (!context_->Initialize())
+	{
+		qWarning() << QString::fromUtf8("OpenCL is not initialized.");
+		return false;
+	}
+	qDebug() << "device_info = " << context_->GetDeviceInfo();
+
+	// Без способа ввода сессии не могут щелкнуть: ошибка, а не тихая запись вместо щелчка
+	input_simulator_.reset();
+	if (click_enabled_)
+	{
+		const QSharedPointer<InputBackend> backend = InputBackend::Create(input_backend_);
+		if (!backend)
+		{
+			qWarning() << QString::fromUtf8("Sessions have no input backend : ") << input_backend_;
+			return false;
+		}
+		input_simulator_.reset(new InputSimulator(backend));
+	}
+
+	sessions_.resize(configs_.size());
+	for (int i = 0; i < configs_.size(); ++i)
+	{
+		Session& session = sessions_[i];
+		session.config = configs_[i];
+		session.finder.reset(new OpenCLImageFinder);
+		session.finder->SetContext(context_);
+		session.finder->SetParams(session.config.detect_area, session.config.monitor_number);
+		session.finder->SetPipelineFile(session.config.pipeline_file);
+		session.finder->SetPollingConfig(polling_config_);
+		session.finder->SetBookingOpenTime(session.config.booking_open_time);
+
+		if (input_simulator_)
+		{
+			// Группа пакетов - номер сессии
+			const bool armed = session.config.monitor_number == OpenCLImageFinder::kAllMonitors
+				? input_simulator_->armFullSequenceOnScreens(session.config.click_point, i)
+				: input_simulator_->armFullSequence(session.config.click_point, i);
+			if (!armed)
+			{
+				qWarning() << QString::fromUtf8("Unable to prepare the click sequence for session : ") << session.config.name;
+				session.done = true;
+				emit SessionFailed(session.config.name);
+				continue;
+			}
+			session.finder->SetInputSimulator(input_simulator_, i);
+		}
+
+		if (!session.finder->BeginRun())
+		{
+			qWarning() << QString::fromUtf8("Session start failed : ") << session.config.name;
+			session.done = true;
+			emit SessionFailed(session.config.name);
+		}
+	}
+
+	return true;
+}
+
+int SessionManager::PickNext(qint64& wait_ns) const
+{
+	int next = -1;
+	qint64 best_served_ns = std::numeric_limits<qint64>::max();
+	wait_ns = std::numeric_limits<qint64>::max();
+	for (size_t i = 0; i < sessions_.size(); ++i)
+	{
+		const Session& session = sessions_[i];
+		if (session.done)
+		{
+			continue;
+		}
+
+		const qint64 session_wait_ns = session.finder->NextTickInNs();
+		if (session_wait_ns > 0)
+		{
+			wait_ns = qMin(wait_ns, session_wait_ns);
+			continue;
+		}
+
+		const qint64 served_ns = session.finder->IsNearBookingOpen()
+			? session.last_served_ns - kPriorityBoostNs
+			: session.last_served_ns;
+		if (served_ns < best_served_ns)
+		{
+			best_served_ns = served_ns;
+			next = static_cast<int>(i);
+		}
+	}
+
+	if (next >= 0)
+	{
+		wait_ns = 0;
+	}
+	return next;
+}
+
+void SessionManager::OnStartClicked()
+{
+	if (configs_.isEmpty() || !StartSessions())
+	{
+		emit Finished(QString::fromUtf8("sessions: not started\n"), false);
+		return;
+	}
+
+	int sessions_left = 0;
+	for (const Session& session : sessions_)
+	{
+		sessions_left += session.done ? 0 : 1;
+	}
+
+	while (sessions_left > 0)
+	{
+		if (QThread::currentThread()->isInterruptionRequested())
+		{
+			qDebug() << "Interrupted!";
+			break;
+		}
+
+		qint64 wait_ns = 0;
+		const int next = PickNext(wait_ns);
+		if (next < 0)
+		{
+			QThread::usleep(static_cast<unsigned long>(qMin(wait_ns, kMaxSleepSliceNs) / 1000));
+			continue;
+		}
+
+		Session& session = sessions_[next];
+		session.last_served_ns = MonotonicNs();
+
+		const OpenCLImageFinder::TickResult result = session.finder->Tick();
+		if (result == OpenCLImageFinder::TickResult::Pending)
+		{
+			continue;
+		}
+
+		session.finder->EndRun();
+		session.done = true;
+		session.succeed = result == OpenCLImageFinder::TickResult::Succeed;
+		--sessions_left;
+
+		if (session.succeed)
+		{
+			emit SessionSucceed(session.config.name);
+		}
+		else
+		{
+			emit SessionFailed(session.config.name);
+		}
+	}
+
+	bool ok = true;
+	for (Session& session : sessions_)
+	{
+		session.finder->EndRun();
+		ok = ok && session.succeed;
+	}
+
+	emit Finished(Report(), ok);
+}
+
+void SessionManager::OnStopClicked()
+{
+	QThread::currentThread()->requestInterruption();
+}
+
+QString SessionManager::Report() const
+{
+	QString report;
+	for (const Session& session : sessions_)
+	{
+		report += QString::fromUtf8("session %1: %2; %3\n")
+			.arg(session.config.name)
+			.arg(session.succeed ? QString::fromUtf8("succeed") : QString::fromUtf8("failed"))
+			.arg(session.finder->Stats().ToString());
+	}
+	return report;
+}
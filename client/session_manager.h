@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QObject>
+#include <QDateTime>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+#include "geometry_area.h"
+#include "polling_scheduler.h"
+
+class InputSimulator;
+class OpenCLContext;
+class OpenCLImageFinder;
+
+// Параметры одной сессии наблюдения: свое окно чата, свои шаблоны и своя точка щелчка
+struct WatchSessionConfig
+{
+	QString name;
+	int monitor_number = 0;
+	geometry_area detect_area;
+	QPoint click_point;
+	QString pipeline_file;
+	QDateTime booking_open_time;
+};
+
+// Несколько независимых сессий наблюдения в одном потоке с общим контекстом OpenCL,
+// скомпилированной программой и кэшем шаблонов. Поиски сессий чередуются в одной очереди устройства
+class SessionManager final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit SessionManager(QObject* parent = nullptr);
+	~SessionManager() override;
+
+	// Файл json вида { "sessions": [ { "name", "monitor", "area": [x, y, w, h], "click": [x, y], "pipeline", "booking_open" } ] }
+	bool LoadFromFile(const QString& path);
+
+	void SetSessions(const QVector<WatchSessionConfig>& sessions);
+	const QVector<WatchSessionConfig>& Sessions() const;
+
+	void SetPollingConfig(const PollingConfig& config);
+
+	// Пустое имя - бэкенд ввода по умолчанию
+	void SetInputBackend(const QString& name);
+
+	void SetClickEnabled(bool enabled);
+
+Q_SIGNALS:
+
+	void SessionSucceed(const QString& name);
+	void SessionFailed(const QString& name);
+
+	// Все сессии завершены. ok - все сработали
+	void Finished(const QString& report, bool ok);
+
+public Q_SLOTS:
+
+	// Блокирующий цикл всех сессий. Вызывать в отдельном потоке
+	void OnStartClicked();
+	void OnStopClicked();
+
+private:
+	struct Session
+	{
+		WatchSessionConfig config;
+		std::unique_ptr<OpenCLImageFinder> finder;
+		bool done = false;
+		bool succeed = false;
+		qint64 last_served_ns = 0;
+	};
+
+	// Сессия, которой пора искать и которая дольше всех ждала. -1 - ни одной, wait_ns - до ближайшей
+	int PickNext(qint64& wait_ns) const;
+
+	bool StartSessions();
+
+	QString Report() const;
+
+private:
+	QVector<WatchSessionConfig> configs_;
+	PollingConfig polling_config_;
+	QString input_backend_;
+	bool click_enabled_ = true;
+
+	QSharedPointer<OpenCLContext> context_;
+	// Одно устройство ввода на все сессии, у каждой сессии своя группа подготовленных пакетов
+	QSharedPointer<InputSimulator> input_simulator_;
+	std::vector<Session> sessions_;
+};
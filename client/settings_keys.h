@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QString>
+
+namespace helpers
+{
+	namespace settings
+	{
+		namespace keys
+		{
+			const QString monitor_number = "monitor_number";
+			const QString detect_area_x = "detect_area_x";
+			const QString detect_area_y = "detect_area_y";
+			const QString detect_area_width = "detect_area_width";
+			const QString detect_area_height = "detect_area_height";
+			const QString mouse_click_x = "mouse_click_x";
+			const QString mouse_click_y = "mouse_click_y";
+			const QString record_file = "record_file";
+			const QString replay_file = "replay_file";
+			const QString replay_as_fast_as_possible = "replay_as_fast_as_possible";
+			const QString pipeline_file = "pipeline_file";
+			const QString booking_open_time = "booking_open_time";
+			const QString poll_idle_interval_ms = "poll_idle_interval_ms";
+			const QString poll_ramp_ms = "poll_ramp_ms";
+			const QString poll_align_to_refresh = "poll_align_to_refresh";
+			const QString input_backend = "input_backend";
+			const QString window_title = "window_title";
+			const QString server_host = "server_host";
+			const QString server_port = "server_port";
+			const QString user_name = "user_name";
+			const QString user_key = "user_key";
+			const QString auto_start_lead_ms = "auto_start_lead_ms";
+		}
+
+		// Настройки, которые клиент принимает от сервера. Остальные - файлы, адрес сервера, ключ пользователя,
+		// способ ввода - задаются только локально
+		inline bool IsServerShared(const QString& key)
+		{
+			return key == keys::detect_area_x || key == keys::detect_area_y
+				|| key == keys::detect_area_width || key == keys::detect_area_height
+				|| key == keys::mouse_click_x || key == keys::mouse_click_y
+				|| key == keys::poll_idle_interval_ms || key == keys::poll_ramp_ms || key == keys::poll_align_to_refresh
+				|| key == keys::auto_start_lead_ms;
+		}
+
+		namespace default_values
+		{
+			const int monitor_number = 0;
+			const int detect_area_x = 375;
+			const int detect_area_y = 160;
+			const int detect_area_width = 550;
+			const int detect_area_height = 950;
+			const int mouse_click_x = 2500;
+			const int mouse_click_y = 1100;
+			const bool replay_as_fast_as_possible = false;
+			const int poll_idle_interval_ms = 1000;
+			const int poll_ramp_ms = 5 * 60 * 1000;
+			const bool poll_align_to_refresh = true;
+			const int server_port = 62022;
+			const int auto_start_lead_ms = 60 * 1000;
+		}
+	}
+}
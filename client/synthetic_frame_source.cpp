@@ -0,0 +1,55 @@
+#include "synthetic_frame_source.h"
+#include "monotonic_clock.h"
+
+#include <QPainter>
+#include <QThread>
+
+SyntheticFrameSource::SyntheticFrameSource(const QImage& background, const QImage& pattern, const QPoint& pattern_pos,
+	qint64 inject_after_ns, Pacing pacing, double refresh_rate)
+	: background_(background.convertToFormat(QImage::Format_RGB32))
+	, inject_after_ns_(inject_after_ns)
+	, pacing_(pacing)
+	, period_ns_(refresh_rate > 0.0 ? static_cast<qint64>(1e9 / refresh_rate) : 0)
+{
+	// Оба кадра готовятся заранее, захват ничего не рисует и не выделяет
+	injected_ = background_.copy();
+	QPainter painter(&injected_);
+	painter.drawImage(pattern_pos, pattern);
+}
+
+bool SyntheticFrameSource::NextFrame(QImage& frame, qint64& timestamp_ns)
+{
+	qint64 now_ns = MonotonicNs();
+	if (start_ns_ == 0)
+	{
+		start_ns_ = now_ns;
+
+		// На экране шаблон появится с ближайшим обновлением после момента вставки
+		qint64 visible_after_ns = inject_after_ns_;
+		if (pacing_ == Pacing::Display && period_ns_ > 0)
+		{
+			visible_after_ns = (inject_after_ns_ + period_ns_ - 1) / period_ns_ * period_ns_;
+		}
+		injected_at_ns_ = start_ns_ + visible_after_ns;
+	}
+
+	if (pacing_ == Pacing::Display && period_ns_ > 0)
+	{
+		const qint64 elapsed_ns = now_ns - start_ns_;
+		const qint64 next_refresh_ns = start_ns_ + (elapsed_ns / period_ns_ + 1) * period_ns_;
+		while (now_ns < next_refresh_ns)
+		{
+			QThread::usleep(static_cast<unsigned long>((next_refresh_ns - now_ns) / 1000));
+			now_ns = MonotonicNs();
+		}
+	}
+
+	timestamp_ns = now_ns - start_ns_;
+	frame = now_ns >= injected_at_ns_ ? injected_ : background_;
+	return true;
+}
+
+qint64 SyntheticFrameSource::InjectedAtNs() const
+{
+	return injected_at_ns_;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QImage>
+#include <QPoint>
+
+#include "frame_source.h"
+
+// Искусственный "экран": фон, на котором в известный момент появляется шаблон
+class SyntheticFrameSource final
+	: public FrameSource
+{
+public:
+	enum class Pacing
+	{
+		Display,     // кадры меняются с частотой обновления экрана, захват ждет следующего кадра
+		FreeRunning  // захват сразу возвращает актуальное содержимое
+	};
+
+	// pattern появляется в pattern_pos через inject_after_ns после первого захвата
+	SyntheticFrameSource(const QImage& background, const QImage& pattern, const QPoint& pattern_pos,
+		qint64 inject_after_ns, Pacing pacing, double refresh_rate = 60.0);
+
+	bool NextFrame(QImage& frame, qint64& timestamp_ns) override;
+
+	// Момент появления шаблона на "экране" по MonotonicNs(). 0 - захват еще не начинался
+	qint64 InjectedAtNs() const;
+
+private:
+	QImage background_;
+	QImage injected_;
+
+	qint64 inject_after_ns_ = 0;
+	Pacing pacing_ = Pacing::FreeRunning;
+	qint64 period_ns_ = 0;
+
+	qint64 start_ns_ = 0;
+	qint64 injected_at_ns_ = 0;
+};
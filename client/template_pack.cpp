@@ -0,0 +1,321 @@
+#include "template_pack.h"
+#include "image_packing.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	using namespace template_pack_format;
+
+	// Уровень с этим масштабом считается готовым вариантом
+	const qreal kScaleTolerance = 0.01;
+
+	quint32 Align(quint32 value, quint32 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Оттенки серого как при упаковке кадра (qGray): уровень пакета совпадает с вариантом, подготовленным из изображения
+	void ToGray(const QImage& image, uchar* dst, int stride)
+	{
+		const QImage rgb = image.format() == QImage::Format_RGB32 ? image : image.convertToFormat(QImage::Format_RGB32);
+		for (int y = 0; y < rgb.height(); ++y)
+		{
+			const QRgb* line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+			uchar* out = dst + y * stride;
+			for (int x = 0; x < rgb.width(); ++x)
+			{
+				out[x] = static_cast<uchar>(qGray(line[x]));
+			}
+		}
+	}
+
+	void Statistics(const uchar* gray, int width, int height, int stride, float& mean, float& stddev)
+	{
+		double sum = 0.0;
+		double sum_sq = 0.0;
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const double value = gray[y * stride + x] / 255.0;
+				sum += value;
+				sum_sq += value * value;
+			}
+		}
+
+		const double count = static_cast<double>(width) * height;
+		mean = static_cast<float>(sum / count);
+		stddev = static_cast<float>(std::sqrt(qMax(0.0, sum_sq / count - (sum / count) * (sum / count))));
+	}
+
+	// Локальные максимумы перепада яркости, сильнейшие первыми
+	QVector<Keypoint> Keypoints(const uchar* gray, int width, int height, int stride)
+	{
+		QVector<float> response(width * height, 0.0f);
+		for (int y = 1; y + 1 < height; ++y)
+		{
+			for (int x = 1; x + 1 < width; ++x)
+			{
+				const int dx = gray[y * stride + x + 1] - gray[y * stride + x - 1];
+				const int dy = gray[(y + 1) * stride + x] - gray[(y - 1) * stride + x];
+				response[y * width + x] = static_cast<float>(qAbs(dx) + qAbs(dy)) / 510.0f;
+			}
+		}
+
+		QVector<Keypoint> points;
+		for (int y = 1; y + 1 < height; ++y)
+		{
+			for (int x = 1; x + 1 < width; ++x)
+			{
+				const float value = response[y * width + x];
+				bool is_max = value > 0.0f;
+				for (int ny = y - 1; is_max && ny <= y + 1; ++ny)
+				{
+					for (int nx = x - 1; nx <= x + 1; ++nx)
+					{
+						if ((nx != x || ny != y) && response[ny * width + nx] > value)
+						{
+							is_max = false;
+							break;
+						}
+					}
+				}
+
+				if (is_max)
+				{
+					points.append({ static_cast<quint16>(x), static_cast<quint16>(y), value });
+				}
+			}
+		}
+
+		std::sort(points.begin(), points.end(), [](const Keypoint& a, const Keypoint& b) { return a.response > b.response; });
+		if (points.size() > kMaxKeypoints)
+		{
+			points.resize(kMaxKeypoints);
+		}
+		return points;
+	}
+}
+
+TemplatePack::~TemplatePack()
+{
+	if (data_)
+	{
+		file_.unmap(const_cast<uchar*>(data_));
+	}
+}
+
+bool TemplatePack::Open(const QString& path)
+{
+	file_.setFileName(path);
+	if (!file_.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open template pack : ") << path << file_.errorString();
+		return false;
+	}
+
+	const qint64 size = file_.size();
+	data_ = size > 0 ? file_.map(0, size) : nullptr;
+	if (!data_ || !template_pack_format::Validate(data_, size))
+	{
+		qWarning() << QString::fromUtf8("Invalid template pack : ") << path;
+		return false;
+	}
+
+	const PackHeader* header = reinterpret_cast<const PackHeader*>(data_);
+	const TemplateEntry* entries = reinterpret_cast<const TemplateEntry*>(data_ + sizeof(PackHeader));
+	version_ = header->pack_version;
+	sha256_ = QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char*>(data_), static_cast<int>(size)),
+		QCryptographicHash::Sha256);
+	templates_.reserve(static_cast<int>(header->template_count));
+	for (quint32 i = 0; i < header->template_count; ++i)
+	{
+		const TemplateEntry& entry = entries[i];
+		Template item;
+		item.name = QString::fromUtf8(entry.name);
+		item.mean = entry.mean;
+		item.stddev = entry.stddev;
+		item.keypoints = reinterpret_cast<const Keypoint*>(data_ + entry.keypoints_offset);
+		item.keypoint_count = static_cast<int>(entry.keypoint_count);
+		for (quint32 level = 0; level < entry.level_count; ++level)
+		{
+			const template_pack_format::Level& stored = entry.levels[level];
+			// Изображение только для чтения поверх отображения файла
+			item.levels.append({ stored.scale, QImage(data_ + stored.offset, static_cast<int>(stored.width),
+				static_cast<int>(stored.height), static_cast<int>(stored.stride), QImage::Format_Grayscale8) });
+		}
+		templates_.append(item);
+	}
+
+	return true;
+}
+
+quint32 TemplatePack::Version() const
+{
+	return version_;
+}
+
+QByteArray TemplatePack::Sha256() const
+{
+	return sha256_;
+}
+
+QString TemplatePack::Path() const
+{
+	return file_.fileName();
+}
+
+const QVector<TemplatePack::Template>& TemplatePack::Templates() const
+{
+	return templates_;
+}
+
+const TemplatePack::Template* TemplatePack::Find(const QString& name) const
+{
+	for (const Template& item : templates_)
+	{
+		if (item.name == name)
+		{
+			return &item;
+		}
+	}
+	return nullptr;
+}
+
+QVector<QImage> TemplatePack::Variants(const Template& item, const QVector<qreal>& scales)
+{
+	QVector<QImage> variants;
+	const Level& base = item.levels.first();
+	for (qreal scale : scales)
+	{
+		const auto level = std::find_if(item.levels.cbegin(), item.levels.cend(),
+			[scale](const Level& candidate) { return qAbs(candidate.scale - scale) < kScaleTolerance; });
+		if (level != item.levels.cend())
+		{
+			variants.append(level->image);
+			continue;
+		}
+
+		const QSize size = (QSizeF(base.image.size()) * (scale / base.scale)).toSize();
+		variants.append(base.image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+	}
+	return variants;
+}
+
+QByteArray TemplatePack::Build(const QVector<DetectionStage>& stages, const QVector<qreal>& scales, quint32 version)
+{
+	if (scales.isEmpty() || scales.size() > kMaxLevels)
+	{
+		qWarning() << QString::fromUtf8("Template pack supports 1 to %1 levels").arg(kMaxLevels);
+		return QByteArray();
+	}
+
+	// Один шаблон на имя стадии: по имени клиент находит его в пакете
+	QVector<const DetectionStage*> unique;
+	QSet<QString> names;
+	for (const DetectionStage& stage : stages)
+	{
+		if (names.contains(stage.name))
+		{
+			continue;
+		}
+
+		if (stage.name.toUtf8().size() >= kNameSize || stage.template_image.isNull())
+		{
+			qWarning() << QString::fromUtf8("Stage can not be packed : ") << stage.name;
+			return QByteArray();
+		}
+		names.insert(stage.name);
+		unique.append(&stage);
+	}
+
+	// Сначала раскладка: заголовок, таблица, затем данные с выравниванием
+	QVector<TemplateEntry> entries(unique.size());
+	QVector<QVector<QImage>> images(unique.size());
+	quint32 offset = Align(sizeof(PackHeader) + sizeof(TemplateEntry) * unique.size(), kAlignment);
+	for (int i = 0; i < unique.size(); ++i)
+	{
+		TemplateEntry& entry = entries[i];
+		std::memset(&entry, 0, sizeof(entry));
+		const QByteArray name = unique[i]->name.toUtf8();
+		std::memcpy(entry.name, name.constData(), name.size());
+
+		const QImage& image = unique[i]->template_image;
+		entry.level_count = static_cast<quint32>(scales.size());
+		for (int level = 0; level < scales.size(); ++level)
+		{
+			const QSize size = (QSizeF(image.size()) * scales[level]).toSize();
+			const QImage scaled = qFuzzyCompare(scales[level], 1.0)
+				? image
+				: image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			if (scaled.isNull())
+			{
+				qWarning() << QString::fromUtf8("Unable to scale template : ") << unique[i]->name << scales[level];
+				return QByteArray();
+			}
+			images[i].append(scaled);
+
+			template_pack_format::Level& stored = entry.levels[level];
+			stored.scale = static_cast<float>(scales[level]);
+			stored.width = static_cast<quint32>(scaled.width());
+			stored.height = static_cast<quint32>(scaled.height());
+			stored.stride = Align(stored.width, 4);
+			stored.offset = offset;
+			offset = Align(offset + stored.stride * stored.height, kAlignment);
+		}
+		entry.keypoints_offset = offset;
+		offset = Align(offset + sizeof(Keypoint) * kMaxKeypoints, kAlignment);
+	}
+
+	if (offset > kMaxPackSize)
+	{
+		qWarning() << QString::fromUtf8("Template pack is too large : ") << offset;
+		return QByteArray();
+	}
+
+	QByteArray pack(static_cast<int>(offset), '\0');
+	uchar* data = reinterpret_cast<uchar*>(pack.data());
+	for (int i = 0; i < entries.size(); ++i)
+	{
+		TemplateEntry& entry = entries[i];
+		for (quint32 level = 0; level < entry.level_count; ++level)
+		{
+			const template_pack_format::Level& stored = entry.levels[level];
+			ToGray(images[i][static_cast<int>(level)], data + stored.offset, static_cast<int>(stored.stride));
+		}
+
+		// Статистика и ключевые точки - по исходному масштабу
+		const template_pack_format::Level& base = entry.levels[0];
+		const uchar* gray = data + base.offset;
+		Statistics(gray, static_cast<int>(base.width), static_cast<int>(base.height), static_cast<int>(base.stride),
+			entry.mean, entry.stddev);
+		const QVector<Keypoint> points = Keypoints(gray, static_cast<int>(base.width), static_cast<int>(base.height),
+			static_cast<int>(base.stride));
+		entry.keypoint_count = static_cast<quint32>(points.size());
+		std::memcpy(data + entry.keypoints_offset, points.constData(), sizeof(Keypoint) * points.size());
+	}
+
+	PackHeader header;
+	std::memcpy(header.magic, kMagic, sizeof(header.magic));
+	header.format_version = kFormatVersion;
+	header.pack_version = version;
+	header.template_count = static_cast<quint32>(entries.size());
+	header.file_size = offset;
+	header.created_ms = QDateTime::currentMSecsSinceEpoch();
+	std::memcpy(data, &header, sizeof(header));
+	std::memcpy(data + sizeof(header), entries.constData(), sizeof(TemplateEntry) * entries.size());
+
+	if (!Validate(data, pack.size()))
+	{
+		qWarning() << QString::fromUtf8("Built template pack is invalid");
+		return QByteArray();
+	}
+	return pack;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+#include "detection_pipeline.h"
+#include "template_pack_format.h"
+
+// Пакет шаблонов, отображенный в память (template_pack_format). Уровни - QImage прямо поверх отображения,
+// без копирования и декодирования, поэтому пакет должен жить, пока используются его изображения
+class TemplatePack final
+{
+public:
+	struct Level
+	{
+		qreal scale = 1.0;
+		QImage image; // Grayscale8
+	};
+
+	struct Template
+	{
+		QString name;
+		QVector<Level> levels;
+		float mean = 0.0f;
+		float stddev = 0.0f;
+		const template_pack_format::Keypoint* keypoints = nullptr;
+		int keypoint_count = 0;
+	};
+
+	TemplatePack() = default;
+	~TemplatePack();
+
+	TemplatePack(const TemplatePack&) = delete;
+	TemplatePack& operator=(const TemplatePack&) = delete;
+
+	// false - файла нет или он не пакет
+	bool Open(const QString& path);
+
+	quint32 Version() const;
+
+	// SHA-256 содержимого: версии пакетов разных серверов или сборок могут совпадать
+	QByteArray Sha256() const;
+
+	QString Path() const;
+
+	const QVector<Template>& Templates() const;
+
+	// Шаблон стадии детекции с именем name, nullptr - в пакете его нет
+	const Template* Find(const QString& name) const;
+
+	// Варианты шаблона под scales: готовые уровни пакета, недостающие масштабируются из уровня 0
+	static QVector<QImage> Variants(const Template& item, const QVector<qreal>& scales);
+
+	// Пакет из шаблонов стадий: уровни под scales, статистика и ключевые точки. Пустой массив - ошибка
+	static QByteArray Build(const QVector<DetectionStage>& stages, const QVector<qreal>& scales, quint32 version);
+
+private:
+	QFile file_;
+	const uchar* data_ = nullptr;
+	quint32 version_ = 0;
+	QByteArray sha256_;
+	QVector<Template> templates_;
+};
@@ -0,0 +1,124 @@
+#include "template_pack_cache.h"
+#include "template_pack.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+	// Предыдущая версия остается на случай отката на сервере
+	const int kKeepVersions = 2;
+
+	const QString kFilePrefix = "pack_";
+	const QString kFileSuffix = ".btp";
+
+	// Версия из имени файла, 0 - файл не из кэша
+	quint32 VersionOf(const QString& file_name)
+	{
+		if (!file_name.startsWith(kFilePrefix) || !file_name.endsWith(kFileSuffix))
+		{
+			return 0;
+		}
+
+		bool ok = false;
+		const quint32 version = file_name.mid(kFilePrefix.size(), file_name.size() - kFilePrefix.size() - kFileSuffix.size()).toUInt(&ok);
+		return ok ? version : 0;
+	}
+}
+
+TemplatePackCache::TemplatePackCache(const QString& dir)
+	: dir_(dir.isEmpty()
+		? QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QString::fromUtf8("/template_packs")
+		: dir)
+{
+}
+
+QString TemplatePackCache::PathFor(quint32 version) const
+{
+	return QDir(dir_).filePath(kFilePrefix + QString::number(version) + kFileSuffix);
+}
+
+QSharedPointer<const TemplatePack> TemplatePackCache::Load(quint32 version, quint32 size) const
+{
+	// Содержимое проверено при загрузке с сервера, здесь только размер: без чтения файла целиком
+	const QString path = PathFor(version);
+	if (QFileInfo(path).size() != static_cast<qint64>(size))
+	{
+		return {};
+	}
+
+	QSharedPointer<TemplatePack> pack(new TemplatePack);
+	if (!pack->Open(path) || pack->Version() != version)
+	{
+		return {};
+	}
+	return pack;
+}
+
+QVector<quint32> TemplatePackCache::Versions() const
+{
+	QVector<quint32> versions;
+	for (const QString& file_name : QDir(dir_).entryList(QDir::Files))
+	{
+		const quint32 version = VersionOf(file_name);
+		if (version != 0)
+		{
+			versions.append(version);
+		}
+	}
+	std::sort(versions.begin(), versions.end(), std::greater<quint32>());
+	return versions;
+}
+
+QSharedPointer<const TemplatePack> TemplatePackCache::LoadLatest() const
+{
+	for (quint32 version : Versions())
+	{
+		QSharedPointer<TemplatePack> pack(new TemplatePack);
+		if (pack->Open(PathFor(version)) && pack->Version() == version)
+		{
+			return pack;
+		}
+	}
+	return {};
+}
+
+QSharedPointer<const TemplatePack> TemplatePackCache::Store(quint32 version, const QByteArray& pack)
+{
+	if (!QDir().mkpath(dir_))
+	{
+		qWarning() << QString::fromUtf8("Unable to create template pack cache : ") << dir_;
+		return {};
+	}
+
+	QSaveFile file(PathFor(version));
+	if (!file.open(QIODevice::WriteOnly) || file.write(pack) != pack.size() || !file.commit())
+	{
+		qWarning() << QString::fromUtf8("Unable to store template pack : ") << file.fileName() << file.errorString();
+		return {};
+	}
+
+	Prune(version);
+	return Load(version, static_cast<quint32>(pack.size()));
+}
+
+void TemplatePackCache::Prune(quint32 keep)
+{
+	// Отображение открытого пакета остается действительным и после удаления файла.
+	// Где файл нельзя удалить, пока он открыт, удаление повторится при следующем сохранении
+	const QVector<quint32> versions = Versions();
+	int kept = 0;
+	for (quint32 version : versions)
+	{
+		if (version == keep || kept++ < kKeepVersions - 1)
+		{
+			continue;
+		}
+		QFile::remove(PathFor(version));
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class TemplatePack;
+
+// Пакеты шаблонов, полученные от сервера, на диске: один файл на версию, хранятся только последние
+class TemplatePackCache final
+{
+public:
+	// Пустой dir - каталог template_packs в данных приложения
+	explicit TemplatePackCache(const QString& dir = QString());
+
+	// Пакет версии version размером size, nullptr - его нет в кэше
+	QSharedPointer<const TemplatePack> Load(quint32 version, quint32 size) const;
+
+	// Пакет с наибольшей версией, для старта без сервера
+	QSharedPointer<const TemplatePack> LoadLatest() const;
+
+	// Сохраняет проверенный файл и открывает его из кэша. Старые версии удаляются
+	QSharedPointer<const TemplatePack> Store(quint32 version, const QByteArray& pack);
+
+private:
+	QString PathFor(quint32 version) const;
+
+	// Версии в кэше, новые первыми
+	QVector<quint32> Versions() const;
+
+	// Оставляет keep и последние версии
+	void Prune(quint32 keep);
+
+private:
+	QString dir_;
+};
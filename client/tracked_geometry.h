@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QMutex>
+#include <QPoint>
+
+#include "geometry_area.h"
+
+// Область поиска и точка щелчка, которые обновляются во время поиска (например, при перемещении окна).
+// Set вызывается из потока интерфейса, Get - из потока поиска на каждом опросе
+class TrackedGeometry final
+{
+public:
+	void Set(const geometry_area& area, const QPoint& click_point)
+	{
+		QMutexLocker locker(&mutex_);
+		area_ = area;
+		click_point_ = click_point;
+		++version_;
+	}
+
+	// true - значения изменились с версии version, она обновляется
+	bool Get(quint64& version, geometry_area& area, QPoint& click_point) const
+	{
+		QMutexLocker locker(&mutex_);
+		if (version == version_)
+		{
+			return false;
+		}
+
+		version = version_;
+		area = area_;
+		click_point = click_point_;
+		return true;
+	}
+
+private:
+	mutable QMutex mutex_;
+	geometry_area area_;
+	QPoint click_point_;
+	quint64 version_ = 0;
+};
@@ -0,0 +1,343 @@
+#include "window_tracker.h"
+
+#include <QDebug>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QSocketNotifier>
+
+// Xlib подключается последним: его макросы (None, Bool, Status) конфликтуют с заголовками Qt
+#ifdef BOOK_TENNIS_HAVE_X11
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#endif
+
+namespace
+{
+	// Окна, которые еще не найдены, ищутся заново с этим периодом. Он же страхует от пропущенных событий
+	const int kRefreshIntervalMs = 1000;
+
+	// Начало экрана Qt сохраняет в физических координатах, масштабируется только размер
+	QRect NativeGeometry(const QScreen* screen)
+	{
+		return QRect(screen->geometry().topLeft(), (QSizeF(screen->geometry().size()) * screen->devicePixelRatio()).toSize());
+	}
+
+#ifdef BOOK_TENNIS_HAVE_X11
+	// Окно может исчезнуть между получением списка и запросом его свойств: такие ошибки не фатальны
+	int IgnoreXErrors(Display*, XErrorEvent*)
+	{
+		return 0;
+	}
+
+	// Обработчик ошибок Xlib общий для процесса, поэтому свой ставится только на время запросов трекера.
+	// Перед возвратом прежнего XSync дожидается ответов на эти запросы, чтобы их ошибки не достались ему
+	class ScopedIgnoreXErrors final
+	{
+	public:
+		explicit ScopedIgnoreXErrors(Display* display)
+			: display_(display)
+			, previous_(XSetErrorHandler(&IgnoreXErrors))
+		{
+		}
+
+		~ScopedIgnoreXErrors()
+		{
+			XSync(display_, False);
+			XSetErrorHandler(previous_);
+		}
+
+		ScopedIgnoreXErrors(const ScopedIgnoreXErrors&) = delete;
+		ScopedIgnoreXErrors& operator=(const ScopedIgnoreXErrors&) = delete;
+
+	private:
+		Display* display_;
+		XErrorHandler previous_;
+	};
+
+	QString WindowTitle(Display* display, Window window, Atom net_wm_name, Atom utf8_string)
+	{
+		Atom type = 0;
+		int format = 0;
+		unsigned long count = 0;
+		unsigned long bytes_after = 0;
+		unsigned char* data = nullptr;
+
+		QString title;
+		if (XGetWindowProperty(display, window, net_wm_name, 0, 1024, False, utf8_string,
+			&type, &format, &count, &bytes_after, &data) == Success && data)
+		{
+			title = QString::fromUtf8(reinterpret_cast<const char*>(data), static_cast<int>(count));
+		}
+		if (data)
+		{
+			XFree(data);
+		}
+
+		// Окна без EWMH-заголовка
+		if (title.isEmpty())
+		{
+			char* name = nullptr;
+			if (XFetchName(display, window, &name) && name)
+			{
+				title = QString::fromLocal8Bit(name);
+				XFree(name);
+			}
+		}
+
+		return title;
+	}
+#endif
+}
+
+WindowTracker::WindowTracker(QObject* parent)
+	: QObject(parent)
+{
+	refresh_timer_.setInterval(kRefreshIntervalMs);
+	bool connection = connect(&refresh_timer_, &QTimer::timeout, this, &WindowTracker::OnRefreshTimer); Q_ASSERT(connection);
+}
+
+WindowTracker::~WindowTracker()
+{
+	Stop();
+}
+
+bool WindowTracker::IsSupported()
+{
+#ifdef BOOK_TENNIS_HAVE_X11
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool WindowTracker::Start(const QString& title)
+{
+	Stop();
+	title_ = title;
+
+#ifdef BOOK_TENNIS_HAVE_X11
+	display_ = XOpenDisplay(nullptr);
+	if (!display_)
+	{
+		qWarning() << QString::fromUtf8("Unable to open X display, window tracking is disabled");
+		return false;
+	}
+
+	// События окна приходят по соединению с X-сервером и обрабатываются в цикле событий Qt
+	notifier_ = new QSocketNotifier(ConnectionNumber(display_), QSocketNotifier::Read, this);
+	bool connection = connect(notifier_, QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated),
+		this, &WindowTracker::OnEvents); Q_ASSERT(connection);
+
+	refresh_timer_.start();
+	if (!FindTrackedWindow())
+	{
+		qDebug() << QString::fromUtf8("Window is not found yet : ") << title_;
+	}
+	return true;
+#else
+	qWarning() << QString::fromUtf8("Window tracking is not supported on this platform");
+	return false;
+#endif
+}
+
+void WindowTracker::Stop()
+{
+	refresh_timer_.stop();
+
+	delete notifier_;
+	notifier_ = nullptr;
+
+#ifdef BOOK_TENNIS_HAVE_X11
+	if (display_)
+	{
+		XCloseDisplay(display_);
+	}
+#endif
+	display_ = nullptr;
+	window_ = 0;
+	client_area_ = QRect();
+}
+
+QRect WindowTracker::ClientArea() const
+{
+	return client_area_;
+}
+
+bool WindowTracker::FindTrackedWindow()
+{
+#ifdef BOOK_TENNIS_HAVE_X11
+	const ScopedIgnoreXErrors ignore_errors(display_);
+	const Window root = DefaultRootWindow(display_);
+	const Atom net_client_list = XInternAtom(display_, "_NET_CLIENT_LIST", False);
+	const Atom net_wm_name = XInternAtom(display_, "_NET_WM_NAME", False);
+	const Atom utf8_string = XInternAtom(display_, "UTF8_STRING", False);
+
+	Atom type = 0;
+	int format = 0;
+	unsigned long count = 0;
+	unsigned long bytes_after = 0;
+	unsigned char* data = nullptr;
+	if (XGetWindowProperty(display_, root, net_client_list, 0, 4096, False, XA_WINDOW,
+		&type, &format, &count, &bytes_after, &data) != Success || !data)
+	{
+		qWarning() << QString::fromUtf8("Window manager does not provide _NET_CLIENT_LIST");
+		return false;
+	}
+
+	const Window* windows = reinterpret_cast<const Window*>(data);
+	Window found = 0;
+	for (unsigned long i = 0; i < count && !found; ++i)
+	{
+		if (WindowTitle(display_, windows[i], net_wm_name, utf8_string).contains(title_, Qt::CaseInsensitive))
+		{
+			found = windows[i];
+		}
+	}
+	XFree(data);
+
+	if (!found)
+	{
+		return false;
+	}
+
+	// Перемещения и изменения размера окна (ICCCM: оконный менеджер присылает ConfigureNotify и при перемещении рамки)
+	window_ = found;
+	XSelectInput(display_, window_, StructureNotifyMask);
+	XFlush(display_);
+	UpdateClientArea();
+	return true;
+#else
+	return false;
+#endif
+}
+
+void WindowTracker::UpdateClientArea()
+{
+#ifdef BOOK_TENNIS_HAVE_X11
+	const ScopedIgnoreXErrors ignore_errors(display_);
+	XWindowAttributes attributes;
+	int x = 0;
+	int y = 0;
+	Window child = 0;
+	if (!XGetWindowAttributes(display_, window_, &attributes)
+		|| !XTranslateCoordinates(display_, window_, attributes.root, 0, 0, &x, &y, &child))
+	{
+		LoseWindow();
+		return;
+	}
+
+	const QRect client_area(x, y, attributes.width, attributes.height);
+	if (client_area != client_area_)
+	{
+		client_area_ = client_area;
+		qDebug() << QString::fromUtf8("Window client area : ") << client_area_;
+		emit ClientAreaChanged(client_area_);
+	}
+#endif
+}
+
+void WindowTracker::LoseWindow()
+{
+	if (!window_)
+	{
+		return;
+	}
+
+	qWarning() << QString::fromUtf8("Tracked window is lost : ") << title_;
+	window_ = 0;
+	client_area_ = QRect();
+	emit WindowLost();
+}
+
+void WindowTracker::OnEvents()
+{
+#ifdef BOOK_TENNIS_HAVE_X11
+	bool geometry_changed = false;
+	while (XPending(display_))
+	{
+		XEvent event;
+		XNextEvent(display_, &event);
+		if (event.xany.window != window_)
+		{
+			continue;
+		}
+
+		if (event.type == DestroyNotify)
+		{
+			LoseWindow();
+			return;
+		}
+
+		geometry_changed = geometry_changed || event.type == ConfigureNotify || event.type == MapNotify;
+	}
+
+	// Пачка событий перетаскивания дает один пересчет
+	if (geometry_changed)
+	{
+		UpdateClientArea();
+	}
+#endif
+}
+
+void WindowTracker::OnRefreshTimer()
+{
+	if (!display_)
+	{
+		return;
+	}
+
+	if (!window_)
+	{
+		FindTrackedWindow();
+		return;
+	}
+
+	UpdateClientArea();
+}
+
+void WindowTracker::Resolve(const QRect& client_area, const QScreen* screen,
+	const geometry_area& relative_area, const QPoint& relative_click,
+	geometry_area& area, QPoint& click_point)
+{
+	// Все вычисления в физических пикселях X-сервера. Кадр экрана тоже в них, от угла экрана
+	const QRect global_area = QRect(client_area.topLeft() + QPoint(relative_area.x, relative_area.y),
+		QSize(relative_area.width, relative_area.height)).intersected(client_area);
+
+	const QPoint screen_origin = screen ? screen->geometry().topLeft() : QPoint();
+	area.x = global_area.x() - screen_origin.x();
+	area.y = global_area.y() - screen_origin.y();
+	area.width = global_area.width();
+	area.height = global_area.height();
+
+	// Щелчок задается в логических координатах Qt: смещение от угла экрана делится на масштаб
+	const QPoint click = client_area.topLeft() + relative_click;
+	const QPoint native_click(qBound(client_area.left(), click.x(), client_area.right()),
+		qBound(client_area.top(), click.y(), client_area.bottom()));
+	const qreal pixel_ratio = screen ? screen->devicePixelRatio() : 1.0;
+	click_point = screen_origin + (QPointF(native_click - screen_origin) / pixel_ratio).toPoint();
+}
+
+bool WindowTracker::Resolve(const geometry_area& relative_area, const QPoint& relative_click,
+	int& monitor_number, geometry_area& area, QPoint& click_point) const
+{
+	if (!client_area_.isValid())
+	{
+		return false;
+	}
+
+	// screenAt ищет по логическим координатам, а клиентская область - в физических
+	const QList<QScreen*> screens = QGuiApplication::screens();
+	QScreen* screen = QGuiApplication::primaryScreen();
+	for (QScreen* candidate : screens)
+	{
+		if (NativeGeometry(candidate).contains(client_area_.center()))
+		{
+			screen = candidate;
+			break;
+		}
+	}
+	monitor_number = screens.indexOf(screen);
+	Resolve(client_area_, screen, relative_area, relative_click, area, click_point);
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QObject>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QTimer>
+
+#include "geometry_area.h"
+
+class QScreen;
+class QSocketNotifier;
+
+struct _XDisplay;
+
+// Поиск окна мессенджера по заголовку и отслеживание его клиентской области.
+// На Linux через X11/EWMH (_NET_CLIENT_LIST, _NET_WM_NAME), на остальных платформах не поддерживается
+class WindowTracker final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit WindowTracker(QObject* parent = nullptr);
+	~WindowTracker() override;
+
+	static bool IsSupported();
+
+	// title - подстрока заголовка окна без учета регистра. Пока окно не найдено, поиск повторяется
+	bool Start(const QString& title);
+	void Stop();
+
+	// Клиентская область окна в физических пикселях X-сервера. Невалидная - окно не найдено
+	QRect ClientArea() const;
+
+	// Область поиска и точка щелчка, заданные в физических пикселях относительно клиентской области, для экрана окна:
+	// область - в координатах кадра этого экрана, точка - в глобальных логических, как у InputSimulator.
+	// Обе ограничены клиентской областью
+	static void Resolve(const QRect& client_area, const QScreen* screen,
+		const geometry_area& relative_area, const QPoint& relative_click,
+		geometry_area& area, QPoint& click_point);
+
+	// То же для текущей клиентской области и экрана, на котором находится окно. false - окно не найдено
+	bool Resolve(const geometry_area& relative_area, const QPoint& relative_click,
+		int& monitor_number, geometry_area& area, QPoint& click_point) const;
+
+Q_SIGNALS:
+
+	void ClientAreaChanged(const QRect& client_area);
+	void WindowLost();
+
+private Q_SLOTS:
+
+	void OnEvents();
+	void OnRefreshTimer();
+
+private:
+	bool FindTrackedWindow();
+	void UpdateClientArea();
+	void LoseWindow();
+
+private:
+	QString title_;
+	QRect client_area_;
+	QTimer refresh_timer_;
+
+	_XDisplay* display_ = nullptr;
+	unsigned long window_ = 0;
+	QSocketNotifier* notifier_ = nullptr;
+};
@@ -0,0 +1,179 @@
+#include "frame_auth.h"
+
+#include <QPasswordDigestor>
+#include <QRandomGenerator>
+#include <QtEndian>
+
+namespace
+{
+	const int kKeySize = 32;
+
+	// Перебор слабых секретов по украденному реестру или перехваченному приветствию дорог
+	const int kUserKeyIterations = 100000;
+	const QByteArray kUserKeySalt = QByteArrayLiteral("book_tennis/user/");
+
+	// Разные метки: подпись приветствия нельзя выдать за ключ сессии и наоборот
+	const QByteArray kHelloLabel = QByteArrayLiteral("book_tennis/hello");
+	const QByteArray kSessionLabel = QByteArrayLiteral("book_tennis/session");
+}
+
+FrameAuthenticator::FrameAuthenticator()
+	: mac_(QCryptographicHash::Sha256)
+	, previous_mac_(QCryptographicHash::Sha256)
+{
+}
+
+void FrameAuthenticator::SetKey(const QByteArray& key)
+{
+	if (has_key_)
+	{
+		previous_mac_.setKey(mac_key_);
+		has_previous_ = true;
+	}
+	mac_key_ = key;
+	mac_.setKey(key);
+	has_key_ = true;
+}
+
+bool FrameAuthenticator::HasKey() const
+{
+	return has_key_;
+}
+
+void FrameAuthenticator::Reset()
+{
+	has_key_ = false;
+	has_previous_ = false;
+	mac_key_.clear();
+	sequence_ = 0;
+}
+
+QByteArray FrameAuthenticator::Sign(const QByteArray& frame)
+{
+	QByteArray signed_frame;
+	signed_frame.reserve(frame.size() + protocol::kMacSize);
+	signed_frame.append(frame);
+
+	uchar* header = reinterpret_cast<uchar*>(signed_frame.data());
+	qToBigEndian<quint16>(qFromBigEndian<quint16>(header + 6) | protocol::kFlagAuthenticated, header + 6);
+
+	const int payload_size = frame.size() - protocol::kHeaderSize;
+	Compute(mac_, header, signed_frame.constData() + protocol::kHeaderSize, payload_size);
+	++sequence_;
+	signed_frame.append(mac_.result().constData(), protocol::kMacSize);
+
+	// Длина в заголовке - с подписью
+	header = reinterpret_cast<uchar*>(signed_frame.data());
+	qToBigEndian<quint32>(static_cast<quint32>(payload_size + protocol::kMacSize), header);
+	return signed_frame;
+}
+
+bool FrameAuthenticator::Verify(protocol::FrameView& frame)
+{
+	if (!has_key_ || !(frame.flags & protocol::kFlagAuthenticated) || frame.payload_size < protocol::kMacSize)
+	{
+		return false;
+	}
+
+	// Заголовок восстанавливается из полей кадра, длина - без подписи, как при подписи
+	const int payload_size = frame.payload_size - protocol::kMacSize;
+	uchar header[protocol::kHeaderSize];
+	qToBigEndian<quint32>(static_cast<quint32>(payload_size), header);
+	header[4] = static_cast<uchar>(frame.type);
+	header[5] = frame.version;
+	qToBigEndian<quint16>(frame.flags, header + 6);
+	const char* received = frame.payload + payload_size;
+
+	Compute(mac_, header, frame.payload, payload_size);
+	bool ok = ConstantTimeEquals(mac_.result().constData(), received, protocol::kMacSize);
+	if (ok)
+	{
+		// Другая сторона перешла на новый ключ, старый больше не нужен
+		has_previous_ = false;
+	}
+	else if (has_previous_)
+	{
+		Compute(previous_mac_, header, frame.payload, payload_size);
+		ok = ConstantTimeEquals(previous_mac_.result().constData(), received, protocol::kMacSize);
+	}
+
+	if (!ok)
+	{
+		return false;
+	}
+
+	++sequence_;
+	frame.payload_size = payload_size;
+	return true;
+}
+
+QByteArray FrameAuthenticator::GenerateNonce()
+{
+	QByteArray nonce(kKeySize, Qt::Uninitialized);
+	QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(nonce.data()), kKeySize / static_cast<int>(sizeof(quint32)));
+	return nonce;
+}
+
+QByteArray FrameAuthenticator::DeriveUserKey(const QString& user_name, const QByteArray& secret)
+{
+	if (secret.isEmpty())
+	{
+		return QByteArray();
+	}
+	return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, secret, kUserKeySalt + user_name.toUtf8(),
+		kUserKeyIterations, kKeySize);
+}
+
+QByteArray FrameAuthenticator::HelloProof(const QByteArray& user_key, const QByteArray& server_nonce,
+	const QByteArray& client_nonce, const QString& user_name)
+{
+	QMessageAuthenticationCode mac(QCryptographicHash::Sha256, user_key);
+	mac.addData(kHelloLabel);
+	mac.addData(server_nonce);
+	mac.addData(client_nonce);
+	mac.addData(user_name.toUtf8());
+	return mac.result();
+}
+
+QByteArray FrameAuthenticator::DeriveSessionKey(const QByteArray& user_key, const QByteArray& server_nonce,
+	const QByteArray& client_nonce, const QByteArray& token_nonce)
+{
+	QMessageAuthenticationCode mac(QCryptographicHash::Sha256, user_key);
+	mac.addData(kSessionLabel);
+	mac.addData(server_nonce);
+	mac.addData(client_nonce);
+	mac.addData(token_nonce);
+	return mac.result();
+}
+
+void FrameAuthenticator::Compute(QMessageAuthenticationCode& mac, const uchar* header, const char* payload, int payload_size)
+{
+	uchar sequence[sizeof(quint64)];
+	qToBigEndian<quint64>(sequence_, sequence);
+
+	mac.reset();
+	mac.addData(reinterpret_cast<const char*>(header), protocol::kHeaderSize);
+	mac.addData(payload, payload_size);
+	mac.addData(reinterpret_cast<const char*>(sequence), sizeof(sequence));
+}
+
+bool ConstantTimeEquals(const char* left, const char* right, int size)
+{
+	// volatile - чтобы компилятор не превратил цикл в сравнение с ранним выходом
+	volatile uchar difference = 0;
+	for (int i = 0; i < size; ++i)
+	{
+		difference |= static_cast<uchar>(left[i]) ^ static_cast<uchar>(right[i]);
+	}
+	return difference == 0;
+}
+
+bool ConstantTimeEquals(const QByteArray& left, const QByteArray& right)
+{
+	// Длина ключа не секрет
+	if (left.size() != right.size())
+	{
+		return false;
+	}
+	return ConstantTimeEquals(left.constData(), right.constData(), left.size());
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+
+#include "protocol.h"
+
+// Подпись кадров ключом сессии: HMAC-SHA256 от заголовка, нагрузки и номера кадра в соединении, усеченный до
+// protocol::kMacSize байт. Номер кадра не передается - обе стороны считают сами, поэтому повтор или
+// перестановка кадра не проходят проверку. Один объект на соединение и направление, объект HMAC с ключом
+// создается при смене ключа и переиспользуется для каждого кадра
+class FrameAuthenticator final
+{
+public:
+	FrameAuthenticator();
+
+	FrameAuthenticator(const FrameAuthenticator&) = delete;
+	FrameAuthenticator& operator=(const FrameAuthenticator&) = delete;
+
+	// Новый ключ. Прежний проверяет кадры, подписанные до того, как другая сторона узнала о смене
+	void SetKey(const QByteArray& key);
+
+	bool HasKey() const;
+
+	// Новое соединение: без ключей, нумерация с начала
+	void Reset();
+
+	// Кадр целиком (как из protocol::Encode) с флагом kFlagAuthenticated и подписью
+	QByteArray Sign(const QByteArray& frame);
+
+	// Проверяет подпись и отрезает ее от нагрузки. false - подписи нет или она неверна
+	bool Verify(protocol::FrameView& frame);
+
+	// Случайные 32 байта: вызов сервера и nonce клиента и продления ключа
+	static QByteArray GenerateNonce();
+
+	// Ключ пользователя из его секрета: PBKDF2-SHA256 с солью из имени пользователя. Реестр сервера хранит только
+	// его, клиент вычисляет при подключении. Пустой секрет - пустой ключ (пользователь без ключа, открытый сервер)
+	static QByteArray DeriveUserKey(const QString& user_name, const QByteArray& secret);
+
+	// Ответ клиента на вызов сервера в Hello. Секрет и ключ пользователя по сети не передаются
+	static QByteArray HelloProof(const QByteArray& user_key, const QByteArray& server_nonce,
+		const QByteArray& client_nonce, const QString& user_name);
+
+	// Ключ сессии вычисляется обеими сторонами из ключа пользователя и nonce соединения. token_nonce - из
+	// SessionToken при продлении, пустой для первого ключа
+	static QByteArray DeriveSessionKey(const QByteArray& user_key, const QByteArray& server_nonce,
+		const QByteArray& client_nonce, const QByteArray& token_nonce = QByteArray());
+
+private:
+	void Compute(QMessageAuthenticationCode& mac, const uchar* header, const char* payload, int payload_size);
+
+private:
+	QByteArray mac_key_;
+	QMessageAuthenticationCode mac_;
+	QMessageAuthenticationCode previous_mac_;
+	bool has_key_ = false;
+	bool has_previous_ = false;
+	quint64 sequence_ = 0;
+};
+
+// Сравнение за время, не зависящее от места первого расхождения (для ключей и подписей)
+bool ConstantTimeEquals(const char* left, const char* right, int size);
+bool ConstantTimeEquals(const QByteArray& left, const QByteArray& right);
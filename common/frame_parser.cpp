@@ -0,0 +1,125 @@
+#include "frame_parser.h"
+
+#include <QIODevice>
+#include <QtEndian>
+#include <cstring>
+
+namespace
+{
+	// Начальный размер приемного буфера: несколько типичных кадров
+	const int kInitialBufferSize = 4096;
+}
+
+FrameParser::FrameParser()
+{
+	buffer_.resize(kInitialBufferSize);
+}
+
+char* FrameParser::Reserve(int size)
+{
+	if (buffer_.size() - end_ >= size)
+	{
+		return buffer_.data() + end_;
+	}
+
+	// Остаток - не больше одного неполного кадра, сдвиг дешевый
+	if (begin_ > 0)
+	{
+		std::memmove(buffer_.data(), buffer_.constData() + begin_, end_ - begin_);
+		end_ -= begin_;
+		begin_ = 0;
+	}
+
+	if (buffer_.size() - end_ < size)
+	{
+		buffer_.resize(qMax(buffer_.size() * 2, end_ + size));
+	}
+	return buffer_.data() + end_;
+}
+
+bool FrameParser::ReadFrom(QIODevice* device)
+{
+	qint64 available = device->bytesAvailable();
+	while (available > 0)
+	{
+		const int chunk = static_cast<int>(qMin<qint64>(available, protocol::kHeaderSize + protocol::kMaxPayloadSize));
+		char* destination = Reserve(chunk);
+		const qint64 read = device->read(destination, chunk);
+		if (read < 0)
+		{
+			error_ = device->errorString();
+			return false;
+		}
+
+		end_ += static_cast<int>(read);
+		if (read == 0)
+		{
+			break;
+		}
+		available = device->bytesAvailable();
+	}
+	return true;
+}
+
+void FrameParser::Append(const char* data, int size)
+{
+	std::memcpy(Reserve(size), data, size);
+	end_ += size;
+}
+
+FrameParser::Status FrameParser::Next(protocol::FrameView& frame)
+{
+	if (!error_.isEmpty())
+	{
+		return Status::Error;
+	}
+
+	const int available = end_ - begin_;
+	if (available < protocol::kHeaderSize)
+	{
+		// Все разобрано: следующее чтение пойдет с начала буфера
+		if (available == 0)
+		{
+			begin_ = end_ = 0;
+		}
+		return Status::NeedMore;
+	}
+
+	const uchar* header = reinterpret_cast<const uchar*>(buffer_.constData() + begin_);
+	const quint32 payload_size = qFromBigEndian<quint32>(header);
+	if (payload_size > static_cast<quint32>(protocol::kMaxPayloadSize))
+	{
+		error_ = QString::fromUtf8("Frame is too large : %1").arg(payload_size);
+		return Status::Error;
+	}
+
+	const quint8 version = header[5];
+	if (version != protocol::kVersion)
+	{
+		error_ = QString::fromUtf8("Unsupported protocol version : %1").arg(version);
+		return Status::Error;
+	}
+
+	if (available < protocol::kHeaderSize + static_cast<int>(payload_size))
+	{
+		return Status::NeedMore;
+	}
+
+	frame.type = static_cast<protocol::MessageType>(header[4]);
+	frame.version = version;
+	frame.flags = qFromBigEndian<quint16>(header + 6);
+	frame.payload = buffer_.constData() + begin_ + protocol::kHeaderSize;
+	frame.payload_size = static_cast<int>(payload_size);
+	begin_ += protocol::kHeaderSize + static_cast<int>(payload_size);
+	return Status::Frame;
+}
+
+QString FrameParser::ErrorString() const
+{
+	return error_;
+}
+
+int FrameParser::Pending() const
+{
+	return end_ - begin_;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include "protocol.h"
+
+class QIODevice;
+
+// Инкрементальный разбор кадров протокола на одно соединение.
+// Данные читаются из сокета прямо в приемный буфер, который переиспользуется между чтениями;
+// кадры отдаются как FrameView поверх него. Неполный кадр ждет следующего чтения, несколько кадров
+// за одно чтение отдаются по очереди
+class FrameParser final
+{
+public:
+	enum class Status
+	{
+		Frame,    // frame заполнен
+		NeedMore, // кадр еще не пришел целиком
+		Error     // нарушение протокола, дальше разбирать нельзя
+	};
+
+	FrameParser();
+
+	// Дочитывает все доступное из device. false - ошибка чтения
+	bool ReadFrom(QIODevice* device);
+
+	// Для данных, полученных не из QIODevice
+	void Append(const char* data, int size);
+
+	// Следующий целый кадр. FrameView действителен до следующего ReadFrom/Append
+	Status Next(protocol::FrameView& frame);
+
+	QString ErrorString() const;
+
+	// Байт в буфере, еще не отданных кадрами
+	int Pending() const;
+
+private:
+	// Место под size байт в конце буфера: сначала сдвигает неразобранный остаток в начало
+	char* Reserve(int size);
+
+private:
+	QByteArray buffer_;
+	int begin_ = 0; // начало неразобранных данных
+	int end_ = 0;   // конец принятых данных
+	QString error_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QtGlobal>
+#include <chrono>
+
+// Общие для всех компонентов монотонные часы, нс. Нужны для сравнения отметок из разных потоков
+inline qint64 MonotonicNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Настенные часы UTC, нс от эпохи. Для обмена отметками времени между машинами
+inline qint64 WallClockNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,66 @@
+#include "process_resources.h"
+
+#include <QFile>
+#include <QString>
+
+#if defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+namespace process_resources
+{
+	qint64 RaiseOpenFileLimit()
+	{
+#if defined(Q_OS_LINUX)
+		rlimit limit{};
+		if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		{
+			return 0;
+		}
+
+		if (limit.rlim_cur < limit.rlim_max)
+		{
+			rlimit raised = limit;
+			raised.rlim_cur = limit.rlim_max;
+			if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+			{
+				limit = raised;
+			}
+		}
+		return limit.rlim_cur == RLIM_INFINITY ? 0 : static_cast<qint64>(limit.rlim_cur);
+#else
+		return 0;
+#endif
+	}
+
+	qint64 ResidentBytes(qint64 pid)
+	{
+#if defined(Q_OS_LINUX)
+		QFile status(pid == 0
+			? QString::fromUtf8("/proc/self/status")
+			: QString::fromUtf8("/proc/%1/status").arg(pid));
+		if (!status.open(QIODevice::ReadOnly | QIODevice::Text))
+		{
+			return -1;
+		}
+
+		// Строка вида "VmRSS:     123456 kB"
+		while (!status.atEnd())
+		{
+			const QByteArray line = status.readLine();
+			if (!line.startsWith("VmRSS:"))
+			{
+				continue;
+			}
+
+			bool ok = false;
+			const qint64 kilobytes = line.mid(6).trimmed().split(' ').value(0).toLongLong(&ok);
+			return ok ? kilobytes * 1024 : -1;
+		}
+		return -1;
+#else
+		Q_UNUSED(pid);
+		return -1;
+#endif
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Ресурсы процесса для нагрузочных прогонов. Реализовано для Linux, на других системах - заглушки
+namespace process_resources
+{
+	// Поднимает мягкий лимит открытых файлов до жесткого: каждое соединение - дескриптор.
+	// Возвращает действующий лимит, 0 - неизвестен
+	qint64 RaiseOpenFileLimit();
+
+	// Резидентная память процесса (VmRSS), байт. pid 0 - текущий процесс, -1 - не удалось прочитать
+	qint64 ResidentBytes(qint64 pid = 0);
+}
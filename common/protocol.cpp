@@ -0,0 +1,601 @@
+#include "protocol.h"
+
+#include <QtEndian>
+#include <limits>
+
+namespace protocol
+{
+	namespace
+	{
+		// Пишет заголовок сразу, длину проставляет в Finish: нагрузка не собирается отдельно
+		class FrameWriter final
+		{
+		public:
+			FrameWriter(MessageType type, int payload_reserve = 0)
+			{
+				frame_.reserve(kHeaderSize + payload_reserve);
+				frame_.resize(kHeaderSize);
+				uchar* header = reinterpret_cast<uchar*>(frame_.data());
+				qToBigEndian<quint32>(0, header);
+				header[4] = static_cast<uchar>(type);
+				header[5] = kVersion;
+				qToBigEndian<quint16>(0, header + 6);
+			}
+
+			void U8(quint8 value)
+			{
+				frame_.append(static_cast<char>(value));
+			}
+
+			void U16(quint16 value)
+			{
+				Append<quint16>(value);
+			}
+
+			void U32(quint32 value)
+			{
+				Append<quint32>(value);
+			}
+
+			void U64(quint64 value)
+			{
+				Append<quint64>(value);
+			}
+
+			void I64(qint64 value)
+			{
+				Append<quint64>(static_cast<quint64>(value));
+			}
+
+			void Bytes(const QByteArray& value)
+			{
+				const int size = qMin(value.size(), static_cast<int>(std::numeric_limits<quint16>::max()));
+				U16(static_cast<quint16>(size));
+				frame_.append(value.constData(), size);
+			}
+
+			void String(const QString& value)
+			{
+				Bytes(value.toUtf8());
+			}
+
+			QByteArray Finish()
+			{
+				qToBigEndian<quint32>(static_cast<quint32>(frame_.size() - kHeaderSize), frame_.data());
+				return frame_;
+			}
+
+		private:
+			template <typename T>
+			void Append(T value)
+			{
+				uchar bytes[sizeof(T)];
+				qToBigEndian<T>(value, bytes);
+				frame_.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+			}
+
+		private:
+			QByteArray frame_;
+		};
+
+		// Чтение полей прямо из приемного буфера. Любой выход за границу переводит в состояние ошибки
+		class PayloadReader final
+		{
+		public:
+			explicit PayloadReader(const FrameView& frame)
+				: data_(reinterpret_cast<const uchar*>(frame.payload))
+				, size_(frame.payload_size)
+			{
+			}
+
+			quint8 U8()
+			{
+				return Has(1) ? data_[offset_++] : 0;
+			}
+
+			quint16 U16()
+			{
+				return Read<quint16>();
+			}
+
+			quint32 U32()
+			{
+				return Read<quint32>();
+			}
+
+			quint64 U64()
+			{
+				return Read<quint64>();
+			}
+
+			qint64 I64()
+			{
+				return static_cast<qint64>(Read<quint64>());
+			}
+
+			QByteArray Bytes()
+			{
+				const int size = U16();
+				if (!Has(size))
+				{
+					return QByteArray();
+				}
+
+				QByteArray value(reinterpret_cast<const char*>(data_ + offset_), size);
+				offset_ += size;
+				return value;
+			}
+
+			QString String()
+			{
+				const int size = U16();
+				if (!Has(size))
+				{
+					return QString();
+				}
+
+				const QString value = QString::fromUtf8(reinterpret_cast<const char*>(data_ + offset_), size);
+				offset_ += size;
+				return value;
+			}
+
+			// Все прочитано без ошибок и ничего не осталось
+			bool Done() const
+			{
+				return ok_ && offset_ == size_;
+			}
+
+			bool Ok() const
+			{
+				return ok_;
+			}
+
+		private:
+			bool Has(int size)
+			{
+				ok_ = ok_ && size <= size_ - offset_;
+				return ok_;
+			}
+
+			template <typename T>
+			T Read()
+			{
+				if (!Has(sizeof(T)))
+				{
+					return 0;
+				}
+
+				const T value = qFromBigEndian<T>(data_ + offset_);
+				offset_ += sizeof(T);
+				return value;
+			}
+
+		private:
+			const uchar* data_ = nullptr;
+			int size_ = 0;
+			int offset_ = 0;
+			bool ok_ = true;
+		};
+
+		bool IsType(const FrameView& frame, MessageType type)
+		{
+			return frame.type == type;
+		}
+
+		void WriteValues(FrameWriter& writer, const QVector<QPair<QString, QString>>& values)
+		{
+			writer.U16(static_cast<quint16>(values.size()));
+			for (const QPair<QString, QString>& value : values)
+			{
+				writer.String(value.first);
+				writer.String(value.second);
+			}
+		}
+
+		void ReadValues(PayloadReader& reader, QVector<QPair<QString, QString>>& values)
+		{
+			const int count = reader.U16();
+			values.clear();
+			for (int i = 0; i < count && reader.Ok(); ++i)
+			{
+				const QString key = reader.String();
+				const QString value = reader.String();
+				values.append(qMakePair(key, value));
+			}
+		}
+	}
+
+	QByteArray Encode(const AuthChallenge& message)
+	{
+		FrameWriter writer(MessageType::AuthChallenge, 3 + message.server_nonce.size());
+		writer.Bytes(message.server_nonce);
+		writer.U8(message.registered ? 1 : 0);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const Hello& message)
+	{
+		FrameWriter writer(MessageType::Hello, 6 + message.user_name.size() * 3 + message.client_nonce.size() + message.proof.size());
+		writer.String(message.user_name);
+		writer.Bytes(message.client_nonce);
+		writer.Bytes(message.proof);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const HelloAck& message)
+	{
+		FrameWriter writer(MessageType::HelloAck, 9);
+		writer.U8(message.accepted ? 1 : 0);
+		writer.U32(message.client_id);
+		writer.U32(message.token_lifetime_ms);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const SettingsRequest& message)
+	{
+		FrameWriter writer(MessageType::SettingsRequest);
+		writer.U16(static_cast<quint16>(message.keys.size()));
+		for (const QString& key : message.keys)
+		{
+			writer.String(key);
+		}
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const SettingsResponse& message)
+	{
+		FrameWriter writer(MessageType::SettingsResponse);
+		writer.U32(message.version);
+		WriteValues(writer, message.values);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const Heartbeat& message)
+	{
+		FrameWriter writer(MessageType::Heartbeat, 16);
+		writer.U64(message.sequence);
+		writer.I64(message.sent_ns);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const BookingOpen& message)
+	{
+		FrameWriter writer(MessageType::BookingOpen, 12);
+		writer.I64(message.open_time_ms);
+		writer.U32(message.court_id);
+		return writer.Finish();
+	}
+
+	bool Decode(const FrameView& frame, AuthChallenge& message)
+	{
+		if (!IsType(frame, MessageType::AuthChallenge))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.server_nonce = reader.Bytes();
+		message.registered = reader.U8() != 0;
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, Hello& message)
+	{
+		if (!IsType(frame, MessageType::Hello))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.user_name = reader.String();
+		message.client_nonce = reader.Bytes();
+		message.proof = reader.Bytes();
+		return reader.Done();
+	}
+
+	QByteArray Encode(const SettingsDelta& message)
+	{
+		FrameWriter writer(MessageType::SettingsDelta);
+		writer.U32(message.base_version);
+		writer.U32(message.version);
+		WriteValues(writer, message.values);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const TimeSyncRequest& message)
+	{
+		FrameWriter writer(MessageType::TimeSyncRequest, 16);
+		writer.U64(message.sequence);
+		writer.I64(message.client_send_ns);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const TimeSyncResponse& message)
+	{
+		FrameWriter writer(MessageType::TimeSyncResponse, 32);
+		writer.U64(message.sequence);
+		writer.I64(message.client_send_ns);
+		writer.I64(message.server_receive_ns);
+		writer.I64(message.server_send_ns);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const SessionToken& message)
+	{
+		FrameWriter writer(MessageType::SessionToken, 6 + message.nonce.size());
+		writer.Bytes(message.nonce);
+		writer.U32(message.token_lifetime_ms);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const TemplatePackInfo& message)
+	{
+		FrameWriter writer(MessageType::TemplatePackInfo, 10 + message.sha256.size());
+		writer.U32(message.version);
+		writer.U32(message.size);
+		writer.Bytes(message.sha256);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const TemplatePackRequest& message)
+	{
+		FrameWriter writer(MessageType::TemplatePackRequest, 8);
+		writer.U32(message.version);
+		writer.U32(message.offset);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const TemplatePackChunk& message)
+	{
+		FrameWriter writer(MessageType::TemplatePackChunk, 10 + message.data.size());
+		writer.U32(message.version);
+		writer.U32(message.offset);
+		writer.Bytes(message.data);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const BookingClaim& message)
+	{
+		FrameWriter writer(MessageType::BookingClaim, 20);
+		writer.U64(message.sequence);
+		writer.U32(message.court_id);
+		writer.I64(message.open_time_ms);
+		return writer.Finish();
+	}
+
+	QByteArray Encode(const BookingClaimResult& message)
+	{
+		FrameWriter writer(MessageType::BookingClaimResult, 37);
+		writer.U64(message.sequence);
+		writer.U32(message.court_id);
+		writer.I64(message.open_time_ms);
+		writer.U8(static_cast<quint8>(message.outcome));
+		writer.U32(message.claim_number);
+		writer.U32(message.winner_id);
+		writer.I64(message.server_receive_ns);
+		return writer.Finish();
+	}
+
+	bool Decode(const FrameView& frame, HelloAck& message)
+	{
+		if (!IsType(frame, MessageType::HelloAck))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.accepted = reader.U8() != 0;
+		message.client_id = reader.U32();
+		message.token_lifetime_ms = reader.U32();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, SettingsRequest& message)
+	{
+		if (!IsType(frame, MessageType::SettingsRequest))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		const int count = reader.U16();
+		message.keys.clear();
+		for (int i = 0; i < count && reader.Ok(); ++i)
+		{
+			message.keys.append(reader.String());
+		}
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, SettingsResponse& message)
+	{
+		if (!IsType(frame, MessageType::SettingsResponse))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.version = reader.U32();
+		ReadValues(reader, message.values);
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, Heartbeat& message)
+	{
+		if (!IsType(frame, MessageType::Heartbeat))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.sequence = reader.U64();
+		message.sent_ns = reader.I64();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, BookingOpen& message)
+	{
+		if (!IsType(frame, MessageType::BookingOpen))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.open_time_ms = reader.I64();
+		message.court_id = reader.U32();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, SettingsDelta& message)
+	{
+		if (!IsType(frame, MessageType::SettingsDelta))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.base_version = reader.U32();
+		message.version = reader.U32();
+		ReadValues(reader, message.values);
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, TimeSyncRequest& message)
+	{
+		if (!IsType(frame, MessageType::TimeSyncRequest))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.sequence = reader.U64();
+		message.client_send_ns = reader.I64();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, TimeSyncResponse& message)
+	{
+		if (!IsType(frame, MessageType::TimeSyncResponse))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.sequence = reader.U64();
+		message.client_send_ns = reader.I64();
+		message.server_receive_ns = reader.I64();
+		message.server_send_ns = reader.I64();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, SessionToken& message)
+	{
+		if (!IsType(frame, MessageType::SessionToken))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.nonce = reader.Bytes();
+		message.token_lifetime_ms = reader.U32();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, TemplatePackInfo& message)
+	{
+		if (!IsType(frame, MessageType::TemplatePackInfo))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.version = reader.U32();
+		message.size = reader.U32();
+		message.sha256 = reader.Bytes();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, TemplatePackRequest& message)
+	{
+		if (!IsType(frame, MessageType::TemplatePackRequest))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.version = reader.U32();
+		message.offset = reader.U32();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, TemplatePackChunk& message)
+	{
+		if (!IsType(frame, MessageType::TemplatePackChunk))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.version = reader.U32();
+		message.offset = reader.U32();
+		message.data = reader.Bytes();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, BookingClaim& message)
+	{
+		if (!IsType(frame, MessageType::BookingClaim))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.sequence = reader.U64();
+		message.court_id = reader.U32();
+		message.open_time_ms = reader.I64();
+		return reader.Done();
+	}
+
+	bool Decode(const FrameView& frame, BookingClaimResult& message)
+	{
+		if (!IsType(frame, MessageType::BookingClaimResult))
+		{
+			return false;
+		}
+
+		PayloadReader reader(frame);
+		message.sequence = reader.U64();
+		message.court_id = reader.U32();
+		message.open_time_ms = reader.I64();
+		const quint8 outcome = reader.U8();
+		message.outcome = static_cast<ClaimOutcome>(outcome);
+		message.claim_number = reader.U32();
+		message.winner_id = reader.U32();
+		message.server_receive_ns = reader.I64();
+		return reader.Done() && outcome <= static_cast<quint8>(ClaimOutcome::NotOpen);
+	}
+
+	const char* TypeName(MessageType type)
+	{
+		switch (type)
+		{
+		case MessageType::Hello: return "Hello";
+		case MessageType::HelloAck: return "HelloAck";
+		case MessageType::SettingsRequest: return "SettingsRequest";
+		case MessageType::SettingsResponse: return "SettingsResponse";
+		case MessageType::Heartbeat: return "Heartbeat";
+		case MessageType::BookingOpen: return "BookingOpen";
+		case MessageType::SettingsDelta: return "SettingsDelta";
+		case MessageType::TimeSyncRequest: return "TimeSyncRequest";
+		case MessageType::TimeSyncResponse: return "TimeSyncResponse";
+		case MessageType::SessionToken: return "SessionToken";
+		case MessageType::TemplatePackInfo: return "TemplatePackInfo";
+		case MessageType::TemplatePackRequest: return "TemplatePackRequest";
+		case MessageType::TemplatePackChunk: return "TemplatePackChunk";
+		case MessageType::BookingClaim: return "BookingClaim";
+		case MessageType::BookingClaimResult: return "BookingClaimResult";
+		case MessageType::AuthChallenge: return "AuthChallenge";
+		}
+		return "Unknown";
+	}
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <QByteArray>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+// Протокол клиент - сервер. Кадр:
+//   FrameHeader (kHeaderSize байт, порядок байт сетевой), затем payload_size байт полезной нагрузки.
+// Полезная нагрузка - поля сообщения подряд: целые в сетевом порядке, строки и байты как u16 длина + данные
+namespace protocol
+{
+	// 2 - ключ сессии в HelloAck и подпись кадров клиента; 3 - раздача пакетов шаблонов; 4 - заявки на слот;
+	// 5 - вызов сервера и ключ сессии, вычисляемый обеими сторонами, вместо передачи секрета и ключа
+	const quint8 kVersion = 5;
+
+	// Длина (4), тип (1), версия (1), флаги (2)
+	const int kHeaderSize = 8;
+
+	// Флаг заголовка: после нагрузки идет подпись кадра ключом сессии (kMacSize байт, входит в длину)
+	const quint16 kFlagAuthenticated = 0x0001;
+
+	const int kMacSize = 16;
+
+	// Кадр больше этого - ошибка протокола, соединение разрывается
+	const int kMaxPayloadSize = 64 * 1024;
+
+	const quint16 kDefaultPort = 62022;
+
+	enum class MessageType : quint8
+	{
+		Hello = 1,            // клиент -> сервер, ответ на AuthChallenge
+		HelloAck = 2,         // сервер -> клиент
+		SettingsRequest = 3,  // клиент -> сервер
+		SettingsResponse = 4, // сервер -> клиент
+		Heartbeat = 5,        // в обе стороны, сервер отвечает эхом
+		BookingOpen = 6,      // сервер -> клиент
+		SettingsDelta = 7,    // сервер -> клиент, рассылка изменившихся настроек
+		TimeSyncRequest = 8,  // клиент -> сервер
+		TimeSyncResponse = 9, // сервер -> клиент
+		SessionToken = 10,    // сервер -> клиент, новый ключ сессии взамен истекающего
+		TemplatePackInfo = 11,    // сервер -> клиент, после приветствия и при смене пакета
+		TemplatePackRequest = 12, // клиент -> сервер
+		TemplatePackChunk = 13,   // сервер -> клиент, ответ на TemplatePackRequest
+		BookingClaim = 14,        // клиент -> сервер
+		BookingClaimResult = 15,  // сервер -> клиент, ответ на BookingClaim
+		AuthChallenge = 16        // сервер -> клиент, первым сообщением после подключения
+	};
+
+	// Случайный вызов соединения. registered - сервер проверяет пользователей по реестру; иначе
+	// (реестр пуст) клиент отвечает пустым ключом пользователя
+	struct AuthChallenge
+	{
+		QByteArray server_nonce;
+		bool registered = false;
+	};
+
+	// proof - FrameAuthenticator::HelloProof ключом пользователя от обоих nonce и имени. Секрет по сети не передается
+	struct Hello
+	{
+		QString user_name;
+		QByteArray client_nonce;
+		QByteArray proof;
+	};
+
+	// После принятого приветствия все кадры клиента подписываются ключом сессии, который обе стороны
+	// вычисляют сами (FrameAuthenticator::DeriveSessionKey). Ключ действует token_lifetime_ms, до истечения
+	// сервер присылает SessionToken
+	struct HelloAck
+	{
+		bool accepted = false;
+		quint32 client_id = 0;
+		quint32 token_lifetime_ms = 0;
+	};
+
+	// Новый ключ сессии - DeriveSessionKey с этим nonce; сам ключ не передается
+	struct SessionToken
+	{
+		QByteArray nonce;
+		quint32 token_lifetime_ms = 0;
+	};
+
+	// Пустой запрос - все настройки
+	struct SettingsRequest
+	{
+		QVector<QString> keys;
+	};
+
+	// Ключи - из helpers::settings::keys клиента. version растет с каждым изменением настроек на сервере
+	struct SettingsResponse
+	{
+		quint32 version = 0;
+		QVector<QPair<QString, QString>> values;
+	};
+
+	// Только изменившиеся значения. Применяется поверх версии base_version,
+	// иначе клиент запрашивает настройки целиком
+	struct SettingsDelta
+	{
+		quint32 base_version = 0;
+		quint32 version = 0;
+		QVector<QPair<QString, QString>> values;
+	};
+
+	struct Heartbeat
+	{
+		quint64 sequence = 0;
+		qint64 sent_ns = 0; // часы отправителя, эхо возвращает как есть
+	};
+
+	// Старший бит номера heartbeat - замерная рассылка сервера всем клиентам, а не эхо.
+	// sent_ns - монотонные часы сервера (сравнимы с часами клиента на той же машине)
+	const quint64 kProbeSequenceFlag = quint64(1) << 63;
+
+	// Текущий пакет шаблонов сервера (template_pack_format). Клиент, у которого этой версии нет в кэше,
+	// забирает файл кусками: запрос следующего куска - после прихода предыдущего
+	struct TemplatePackInfo
+	{
+		quint32 version = 0;
+		quint32 size = 0;
+		QByteArray sha256;
+	};
+
+	// Кусок с offset. Если версия уже не текущая, сервер вместо куска присылает TemplatePackInfo
+	struct TemplatePackRequest
+	{
+		quint32 version = 0;
+		quint32 offset = 0;
+	};
+
+	struct TemplatePackChunk
+	{
+		quint32 version = 0;
+		quint32 offset = 0;
+		QByteArray data;
+	};
+
+	// С запасом меньше kMaxPayloadSize
+	const int kTemplatePackChunkSize = 48 * 1024;
+
+	// Время по часам сервера
+	struct BookingOpen
+	{
+		qint64 open_time_ms = 0; // UTC, мс от эпохи
+		quint32 court_id = 0;
+	};
+
+	// Заявка на слот, объявленный BookingOpen: court_id и open_time_ms из него.
+	// Сервер отмечает время прихода заявки по своим часам, к которым клиенты синхронизируют свои
+	struct BookingClaim
+	{
+		quint64 sequence = 0;
+		quint32 court_id = 0;
+		qint64 open_time_ms = 0;
+	};
+
+	enum class ClaimOutcome : quint8
+	{
+		Won = 0,      // первая заявка на слот; повторная заявка победителя (с любого его соединения) - тоже Won
+		Lost = 1,     // слот уже занят, winner_id - победитель
+		TooEarly = 2, // заявка пришла до открытия и не учитывается
+		NotOpen = 3   // такой слот не объявлен или уже заменен другим
+	};
+
+	// claim_number - порядковый номер заявки среди всех заявок на слот в порядке разбора, повторные тоже считаются
+	// (1 - заявка победителя). winner_id - идентификатор пользователя-победителя (хэш имени), общий для всех
+	// его соединений. server_receive_ns - отметка прихода (UTC, нс от эпохи), по которой заявка сравнивалась
+	// со временем открытия
+	struct BookingClaimResult
+	{
+		quint64 sequence = 0; // эхо
+		quint32 court_id = 0;
+		qint64 open_time_ms = 0;
+		ClaimOutcome outcome = ClaimOutcome::NotOpen;
+		quint32 claim_number = 0;
+		quint32 winner_id = 0;
+		qint64 server_receive_ns = 0;
+	};
+
+	// Обмен для оценки сдвига часов клиента относительно сервера (как в NTP).
+	// Все отметки - UTC, нс от эпохи: t0 и t3 по часам клиента, t1 и t2 по часам сервера
+	struct TimeSyncRequest
+	{
+		quint64 sequence = 0;
+		qint64 client_send_ns = 0;    // t0
+	};
+
+	struct TimeSyncResponse
+	{
+		quint64 sequence = 0;
+		qint64 client_send_ns = 0;    // t0, эхо
+		qint64 server_receive_ns = 0; // t1
+		qint64 server_send_ns = 0;    // t2
+	};
+
+	// Кадр внутри приемного буфера разборщика, без копирования. Действителен до следующего чтения в буфер
+	struct FrameView
+	{
+		MessageType type = MessageType::Heartbeat;
+		quint8 version = 0;
+		quint16 flags = 0;
+		const char* payload = nullptr;
+		int payload_size = 0;
+	};
+
+	// Кадр целиком (заголовок и нагрузка) для отправки одним write
+	QByteArray Encode(const AuthChallenge& message);
+	QByteArray Encode(const Hello& message);
+	QByteArray Encode(const HelloAck& message);
+	QByteArray Encode(const SettingsRequest& message);
+	QByteArray Encode(const SettingsResponse& message);
+	QByteArray Encode(const Heartbeat& message);
+	QByteArray Encode(const BookingOpen& message);
+	QByteArray Encode(const SettingsDelta& message);
+	QByteArray Encode(const TimeSyncRequest& message);
+	QByteArray Encode(const TimeSyncResponse& message);
+	QByteArray Encode(const SessionToken& message);
+	QByteArray Encode(const TemplatePackInfo& message);
+	QByteArray Encode(const TemplatePackRequest& message);
+	QByteArray Encode(const TemplatePackChunk& message);
+	QByteArray Encode(const BookingClaim& message);
+	QByteArray Encode(const BookingClaimResult& message);
+
+	// false - нагрузка короче, чем нужно, или лишние байты в конце
+	bool Decode(const FrameView& frame, AuthChallenge& message);
+	bool Decode(const FrameView& frame, Hello& message);
+	bool Decode(const FrameView& frame, HelloAck& message);
+	bool Decode(const FrameView& frame, SettingsRequest& message);
+	bool Decode(const FrameView& frame, SettingsResponse& message);
+	bool Decode(const FrameView& frame, Heartbeat& message);
+	bool Decode(const FrameView& frame, BookingOpen& message);
+	bool Decode(const FrameView& frame, SettingsDelta& message);
+	bool Decode(const FrameView& frame, TimeSyncRequest& message);
+	bool Decode(const FrameView& frame, TimeSyncResponse& message);
+	bool Decode(const FrameView& frame, SessionToken& message);
+	bool Decode(const FrameView& frame, TemplatePackInfo& message);
+	bool Decode(const FrameView& frame, TemplatePackRequest& message);
+	bool Decode(const FrameView& frame, TemplatePackChunk& message);
+	bool Decode(const FrameView& frame, BookingClaim& message);
+	bool Decode(const FrameView& frame, BookingClaimResult& message);
+
+	const char* TypeName(MessageType type);
+}
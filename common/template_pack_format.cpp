@@ -0,0 +1,62 @@
+#include "template_pack_format.h"
+
+#include <cstring>
+
+namespace template_pack_format
+{
+	namespace
+	{
+		bool Fits(quint64 offset, quint64 size, quint64 file_size)
+		{
+			return offset <= file_size && size <= file_size - offset;
+		}
+	}
+
+	bool Validate(const uchar* data, qint64 size)
+	{
+		// Файл читается на месте, структуры в нем - в порядке байт little-endian
+		if (Q_BYTE_ORDER != Q_LITTLE_ENDIAN || !data || size < static_cast<qint64>(sizeof(PackHeader))
+			|| size > kMaxPackSize)
+		{
+			return false;
+		}
+
+		const PackHeader* header = reinterpret_cast<const PackHeader*>(data);
+		if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->format_version != kFormatVersion
+			|| header->file_size != static_cast<quint64>(size))
+		{
+			return false;
+		}
+
+		const quint64 file_size = static_cast<quint64>(size);
+		if (!Fits(sizeof(PackHeader), quint64(header->template_count) * sizeof(TemplateEntry), file_size))
+		{
+			return false;
+		}
+
+		const TemplateEntry* entries = reinterpret_cast<const TemplateEntry*>(data + sizeof(PackHeader));
+		for (quint32 i = 0; i < header->template_count; ++i)
+		{
+			const TemplateEntry& entry = entries[i];
+			if (std::memchr(entry.name, 0, sizeof(entry.name)) == nullptr
+				|| entry.level_count == 0 || entry.level_count > static_cast<quint32>(kMaxLevels)
+				|| entry.keypoint_count > static_cast<quint32>(kMaxKeypoints)
+				|| !Fits(entry.keypoints_offset, quint64(entry.keypoint_count) * sizeof(Keypoint), file_size))
+			{
+				return false;
+			}
+
+			for (quint32 level = 0; level < entry.level_count; ++level)
+			{
+				const Level& item = entry.levels[level];
+				if (item.width == 0 || item.height == 0 || item.stride < item.width || item.stride % 4 != 0
+					|| !Fits(item.offset, quint64(item.stride) * item.height, file_size))
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Пакет шаблонов - файл, который клиент отображает в память и использует без разбора и декодирования:
+//   PackHeader, TemplateEntry * template_count, затем данные: уровни (8 бит, оттенки серого) и ключевые точки.
+// Смещения - от начала файла, данные выровнены на kAlignment. Порядок байт little-endian.
+// Пакет собирает клиент (--build-template-pack), раздает сервер, клиент хранит полученный файл как есть
+namespace template_pack_format
+{
+	const char kMagic[4] = { 'B', 'T', 'T', 'P' };
+	const quint32 kFormatVersion = 1;
+
+	// Имя стадии детекции, UTF-8 с завершающим нулем
+	const int kNameSize = 32;
+	const int kMaxLevels = 4;
+	const int kMaxKeypoints = 64;
+	const quint32 kAlignment = 16;
+
+	// Больше - признак порчи, такой пакет не раздается и не загружается
+	const quint32 kMaxPackSize = 16 * 1024 * 1024;
+
+	struct PackHeader
+	{
+		char magic[4];
+		quint32 format_version;
+		quint32 pack_version;   // растет с каждой сборкой: по нему клиент решает, нужна ли загрузка
+		quint32 template_count;
+		quint64 file_size;
+		qint64 created_ms;      // UTC, мс от эпохи
+	};
+
+	// Вариант шаблона под масштаб экрана. Строки выровнены на 4 байта (stride)
+	struct Level
+	{
+		float scale;
+		quint32 width;
+		quint32 height;
+		quint32 stride;
+		quint32 offset;
+	};
+
+	// Точки с наибольшим перепадом яркости на уровне 0
+	struct Keypoint
+	{
+		quint16 x;
+		quint16 y;
+		float response;
+	};
+
+	struct TemplateEntry
+	{
+		char name[kNameSize];
+		quint32 level_count;
+		quint32 keypoint_count;
+		quint32 keypoints_offset;
+		float mean;             // яркость уровня 0, 0..1
+		float stddev;
+		Level levels[kMaxLevels];
+	};
+
+	// Заголовок, таблица и все данные, на которые она ссылается, лежат внутри size.
+	// false - не пакет, другая версия формата, испорченный файл или машина с другим порядком байт
+	bool Validate(const uchar* data, qint64 size);
+}
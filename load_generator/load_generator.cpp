@@ -0,0 +1,333 @@
+#include "load_generator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+
+#include "monotonic_clock.h"
+#include "process_resources.h"
+#include "protocol.h"
+
+namespace
+{
+	const int kProgressIntervalMs = 1000;
+
+	// Дескрипторы сверх клиентских: стандартные потоки, пробуждение циклов событий
+	const int kReservedFiles = 64;
+
+	double Percentile(const QVector<qint64>& sorted, double p)
+	{
+		const int index = qBound(0, static_cast<int>(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+		return sorted[index] / 1000000.0;
+	}
+
+	QString FormatLatencies(const QString& name, QVector<qint64> latencies)
+	{
+		if (latencies.isEmpty())
+		{
+			return QString::fromUtf8("%1\t0\t-\t-\t-\t-\t-\n").arg(name);
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		double sum = 0.0;
+		for (qint64 latency : latencies)
+		{
+			sum += latency;
+		}
+
+		return QString::fromUtf8("%1\t%2\t%3\t%4\t%5\t%6\t%7\n")
+			.arg(name)
+			.arg(latencies.size())
+			.arg(sum / latencies.size() / 1000000.0, 0, 'f', 3)
+			.arg(Percentile(latencies, 0.5), 0, 'f', 3)
+			.arg(Percentile(latencies, 0.9), 0, 'f', 3)
+			.arg(Percentile(latencies, 0.99), 0, 'f', 3)
+			.arg(latencies.last() / 1000000.0, 0, 'f', 3);
+	}
+}
+
+LoadGenerator::LoadGenerator(QObject* parent)
+	: QObject(parent)
+{
+	config_.port = protocol::kDefaultPort;
+	progress_timer_.setInterval(kProgressIntervalMs);
+	hold_timer_.setSingleShot(true);
+
+	bool connection = true;
+	connection = connect(&progress_timer_, &QTimer::timeout, this, &LoadGenerator::OnProgressTimer); Q_ASSERT(connection);
+	connection = connect(&hold_timer_, &QTimer::timeout, this, &LoadGenerator::OnHoldTimer); Q_ASSERT(connection);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+	for (QThread* thread : threads_)
+	{
+		thread->quit();
+	}
+	for (QThread* thread : threads_)
+	{
+		thread->wait();
+	}
+}
+
+bool LoadGenerator::ParseArguments(const QCoreApplication& app, int& exit_code)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QString::fromUtf8("book_tennis_server load generator"));
+	parser.addHelpOption();
+
+	const QCommandLineOption host_option("host", QString::fromUtf8("Server address."), "host");
+	const QCommandLineOption port_option("port", QString::fromUtf8("Server port."), "port");
+	const QCommandLineOption clients_option("clients", QString::fromUtf8("Simulated clients."), "count");
+	const QCommandLineOption threads_option("threads", QString::fromUtf8("Generator threads, 0 - one per core."), "count");
+	const QCommandLineOption concurrency_option("concurrency", QString::fromUtf8("Connections being established at once."), "count");
+	const QCommandLineOption heartbeat_option("heartbeat-interval", QString::fromUtf8("Heartbeat interval of every client."), "msecs");
+	const QCommandLineOption hold_option("hold", QString::fromUtf8("Keep the clients connected for the given time after all connected."), "msecs");
+	const QCommandLineOption connect_timeout_option("connect-timeout", QString::fromUtf8("Stop waiting for connections after the given time."), "msecs");
+	const QCommandLineOption server_pid_option("server-pid", QString::fromUtf8("Server process id to measure its memory (Linux)."), "pid");
+	const QCommandLineOption user_prefix_option("user-prefix", QString::fromUtf8("Client names are prefix_N."), "prefix");
+	parser.addOptions({ host_option, port_option, clients_option, threads_option, concurrency_option,
+		heartbeat_option, hold_option, connect_timeout_option, server_pid_option, user_prefix_option });
+	const QCommandLineOption claims_option("claims",
+		QString::fromUtf8("Claims per client on the announced booking slot once it opens, each after the previous answer."), "count");
+	parser.addOption(claims_option);
+
+	if (!parser.parse(app.arguments()))
+	{
+		QTextStream(stderr) << parser.errorText() << '\n';
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	if (parser.isSet(QStringLiteral("help")))
+	{
+		QTextStream(stdout) << parser.helpText();
+		exit_code = Succeed;
+		return false;
+	}
+
+	bool ok = true;
+	if (parser.isSet(port_option))
+	{
+		const uint port = parser.value(port_option).toUInt(&ok);
+		ok = ok && port > 0 && port <= 65535;
+		config_.port = static_cast<quint16>(port);
+	}
+
+	const auto read_int = [&parser, &ok](const QCommandLineOption& option, int& value, int minimum) {
+		if (ok && parser.isSet(option))
+		{
+			value = parser.value(option).toInt(&ok);
+			ok = ok && value >= minimum;
+		}
+	};
+	read_int(clients_option, config_.clients, 1);
+	read_int(threads_option, config_.threads, 0);
+	read_int(concurrency_option, config_.concurrency, 1);
+	read_int(heartbeat_option, config_.heartbeat_interval_ms, 0);
+	read_int(hold_option, config_.hold_ms, 0);
+	read_int(connect_timeout_option, config_.connect_timeout_ms, 1);
+	read_int(claims_option, config_.claims, 0);
+
+	if (ok && parser.isSet(server_pid_option))
+	{
+		config_.server_pid = parser.value(server_pid_option).toLongLong(&ok);
+		ok = ok && config_.server_pid > 0;
+	}
+
+	if (!ok)
+	{
+		QTextStream(stderr) << QString::fromUtf8("Invalid arguments\n") << parser.helpText();
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	if (parser.isSet(host_option))
+	{
+		config_.host = parser.value(host_option);
+	}
+	if (parser.isSet(user_prefix_option))
+	{
+		config_.user_prefix = parser.value(user_prefix_option);
+	}
+	if (config_.threads == 0)
+	{
+		config_.threads = qMax(1, QThread::idealThreadCount());
+	}
+	config_.threads = qMin(config_.threads, config_.clients);
+	return true;
+}
+
+void LoadGenerator::Start()
+{
+	const qint64 open_file_limit = process_resources::RaiseOpenFileLimit();
+	if (open_file_limit > 0 && open_file_limit < config_.clients + kReservedFiles)
+	{
+		qWarning() << QString::fromUtf8("Open file limit is too low for the clients : ") << open_file_limit
+			<< QString::fromUtf8(", raise it with ulimit -n");
+	}
+
+	if (config_.server_pid > 0)
+	{
+		server_resident_before_ = process_resources::ResidentBytes(config_.server_pid);
+	}
+
+	qDebug() << QString::fromUtf8("Connecting %1 clients to %2:%3 from %4 threads")
+		.arg(config_.clients).arg(config_.host).arg(config_.port).arg(config_.threads);
+
+	start_ns_ = MonotonicNs();
+	int first_client = 0;
+	for (int i = 0; i < config_.threads; ++i)
+	{
+		// Остаток от деления - первым потокам
+		const int client_count = config_.clients / config_.threads + (i < config_.clients % config_.threads ? 1 : 0);
+
+		QThread* thread = new QThread(this);
+		thread->setObjectName(QString::fromUtf8("load_worker_%1").arg(i));
+		LoadWorker* worker = new LoadWorker(i, first_client, client_count, config_);
+		worker->moveToThread(thread);
+		first_client += client_count;
+
+		bool connection = connect(thread, &QThread::finished, worker, &QObject::deleteLater); Q_ASSERT(connection);
+		thread->start();
+		QMetaObject::invokeMethod(worker, [worker]() { worker->Start(); }, Qt::QueuedConnection);
+		threads_.append(thread);
+		workers_.append(worker);
+	}
+	progress_timer_.start();
+}
+
+void LoadGenerator::OnProgressTimer()
+{
+	int connected = 0;
+	int failed = 0;
+	for (const LoadWorker* worker : workers_)
+	{
+		connected += worker->ConnectedCount();
+		failed += worker->FailedCount();
+	}
+
+	const qint64 elapsed_ms = (MonotonicNs() - start_ns_) / 1000000;
+	qDebug() << QString::fromUtf8("%1 ms : connected %2, failed %3 of %4")
+		.arg(elapsed_ms).arg(connected).arg(failed).arg(config_.clients);
+
+	if (all_settled_)
+	{
+		return;
+	}
+
+	const bool timed_out = elapsed_ms >= config_.connect_timeout_ms;
+	if (connected + failed < config_.clients && !timed_out)
+	{
+		return;
+	}
+
+	if (timed_out)
+	{
+		qWarning() << QString::fromUtf8("Connect timeout, clients still connecting : ") << config_.clients - connected - failed;
+	}
+
+	all_settled_ = true;
+	if (config_.server_pid > 0)
+	{
+		server_resident_connected_ = process_resources::ResidentBytes(config_.server_pid);
+	}
+	hold_timer_.start(config_.hold_ms);
+}
+
+void LoadGenerator::OnHoldTimer()
+{
+	Finish();
+}
+
+void LoadGenerator::Finish()
+{
+	progress_timer_.stop();
+
+	// Сокеты закрываются в своих потоках, отчеты забираются синхронно
+	LoadReport report;
+	for (LoadWorker* worker : workers_)
+	{
+		LoadReport worker_report;
+		QMetaObject::invokeMethod(worker, [worker, &worker_report]() { worker->Stop(worker_report); }, Qt::BlockingQueuedConnection);
+		report.Merge(worker_report);
+	}
+
+	QTextStream(stdout) << FormatReport(report);
+	emit Finished(report.connected > 0 ? Succeed : Failed);
+}
+
+QString LoadGenerator::FormatClaims(const LoadReport& report) const
+{
+	QString text;
+	QTextStream stream(&text);
+
+	if (report.claim_ack_ns.isEmpty())
+	{
+		stream << QString::fromUtf8("no claims answered: run the server with --booking-open-in longer than the connect time\n");
+		stream.flush();
+		return text;
+	}
+
+	const double claim_seconds = (report.last_claim_ack_ns - report.first_claim_ns) / 1000000000.0;
+	stream << QString::fromUtf8("claims %1: won %2, lost %3, rejected %4; %5 claims/s\n")
+		.arg(report.claim_ack_ns.size())
+		.arg(report.claims_won)
+		.arg(report.claims_lost)
+		.arg(report.claims_rejected)
+		.arg(claim_seconds > 0.0 ? report.claim_ack_ns.size() / claim_seconds : 0.0, 0, 'f', 0);
+	stream << QString::fromUtf8("latency\tsamples\tmean ms\tp50 ms\tp90 ms\tp99 ms\tmax ms\n");
+	stream << FormatLatencies(QString::fromUtf8("claim"), report.claim_ack_ns);
+
+	// Слот один: победитель должен быть один и одинаковый во всех ответах
+	stream << QString::fromUtf8("winners %1, distinct winners in answers %2%3\n")
+		.arg(report.claim_winners)
+		.arg(report.winner_ids.size())
+		.arg(report.claim_winners == 1 && report.winner_ids.size() == 1 ? QString() : QString::fromUtf8(" - ARBITRATION MISMATCH"));
+	stream.flush();
+	return text;
+}
+
+QString LoadGenerator::FormatReport(const LoadReport& report) const
+{
+	QString text;
+	QTextStream stream(&text);
+
+	const double connect_seconds = (report.last_ready_ns - report.first_connect_ns) / 1000000000.0;
+	stream << QString::fromUtf8("clients %1, connected %2, failed %3, disconnected %4\n")
+		.arg(config_.clients).arg(report.connected).arg(report.failed).arg(report.disconnected);
+	if (report.connected > 0 && connect_seconds > 0.0)
+	{
+		stream << QString::fromUtf8("connect rate %1 clients/s (%2 s)\n")
+			.arg(report.connected / connect_seconds, 0, 'f', 0)
+			.arg(connect_seconds, 0, 'f', 3);
+	}
+
+	if (server_resident_before_ >= 0 && server_resident_connected_ >= 0 && report.connected > 0)
+	{
+		stream << QString::fromUtf8("server resident %1 MB -> %2 MB, %3 KB per connection\n")
+			.arg(server_resident_before_ / (1024.0 * 1024.0), 0, 'f', 1)
+			.arg(server_resident_connected_ / (1024.0 * 1024.0), 0, 'f', 1)
+			.arg((server_resident_connected_ - server_resident_before_) / 1024.0 / report.connected, 0, 'f', 1);
+	}
+
+	stream << QString::fromUtf8("latency\tsamples\tmean ms\tp50 ms\tp90 ms\tp99 ms\tmax ms\n");
+	stream << FormatLatencies(QString::fromUtf8("handshake"), report.handshake_ns);
+	stream << FormatLatencies(QString::fromUtf8("heartbeat"), report.heartbeat_rtt_ns);
+	stream << FormatLatencies(QString::fromUtf8("broadcast"), report.probe_ns);
+	if (report.probe_ns.isEmpty())
+	{
+		stream << QString::fromUtf8("no broadcasts received: run the server with --probe-interval\n");
+	}
+
+	if (config_.claims > 0)
+	{
+		stream << FormatClaims(report);
+	}
+	stream.flush();
+	return text;
+}
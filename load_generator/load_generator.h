@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include "load_worker.h"
+
+class QCoreApplication;
+class QThread;
+
+// Нагрузочный прогон сервера с одной машины: тысячи имитируемых клиентов через loopback в нескольких
+// потоках. Меряет скорость подключения, задержку приветствия и heartbeat, задержку доставки рассылок,
+// память сервера на соединение и скорость разбора заявок на слот
+class LoadGenerator final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	enum ExitCode
+	{
+		Succeed = 0,
+		Failed = 1,
+		InvalidArguments = 3
+	};
+
+	explicit LoadGenerator(QObject* parent = nullptr);
+	~LoadGenerator() override;
+
+	// Разбор аргументов. false - продолжать не нужно, код в exit_code
+	bool ParseArguments(const QCoreApplication& app, int& exit_code);
+
+	void Start();
+
+Q_SIGNALS:
+
+	void Finished(int exit_code);
+
+private Q_SLOTS:
+
+	void OnProgressTimer();
+
+	void OnHoldTimer();
+
+private:
+	void Finish();
+
+	QString FormatReport(const LoadReport& report) const;
+
+	// Заявки на слот: скорость разбора, задержка ответа, единственность победителя
+	QString FormatClaims(const LoadReport& report) const;
+
+private:
+	LoadConfig config_;
+
+	QVector<QThread*> threads_;
+	QVector<LoadWorker*> workers_;
+
+	QTimer progress_timer_;
+	QTimer hold_timer_;
+
+	qint64 start_ns_ = 0;
+	bool all_settled_ = false;
+
+	// Память сервера до подключения и после подключения всех клиентов, байт
+	qint64 server_resident_before_ = -1;
+	qint64 server_resident_connected_ = -1;
+};
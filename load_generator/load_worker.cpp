@@ -0,0 +1,442 @@
+#include "load_worker.h"
+
+#include <QDateTime>
+#include <QTcpSocket>
+
+#include "monotonic_clock.h"
+
+#include <limits>
+
+namespace
+{
+	// Heartbeat рассылается порциями с этим шагом, чтобы не отправлять всем клиентам разом
+	const int kHeartbeatTickMs = 100;
+}
+
+void LoadReport::Merge(const LoadReport& other)
+{
+	connected += other.connected;
+	failed += other.failed;
+	disconnected += other.disconnected;
+	if (other.first_connect_ns != 0 && (first_connect_ns == 0 || other.first_connect_ns < first_connect_ns))
+	{
+		first_connect_ns = other.first_connect_ns;
+	}
+	last_ready_ns = qMax(last_ready_ns, other.last_ready_ns);
+	handshake_ns += other.handshake_ns;
+	heartbeat_rtt_ns += other.heartbeat_rtt_ns;
+	probe_ns += other.probe_ns;
+	claim_ack_ns += other.claim_ack_ns;
+	claims_won += other.claims_won;
+	claims_lost += other.claims_lost;
+	claims_rejected += other.claims_rejected;
+	claim_winners += other.claim_winners;
+	winner_ids += other.winner_ids;
+	if (other.first_claim_ns != 0 && (first_claim_ns == 0 || other.first_claim_ns < first_claim_ns))
+	{
+		first_claim_ns = other.first_claim_ns;
+	}
+	last_claim_ack_ns = qMax(last_claim_ack_ns, other.last_claim_ack_ns);
+}
+
+LoadWorker::LoadWorker(int index, int first_client, int client_count, const LoadConfig& config, QObject* parent)
+	: QObject(parent)
+	, index_(index)
+	, first_client_(first_client)
+	, client_count_(client_count)
+	, config_(config)
+	// С родителем: таймер переносится в поток вместе с обработчиком
+	, heartbeat_timer_(this)
+	, claim_timer_(this)
+{
+	const int threads = qMax(1, config_.threads);
+	in_flight_limit_ = qMax(1, config_.concurrency / threads);
+	heartbeat_timer_.setInterval(kHeartbeatTickMs);
+	claim_timer_.setSingleShot(true);
+	claim_timer_.setTimerType(Qt::PreciseTimer);
+
+	bool connection = connect(&heartbeat_timer_, &QTimer::timeout, this, &LoadWorker::OnHeartbeatTimer); Q_ASSERT(connection);
+	connection = connect(&claim_timer_, &QTimer::timeout, this, &LoadWorker::OnClaimTimer); Q_ASSERT(connection);
+}
+
+LoadWorker::~LoadWorker()
+{
+	qDeleteAll(clients_);
+}
+
+int LoadWorker::ConnectedCount() const
+{
+	return connected_count_.loadRelaxed();
+}
+
+int LoadWorker::FailedCount() const
+{
+	return failed_count_.loadRelaxed();
+}
+
+void LoadWorker::Start()
+{
+	clients_.reserve(client_count_);
+	report_.handshake_ns.reserve(client_count_);
+	heartbeat_timer_.start();
+	LaunchMore();
+}
+
+void LoadWorker::Stop(LoadReport& report)
+{
+	heartbeat_timer_.stop();
+	claim_timer_.stop();
+	for (SimClient* client : clients_)
+	{
+		report_.claim_winners += client->won ? 1 : 0;
+		// Обрыв сверх отчета не считается
+		client->socket->disconnect(this);
+		client->socket->abort();
+		delete client->socket;
+		client->socket = nullptr;
+	}
+	qDeleteAll(clients_);
+	clients_.clear();
+	report = report_;
+}
+
+void LoadWorker::LaunchMore()
+{
+	while (in_flight_ < in_flight_limit_ && clients_.size() < client_count_)
+	{
+		const int index = clients_.size();
+		SimClient* client = new SimClient;
+		client->socket = new QTcpSocket(this);
+		clients_.append(client);
+		++in_flight_;
+
+		bool connection = true;
+		connection = connect(client->socket, &QTcpSocket::connected, this, [this, index]() { OnConnected(index); }); Q_ASSERT(connection);
+		connection = connect(client->socket, &QTcpSocket::readyRead, this, [this, index]() { OnReadyRead(index); }); Q_ASSERT(connection);
+		connection = connect(client->socket, &QTcpSocket::errorOccurred, this, [this, index]() { OnError(index); }); Q_ASSERT(connection);
+
+		client->connect_start_ns = MonotonicNs();
+		if (report_.first_connect_ns == 0)
+		{
+			report_.first_connect_ns = client->connect_start_ns;
+		}
+		client->socket->connectToHost(config_.host, config_.port);
+	}
+}
+
+void LoadWorker::OnConnected(int index)
+{
+	// Приветствие - в ответ на вызов сервера
+	SimClient& client = *clients_[index];
+	client.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+	client.user_name = QString::fromUtf8("%1_%2").arg(config_.user_prefix).arg(first_client_ + index);
+}
+
+void LoadWorker::OnReadyRead(int index)
+{
+	SimClient& client = *clients_[index];
+	if (!client.parser.ReadFrom(client.socket))
+	{
+		Drop(client);
+		return;
+	}
+
+	protocol::FrameView frame;
+	FrameParser::Status status = client.parser.Next(frame);
+	while (status == FrameParser::Status::Frame)
+	{
+		if (!HandleFrame(client, frame))
+		{
+			Drop(client);
+			return;
+		}
+		status = client.parser.Next(frame);
+	}
+
+	if (status == FrameParser::Status::Error)
+	{
+		Drop(client);
+	}
+}
+
+bool LoadWorker::HandleFrame(SimClient& client, const protocol::FrameView& frame)
+{
+	switch (frame.type)
+	{
+	case protocol::MessageType::AuthChallenge:
+	{
+		protocol::AuthChallenge challenge;
+		if (!protocol::Decode(frame, challenge) || challenge.server_nonce.isEmpty() || !client.server_nonce.isEmpty())
+		{
+			return false;
+		}
+
+		client.server_nonce = challenge.server_nonce;
+		client.client_nonce = FrameAuthenticator::GenerateNonce();
+
+		protocol::Hello hello;
+		hello.user_name = client.user_name;
+		hello.client_nonce = client.client_nonce;
+		hello.proof = FrameAuthenticator::HelloProof(QByteArray(), client.server_nonce, client.client_nonce, hello.user_name);
+		client.socket->write(protocol::Encode(hello));
+		return true;
+	}
+	case protocol::MessageType::HelloAck:
+	{
+		protocol::HelloAck ack;
+		if (!protocol::Decode(frame, ack) || client.server_nonce.isEmpty())
+		{
+			return false;
+		}
+
+		if (!ack.accepted)
+		{
+			Settle(client, false);
+			return true;
+		}
+
+		const qint64 now_ns = MonotonicNs();
+		report_.handshake_ns.append(now_ns - client.connect_start_ns);
+		report_.last_ready_ns = qMax(report_.last_ready_ns, now_ns);
+		client.ready = true;
+		client.authenticator.SetKey(FrameAuthenticator::DeriveSessionKey(QByteArray(), client.server_nonce, client.client_nonce));
+		client.socket->write(client.authenticator.Sign(protocol::Encode(protocol::SettingsRequest())));
+		Settle(client, true);
+		return true;
+	}
+	case protocol::MessageType::Heartbeat:
+	{
+		protocol::Heartbeat heartbeat;
+		if (!protocol::Decode(frame, heartbeat))
+		{
+			return false;
+		}
+
+		const qint64 elapsed_ns = MonotonicNs() - heartbeat.sent_ns;
+		if (heartbeat.sequence & protocol::kProbeSequenceFlag)
+		{
+			report_.probe_ns.append(elapsed_ns);
+		}
+		else if (heartbeat.sequence == client.heartbeat_sequence)
+		{
+			report_.heartbeat_rtt_ns.append(elapsed_ns);
+		}
+		return true;
+	}
+	case protocol::MessageType::SessionToken:
+	{
+		protocol::SessionToken token;
+		if (!protocol::Decode(frame, token) || token.nonce.isEmpty())
+		{
+			return false;
+		}
+
+		client.authenticator.SetKey(FrameAuthenticator::DeriveSessionKey(QByteArray(), client.server_nonce, client.client_nonce, token.nonce));
+		return true;
+	}
+	case protocol::MessageType::BookingOpen:
+	{
+		protocol::BookingOpen booking_open;
+		if (!protocol::Decode(frame, booking_open))
+		{
+			return false;
+		}
+
+		OnBookingOpen(client, booking_open);
+		return true;
+	}
+	case protocol::MessageType::BookingClaimResult:
+	{
+		protocol::BookingClaimResult result;
+		if (!protocol::Decode(frame, result))
+		{
+			return false;
+		}
+
+		// Ответ на прежнюю заявку после переподключения не ожидается, но и не ошибка
+		if (result.sequence != client.claim_sequence)
+		{
+			return true;
+		}
+
+		const qint64 now_ns = MonotonicNs();
+		report_.claim_ack_ns.append(now_ns - client.claim_sent_ns);
+		report_.last_claim_ack_ns = qMax(report_.last_claim_ack_ns, now_ns);
+		switch (result.outcome)
+		{
+		case protocol::ClaimOutcome::Won:
+			++report_.claims_won;
+			client.won = true;
+			report_.winner_ids.insert(result.winner_id);
+			break;
+		case protocol::ClaimOutcome::Lost:
+			++report_.claims_lost;
+			report_.winner_ids.insert(result.winner_id);
+			break;
+		default:
+			++report_.claims_rejected;
+			break;
+		}
+
+		if (client.claims_left > 0)
+		{
+			SendClaim(client);
+		}
+		return true;
+	}
+	case protocol::MessageType::SettingsResponse:
+	case protocol::MessageType::SettingsDelta:
+	case protocol::MessageType::TimeSyncResponse:
+	case protocol::MessageType::TemplatePackInfo:
+		// Содержимое генератору не нужно
+		return true;
+	default:
+		return false;
+	}
+}
+
+void LoadWorker::OnError(int index)
+{
+	Lose(*clients_[index]);
+}
+
+void LoadWorker::Drop(SimClient& client)
+{
+	// abort не сообщает об ошибке, соединение учитывается здесь
+	client.socket->abort();
+	Lose(client);
+}
+
+void LoadWorker::Lose(SimClient& client)
+{
+	if (!client.settled)
+	{
+		Settle(client, false);
+		return;
+	}
+
+	if (client.ready)
+	{
+		client.ready = false;
+		++report_.disconnected;
+	}
+}
+
+void LoadWorker::Settle(SimClient& client, bool ok)
+{
+	if (client.settled)
+	{
+		return;
+	}
+
+	client.settled = true;
+	--in_flight_;
+	if (ok)
+	{
+		++report_.connected;
+		connected_count_.fetchAndAddRelaxed(1);
+	}
+	else
+	{
+		++report_.failed;
+		failed_count_.fetchAndAddRelaxed(1);
+	}
+	LaunchMore();
+}
+
+void LoadWorker::OnHeartbeatTimer()
+{
+	if (clients_.isEmpty() || config_.heartbeat_interval_ms <= 0)
+	{
+		return;
+	}
+
+	// За heartbeat_interval_ms обходятся все клиенты потока
+	const int ticks = qMax(1, config_.heartbeat_interval_ms / kHeartbeatTickMs);
+	const int batch = (clients_.size() + ticks - 1) / ticks;
+	const qint64 now_ns = MonotonicNs();
+	for (int i = 0; i < batch; ++i)
+	{
+		heartbeat_cursor_ = (heartbeat_cursor_ + 1) % clients_.size();
+		SimClient& client = *clients_[heartbeat_cursor_];
+		if (!client.ready)
+		{
+			continue;
+		}
+
+		protocol::Heartbeat heartbeat;
+		heartbeat.sequence = ++client.heartbeat_sequence;
+		heartbeat.sent_ns = now_ns;
+		client.socket->write(client.authenticator.Sign(protocol::Encode(heartbeat)));
+	}
+}
+
+void LoadWorker::OnBookingOpen(SimClient& client, const protocol::BookingOpen& booking_open)
+{
+	if (config_.claims <= 0)
+	{
+		return;
+	}
+
+	if (!has_booking_open_)
+	{
+		booking_open_ = booking_open;
+		has_booking_open_ = true;
+		claim_timer_.start(static_cast<int>(qBound<qint64>(0, booking_open.open_time_ms - QDateTime::currentMSecsSinceEpoch(),
+			std::numeric_limits<int>::max())));
+	}
+
+	if (booking_open.court_id != booking_open_.court_id || booking_open.open_time_ms != booking_open_.open_time_ms)
+	{
+		return;
+	}
+
+	client.has_booking_open = true;
+	// Клиент, подключившийся после открытия, подает заявки сразу
+	if (claims_started_ && !client.claiming)
+	{
+		client.claiming = true;
+		client.claims_left = config_.claims;
+		SendClaim(client);
+	}
+}
+
+void LoadWorker::OnClaimTimer()
+{
+	// Сервер не учитывает заявки до открытия: таймер, сработавший раньше, перезапускается на остаток
+	const qint64 remaining_ms = booking_open_.open_time_ms - QDateTime::currentMSecsSinceEpoch();
+	if (remaining_ms > 0)
+	{
+		claim_timer_.start(static_cast<int>(qMin<qint64>(remaining_ms, std::numeric_limits<int>::max())));
+		return;
+	}
+
+	claims_started_ = true;
+	for (SimClient* client : clients_)
+	{
+		if (!client->ready || !client->has_booking_open || client->claiming)
+		{
+			continue;
+		}
+
+		client->claiming = true;
+		client->claims_left = config_.claims;
+		SendClaim(*client);
+	}
+}
+
+void LoadWorker::SendClaim(SimClient& client)
+{
+	protocol::BookingClaim claim;
+	claim.sequence = ++client.claim_sequence;
+	claim.court_id = booking_open_.court_id;
+	claim.open_time_ms = booking_open_.open_time_ms;
+
+	--client.claims_left;
+	client.claim_sent_ns = MonotonicNs();
+	if (report_.first_claim_ns == 0)
+	{
+		report_.first_claim_ns = client.claim_sent_ns;
+	}
+	client.socket->write(client.authenticator.Sign(protocol::Encode(claim)));
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+#include "frame_auth.h"
+#include "frame_parser.h"
+#include "protocol.h"
+
+class QTcpSocket;
+
+struct LoadConfig
+{
+	QString host = QString::fromUtf8("127.0.0.1");
+	quint16 port = 0;
+	int clients = 10000;
+	int threads = 0;
+	// Одновременно устанавливаемых соединений на все потоки: очередь SYN на сервере не бесконечна
+	int concurrency = 512;
+	int heartbeat_interval_ms = 5000;
+	// Сколько держать нагрузку после подключения всех клиентов
+	int hold_ms = 30000;
+	int connect_timeout_ms = 120000;
+	qint64 server_pid = 0;
+	QString user_prefix = QString::fromUtf8("load");
+	// Заявок на объявленный слот от каждого клиента: следующая - после ответа на предыдущую. 0 - без заявок
+	int claims = 0;
+};
+
+// Итог потока генератора. Задержки - монотонные часы, нс
+struct LoadReport
+{
+	int connected = 0;
+	int failed = 0;
+	int disconnected = 0;
+	qint64 first_connect_ns = 0;
+	qint64 last_ready_ns = 0;
+	QVector<qint64> handshake_ns;
+	QVector<qint64> heartbeat_rtt_ns;
+	// От постановки замерной рассылки в очередь на сервере до разбора кадра клиентом
+	QVector<qint64> probe_ns;
+	// Заявки на слот: от отправки до ответа сервера
+	QVector<qint64> claim_ack_ns;
+	int claims_won = 0;
+	int claims_lost = 0;
+	int claims_rejected = 0;
+	// Клиенты, получившие Won, и победители, названные в ответах: при верном разборе оба - один клиент
+	int claim_winners = 0;
+	QSet<quint32> winner_ids;
+	qint64 first_claim_ns = 0;
+	qint64 last_claim_ack_ns = 0;
+
+	void Merge(const LoadReport& other);
+};
+
+// Часть имитируемых клиентов в своем потоке со своим циклом событий:
+// подключение, приветствие, запрос настроек, heartbeat, прием рассылок
+class LoadWorker final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	LoadWorker(int index, int first_client, int client_count, const LoadConfig& config, QObject* parent = nullptr);
+	~LoadWorker() override;
+
+	// Читаются из главного потока для вывода хода подключения
+	int ConnectedCount() const;
+	int FailedCount() const;
+
+	// Вызываются в потоке обработчика
+	void Start();
+	void Stop(LoadReport& report);
+
+private Q_SLOTS:
+
+	void OnHeartbeatTimer();
+
+	// Момент открытия записи: заявки от всех готовых клиентов
+	void OnClaimTimer();
+
+private:
+	struct SimClient
+	{
+		QTcpSocket* socket = nullptr;
+		FrameParser parser;
+		// Кадры после приветствия подписываются ключом сессии, как у настоящего клиента. Ключ пользователя пустой:
+		// генератор работает с сервером без реестра или с пользователями без ключа
+		FrameAuthenticator authenticator;
+		QString user_name;
+		QByteArray server_nonce;
+		QByteArray client_nonce;
+		qint64 connect_start_ns = 0;
+		bool ready = false;
+		bool settled = false; // подключение завершилось успехом или ошибкой
+		quint64 heartbeat_sequence = 0;
+		bool has_booking_open = false;
+		bool claiming = false;
+		int claims_left = 0;
+		quint64 claim_sequence = 0;
+		qint64 claim_sent_ns = 0;
+		bool won = false;
+	};
+
+	// Запускает подключения, пока их в полете меньше предела
+	void LaunchMore();
+
+	void OnConnected(int index);
+	void OnReadyRead(int index);
+	void OnError(int index);
+
+	bool HandleFrame(SimClient& client, const protocol::FrameView& frame);
+
+	void OnBookingOpen(SimClient& client, const protocol::BookingOpen& booking_open);
+
+	void SendClaim(SimClient& client);
+
+	// Нарушение протокола: разрыв со своей стороны
+	void Drop(SimClient& client);
+
+	// Соединение потеряно: до приветствия - неудачное подключение, после - обрыв
+	void Lose(SimClient& client);
+
+	// Подключение завершено: освобождает место для следующего
+	void Settle(SimClient& client, bool ok);
+
+private:
+	int index_ = 0;
+	int first_client_ = 0;
+	int client_count_ = 0;
+	LoadConfig config_;
+	int in_flight_limit_ = 1;
+
+	QVector<SimClient*> clients_;
+	int in_flight_ = 0;
+	int heartbeat_cursor_ = 0;
+	QTimer heartbeat_timer_;
+
+	// Слот, на который подаются заявки: первое объявление, полученное потоком
+	protocol::BookingOpen booking_open_;
+	bool has_booking_open_ = false;
+	bool claims_started_ = false;
+	QTimer claim_timer_;
+
+	QAtomicInt connected_count_;
+	QAtomicInt failed_count_;
+	LoadReport report_;
+};
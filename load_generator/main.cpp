@@ -0,0 +1,23 @@
+#include <QCoreApplication>
+#include <QTimer>
+
+#include "load_generator.h"
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	app.setOrganizationName(QString::fromUtf8("Ssipta"));
+	app.setApplicationName(QString::fromUtf8("book_tennis_load_generator"));
+
+	LoadGenerator generator;
+	int exit_code = LoadGenerator::Succeed;
+	if (!generator.ParseArguments(app, exit_code))
+	{
+		return exit_code;
+	}
+
+	bool connection = QObject::connect(&generator, &LoadGenerator::Finished, &app, &QCoreApplication::exit); Q_ASSERT(connection);
+	QTimer::singleShot(0, &generator, &LoadGenerator::Start);
+	return app.exec();
+}
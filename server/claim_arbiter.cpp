@@ -0,0 +1,72 @@
+#include "claim_arbiter.h"
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+}
+
+quint32 ClaimArbiter::ClaimantId(const QString& user_name)
+{
+	const QByteArray digest = QCryptographicHash::hash(user_name.toUtf8(), QCryptographicHash::Sha256);
+	const quint32 id = qFromBigEndian<quint32>(digest.constData());
+	// 0 в состоянии слота - победителя еще нет
+	return id != 0 ? id : 1;
+}
+
+ClaimArbiter::Shard& ClaimArbiter::ShardFor(quint32 court_id)
+{
+	return shards_[qHash(court_id) % kShardCount];
+}
+
+void ClaimArbiter::OpenSlot(const protocol::BookingOpen& booking_open)
+{
+	Shard& shard = ShardFor(booking_open.court_id);
+	QWriteLocker locker(&shard.lock);
+	QSharedPointer<Slot>& slot = shard.slots[booking_open.court_id];
+
+	// Повторное объявление того же времени не сбрасывает уже разобранные заявки
+	if (slot && slot->open_time_ms == booking_open.open_time_ms)
+	{
+		return;
+	}
+
+	slot.reset(new Slot);
+	slot->open_time_ms = booking_open.open_time_ms;
+}
+
+ClaimArbiter::Decision ClaimArbiter::Claim(quint32 court_id, qint64 open_time_ms, quint32 claimant_id, qint64 arrival_ns)
+{
+	Decision decision;
+	Shard& shard = ShardFor(court_id);
+	QReadLocker locker(&shard.lock);
+	const auto it = shard.slots.constFind(court_id);
+	if (it == shard.slots.cend() || (*it)->open_time_ms != open_time_ms)
+	{
+		return decision;
+	}
+
+	if (arrival_ns < open_time_ms * kNsInMs)
+	{
+		decision.outcome = protocol::ClaimOutcome::TooEarly;
+		return decision;
+	}
+
+	// Порядок заявок - порядок успешных обменов над состоянием слота
+	Slot& slot = **it;
+	quint64 state = slot.state.loadAcquire();
+	quint64 next = 0;
+	do
+	{
+		const quint32 winner = static_cast<quint32>(state);
+		const quint32 claim_number = static_cast<quint32>(state >> 32) + 1;
+		next = (quint64(claim_number) << 32) | (winner != 0 ? winner : claimant_id);
+	} while (!slot.state.testAndSetOrdered(state, next, state));
+
+	decision.claim_number = static_cast<quint32>(next >> 32);
+	decision.winner_id = static_cast<quint32>(next);
+	decision.outcome = decision.winner_id == claimant_id ? protocol::ClaimOutcome::Won : protocol::ClaimOutcome::Lost;
+	return decision;
+}
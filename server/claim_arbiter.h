@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+
+#include "protocol.h"
+
+// Разбор заявок на слоты в момент открытия записи: слот получает первая дошедшая заявка.
+// Общий для всех потоков-обработчиков. Слоты разложены по сегментам по номеру корта, сегмент блокируется
+// на чтение; сама заявка - одна атомарная операция над состоянием слота, потоки не ждут друг друга
+class ClaimArbiter final
+{
+public:
+	struct Decision
+	{
+		protocol::ClaimOutcome outcome = protocol::ClaimOutcome::NotOpen;
+		quint32 claim_number = 0;
+		quint32 winner_id = 0;
+	};
+
+	// Участник разбора - пользователь, а не соединение: переподключение или второе соединение того же
+	// пользователя не дает второго шанса и не отбирает выигранный слот. Не 0
+	static quint32 ClaimantId(const QString& user_name);
+
+	// Слот корта с новым временем открытия заменяет прежний вместе с его результатом
+	void OpenSlot(const protocol::BookingOpen& booking_open);
+
+	// arrival_ns - отметка прихода заявки, UTC, нс от эпохи. claimant_id - ClaimantId пользователя.
+	// claim_number - порядковый номер заявки среди всех учтенных на слот, повторные заявки тоже учитываются
+	Decision Claim(quint32 court_id, qint64 open_time_ms, quint32 claimant_id, qint64 arrival_ns);
+
+private:
+	struct Slot
+	{
+		qint64 open_time_ms = 0;
+		// Старшие 32 бита - число учтенных заявок, младшие - участник первой: номер и победитель меняются вместе
+		QAtomicInteger<quint64> state;
+	};
+
+	// Выровнены по строке кэша: заявки на разные корты не мешают друг другу
+	struct alignas(64) Shard
+	{
+		QReadWriteLock lock;
+		QHash<quint32, QSharedPointer<Slot>> slots;
+	};
+
+	static const int kShardCount = 64;
+
+	Shard& ShardFor(quint32 court_id);
+
+private:
+	Shard shards_[kShardCount];
+};
@@ -0,0 +1,555 @@
+#include "client_session.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QTcpSocket>
+
+#include "claim_arbiter.h"
+#include "monotonic_clock.h"
+#include "shared_settings.h"
+#include "user_registry.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Ключ сессии живет 10 минут, на середине срока выдается новый
+	const quint32 kTokenLifetimeMs = 10 * 60 * 1000;
+	const qint64 kNsInMs = 1000000;
+
+	// Соединение без приветствия дольше этого закрывается
+	const int kHelloTimeoutMs = 10 * 1000;
+
+	// Буфер записи сокета держится небольшим, остальное ждет в очереди соединения, где его можно вытеснить
+	const qint64 kSocketBufferLimit = 64 * 1024;
+
+	// Выше верхней отметки дольше kSlowClientGraceMs - клиент отключается; выше предела - сразу.
+	// Память на соединение ограничена пределом при любом числе медленных клиентов
+	const qint64 kHighWatermarkBytes = 256 * 1024;
+	const qint64 kLowWatermarkBytes = 64 * 1024;
+	const qint64 kHardLimitBytes = 1024 * 1024;
+	const qint64 kSlowClientGraceMs = 5000;
+
+	OutboundQueue::Coalesce CoalesceKey(const QByteArray& frame)
+	{
+		if (frame.size() < protocol::kHeaderSize)
+		{
+			return OutboundQueue::Coalesce::None;
+		}
+
+		switch (static_cast<protocol::MessageType>(frame.at(4)))
+		{
+		case protocol::MessageType::BookingOpen:
+			return OutboundQueue::Coalesce::BookingOpen;
+		case protocol::MessageType::SettingsResponse:
+		case protocol::MessageType::SettingsDelta:
+			return OutboundQueue::Coalesce::Settings;
+		case protocol::MessageType::SessionToken:
+			// Не вытесняется: клиент переходит на каждый ключ по очереди, а сервер помнит только предыдущий
+			return OutboundQueue::Coalesce::None;
+		case protocol::MessageType::TemplatePackInfo:
+			return OutboundQueue::Coalesce::TemplatePack;
+		case protocol::MessageType::Heartbeat:
+			// Старший бит номера - первый байт нагрузки
+			return frame.size() > protocol::kHeaderSize && (static_cast<uchar>(frame.at(protocol::kHeaderSize)) & 0x80)
+				? OutboundQueue::Coalesce::Probe
+				: OutboundQueue::Coalesce::None;
+		default:
+			return OutboundQueue::Coalesce::None;
+		}
+	}
+}
+
+ClientSession::ClientSession(QTcpSocket* socket, quint32 client_id, const QSharedPointer<SharedSettings>& settings,
+	const QSharedPointer<UserRegistry>& registry, const QSharedPointer<ServerMetrics>& metrics,
+	const QSharedPointer<ClaimArbiter>& arbiter, int worker_index, QObject* parent)
+	: QObject(parent)
+	, socket_(socket)
+	, client_id_(client_id)
+	, settings_(settings)
+	, registry_(registry)
+	, metrics_(metrics)
+	, arbiter_(arbiter)
+	, worker_metrics_(metrics->ForWorker(worker_index))
+{
+	socket_->setParent(this);
+	// Рассылки - мелкие кадры, которые должны уйти сразу, а не ждать алгоритма Нейгла
+	socket_->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+	bool connection = connect(socket_, &QTcpSocket::readyRead, this, &ClientSession::OnReadyRead); Q_ASSERT(connection);
+	connection = connect(socket_, &QTcpSocket::bytesWritten, this, &ClientSession::OnBytesWritten); Q_ASSERT(connection);
+	connection = connect(socket_, &QTcpSocket::disconnected, this, [this]() { emit Closed(client_id_); }); Q_ASSERT(connection);
+
+	deadline_timer_.setSingleShot(true);
+	connection = connect(&deadline_timer_, &QTimer::timeout, this, &ClientSession::OnDeadlineTimer); Q_ASSERT(connection);
+	deadline_timer_.start(kHelloTimeoutMs);
+
+	// Пока в реестре нет пользователей, сервер принимает всех. Реестр, который не удалось прочитать, не пускает никого
+	registered_ = !registry_->IsOpen() || registry_->Count() > 0;
+	protocol::AuthChallenge challenge;
+	challenge.server_nonce = FrameAuthenticator::GenerateNonce();
+	challenge.registered = registered_;
+	server_nonce_ = challenge.server_nonce;
+	Send(protocol::Encode(challenge));
+}
+
+ClientSession::~ClientSession() = default;
+
+quint32 ClientSession::ClientId() const
+{
+	return client_id_;
+}
+
+bool ClientSession::IsAuthenticated() const
+{
+	return authenticated_;
+}
+
+void ClientSession::Send(const QByteArray& frame)
+{
+	Enqueue(frame);
+}
+
+void ClientSession::SendNow(const QByteArray& frame)
+{
+	Enqueue(frame);
+	socket_->flush();
+}
+
+qint64 ClientSession::PendingWriteBytes() const
+{
+	return socket_->bytesToWrite() + outbound_.Bytes();
+}
+
+void ClientSession::Enqueue(const QByteArray& frame)
+{
+	if (evicting_)
+	{
+		return;
+	}
+
+	// Быстрый путь: очередь пуста и сокет успевает - кадр сразу в сокет, без очереди
+	if (outbound_.IsEmpty() && socket_->bytesToWrite() < kSocketBufferLimit)
+	{
+		worker_metrics_.bytes_out.fetchAndAddRelaxed(static_cast<quint64>(frame.size()));
+		socket_->write(frame);
+		return;
+	}
+
+	const OutboundQueue::Coalesce key = CoalesceKey(frame);
+	if (outbound_.Push(frame, key))
+	{
+		worker_metrics_.coalesced_frames.fetchAndAddRelaxed(1);
+
+		// Вытесненное изменение настроек нельзя просто выбросить: вместо цепочки изменений - полный снимок
+		if (key == OutboundQueue::Coalesce::Settings)
+		{
+			outbound_.Push(protocol::Encode(BuildSettings(QVector<QString>())), key);
+		}
+	}
+	CheckBackpressure();
+}
+
+void ClientSession::Pump()
+{
+	while (!outbound_.IsEmpty() && socket_->bytesToWrite() < kSocketBufferLimit)
+	{
+		const QByteArray frame = outbound_.Pop();
+		worker_metrics_.bytes_out.fetchAndAddRelaxed(static_cast<quint64>(frame.size()));
+		socket_->write(frame);
+	}
+}
+
+void ClientSession::OnBytesWritten()
+{
+	Pump();
+	CheckBackpressure();
+}
+
+void ClientSession::OnDeadlineTimer()
+{
+	if (closing_ || evicting_)
+	{
+		return;
+	}
+
+	if (!authenticated_)
+	{
+		worker_metrics_.auth_failures.fetchAndAddRelaxed(1);
+		Drop(QString::fromUtf8("no hello in %1 ms").arg(kHelloTimeoutMs));
+		return;
+	}
+
+	// Грубый таймер может сработать немного раньше срока
+	const qint64 left_ns = token_deadline_ns_ - MonotonicNs();
+	if (left_ns > 0)
+	{
+		deadline_timer_.start(static_cast<int>((left_ns + kNsInMs - 1) / kNsInMs));
+		return;
+	}
+	Reject(QString::fromUtf8("session key expired"));
+}
+
+void ClientSession::CheckBackpressure()
+{
+	if (evicting_)
+	{
+		return;
+	}
+
+	const qint64 pending = PendingWriteBytes();
+	if (pending > kHardLimitBytes)
+	{
+		ScheduleEviction(QString::fromUtf8("write queue over the limit : %1 bytes").arg(pending));
+		return;
+	}
+
+	if (pending <= kLowWatermarkBytes)
+	{
+		over_watermark_since_ns_ = 0;
+		return;
+	}
+
+	if (pending <= kHighWatermarkBytes)
+	{
+		return;
+	}
+
+	const qint64 now_ns = MonotonicNs();
+	if (over_watermark_since_ns_ == 0)
+	{
+		over_watermark_since_ns_ = now_ns;
+	}
+	else if (now_ns - over_watermark_since_ns_ > kSlowClientGraceMs * kNsInMs)
+	{
+		ScheduleEviction(QString::fromUtf8("slow client, %1 bytes pending").arg(pending));
+	}
+}
+
+void ClientSession::ScheduleEviction(const QString& reason)
+{
+	evicting_ = true;
+	outbound_.Clear();
+	worker_metrics_.evicted_clients.fetchAndAddRelaxed(1);
+	QMetaObject::invokeMethod(this, [this, reason]() { Drop(reason); }, Qt::QueuedConnection);
+}
+
+void ClientSession::OnReadyRead()
+{
+	// Отметка прихода для синхронизации часов и заявок - до разбора, как можно ближе к получению
+	receive_ns_ = WallClockNs();
+	receive_monotonic_ns_ = MonotonicNs();
+
+	worker_metrics_.bytes_in.fetchAndAddRelaxed(static_cast<quint64>(qMax<qint64>(socket_->bytesAvailable(), 0)));
+	if (!parser_.ReadFrom(socket_))
+	{
+		worker_metrics_.parse_errors.fetchAndAddRelaxed(1);
+		Drop(parser_.ErrorString());
+		return;
+	}
+
+	// За одно чтение может прийти несколько кадров или часть кадра
+	protocol::FrameView frame;
+	FrameParser::Status status = parser_.Next(frame);
+	while (status == FrameParser::Status::Frame)
+	{
+		const qint64 frame_start_ns = MonotonicNs();
+		worker_metrics_.frames_in.fetchAndAddRelaxed(1);
+		if (!Authenticate(frame))
+		{
+			worker_metrics_.auth_failures.fetchAndAddRelaxed(1);
+			Drop(QString::fromUtf8("Bad signature of %1 message").arg(QString::fromLatin1(protocol::TypeName(frame.type))));
+			return;
+		}
+
+		if (!HandleFrame(frame))
+		{
+			worker_metrics_.parse_errors.fetchAndAddRelaxed(1);
+			Drop(QString::fromUtf8("Malformed %1 message").arg(QString::fromLatin1(protocol::TypeName(frame.type))));
+			return;
+		}
+		metrics_->RecordMessage(frame.type, MonotonicNs() - frame_start_ns);
+		status = parser_.Next(frame);
+	}
+
+	if (status == FrameParser::Status::Error)
+	{
+		worker_metrics_.parse_errors.fetchAndAddRelaxed(1);
+		Drop(parser_.ErrorString());
+	}
+}
+
+bool ClientSession::FindAllowedUser(const QString& user_name, UserRecord& user) const
+{
+	return registry_->Find(user_name, user) && user.IsLicensed(QDateTime::currentMSecsSinceEpoch());
+}
+
+void ClientSession::Reject(const QString& reason)
+{
+	qWarning() << QString::fromUtf8("Client rejected : ") << client_id_ << user_name_ << reason;
+	worker_metrics_.auth_failures.fetchAndAddRelaxed(1);
+	authenticated_ = false;
+	closing_ = true;
+	deadline_timer_.stop();
+
+	protocol::HelloAck ack;
+	ack.accepted = false;
+	ack.client_id = client_id_;
+
+	// Мимо очереди: после закрытия очередь уже не разбирается
+	outbound_.Clear();
+	socket_->write(protocol::Encode(ack));
+
+	// Отказ уходит клиенту, затем соединение закрывается (Closed придет по disconnected)
+	socket_->disconnectFromHost();
+}
+
+bool ClientSession::Authenticate(protocol::FrameView& frame)
+{
+	// Кадры после отказа не разбираются
+	if (closing_)
+	{
+		return true;
+	}
+
+	// Приветствие не подписано: ключа еще нет
+	if (!authenticated_)
+	{
+		return !(frame.flags & protocol::kFlagAuthenticated);
+	}
+	return authenticator_.Verify(frame);
+}
+
+void ClientSession::SetSessionKey(const QByteArray& token_nonce)
+{
+	authenticator_.SetKey(FrameAuthenticator::DeriveSessionKey(user_key_, server_nonce_, client_nonce_, token_nonce));
+	const qint64 now_ns = MonotonicNs();
+	renew_after_ns_ = now_ns + kTokenLifetimeMs / 2 * kNsInMs;
+	token_deadline_ns_ = now_ns + kTokenLifetimeMs * kNsInMs;
+	deadline_timer_.start(static_cast<int>(kTokenLifetimeMs));
+}
+
+void ClientSession::RenewSessionKey()
+{
+	// Смена ключа пользователя в реестре тоже завершает сессию
+	UserRecord user;
+	if (registered_ && (!FindAllowedUser(user_name_, user) || !ConstantTimeEquals(user.key, user_key_)))
+	{
+		Reject(QString::fromUtf8("user is disabled, license expired or key changed"));
+		return;
+	}
+
+	protocol::SessionToken token;
+	token.nonce = FrameAuthenticator::GenerateNonce();
+	token.token_lifetime_ms = kTokenLifetimeMs;
+	SetSessionKey(token.nonce);
+	Send(protocol::Encode(token));
+}
+
+bool ClientSession::HandleFrame(const protocol::FrameView& frame)
+{
+	if (closing_)
+	{
+		return true;
+	}
+
+	// До приветствия принимается только оно
+	if (!authenticated_ && frame.type != protocol::MessageType::Hello)
+	{
+		return false;
+	}
+
+	// Пользователя могли отключить или лицензия могла закончиться: проверка по реестру при продлении ключа.
+	// Клиент без сообщений дольше срока ключа отключается
+	if (authenticated_)
+	{
+		const qint64 now_ns = MonotonicNs();
+		if (now_ns >= token_deadline_ns_)
+		{
+			Reject(QString::fromUtf8("session key expired"));
+			return true;
+		}
+
+		if (now_ns >= renew_after_ns_)
+		{
+			RenewSessionKey();
+			if (closing_)
+			{
+				return true;
+			}
+		}
+	}
+
+	switch (frame.type)
+	{
+	case protocol::MessageType::Hello:
+	{
+		// Повторное приветствие в той же сессии - нарушение протокола. nonce клиента - той же длины, что и вызов
+		protocol::Hello hello;
+		if (authenticated_ || !protocol::Decode(frame, hello) || hello.client_nonce.size() != server_nonce_.size())
+		{
+			return false;
+		}
+
+		user_name_ = hello.user_name;
+		client_nonce_ = hello.client_nonce;
+
+		// Клиент доказывает знание ключа пользователя ответом на вызов этого соединения
+		UserRecord user;
+		if (registered_ && (!FindAllowedUser(hello.user_name, user)
+			|| !ConstantTimeEquals(hello.proof, FrameAuthenticator::HelloProof(user.key, server_nonce_, client_nonce_, user_name_))))
+		{
+			Reject(QString::fromUtf8("unknown user, wrong key or no license"));
+			return true;
+		}
+
+		user_key_ = user.key;
+		user_settings_ = user.settings;
+		claimant_id_ = ClaimArbiter::ClaimantId(user_name_);
+		authenticated_ = true;
+		qDebug() << QString::fromUtf8("Client hello : ") << client_id_ << user_name_;
+
+		protocol::HelloAck ack;
+		ack.accepted = true;
+		ack.client_id = client_id_;
+		ack.token_lifetime_ms = kTokenLifetimeMs;
+		SetSessionKey(QByteArray());
+		Send(protocol::Encode(ack));
+
+		// Время открытия записи, если уже известно, клиент получает сразу
+		protocol::BookingOpen booking_open;
+		if (settings_->CurrentBookingOpen(booking_open))
+		{
+			Send(protocol::Encode(booking_open));
+		}
+
+		protocol::TemplatePackInfo template_pack;
+		if (settings_->CurrentTemplatePack(template_pack))
+		{
+			Send(protocol::Encode(template_pack));
+		}
+		return true;
+	}
+	case protocol::MessageType::TemplatePackRequest:
+	{
+		protocol::TemplatePackRequest request;
+		if (!protocol::Decode(frame, request))
+		{
+			return false;
+		}
+
+		// Следующий кусок клиент запрашивает после прихода предыдущего: в очереди соединения не больше одного
+		protocol::TemplatePackChunk chunk;
+		if (settings_->TemplatePackChunk(request.version, request.offset, chunk))
+		{
+			Send(protocol::Encode(chunk));
+			return true;
+		}
+
+		// Пакет сменился во время загрузки: клиент начинает заново с текущей версии
+		protocol::TemplatePackInfo template_pack;
+		if (!settings_->CurrentTemplatePack(template_pack))
+		{
+			return false;
+		}
+		Send(protocol::Encode(template_pack));
+		return true;
+	}
+	case protocol::MessageType::SettingsRequest:
+	{
+		protocol::SettingsRequest request;
+		if (!protocol::Decode(frame, request))
+		{
+			return false;
+		}
+
+		Send(protocol::Encode(BuildSettings(request.keys)));
+		return true;
+	}
+	case protocol::MessageType::Heartbeat:
+	{
+		protocol::Heartbeat heartbeat;
+		if (!protocol::Decode(frame, heartbeat))
+		{
+			return false;
+		}
+
+		Send(protocol::Encode(heartbeat));
+		return true;
+	}
+	case protocol::MessageType::TimeSyncRequest:
+	{
+		protocol::TimeSyncRequest request;
+		if (!protocol::Decode(frame, request))
+		{
+			return false;
+		}
+
+		protocol::TimeSyncResponse response;
+		response.sequence = request.sequence;
+		response.client_send_ns = request.client_send_ns;
+		response.server_receive_ns = receive_ns_;
+		response.server_send_ns = WallClockNs();
+		SendNow(protocol::Encode(response));
+		return true;
+	}
+	case protocol::MessageType::BookingClaim:
+	{
+		protocol::BookingClaim claim;
+		if (!protocol::Decode(frame, claim))
+		{
+			return false;
+		}
+
+		const ClaimArbiter::Decision decision = arbiter_->Claim(claim.court_id, claim.open_time_ms, claimant_id_, receive_ns_);
+		protocol::BookingClaimResult result;
+		result.sequence = claim.sequence;
+		result.court_id = claim.court_id;
+		result.open_time_ms = claim.open_time_ms;
+		result.outcome = decision.outcome;
+		result.claim_number = decision.claim_number;
+		result.winner_id = decision.winner_id;
+		result.server_receive_ns = receive_ns_;
+
+		// Ответ сразу отдается ядру: задержка подтверждения - разбор и одна атомарная операция
+		SendNow(protocol::Encode(result));
+		metrics_->RecordClaim(decision.outcome, MonotonicNs() - receive_monotonic_ns_);
+		return true;
+	}
+	default:
+		// Сообщения сервера клиенту и неизвестные типы
+		return false;
+	}
+}
+
+protocol::SettingsResponse ClientSession::BuildSettings(const QVector<QString>& keys) const
+{
+	// Собственные настройки пользователя важнее общих
+	protocol::SettingsResponse response = settings_->Snapshot(keys);
+	for (auto it = user_settings_.cbegin(); it != user_settings_.cend(); ++it)
+	{
+		if (!keys.isEmpty() && !keys.contains(it.key()))
+		{
+			continue;
+		}
+
+		auto value = std::find_if(response.values.begin(), response.values.end(),
+			[&it](const QPair<QString, QString>& item) { return item.first == it.key(); });
+		if (value != response.values.end())
+		{
+			value->second = it.value();
+		}
+		else
+		{
+			response.values.append(qMakePair(it.key(), it.value()));
+		}
+	}
+	return response;
+}
+
+void ClientSession::Drop(const QString& reason)
+{
+	qWarning() << QString::fromUtf8("Client dropped : ") << client_id_ << reason;
+	deadline_timer_.stop();
+	socket_->abort();
+	emit Closed(client_id_);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <QMap>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include "frame_auth.h"
+#include "frame_parser.h"
+#include "outbound_queue.h"
+#include "server_metrics.h"
+
+class ClaimArbiter;
+class QTcpSocket;
+class SharedSettings;
+class UserRegistry;
+struct UserRecord;
+
+// Одно соединение с клиентом: разбор входящих кадров и ответы на них
+class ClientSession final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	// Сессия становится владельцем сокета. worker_index - обработчик, в чьи метрики пишет сессия
+	ClientSession(QTcpSocket* socket, quint32 client_id, const QSharedPointer<SharedSettings>& settings,
+		const QSharedPointer<UserRegistry>& registry, const QSharedPointer<ServerMetrics>& metrics,
+		const QSharedPointer<ClaimArbiter>& arbiter, int worker_index, QObject* parent = nullptr);
+	~ClientSession() override;
+
+	quint32 ClientId() const;
+
+	// Только приветствовавшие клиенты получают рассылки
+	bool IsAuthenticated() const;
+
+	// frame - общий QByteArray: до записи в сокет он не копируется, QIODevice::write копирует его
+	// в буфер записи этого сокета. Если сокет не успевает отдавать данные, кадр ждет в ограниченной очереди соединения
+	void Send(const QByteArray& frame);
+
+	// То же и сразу отдать данные ядру, не дожидаясь цикла событий (для рассылок)
+	void SendNow(const QByteArray& frame);
+
+	// Данные в буфере записи сокета и в очереди соединения, еще не переданные ядру
+	qint64 PendingWriteBytes() const;
+
+	// Отключает клиента, который дольше допустимого не разбирает свою очередь. Вызывается периодически:
+	// зависший клиент не читает, и событий записи от него нет
+	void CheckBackpressure();
+
+Q_SIGNALS:
+
+	// Соединение закрыто клиентом или разорвано сервером
+	void Closed(quint32 client_id);
+
+private Q_SLOTS:
+
+	void OnReadyRead();
+
+	// Сокет передал данные ядру: место в буфере сокета для следующих кадров очереди
+	void OnBytesWritten();
+
+	// Клиент не поздоровался вовремя или ключ сессии истек без продления
+	void OnDeadlineTimer();
+
+private:
+	// После приветствия - проверка и снятие подписи кадра. false - соединение закрывается
+	bool Authenticate(protocol::FrameView& frame);
+
+	// false - нарушение протокола, соединение закрывается
+	bool HandleFrame(const protocol::FrameView& frame);
+
+	// Ключ сессии из ключа пользователя и nonce соединения, срок отсчитывается заново.
+	// token_nonce - из SessionToken при продлении, пустой для первого ключа
+	void SetSessionKey(const QByteArray& token_nonce);
+
+	// Повторная проверка по реестру и новый ключ взамен истекающего
+	void RenewSessionKey();
+
+	void Drop(const QString& reason);
+
+	// Пользователь есть в реестре, включен и с действующей лицензией.
+	// Дорогая проверка: только при приветствии и продлении ключа сессии, не на каждом сообщении
+	bool FindAllowedUser(const QString& user_name, UserRecord& user) const;
+
+	// Отказ в HelloAck и закрытие соединения
+	void Reject(const QString& reason);
+
+	// Настройки для клиента: общие и поверх них собственные пользователя. Пустой список - все
+	protocol::SettingsResponse BuildSettings(const QVector<QString>& keys) const;
+
+	void Enqueue(const QByteArray& frame);
+
+	// Перекладывает кадры из очереди в сокет, пока буфер сокета не заполнен
+	void Pump();
+
+	// Отключение вне текущего обработчика: сессия может быть в обходе обработчика
+	void ScheduleEviction(const QString& reason);
+
+private:
+	QTcpSocket* socket_ = nullptr;
+	FrameParser parser_;
+	quint32 client_id_ = 0;
+	bool authenticated_ = false;
+	bool closing_ = false;
+	// Отметки прихода последнего чтения: настенные часы для клиента, монотонные для метрик
+	qint64 receive_ns_ = 0;
+	qint64 receive_monotonic_ns_ = 0;
+	// Клиент проверяется по реестру (реестр не был пуст при подключении)
+	bool registered_ = false;
+	QString user_name_;
+	// Участник разбора заявок: ClaimArbiter::ClaimantId имени, вычисляется один раз при приветствии
+	quint32 claimant_id_ = 0;
+	// Ключ пользователя из реестра (пустой без реестра) и nonce соединения: из них выводятся ключи сессии
+	QByteArray user_key_;
+	QByteArray server_nonce_;
+	QByteArray client_nonce_;
+	// Ключ сессии и сроки по монотонным часам: на каждом сообщении только сравнение чисел и HMAC
+	FrameAuthenticator authenticator_;
+	qint64 renew_after_ns_ = 0;
+	qint64 token_deadline_ns_ = 0;
+	// Срок приветствия, после него - срок ключа: молчащий клиент отключается, не дожидаясь своего кадра
+	QTimer deadline_timer_;
+	QMap<QString, QString> user_settings_;
+	QSharedPointer<SharedSettings> settings_;
+	QSharedPointer<UserRegistry> registry_;
+	QSharedPointer<ServerMetrics> metrics_;
+	QSharedPointer<ClaimArbiter> arbiter_;
+	ServerMetrics::Worker& worker_metrics_;
+	OutboundQueue outbound_;
+	// Момент, с которого клиент непрерывно выше верхней отметки; 0 - ниже
+	qint64 over_watermark_since_ns_ = 0;
+	bool evicting_ = false;
+};
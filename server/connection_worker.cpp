@@ -0,0 +1,119 @@
+#include "connection_worker.h"
+
+#include <QDebug>
+#include <QTcpSocket>
+
+#include "client_session.h"
+#include "monotonic_clock.h"
+#include "server_metrics.h"
+
+namespace
+{
+	const int kQueueSampleIntervalMs = 1000;
+}
+
+ConnectionWorker::ConnectionWorker(int index, const QSharedPointer<SharedSettings>& settings,
+	const QSharedPointer<UserRegistry>& registry, const QSharedPointer<ServerMetrics>& metrics,
+	const QSharedPointer<ClaimArbiter>& arbiter, QObject* parent)
+	: QObject(parent)
+	, index_(index)
+	, settings_(settings)
+	, registry_(registry)
+	, metrics_(metrics)
+	, arbiter_(arbiter)
+	// С родителем: таймер переносится в поток вместе с обработчиком
+	, queue_sample_timer_(this)
+{
+	bool connection = connect(&queue_sample_timer_, &QTimer::timeout, this, &ConnectionWorker::OnQueueSampleTimer); Q_ASSERT(connection);
+}
+
+// Сессии - дочерние объекты и удаляются вместе с обработчиком в его потоке
+ConnectionWorker::~ConnectionWorker() = default;
+
+int ConnectionWorker::Index() const
+{
+	return index_;
+}
+
+int ConnectionWorker::ConnectionCount() const
+{
+	return connection_count_.loadRelaxed();
+}
+
+void ConnectionWorker::ReserveConnection()
+{
+	connection_count_.fetchAndAddRelaxed(1);
+}
+
+void ConnectionWorker::AddConnection(qintptr socket_descriptor, quint32 client_id)
+{
+	QTcpSocket* socket = new QTcpSocket;
+	if (!socket->setSocketDescriptor(socket_descriptor))
+	{
+		qWarning() << QString::fromUtf8("Unable to accept the connection : ") << socket->errorString();
+		delete socket;
+		connection_count_.fetchAndSubRelaxed(1);
+		return;
+	}
+
+	ClientSession* session = new ClientSession(socket, client_id, settings_, registry_, metrics_, arbiter_, index_, this);
+	sessions_.insert(client_id, session);
+	metrics_->ForWorker(index_).connections.storeRelaxed(sessions_.size());
+
+	// Таймер запускается в потоке обработчика при первом соединении
+	if (!queue_sample_timer_.isActive())
+	{
+		queue_sample_timer_.start(kQueueSampleIntervalMs);
+	}
+	bool connection = connect(session, &ClientSession::Closed, this, &ConnectionWorker::OnSessionClosed); Q_ASSERT(connection);
+	emit ClientConnected(client_id);
+}
+
+void ConnectionWorker::Broadcast(const QByteArray& frame, quint64 sequence, qint64 enqueued_ns)
+{
+	int clients = 0;
+	for (auto it = sessions_.cbegin(); it != sessions_.cend(); ++it)
+	{
+		if (it.value()->IsAuthenticated())
+		{
+			it.value()->SendNow(frame);
+			++clients;
+		}
+	}
+	emit BroadcastDone(sequence, clients, MonotonicNs() - enqueued_ns);
+}
+
+void ConnectionWorker::OnSessionClosed(quint32 client_id)
+{
+	ClientSession* session = sessions_.take(client_id);
+	if (!session)
+	{
+		return;
+	}
+
+	// Из обработчика сигнала самой сессии удалять ее нельзя
+	session->deleteLater();
+	connection_count_.fetchAndSubRelaxed(1);
+	metrics_->ForWorker(index_).connections.storeRelaxed(sessions_.size());
+	emit ClientDisconnected(client_id);
+}
+
+void ConnectionWorker::OnQueueSampleTimer()
+{
+	qint64 total = 0;
+	qint64 largest = 0;
+	for (auto it = sessions_.cbegin(); it != sessions_.cend(); ++it)
+	{
+		const qint64 pending = it.value()->PendingWriteBytes();
+		total += pending;
+		largest = qMax(largest, pending);
+
+		// Зависший клиент не дает событий записи: его отметка проверяется здесь. Отключение - отложенное,
+		// обход сессий не нарушается
+		it.value()->CheckBackpressure();
+	}
+
+	ServerMetrics::Worker& metrics = metrics_->ForWorker(index_);
+	metrics.write_queue_bytes.storeRelaxed(total);
+	metrics.write_queue_max_bytes.storeRelaxed(largest);
+}
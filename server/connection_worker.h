@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+
+class ClaimArbiter;
+class ClientSession;
+class ServerMetrics;
+class SharedSettings;
+class UserRegistry;
+
+// Обслуживает часть соединений сервера в своем потоке со своим циклом событий.
+// Сокеты и сессии создаются и удаляются только в этом потоке
+class ConnectionWorker final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	ConnectionWorker(int index, const QSharedPointer<SharedSettings>& settings,
+		const QSharedPointer<UserRegistry>& registry, const QSharedPointer<ServerMetrics>& metrics,
+		const QSharedPointer<ClaimArbiter>& arbiter, QObject* parent = nullptr);
+	~ConnectionWorker() override;
+
+	int Index() const;
+
+	// Число обслуживаемых соединений, читается из потока сервера для распределения новых
+	int ConnectionCount() const;
+
+	// Поток сервера учитывает соединение сразу при назначении, до того как оно дойдет до обработчика
+	void ReserveConnection();
+
+	// Вызывается в потоке обработчика (через очередь из потока сервера)
+	void AddConnection(qintptr socket_descriptor, quint32 client_id);
+
+	// Отправка готового кадра всем приветствовавшим клиентам обработчика. До записи в сокеты кадр общий,
+	// копию получает только буфер записи каждого сокета.
+	// enqueued_ns - момент постановки рассылки в очередь, для замера времени доставки до сокетов
+	void Broadcast(const QByteArray& frame, quint64 sequence, qint64 enqueued_ns);
+
+Q_SIGNALS:
+
+	void ClientConnected(quint32 client_id);
+	void ClientDisconnected(quint32 client_id);
+
+	// elapsed_ns - от постановки в очередь до передачи ядру кадра последнего клиента обработчика
+	void BroadcastDone(quint64 sequence, int clients, qint64 elapsed_ns);
+
+private Q_SLOTS:
+
+	void OnSessionClosed(quint32 client_id);
+
+	// Замер очередей записи для метрик и проверка медленных клиентов
+	void OnQueueSampleTimer();
+
+private:
+	int index_ = 0;
+	QSharedPointer<SharedSettings> settings_;
+	QSharedPointer<UserRegistry> registry_;
+	QSharedPointer<ServerMetrics> metrics_;
+	QSharedPointer<ClaimArbiter> arbiter_;
+	QHash<quint32, ClientSession*> sessions_;
+	QAtomicInt connection_count_;
+	QTimer queue_sample_timer_;
+};
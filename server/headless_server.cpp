@@ -0,0 +1,224 @@
+#include "headless_server.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QTextStream>
+
+#include "process_resources.h"
+#include "protocol.h"
+
+namespace
+{
+	const int kDefaultStatsIntervalMs = 5000;
+}
+
+HeadlessServer::HeadlessServer(QObject* parent)
+	: QObject(parent)
+	, port_(protocol::kDefaultPort)
+{
+	stats_timer_.setInterval(kDefaultStatsIntervalMs);
+	probe_timer_.setTimerType(Qt::PreciseTimer);
+
+	bool connection = true;
+	connection = connect(&stats_timer_, &QTimer::timeout, this, &HeadlessServer::OnStatsTimer); Q_ASSERT(connection);
+	connection = connect(&probe_timer_, &QTimer::timeout, this, &HeadlessServer::OnProbeTimer); Q_ASSERT(connection);
+}
+
+HeadlessServer::~HeadlessServer() = default;
+
+bool HeadlessServer::ParseArguments(const QCoreApplication& app, int& exit_code)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QString::fromUtf8("book_tennis_server headless mode"));
+	parser.addHelpOption();
+
+	const QCommandLineOption headless_option("headless", QString::fromUtf8("Run without widgets."));
+	const QCommandLineOption port_option("port", QString::fromUtf8("Listen port."), "port");
+	const QCommandLineOption workers_option("workers", QString::fromUtf8("Connection worker threads, 0 - one per core."), "count");
+	const QCommandLineOption registry_option("registry", QString::fromUtf8("User registry directory."), "dir");
+	const QCommandLineOption stats_interval_option("stats-interval", QString::fromUtf8("Status log interval."), "msecs");
+	const QCommandLineOption probe_interval_option("probe-interval",
+		QString::fromUtf8("Broadcast a timing probe to all clients with the given interval (load testing)."), "msecs");
+	parser.addOptions({ headless_option, port_option, workers_option, registry_option,
+		stats_interval_option, probe_interval_option });
+	const QCommandLineOption metrics_address_option("metrics-address", QString::fromUtf8("Metrics HTTP listener address."), "address");
+	const QCommandLineOption metrics_port_option("metrics-port", QString::fromUtf8("Metrics HTTP listener port, 0 - disabled."), "port");
+	const QCommandLineOption metrics_socket_option("metrics-socket", QString::fromUtf8("Local socket name for the metrics summary, empty - disabled."), "name");
+	const QCommandLineOption metrics_file_option("metrics-file", QString::fromUtf8("Dump metrics in Prometheus format to the file periodically."), "file");
+	const QCommandLineOption metrics_file_interval_option("metrics-file-interval", QString::fromUtf8("Metrics dump interval."), "msecs");
+	parser.addOptions({ metrics_address_option, metrics_port_option, metrics_socket_option,
+		metrics_file_option, metrics_file_interval_option });
+	const QCommandLineOption template_pack_option("template-pack",
+		QString::fromUtf8("Distribute the template pack file to clients, reloaded when the file changes."), "file");
+	parser.addOption(template_pack_option);
+	const QCommandLineOption booking_open_in_option("booking-open-in",
+		QString::fromUtf8("Announce the booking opening the given time after the start (claim load testing)."), "msecs");
+	const QCommandLineOption court_option("court", QString::fromUtf8("Court of the announced booking opening."), "number");
+	parser.addOptions({ booking_open_in_option, court_option });
+
+	if (!parser.parse(app.arguments()))
+	{
+		QTextStream(stderr) << parser.errorText() << '\n';
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	if (parser.isSet(QStringLiteral("help")))
+	{
+		QTextStream(stdout) << parser.helpText();
+		exit_code = Succeed;
+		return false;
+	}
+
+	bool ok = true;
+	if (parser.isSet(port_option))
+	{
+		const uint port = parser.value(port_option).toUInt(&ok);
+		ok = ok && port > 0 && port <= 65535;
+		port_ = static_cast<quint16>(port);
+	}
+
+	if (ok && parser.isSet(workers_option))
+	{
+		worker_count_ = parser.value(workers_option).toInt(&ok);
+		ok = ok && worker_count_ >= 0;
+	}
+
+	if (ok && parser.isSet(stats_interval_option))
+	{
+		const int stats_interval_ms = parser.value(stats_interval_option).toInt(&ok);
+		ok = ok && stats_interval_ms > 0;
+		stats_timer_.setInterval(stats_interval_ms);
+	}
+
+	if (ok && parser.isSet(probe_interval_option))
+	{
+		probe_interval_ms_ = parser.value(probe_interval_option).toInt(&ok);
+		ok = ok && probe_interval_ms_ >= 0;
+	}
+
+	if (ok && parser.isSet(metrics_address_option))
+	{
+		ok = metrics_address_.setAddress(parser.value(metrics_address_option));
+	}
+
+	if (ok && parser.isSet(metrics_port_option))
+	{
+		const uint port = parser.value(metrics_port_option).toUInt(&ok);
+		ok = ok && port <= 65535;
+		metrics_port_ = static_cast<quint16>(port);
+	}
+
+	if (ok && parser.isSet(metrics_file_interval_option))
+	{
+		metrics_file_interval_ms_ = parser.value(metrics_file_interval_option).toInt(&ok);
+		ok = ok && metrics_file_interval_ms_ > 0;
+	}
+
+	if (ok && parser.isSet(booking_open_in_option))
+	{
+		booking_open_in_ms_ = parser.value(booking_open_in_option).toLongLong(&ok);
+		ok = ok && booking_open_in_ms_ >= 0;
+	}
+
+	if (ok && parser.isSet(court_option))
+	{
+		court_id_ = parser.value(court_option).toUInt(&ok);
+	}
+
+	if (!ok)
+	{
+		QTextStream(stderr) << QString::fromUtf8("Invalid arguments\n") << parser.helpText();
+		exit_code = InvalidArguments;
+		return false;
+	}
+
+	registry_dir_ = parser.value(registry_option);
+	if (parser.isSet(metrics_socket_option))
+	{
+		metrics_local_name_ = parser.value(metrics_socket_option);
+	}
+	metrics_file_ = parser.value(metrics_file_option);
+	template_pack_file_ = parser.value(template_pack_option);
+	return true;
+}
+
+bool HeadlessServer::Start()
+{
+	const qint64 open_file_limit = process_resources::RaiseOpenFileLimit();
+	sp_server_.reset(new ThreadedServer(worker_count_, registry_dir_));
+
+	bool connection = connect(sp_server_.data(), &ThreadedServer::BroadcastFinished, this, &HeadlessServer::OnBroadcastFinished); Q_ASSERT(connection);
+	if (!sp_server_->listen(QHostAddress::Any, port_))
+	{
+		qWarning() << QString::fromUtf8("Unable to start the server on port : ") << port_ << sp_server_->errorString();
+		return false;
+	}
+
+	qDebug() << "Server listens on port " << port_ << " with " << sp_server_->WorkerCount() << " workers, open file limit " << open_file_limit;
+	// Метрики необязательны: сервер работает и без них
+	sp_metrics_exporter_.reset(new MetricsExporter(sp_server_->Metrics()));
+	if (metrics_port_ != 0)
+	{
+		sp_metrics_exporter_->ListenHttp(metrics_address_, metrics_port_);
+	}
+	if (!metrics_local_name_.isEmpty())
+	{
+		sp_metrics_exporter_->ListenLocal(metrics_local_name_);
+	}
+	if (!metrics_file_.isEmpty())
+	{
+		sp_metrics_exporter_->StartFileDump(metrics_file_, metrics_file_interval_ms_);
+	}
+
+	if (!template_pack_file_.isEmpty())
+	{
+		connection = connect(&template_pack_source_, &TemplatePackSource::PackChanged, sp_server_.data(), &ThreadedServer::PublishTemplatePack); Q_ASSERT(connection);
+		template_pack_source_.Watch(template_pack_file_);
+	}
+
+	if (booking_open_in_ms_ >= 0)
+	{
+		protocol::BookingOpen booking_open;
+		booking_open.open_time_ms = QDateTime::currentMSecsSinceEpoch() + booking_open_in_ms_;
+		booking_open.court_id = court_id_;
+		// Замерное объявление не должно остаться в настройках рабочего сервера
+		sp_server_->PublishBookingOpen(booking_open, false);
+		qDebug() << QString::fromUtf8("Booking opens at %1 for court %2")
+			.arg(QDateTime::fromMSecsSinceEpoch(booking_open.open_time_ms, Qt::UTC).toString(Qt::ISODateWithMs))
+			.arg(court_id_);
+	}
+
+	stats_timer_.start();
+	if (probe_interval_ms_ > 0)
+	{
+		probe_timer_.start(probe_interval_ms_);
+	}
+	return true;
+}
+
+void HeadlessServer::OnStatsTimer()
+{
+	const int connections = sp_server_->ConnectionCount();
+	const qint64 resident_bytes = process_resources::ResidentBytes();
+	qDebug() << QString::fromUtf8("Clients %1, resident %2 MB (%3 KB per client), last broadcast %4 clients in %5 us")
+		.arg(connections)
+		.arg(resident_bytes / (1024.0 * 1024.0), 0, 'f', 1)
+		.arg(connections > 0 ? resident_bytes / 1024.0 / connections : 0.0, 0, 'f', 1)
+		.arg(last_broadcast_clients_)
+		.arg(last_fanout_ns_ / 1000.0, 0, 'f', 1);
+}
+
+void HeadlessServer::OnProbeTimer()
+{
+	sp_server_->BroadcastProbe();
+}
+
+void HeadlessServer::OnBroadcastFinished(quint64 sequence, int clients, qint64 fanout_ns)
+{
+	Q_UNUSED(sequence);
+	last_broadcast_clients_ = clients;
+	last_fanout_ns_ = fanout_ns;
+}
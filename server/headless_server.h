@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QTimer>
+
+#include "metrics_exporter.h"
+#include "template_pack_source.h"
+#include "threaded_server.h"
+
+class QCoreApplication;
+
+// Сервер без виджетов: параметры из командной строки, состояние периодически пишется в лог.
+// Для работы на машине без дисплея и для нагрузочных прогонов
+class HeadlessServer final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	enum ExitCode
+	{
+		Succeed = 0,
+		Failed = 1,
+		InvalidArguments = 3
+	};
+
+	explicit HeadlessServer(QObject* parent = nullptr);
+	~HeadlessServer() override;
+
+	// Разбор аргументов. false - продолжать не нужно, код в exit_code
+	bool ParseArguments(const QCoreApplication& app, int& exit_code);
+
+	// false - не удалось начать прием соединений
+	bool Start();
+
+private Q_SLOTS:
+
+	void OnStatsTimer();
+
+	void OnProbeTimer();
+
+	void OnBroadcastFinished(quint64 sequence, int clients, qint64 fanout_ns);
+
+private:
+	QScopedPointer<ThreadedServer> sp_server_;
+
+	quint16 port_ = 0;
+
+	int worker_count_ = 0;
+
+	QString registry_dir_;
+
+	QTimer stats_timer_;
+
+	// 0 - замерные рассылки не отправляются
+	int probe_interval_ms_ = 0;
+
+	QTimer probe_timer_;
+
+	// Порт 0 - без HTTP, пустое имя - без локального сокета, пустой путь - без записи в файл
+	QHostAddress metrics_address_ = QHostAddress(QHostAddress::LocalHost);
+	quint16 metrics_port_ = metrics_defaults::kHttpPort;
+	QString metrics_local_name_ = QString::fromLatin1(metrics_defaults::kLocalName);
+	QString metrics_file_;
+	int metrics_file_interval_ms_ = metrics_defaults::kDumpIntervalMs;
+
+	QScopedPointer<MetricsExporter> sp_metrics_exporter_;
+
+	// Пустой путь - пакет шаблонов не раздается
+	QString template_pack_file_;
+
+	TemplatePackSource template_pack_source_;
+
+	// Объявить открытие записи через столько мс после старта (заявки в нагрузочном прогоне), -1 - не объявлять
+	qint64 booking_open_in_ms_ = -1;
+
+	quint32 court_id_ = 0;
+
+	int last_broadcast_clients_ = 0;
+
+	qint64 last_fanout_ns_ = 0;
+};
@@ -1,11 +1,65 @@
+#include <QCoreApplication>
+#include <cstring>
+
+#include "headless_server.h"
+
+#ifndef BOOK_TENNIS_SERVER_HEADLESS
 #include <QApplication>
 #include "mainwidget.h"
-#include <iostream>
+#endif
+
+namespace
+{
+	bool IsHeadless(int argc, char* argv[])
+	{
+#ifdef BOOK_TENNIS_SERVER_HEADLESS
+		Q_UNUSED(argc);
+		Q_UNUSED(argv);
+		return true;
+#else
+		for (int i = 1; i < argc; ++i)
+		{
+			if (std::strcmp(argv[i], "--headless") == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+#endif
+	}
 
+	// Без виджетов и дисплея: хватает QCoreApplication
+	int RunHeadless(int argc, char* argv[])
+	{
+		QCoreApplication app(argc, argv);
+
+		app.setOrganizationName(QString::fromUtf8("Ssipta"));
+		app.setApplicationName(QString::fromUtf8("book_tennis_server"));
+
+		HeadlessServer server;
+		int exit_code = HeadlessServer::Succeed;
+		if (!server.ParseArguments(app, exit_code))
+		{
+			return exit_code;
+		}
+
+		if (!server.Start())
+		{
+			return HeadlessServer::Failed;
+		}
+		return app.exec();
+	}
+}
 
 int main(int argc, char* argv[])
 {
 	setlocale(LC_ALL, "Russian");
+	if (IsHeadless(argc, argv))
+	{
+		return RunHeadless(argc, argv);
+	}
+
+#ifndef BOOK_TENNIS_SERVER_HEADLESS
 	QApplication app(argc, argv);
 
 	app.setOrganizationName(QString::fromUtf8("Ssipta"));
@@ -14,5 +68,7 @@ int main(int argc, char* argv[])
 	MainWidget w;
 	w.setGeometry(300,300,500,500);
 	w.show();
+	w.StartServer();
 	return app.exec();
-}
\ No newline at end of file
+#endif
+}
@@ -1,51 +1,216 @@
 #include "mainwidget.h"
 
+#include <QDateTimeEdit>
 #include <QDebug>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QSettings>
+#include <QSpinBox>
+#include <QVBoxLayout>
+
+#include "frame_auth.h"
+#include "protocol.h"
+#include "user_registry.h"
+
+namespace
+{
+	const QString kTemplatePackFileKey = "template_pack_file";
+}
 
 MainWidget::MainWidget(QWidget* parent)
 	: QWidget(parent)
 {
+	connections_label_ = new QLabel;
+	broadcast_label_ = new QLabel;
+	users_label_ = new QLabel;
+	QVBoxLayout* main_lay = new QVBoxLayout;
+	main_lay->addWidget(connections_label_);
+	main_lay->addLayout(CreateBookingOpenControl());
+	main_lay->addLayout(CreateSettingControl());
+	main_lay->addWidget(users_label_);
+	main_lay->addLayout(CreateUserControl());
+	main_lay->addLayout(CreateTemplatePackControl());
+	main_lay->addWidget(broadcast_label_);
+	main_lay->addStretch();
+	setLayout(main_lay);
+	OnConnectionCountChanged(0);
+}
+
+QLayout* MainWidget::CreateBookingOpenControl()
+{
+	QDateTimeEdit* open_time_edit = new QDateTimeEdit(QDateTime::currentDateTime());
+	open_time_edit->setDisplayFormat(QString::fromUtf8("dd.MM.yyyy HH:mm:ss"));
+	QSpinBox* court_spin = new QSpinBox;
+	court_spin->setMinimum(0);
+	court_spin->setMaximum(9999);
+	QPushButton* publish_button = new QPushButton(QString::fromUtf8("Объявить открытие записи"));
+	bool connection = connect(publish_button, &QPushButton::clicked, this, [this, open_time_edit, court_spin]() {
+		if (!sp_server_)
+		{
+			return;
+		}
+
+		protocol::BookingOpen booking_open;
+		booking_open.open_time_ms = open_time_edit->dateTime().toMSecsSinceEpoch();
+		booking_open.court_id = static_cast<quint32>(court_spin->value());
+		sp_server_->PublishBookingOpen(booking_open);
+		}); Q_ASSERT(connection);
+
+	QHBoxLayout* booking_lay = new QHBoxLayout;
+	booking_lay->addWidget(new QLabel(QString::fromUtf8("Открытие")));
+	booking_lay->addWidget(open_time_edit);
+	booking_lay->addWidget(new QLabel(QString::fromUtf8("корт")));
+	booking_lay->addWidget(court_spin);
+	booking_lay->addWidget(publish_button);
+	return booking_lay;
+}
+
+QLayout* MainWidget::CreateSettingControl()
+{
+	QLineEdit* key_edit = new QLineEdit;
+	key_edit->setPlaceholderText(QString::fromUtf8("ключ"));
+	QLineEdit* value_edit = new QLineEdit;
+	value_edit->setPlaceholderText(QString::fromUtf8("значение"));
+	QPushButton* publish_button = new QPushButton(QString::fromUtf8("Разослать настройку"));
+	bool connection = connect(publish_button, &QPushButton::clicked, this, [this, key_edit, value_edit]() {
+		if (!sp_server_ || key_edit->text().trimmed().isEmpty())
+		{
+			return;
+		}
+
+		sp_server_->PublishSettings({ qMakePair(key_edit->text().trimmed(), value_edit->text()) });
+		}); Q_ASSERT(connection);
+
+	QHBoxLayout* setting_lay = new QHBoxLayout;
+	setting_lay->addWidget(key_edit);
+	setting_lay->addWidget(value_edit);
+	setting_lay->addWidget(publish_button);
+	return setting_lay;
+}
+
+QLayout* MainWidget::CreateUserControl()
+{
+	QLineEdit* name_edit = new QLineEdit;
+	name_edit->setPlaceholderText(QString::fromUtf8("пользователь"));
+	QLineEdit* secret_edit = new QLineEdit;
+	secret_edit->setPlaceholderText(QString::fromUtf8("ключ"));
+	QDateEdit* license_edit = new QDateEdit(QDate::currentDate().addYears(1));
+	license_edit->setCalendarPopup(true);
+	QPushButton* put_button = new QPushButton(QString::fromUtf8("Добавить"));
+	QPushButton* remove_button = new QPushButton(QString::fromUtf8("Удалить"));
+
+	bool connection = connect(put_button, &QPushButton::clicked, this, [this, name_edit, secret_edit, license_edit]() {
+		if (!sp_server_ || name_edit->text().trimmed().isEmpty())
+		{
+			return;
+		}
+
+		UserRecord record;
+		sp_server_->Registry()->Find(name_edit->text().trimmed(), record);
+		record.name = name_edit->text().trimmed();
+		// В реестр попадает только ключ из секрета; сам секрет знает лишь пользователь
+		record.key = FrameAuthenticator::DeriveUserKey(record.name, secret_edit->text().toUtf8());
+		secret_edit->clear();
+		record.license_until_ms = QDateTime(license_edit->date().addDays(1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+		record.enabled = true;
+		sp_server_->Registry()->Put(record);
+		UpdateUsersLabel();
+		}); Q_ASSERT(connection);
+	connection = connect(remove_button, &QPushButton::clicked, this, [this, name_edit]() {
+		if (!sp_server_)
+		{
+			return;
+		}
+
+		sp_server_->Registry()->Remove(name_edit->text().trimmed());
+		UpdateUsersLabel();
+		}); Q_ASSERT(connection);
+
+	QHBoxLayout* user_lay = new QHBoxLayout;
+	user_lay->addWidget(name_edit);
+	user_lay->addWidget(secret_edit);
+	user_lay->addWidget(new QLabel(QString::fromUtf8("лицензия до")));
+	user_lay->addWidget(license_edit);
+	user_lay->addWidget(put_button);
+	user_lay->addWidget(remove_button);
+	return user_lay;
+}
+
+void MainWidget::UpdateUsersLabel()
+{
+	const int count = sp_server_ ? sp_server_->Registry()->Count() : 0;
+	users_label_->setText(count > 0
+		? QString::fromUtf8("Пользователей в реестре: %1").arg(count)
+		: QString::fromUtf8("Реестр пуст: принимаются все клиенты"));
+}
+
+QLayout* MainWidget::CreateTemplatePackControl()
+{
+	QLineEdit* path_edit = new QLineEdit(QSettings().value(kTemplatePackFileKey).toString());
+	path_edit->setPlaceholderText(QString::fromUtf8("файл пакета шаблонов"));
+	QPushButton* watch_button = new QPushButton(QString::fromUtf8("Раздавать пакет"));
+	bool connection = connect(watch_button, &QPushButton::clicked, this, [this, path_edit]() {
+		const QString path = path_edit->text().trimmed();
+		QSettings().setValue(kTemplatePackFileKey, path);
+		if (!path.isEmpty())
+		{
+			template_pack_source_.Watch(path);
+		}
+		}); Q_ASSERT(connection);
+
+	QHBoxLayout* pack_lay = new QHBoxLayout;
+	pack_lay->addWidget(path_edit);
+	pack_lay->addWidget(watch_button);
+	return pack_lay;
 }
 
 void MainWidget::StartServer()
 {
-	sp_server_.reset(new QTcpServer());
+	sp_server_.reset(new ThreadedServer());
 
-	const int port_number = 62022;
+	const quint16 port_number = protocol::kDefaultPort;
 	bool connection = true;
-	connection = connect(sp_server_.data(), &QTcpServer::newConnection, this, &MainWidget::OnUserConnected); Q_ASSERT(connection);
+	connection = connect(sp_server_.data(), &ThreadedServer::ConnectionCountChanged, this, &MainWidget::OnConnectionCountChanged); Q_ASSERT(connection);
+	connection = connect(sp_server_.data(), &ThreadedServer::BroadcastFinished, this, &MainWidget::OnBroadcastFinished); Q_ASSERT(connection);
+	connection = connect(&template_pack_source_, &TemplatePackSource::PackChanged, sp_server_.data(), &ThreadedServer::PublishTemplatePack); Q_ASSERT(connection);
+	UpdateUsersLabel();
+
+	const QString template_pack_file = QSettings().value(kTemplatePackFileKey).toString();
+	if (!template_pack_file.isEmpty())
+	{
+		template_pack_source_.Watch(template_pack_file);
+	}
 	if (!sp_server_->isListening())
 	{
-		if (!sp_server_->listen(QHostAddress::Any, 62022))
+		if (!sp_server_->listen(QHostAddress::Any, port_number))
+		{
+			qDebug() << "Unable to start the server with port " << port_number;
+		}
+		else
 		{
-			qDebug() << "Unable to start the server with port " << 62022;
+			qDebug() << "Server listens on port " << port_number << " with " << sp_server_->WorkerCount() << " workers";
 		}
 	}
 	else
 	{
 		qDebug() << "Server already listen";
 	}
+
+	// Метрики только для этой машины: HTTP на localhost и локальный сокет
+	sp_metrics_exporter_.reset(new MetricsExporter(sp_server_->Metrics()));
+	sp_metrics_exporter_->ListenHttp(QHostAddress::LocalHost, metrics_defaults::kHttpPort);
+	sp_metrics_exporter_->ListenLocal(QString::fromLatin1(metrics_defaults::kLocalName));
 }
 
-void MainWidget::OnUserConnected()
+void MainWidget::OnConnectionCountChanged(int connection_count)
 {
-	qDebug() << "New user connected!";
-	QTcpSocket* client_socket = sp_server_->nextPendingConnection();
-	const int id_user_socs = client_socket->socketDescriptor();
-	clients_map_[id_user_socs] = client_socket;
-	bool connection = true;
-	connection = connect(client_socket, &QTcpSocket::readyRead, this, &MainWidget::OnReadyRead); Q_ASSERT(connection);
+	connections_label_->setText(QString::fromUtf8("Подключено клиентов: %1").arg(connection_count));
 }
 
-void MainWidget::OnReadyRead()
+void MainWidget::OnBroadcastFinished(quint64 sequence, int clients, qint64 fanout_ns)
 {
-	QTcpSocket* client_socket = qobject_cast<QTcpSocket*>(sender());
-	if (!client_socket)
-	{
-		return;
-	}
-
-	const int id_user_socs = client_socket->socketDescriptor();
-	const QByteArray data_from_client = client_socket->readAll();
-	//to do...
-}
\ No newline at end of file
+	broadcast_label_->setText(QString::fromUtf8("Рассылка %1: %2 клиентов за %3 мкс")
+		.arg(sequence).arg(clients).arg(fanout_ns / 1000.0, 0, 'f', 1));
+}
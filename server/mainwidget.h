@@ -1,7 +1,11 @@
 #include <QWidget>
 
-#include <QTcpServer>
-#include <QTcpSocket>
+#include "metrics_exporter.h"
+#include "template_pack_source.h"
+#include "threaded_server.h"
+
+class QLabel;
+class QLayout;
 
 class MainWidget final
 	: public QWidget
@@ -16,11 +20,28 @@ public:
 
 private Q_SLOTS:
 
-	void OnUserConnected();
+	void OnConnectionCountChanged(int connection_count);
+
+	void OnBroadcastFinished(quint64 sequence, int clients, qint64 fanout_ns);
+
+private:
+
+	QLayout* CreateBookingOpenControl();
+
+	QLayout* CreateSettingControl();
+
+	QLayout* CreateUserControl();
+
+	QLayout* CreateTemplatePackControl();
 
-	void OnReadyRead();
+	void UpdateUsersLabel();
 
 private:
-	QScopedPointer<QTcpServer> sp_server_;
-	QMap<int, QTcpSocket*> clients_map_;
-};
\ No newline at end of file
+	// Соединения обслуживаются в пуле потоков сервера, виджет только показывает их число
+	QScopedPointer<ThreadedServer> sp_server_;
+	QScopedPointer<MetricsExporter> sp_metrics_exporter_;
+	TemplatePackSource template_pack_source_;
+	QLabel* connections_label_ = nullptr;
+	QLabel* broadcast_label_ = nullptr;
+	QLabel* users_label_ = nullptr;
+};
@@ -0,0 +1,141 @@
+#include "metrics_exporter.h"
+
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "server_metrics.h"
+
+namespace
+{
+	// Запрос длиннее - не к нам
+	const int kMaxRequestSize = 8 * 1024;
+
+	QByteArray HttpResponse(const QByteArray& status, const QByteArray& content_type, const QByteArray& body)
+	{
+		QByteArray response;
+		response.reserve(body.size() + 160);
+		response += "HTTP/1.0 " + status + "\r\n";
+		response += "Content-Type: " + content_type + "\r\n";
+		response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+		response += "Connection: close\r\n\r\n";
+		response += body;
+		return response;
+	}
+}
+
+MetricsExporter::MetricsExporter(const QSharedPointer<ServerMetrics>& metrics, QObject* parent)
+	: QObject(parent)
+	, metrics_(metrics)
+{
+	bool connection = connect(&dump_timer_, &QTimer::timeout, this, &MetricsExporter::OnDumpTimer); Q_ASSERT(connection);
+}
+
+MetricsExporter::~MetricsExporter() = default;
+
+bool MetricsExporter::ListenHttp(const QHostAddress& address, quint16 port)
+{
+	if (!http_server_)
+	{
+		http_server_ = new QTcpServer(this);
+		bool connection = connect(http_server_, &QTcpServer::newConnection, this, &MetricsExporter::OnHttpConnection); Q_ASSERT(connection);
+	}
+
+	if (!http_server_->listen(address, port))
+	{
+		qWarning() << QString::fromUtf8("Unable to start the metrics listener : ") << port << http_server_->errorString();
+		return false;
+	}
+	qDebug() << QString::fromUtf8("Metrics on http://%1:%2/metrics").arg(address.toString()).arg(port);
+	return true;
+}
+
+bool MetricsExporter::ListenLocal(const QString& name)
+{
+	if (!local_server_)
+	{
+		local_server_ = new QLocalServer(this);
+		bool connection = connect(local_server_, &QLocalServer::newConnection, this, &MetricsExporter::OnLocalConnection); Q_ASSERT(connection);
+	}
+
+	// Сокет, оставшийся после падения прошлого запуска, мешает listen
+	QLocalServer::removeServer(name);
+	if (!local_server_->listen(name))
+	{
+		qWarning() << QString::fromUtf8("Unable to start the local metrics socket : ") << name << local_server_->errorString();
+		return false;
+	}
+	qDebug() << QString::fromUtf8("Metrics summary on local socket : ") << local_server_->fullServerName();
+	return true;
+}
+
+void MetricsExporter::StartFileDump(const QString& path, int interval_ms)
+{
+	dump_path_ = path;
+	dump_timer_.start(interval_ms);
+	OnDumpTimer();
+}
+
+void MetricsExporter::OnHttpConnection()
+{
+	while (QTcpSocket* socket = http_server_->nextPendingConnection())
+	{
+		bool connection = connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater); Q_ASSERT(connection);
+		connection = connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+			// Нужна только строка запроса; ответ - и соединение закрывается
+			if (!socket->canReadLine())
+			{
+				if (socket->bytesAvailable() > kMaxRequestSize)
+				{
+					socket->abort();
+				}
+				return;
+			}
+
+			const QList<QByteArray> request = socket->readLine(kMaxRequestSize).trimmed().split(' ');
+			socket->disconnect(this);
+			if (request.size() < 2 || request[0] != "GET")
+			{
+				socket->write(HttpResponse("405 Method Not Allowed", "text/plain", "Only GET is supported\n"));
+			}
+			else if (request[1] == "/metrics")
+			{
+				socket->write(HttpResponse("200 OK", "text/plain; version=0.0.4; charset=utf-8", metrics_->ToPrometheus().toUtf8()));
+			}
+			else
+			{
+				socket->write(HttpResponse("200 OK", "text/plain; charset=utf-8", metrics_->ToText().toUtf8()));
+			}
+			socket->disconnectFromHost();
+			}); Q_ASSERT(connection);
+	}
+}
+
+void MetricsExporter::OnLocalConnection()
+{
+	while (QLocalSocket* socket = local_server_->nextPendingConnection())
+	{
+		bool connection = connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater); Q_ASSERT(connection);
+		socket->write(metrics_->ToText().toUtf8());
+		socket->disconnectFromServer();
+	}
+}
+
+void MetricsExporter::OnDumpTimer()
+{
+	QSaveFile file(dump_path_);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+	{
+		qWarning() << QString::fromUtf8("Unable to write metrics : ") << dump_path_ << file.errorString();
+		return;
+	}
+
+	file.write(metrics_->ToPrometheus().toUtf8());
+	if (!file.commit())
+	{
+		qWarning() << QString::fromUtf8("Unable to write metrics : ") << dump_path_ << file.errorString();
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QHostAddress>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+
+class QLocalServer;
+class QTcpServer;
+class ServerMetrics;
+
+namespace metrics_defaults
+{
+	const quint16 kHttpPort = 62023;
+	const char* const kLocalName = "book_tennis_server_metrics";
+	const int kDumpIntervalMs = 10000;
+}
+
+// Выдача метрик сервера: HTTP на отдельном порту (GET /metrics - формат Prometheus, остальное - сводка),
+// локальный сокет со сводкой и периодическая запись в файл. Работает в потоке сервера; метрики читаются
+// без блокировок, обработчики соединений не ждут
+class MetricsExporter final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit MetricsExporter(const QSharedPointer<ServerMetrics>& metrics, QObject* parent = nullptr);
+	~MetricsExporter() override;
+
+	bool ListenHttp(const QHostAddress& address, quint16 port);
+
+	// Сводка отдается каждому подключившемуся к локальному сокету (например, socat - UNIX-CONNECT:...)
+	bool ListenLocal(const QString& name);
+
+	// Файл в формате Prometheus (подходит для textfile collector), заменяется атомарно
+	void StartFileDump(const QString& path, int interval_ms);
+
+private Q_SLOTS:
+
+	void OnHttpConnection();
+
+	void OnLocalConnection();
+
+	void OnDumpTimer();
+
+private:
+	QSharedPointer<ServerMetrics> metrics_;
+	QTcpServer* http_server_ = nullptr;
+	QLocalServer* local_server_ = nullptr;
+	QString dump_path_;
+	QTimer dump_timer_;
+};
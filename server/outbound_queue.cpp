@@ -0,0 +1,70 @@
+#include "outbound_queue.h"
+
+bool OutboundQueue::Push(const QByteArray& frame, Coalesce key)
+{
+	bool superseded = false;
+	if (key != Coalesce::None)
+	{
+		// Очередь короткая (ограничена байтами), линейный проход дешевле индекса
+		for (int i = entries_.size() - 1; i >= head_; --i)
+		{
+			if (entries_[i].key == key)
+			{
+				bytes_ -= entries_[i].frame.size();
+				entries_.remove(i);
+				superseded = true;
+			}
+		}
+	}
+
+	Entry entry;
+	entry.frame = frame;
+	entry.key = key;
+	entries_.append(entry);
+	bytes_ += frame.size();
+	return superseded;
+}
+
+bool OutboundQueue::IsEmpty() const
+{
+	return head_ == entries_.size();
+}
+
+qint64 OutboundQueue::Bytes() const
+{
+	return bytes_;
+}
+
+int OutboundQueue::Size() const
+{
+	return entries_.size() - head_;
+}
+
+QByteArray OutboundQueue::Pop()
+{
+	Q_ASSERT(!IsEmpty());
+	QByteArray frame;
+	frame.swap(entries_[head_].frame);
+	++head_;
+	bytes_ -= frame.size();
+
+	// Опустевшая очередь начинается сначала, наполовину пустая - сжимается
+	if (head_ == entries_.size())
+	{
+		entries_.clear();
+		head_ = 0;
+	}
+	else if (head_ > 32 && head_ * 2 > entries_.size())
+	{
+		entries_.remove(0, head_);
+		head_ = 0;
+	}
+	return frame;
+}
+
+void OutboundQueue::Clear()
+{
+	entries_.clear();
+	head_ = 0;
+	bytes_ = 0;
+}
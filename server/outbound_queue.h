@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+// Очередь исходящих кадров одного соединения поверх буфера записи сокета. Кадры - общие неизменяемые буферы
+// (копия QByteArray - только счетчик ссылок), поэтому кадр рассылки в очередях тысяч клиентов хранится один раз.
+// Кадр с ключом вытесняет из очереди еще не отправленные кадры с тем же ключом: медленному клиенту нужно
+// только последнее состояние, а не вся история изменений
+class OutboundQueue final
+{
+public:
+	enum class Coalesce : quint8
+	{
+		None,         // отправляется обязательно
+		BookingOpen,  // важно только последнее объявленное время
+		Settings,     // изменения настроек заменяются полным снимком
+		Probe,        // замерные рассылки
+		TemplatePack  // нужен только текущий пакет шаблонов
+	};
+
+	// true - из очереди вытеснен кадр с тем же ключом
+	bool Push(const QByteArray& frame, Coalesce key);
+
+	bool IsEmpty() const;
+
+	// Байт в очереди, без буфера сокета
+	qint64 Bytes() const;
+
+	int Size() const;
+
+	QByteArray Pop();
+
+	void Clear();
+
+private:
+	struct Entry
+	{
+		QByteArray frame;
+		Coalesce key = Coalesce::None;
+	};
+
+	// Кольцо поверх вектора: Pop не сдвигает элементы
+	QVector<Entry> entries_;
+	int head_ = 0;
+	qint64 bytes_ = 0;
+};
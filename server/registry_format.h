@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Файлы реестра пользователей (порядок байт - как на машине сервера):
+//   снимок: FileHeader, SnapshotHeader, { EntryHeader, запись } * count
+//   журнал: FileHeader, { EntryHeader, запись или имя } * N - только дописывается
+// Запись сериализуется QDataStream. crc - CRC-32 данных записи: оборванный хвост журнала отбрасывается.
+// Версия 1 хранила секрет пользователя как есть, версия 2 - только ключ из него (FrameAuthenticator::DeriveUserKey).
+// Файлы версии 1 читаются с вычислением ключа и сразу переписываются
+namespace registry_format
+{
+	const char kSnapshotMagic[4] = { 'B', 'T', 'U', 'S' };
+	const char kLogMagic[4] = { 'B', 'T', 'U', 'L' };
+	const quint32 kVersion = 2;
+	const quint32 kSecretVersion = 1;
+
+	// Запись больше этого - признак порчи файла
+	const quint32 kMaxEntrySize = 1024 * 1024;
+
+	enum class Operation : quint8
+	{
+		Put = 1,
+		Remove = 2
+	};
+
+	struct FileHeader
+	{
+		char magic[4];
+		quint32 version;
+		quint32 header_size;
+		quint32 reserved;
+	};
+
+	struct SnapshotHeader
+	{
+		quint64 count;
+	};
+
+	struct EntryHeader
+	{
+		quint32 size;
+		quint32 crc;
+		quint8 operation; // Operation
+		quint8 reserved[3];
+	};
+}
@@ -0,0 +1,289 @@
+#include "server_metrics.h"
+
+#include <QTextStream>
+#include <QtAlgorithms>
+
+#include "monotonic_clock.h"
+
+namespace
+{
+	// Первая корзина - до 2^10 нс (~1 мкс)
+	const int kFirstBucketBits = 10;
+
+	QString Seconds(qint64 ns)
+	{
+		return QString::number(ns / 1000000000.0, 'g', 6);
+	}
+
+	QString Milliseconds(qint64 ns)
+	{
+		return QString::number(ns / 1000000.0, 'f', 3);
+	}
+
+	const char* ClaimOutcomeName(int outcome)
+	{
+		switch (static_cast<protocol::ClaimOutcome>(outcome))
+		{
+		case protocol::ClaimOutcome::Won: return "won";
+		case protocol::ClaimOutcome::Lost: return "lost";
+		case protocol::ClaimOutcome::TooEarly: return "too_early";
+		case protocol::ClaimOutcome::NotOpen: return "not_open";
+		}
+		return "unknown";
+	}
+
+	void WriteHelp(QTextStream& stream, const char* name, const char* type, const char* help)
+	{
+		stream << "# HELP " << name << ' ' << help << '\n';
+		stream << "# TYPE " << name << ' ' << type << '\n';
+	}
+
+	void WriteHistogram(QTextStream& stream, const char* name, const QString& labels, const LatencyHistogram& histogram)
+	{
+		const QString prefix = labels.isEmpty() ? QString() : labels + QLatin1Char(',');
+		quint64 cumulative = 0;
+		for (int bucket = 0; bucket < LatencyHistogram::kBuckets; ++bucket)
+		{
+			cumulative += histogram.BucketCount(bucket);
+			stream << name << "_bucket{" << prefix << "le=\"" << Seconds(LatencyHistogram::UpperBoundNs(bucket)) << "\"} " << cumulative << '\n';
+		}
+		// Счетчик читается отдельно от корзин: +Inf не меньше последней корзины даже при записи во время чтения
+		const quint64 count = qMax(histogram.Count(), cumulative + histogram.BucketCount(LatencyHistogram::kBuckets));
+		stream << name << "_bucket{" << prefix << "le=\"+Inf\"} " << count << '\n';
+		const QString braces = labels.isEmpty() ? QString() : QLatin1Char('{') + labels + QLatin1Char('}');
+		stream << name << "_sum" << braces << ' ' << Seconds(histogram.SumNs()) << '\n';
+		stream << name << "_count" << braces << ' ' << count << '\n';
+	}
+}
+
+void LatencyHistogram::Record(qint64 elapsed_ns)
+{
+	const quint64 ns = static_cast<quint64>(qMax<qint64>(elapsed_ns, 0));
+	const int bits = 64 - qCountLeadingZeroBits(ns | 1);
+	const int bucket = qBound(0, bits - kFirstBucketBits, kBuckets);
+	buckets_[bucket].fetchAndAddRelaxed(1);
+	sum_ns_.fetchAndAddRelaxed(static_cast<qint64>(ns));
+	count_.fetchAndAddRelaxed(1);
+}
+
+quint64 LatencyHistogram::Count() const
+{
+	return count_.loadRelaxed();
+}
+
+qint64 LatencyHistogram::SumNs() const
+{
+	return sum_ns_.loadRelaxed();
+}
+
+qint64 LatencyHistogram::PercentileNs(double p) const
+{
+	quint64 total = 0;
+	quint64 counts[kBuckets + 1];
+	for (int bucket = 0; bucket <= kBuckets; ++bucket)
+	{
+		counts[bucket] = buckets_[bucket].loadRelaxed();
+		total += counts[bucket];
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	const quint64 rank = qMax<quint64>(1, static_cast<quint64>(p * total + 0.5));
+	quint64 cumulative = 0;
+	for (int bucket = 0; bucket < kBuckets; ++bucket)
+	{
+		cumulative += counts[bucket];
+		if (cumulative >= rank)
+		{
+			return UpperBoundNs(bucket);
+		}
+	}
+	return UpperBoundNs(kBuckets - 1);
+}
+
+qint64 LatencyHistogram::UpperBoundNs(int bucket)
+{
+	return qint64(1) << (kFirstBucketBits + bucket);
+}
+
+quint64 LatencyHistogram::BucketCount(int bucket) const
+{
+	return buckets_[bucket].loadRelaxed();
+}
+
+ServerMetrics::ServerMetrics(int worker_count)
+	: worker_count_(worker_count)
+	, workers_(new Worker[worker_count])
+	, start_ns_(MonotonicNs())
+{
+}
+
+int ServerMetrics::WorkerCount() const
+{
+	return worker_count_;
+}
+
+ServerMetrics::Worker& ServerMetrics::ForWorker(int index)
+{
+	return workers_[index];
+}
+
+const ServerMetrics::Worker& ServerMetrics::ForWorker(int index) const
+{
+	return workers_[index];
+}
+
+void ServerMetrics::RecordMessage(protocol::MessageType type, qint64 handling_ns)
+{
+	const int slot = static_cast<int>(type) < kMessageSlots ? static_cast<int>(type) : 0;
+	messages_[slot].handling.Record(handling_ns);
+}
+
+void ServerMetrics::RecordBroadcast(int clients, qint64 fanout_ns)
+{
+	broadcast_fanout_.Record(fanout_ns);
+	broadcast_clients_.fetchAndAddRelaxed(static_cast<quint64>(clients));
+}
+
+void ServerMetrics::RecordClaim(protocol::ClaimOutcome outcome, qint64 ack_ns)
+{
+	claim_ack_.Record(ack_ns);
+	claims_[qMin(static_cast<int>(outcome), kClaimOutcomes - 1)].fetchAndAddRelaxed(1);
+}
+
+void ServerMetrics::AddAccepted()
+{
+	accepted_.fetchAndAddRelaxed(1);
+}
+
+void ServerMetrics::SetPendingBroadcasts(int count)
+{
+	pending_broadcasts_.storeRelaxed(count);
+}
+
+QString ServerMetrics::ToPrometheus() const
+{
+	QString text;
+	QTextStream stream(&text);
+
+	WriteHelp(stream, "book_tennis_uptime_seconds", "gauge", "Time since the server start.");
+	stream << "book_tennis_uptime_seconds " << Seconds(MonotonicNs() - start_ns_) << '\n';
+
+	WriteHelp(stream, "book_tennis_accepted_connections_total", "counter", "Accepted TCP connections.");
+	stream << "book_tennis_accepted_connections_total " << accepted_.loadRelaxed() << '\n';
+
+	// Метрики обработчиков: одно семейство - все потоки подряд
+	const auto write_worker_family = [this, &stream](const char* name, const char* type, const char* help,
+		qint64 (*value)(const Worker&)) {
+		WriteHelp(stream, name, type, help);
+		for (int i = 0; i < worker_count_; ++i)
+		{
+			stream << name << "{worker=\"" << i << "\"} " << value(workers_[i]) << '\n';
+		}
+	};
+	write_worker_family("book_tennis_connections", "gauge", "Open client connections per worker thread.",
+		[](const Worker& worker) { return worker.connections.loadRelaxed(); });
+	write_worker_family("book_tennis_received_bytes_total", "counter", "Bytes read from client sockets.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.bytes_in.loadRelaxed()); });
+	write_worker_family("book_tennis_sent_bytes_total", "counter", "Bytes queued to client sockets.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.bytes_out.loadRelaxed()); });
+	write_worker_family("book_tennis_received_frames_total", "counter", "Frames received from clients.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.frames_in.loadRelaxed()); });
+	write_worker_family("book_tennis_parse_errors_total", "counter", "Connections dropped for malformed data.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.parse_errors.loadRelaxed()); });
+	write_worker_family("book_tennis_auth_failures_total", "counter", "Rejected hellos, expired keys and bad signatures.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.auth_failures.loadRelaxed()); });
+	write_worker_family("book_tennis_write_queue_bytes", "gauge", "Bytes waiting in client socket buffers and write queues.",
+		[](const Worker& worker) { return worker.write_queue_bytes.loadRelaxed(); });
+	write_worker_family("book_tennis_write_queue_max_bytes", "gauge", "Largest pending output of a client of a worker.",
+		[](const Worker& worker) { return worker.write_queue_max_bytes.loadRelaxed(); });
+	write_worker_family("book_tennis_coalesced_frames_total", "counter", "Queued frames superseded by newer ones.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.coalesced_frames.loadRelaxed()); });
+	write_worker_family("book_tennis_evicted_clients_total", "counter", "Clients disconnected for not reading their output.",
+		[](const Worker& worker) { return static_cast<qint64>(worker.evicted_clients.loadRelaxed()); });
+
+	WriteHelp(stream, "book_tennis_message_handling_seconds", "histogram", "Time to verify, parse and handle one client frame.");
+	for (int slot = 0; slot < kMessageSlots; ++slot)
+	{
+		if (messages_[slot].handling.Count() == 0)
+		{
+			continue;
+		}
+		const QString labels = QString::fromUtf8("type=\"%1\"")
+			.arg(QString::fromLatin1(protocol::TypeName(static_cast<protocol::MessageType>(slot))));
+		WriteHistogram(stream, "book_tennis_message_handling_seconds", labels, messages_[slot].handling);
+	}
+
+	WriteHelp(stream, "book_tennis_broadcast_fanout_seconds", "histogram", "From broadcast enqueue to the last client socket.");
+	WriteHistogram(stream, "book_tennis_broadcast_fanout_seconds", QString(), broadcast_fanout_);
+
+	WriteHelp(stream, "book_tennis_broadcast_deliveries_total", "counter", "Broadcast frames queued to clients.");
+	stream << "book_tennis_broadcast_deliveries_total " << broadcast_clients_.loadRelaxed() << '\n';
+
+	WriteHelp(stream, "book_tennis_pending_broadcasts", "gauge", "Broadcasts not yet reported by all workers.");
+	stream << "book_tennis_pending_broadcasts " << pending_broadcasts_.loadRelaxed() << '\n';
+
+	WriteHelp(stream, "book_tennis_claims_total", "counter", "Booking claims by outcome.");
+	for (int outcome = 0; outcome < kClaimOutcomes; ++outcome)
+	{
+		stream << "book_tennis_claims_total{outcome=\"" << ClaimOutcomeName(outcome) << "\"} " << claims_[outcome].loadRelaxed() << '\n';
+	}
+
+	WriteHelp(stream, "book_tennis_claim_ack_seconds", "histogram", "From claim arrival to the answer passed to the kernel.");
+	WriteHistogram(stream, "book_tennis_claim_ack_seconds", QString(), claim_ack_);
+
+	stream.flush();
+	return text;
+}
+
+QString ServerMetrics::ToText() const
+{
+	QString text;
+	QTextStream stream(&text);
+
+	stream << "uptime s\t" << Seconds(MonotonicNs() - start_ns_) << '\n';
+	stream << "accepted\t" << accepted_.loadRelaxed() << '\n';
+	stream << "worker\tconnections\tbytes in\tbytes out\tframes in\tparse errors\tauth failures\twrite queue\twrite queue max\tcoalesced\tevicted\n";
+	for (int i = 0; i < worker_count_; ++i)
+	{
+		const Worker& worker = workers_[i];
+		stream << i << '\t' << worker.connections.loadRelaxed()
+			<< '\t' << worker.bytes_in.loadRelaxed() << '\t' << worker.bytes_out.loadRelaxed()
+			<< '\t' << worker.frames_in.loadRelaxed() << '\t' << worker.parse_errors.loadRelaxed()
+			<< '\t' << worker.auth_failures.loadRelaxed()
+			<< '\t' << worker.write_queue_bytes.loadRelaxed() << '\t' << worker.write_queue_max_bytes.loadRelaxed()
+			<< '\t' << worker.coalesced_frames.loadRelaxed() << '\t' << worker.evicted_clients.loadRelaxed() << '\n';
+	}
+
+	// Перцентили - верхние границы корзин
+	stream << "latency\tcount\tmean ms\tp50 ms\tp99 ms\tp99.9 ms\n";
+	const auto write_latency = [&stream](const QString& name, const LatencyHistogram& histogram) {
+		const quint64 count = histogram.Count();
+		if (count == 0)
+		{
+			return;
+		}
+		stream << name << '\t' << count << '\t' << Milliseconds(histogram.SumNs() / static_cast<qint64>(count))
+			<< "\t<" << Milliseconds(histogram.PercentileNs(0.5))
+			<< "\t<" << Milliseconds(histogram.PercentileNs(0.99))
+			<< "\t<" << Milliseconds(histogram.PercentileNs(0.999)) << '\n';
+	};
+	for (int slot = 0; slot < kMessageSlots; ++slot)
+	{
+		write_latency(QString::fromLatin1(protocol::TypeName(static_cast<protocol::MessageType>(slot))), messages_[slot].handling);
+	}
+	write_latency(QString::fromUtf8("broadcast"), broadcast_fanout_);
+	write_latency(QString::fromUtf8("claim ack"), claim_ack_);
+	stream << "pending broadcasts\t" << pending_broadcasts_.loadRelaxed() << '\n';
+	stream << "claims";
+	for (int outcome = 0; outcome < kClaimOutcomes; ++outcome)
+	{
+		stream << '\t' << ClaimOutcomeName(outcome) << ' ' << claims_[outcome].loadRelaxed();
+	}
+	stream << '\n';
+
+	stream.flush();
+	return text;
+}
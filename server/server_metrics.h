@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QScopedArrayPointer>
+#include <QString>
+
+#include "protocol.h"
+
+// Гистограмма задержек без блокировок: корзины по степеням двойки от ~1 мкс до ~17 с.
+// Запись - несколько атомарных сложений, чтение - из любого потока без остановки записи
+class LatencyHistogram final
+{
+public:
+	static const int kBuckets = 25;
+
+	void Record(qint64 elapsed_ns);
+
+	quint64 Count() const;
+	qint64 SumNs() const;
+
+	// Приближенно: верхняя граница корзины, в которую попадает перцентиль
+	qint64 PercentileNs(double p) const;
+
+	// Верхняя граница корзины, нс
+	static qint64 UpperBoundNs(int bucket);
+
+	quint64 BucketCount(int bucket) const;
+
+private:
+	// Последняя корзина - все, что не влезло в предыдущие
+	QAtomicInteger<quint64> buckets_[kBuckets + 1];
+	QAtomicInteger<quint64> count_;
+	QAtomicInteger<qint64> sum_ns_;
+};
+
+// Метрики сервера для подбора железа и поиска медленных мест в час пик. Счетчики и гистограммы атомарны,
+// пишутся из потоков обработчиков и потока сервера, читаются экспортером без блокировок
+class ServerMetrics final
+{
+public:
+	// Метрики одного потока-обработчика. Выровнены по строке кэша: потоки не мешают друг другу
+	struct alignas(64) Worker
+	{
+		QAtomicInteger<qint64> connections;
+		QAtomicInteger<quint64> bytes_in;
+		QAtomicInteger<quint64> bytes_out;
+		QAtomicInteger<quint64> frames_in;
+		QAtomicInteger<quint64> parse_errors;
+		QAtomicInteger<quint64> auth_failures;
+		// Данные, ждущие отправки в сокетах и очередях соединений обработчика (замер раз в секунду)
+		QAtomicInteger<qint64> write_queue_bytes;
+		QAtomicInteger<qint64> write_queue_max_bytes;
+		// Кадры, вытесненные из очередей более новыми, и отключенные медленные клиенты
+		QAtomicInteger<quint64> coalesced_frames;
+		QAtomicInteger<quint64> evicted_clients;
+	};
+
+	explicit ServerMetrics(int worker_count);
+
+	int WorkerCount() const;
+	Worker& ForWorker(int index);
+	const Worker& ForWorker(int index) const;
+
+	// Время разбора и обработки одного входящего кадра
+	void RecordMessage(protocol::MessageType type, qint64 handling_ns);
+
+	// От постановки рассылки в очередь до передачи ядру кадра последнего клиента
+	void RecordBroadcast(int clients, qint64 fanout_ns);
+
+	// Разобранная заявка на слот. ack_ns - от отметки прихода до передачи ответа ядру
+	void RecordClaim(protocol::ClaimOutcome outcome, qint64 ack_ns);
+
+	void AddAccepted();
+
+	// Рассылки, по которым еще не отчитались все обработчики
+	void SetPendingBroadcasts(int count);
+
+	// Формат Prometheus (text exposition 0.0.4)
+	QString ToPrometheus() const;
+
+	// Сводка для человека
+	QString ToText() const;
+
+private:
+	// Типы сообщений умещаются в эти слоты, остальные считаются в нулевом
+	static const int kMessageSlots = 16;
+
+	// По числу значений protocol::ClaimOutcome
+	static const int kClaimOutcomes = 4;
+
+	struct MessageMetrics
+	{
+		LatencyHistogram handling;
+	};
+
+	int worker_count_ = 0;
+	QScopedArrayPointer<Worker> workers_;
+	MessageMetrics messages_[kMessageSlots];
+	LatencyHistogram broadcast_fanout_;
+	QAtomicInteger<quint64> broadcast_clients_;
+	QAtomicInteger<quint64> accepted_;
+	QAtomicInteger<qint64> pending_broadcasts_;
+	LatencyHistogram claim_ack_;
+	QAtomicInteger<quint64> claims_[kClaimOutcomes];
+	qint64 start_ns_ = 0;
+};
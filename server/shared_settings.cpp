@@ -0,0 +1,150 @@
+#include "shared_settings.h"
+
+#include <QSettings>
+
+namespace
+{
+	const QString kClientSettingsGroup = "client_settings";
+	// Объявление хранится целыми числами без потери точности: время в мс от эпохи (UTC) и корт
+	const QString kBookingOpenTimeKey = "booking_open_time_ms";
+	const QString kBookingCourtKey = "booking_court_id";
+}
+
+void SharedSettings::Load()
+{
+	QSettings settings;
+	bool time_ok = false;
+	bool court_ok = false;
+	const qint64 open_time_ms = settings.value(kBookingOpenTimeKey).toLongLong(&time_ok);
+	const quint32 court_id = settings.value(kBookingCourtKey).toUInt(&court_ok);
+
+	QWriteLocker locker(&lock_);
+	settings.beginGroup(kClientSettingsGroup);
+	values_.clear();
+	for (const QString& key : settings.childKeys())
+	{
+		values_.insert(key, settings.value(key).toString());
+	}
+	++version_;
+
+	// Объявление восстанавливается только целиком
+	has_booking_open_ = time_ok && court_ok;
+	if (has_booking_open_)
+	{
+		booking_open_.open_time_ms = open_time_ms;
+		booking_open_.court_id = court_id;
+	}
+}
+
+protocol::SettingsResponse SharedSettings::Snapshot(const QVector<QString>& keys) const
+{
+	protocol::SettingsResponse response;
+
+	QReadLocker locker(&lock_);
+	response.version = version_;
+	if (keys.isEmpty())
+	{
+		response.values.reserve(values_.size());
+		for (auto it = values_.cbegin(); it != values_.cend(); ++it)
+		{
+			response.values.append(qMakePair(it.key(), it.value()));
+		}
+		return response;
+	}
+
+	for (const QString& key : keys)
+	{
+		const auto it = values_.constFind(key);
+		if (it != values_.cend())
+		{
+			response.values.append(qMakePair(key, it.value()));
+		}
+	}
+	return response;
+}
+
+protocol::SettingsDelta SharedSettings::Update(const QVector<QPair<QString, QString>>& values)
+{
+	protocol::SettingsDelta delta;
+	{
+		QWriteLocker locker(&lock_);
+		delta.base_version = version_;
+		for (const QPair<QString, QString>& value : values)
+		{
+			const auto it = values_.constFind(value.first);
+			if (it == values_.cend() || it.value() != value.second)
+			{
+				values_.insert(value.first, value.second);
+				delta.values.append(value);
+			}
+		}
+
+		if (delta.values.isEmpty())
+		{
+			delta.version = version_;
+			return delta;
+		}
+		delta.version = ++version_;
+	}
+
+	QSettings settings;
+	settings.beginGroup(kClientSettingsGroup);
+	for (const QPair<QString, QString>& value : delta.values)
+	{
+		settings.setValue(value.first, value.second);
+	}
+	return delta;
+}
+
+void SharedSettings::SetBookingOpen(const protocol::BookingOpen& booking_open, bool persist)
+{
+	{
+		QWriteLocker locker(&lock_);
+		booking_open_ = booking_open;
+		has_booking_open_ = true;
+	}
+
+	if (!persist)
+	{
+		return;
+	}
+
+	QSettings settings;
+	settings.setValue(kBookingOpenTimeKey, booking_open.open_time_ms);
+	settings.setValue(kBookingCourtKey, booking_open.court_id);
+}
+
+bool SharedSettings::CurrentBookingOpen(protocol::BookingOpen& booking_open) const
+{
+	QReadLocker locker(&lock_);
+	booking_open = booking_open_;
+	return has_booking_open_;
+}
+
+void SharedSettings::SetTemplatePack(const QByteArray& pack, const protocol::TemplatePackInfo& info)
+{
+	QWriteLocker locker(&lock_);
+	template_pack_ = pack;
+	template_pack_info_ = info;
+}
+
+bool SharedSettings::CurrentTemplatePack(protocol::TemplatePackInfo& info) const
+{
+	QReadLocker locker(&lock_);
+	info = template_pack_info_;
+	return !template_pack_.isEmpty();
+}
+
+bool SharedSettings::TemplatePackChunk(quint32 version, quint32 offset, protocol::TemplatePackChunk& chunk) const
+{
+	QReadLocker locker(&lock_);
+	if (template_pack_.isEmpty() || version != template_pack_info_.version || offset >= static_cast<quint32>(template_pack_.size()))
+	{
+		return false;
+	}
+
+	chunk.version = version;
+	chunk.offset = offset;
+	chunk.data = template_pack_.mid(static_cast<int>(offset), protocol::kTemplatePackChunkSize);
+	return true;
+}
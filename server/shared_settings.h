@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QMap>
+#include <QReadWriteLock>
+#include <QString>
+
+#include "protocol.h"
+
+// Настройки, которые сервер раздает клиентам, и объявленное время открытия записи.
+// Общие для всех потоков-обработчиков; изменения сохраняются в QSettings сервера
+class SharedSettings final
+{
+public:
+	// Из группы client_settings и настроек booking_open_time_ms и booking_court_id
+	void Load();
+
+	// Пустой список - все настройки
+	protocol::SettingsResponse Snapshot(const QVector<QString>& keys) const;
+
+	// Запоминает значения и возвращает разницу с прежней версией: только действительно изменившиеся
+	protocol::SettingsDelta Update(const QVector<QPair<QString, QString>>& values);
+
+	// persist = false - объявление только в памяти (замерные прогоны), сохраненное в QSettings не меняется
+	void SetBookingOpen(const protocol::BookingOpen& booking_open, bool persist);
+
+	// false - время открытия еще не объявлено
+	bool CurrentBookingOpen(protocol::BookingOpen& booking_open) const;
+
+	// Пакет шаблонов (template_pack_format) целиком, раздается клиентам кусками
+	void SetTemplatePack(const QByteArray& pack, const protocol::TemplatePackInfo& info);
+
+	// false - пакета нет
+	bool CurrentTemplatePack(protocol::TemplatePackInfo& info) const;
+
+	// false - версия уже не текущая или offset за концом файла
+	bool TemplatePackChunk(quint32 version, quint32 offset, protocol::TemplatePackChunk& chunk) const;
+
+private:
+	mutable QReadWriteLock lock_;
+	QMap<QString, QString> values_;
+	quint32 version_ = 0;
+	protocol::BookingOpen booking_open_;
+	bool has_booking_open_ = false;
+	// Копия QByteArray - только счетчик ссылок, файл в памяти один
+	QByteArray template_pack_;
+	protocol::TemplatePackInfo template_pack_info_;
+};
@@ -0,0 +1,80 @@
+#include "template_pack_source.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include "template_pack_format.h"
+
+namespace
+{
+	const int kReloadDelayMs = 500;
+}
+
+TemplatePackSource::TemplatePackSource(QObject* parent)
+	: QObject(parent)
+{
+	reload_timer_.setSingleShot(true);
+	reload_timer_.setInterval(kReloadDelayMs);
+	bool connection = connect(&reload_timer_, &QTimer::timeout, this, &TemplatePackSource::Reload); Q_ASSERT(connection);
+	connection = connect(&watcher_, &QFileSystemWatcher::fileChanged, this, &TemplatePackSource::OnFileChanged); Q_ASSERT(connection);
+	// Замена файла переименованием снимает слежение за ним, каталог сообщает о появлении нового
+	connection = connect(&watcher_, &QFileSystemWatcher::directoryChanged, this, &TemplatePackSource::OnFileChanged); Q_ASSERT(connection);
+}
+
+TemplatePackSource::~TemplatePackSource() = default;
+
+bool TemplatePackSource::Watch(const QString& path)
+{
+	path_ = path;
+	if (!watcher_.files().isEmpty())
+	{
+		watcher_.removePaths(watcher_.files());
+	}
+	if (!watcher_.directories().isEmpty())
+	{
+		watcher_.removePaths(watcher_.directories());
+	}
+
+	watcher_.addPath(QFileInfo(path_).absolutePath());
+	Reload();
+	return version_ != 0;
+}
+
+void TemplatePackSource::OnFileChanged()
+{
+	reload_timer_.start();
+}
+
+void TemplatePackSource::Reload()
+{
+	if (QFile::exists(path_) && !watcher_.files().contains(path_))
+	{
+		watcher_.addPath(path_);
+	}
+
+	QFile file(path_);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open template pack : ") << path_ << file.errorString();
+		return;
+	}
+
+	const QByteArray pack = file.readAll();
+	if (!template_pack_format::Validate(reinterpret_cast<const uchar*>(pack.constData()), pack.size()))
+	{
+		qWarning() << QString::fromUtf8("Invalid template pack, previous version is kept : ") << path_;
+		return;
+	}
+
+	const quint32 version = reinterpret_cast<const template_pack_format::PackHeader*>(pack.constData())->pack_version;
+	if (version == version_)
+	{
+		return;
+	}
+
+	version_ = version;
+	qDebug() << QString::fromUtf8("Template pack loaded : ") << path_ << QString::fromUtf8(" version ") << version
+		<< QString::fromUtf8(" bytes ") << pack.size();
+	emit PackChanged(pack, version);
+}
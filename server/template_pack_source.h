@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QTimer>
+
+// Файл пакета шаблонов, который раздает сервер. Новая сборка кладется поверх старой, файл перечитывается сам.
+// Испорченный или недописанный файл пропускается: клиенты остаются на прежней версии
+class TemplatePackSource final
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TemplatePackSource(QObject* parent = nullptr);
+	~TemplatePackSource() override;
+
+	// Читает файл и следит за ним. false - файла нет или это не пакет, слежение все равно продолжается
+	bool Watch(const QString& path);
+
+Q_SIGNALS:
+
+	// Файл прочитан и проверен, версия отличается от прежней
+	void PackChanged(const QByteArray& pack, quint32 version);
+
+private Q_SLOTS:
+
+	void OnFileChanged();
+
+	void Reload();
+
+private:
+	QString path_;
+	QFileSystemWatcher watcher_;
+	// Запись файла идет частями: перечитываем, когда изменения затихли
+	QTimer reload_timer_;
+	quint32 version_ = 0;
+};
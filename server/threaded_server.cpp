@@ -0,0 +1,218 @@
+#include "threaded_server.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QStandardPaths>
+#include <QThread>
+
+#include "claim_arbiter.h"
+#include "connection_worker.h"
+#include "monotonic_clock.h"
+#include "server_metrics.h"
+#include "shared_settings.h"
+#include "user_registry.h"
+
+ThreadedServer::ThreadedServer(int worker_count, const QString& registry_dir, QObject* parent)
+	: QTcpServer(parent)
+	, settings_(new SharedSettings)
+	, registry_(new UserRegistry)
+	, arbiter_(new ClaimArbiter)
+{
+	settings_->Load();
+	// Load восстанавливает объявление только целиком, с временем в мс и кортом: слот открывается тот же,
+	// что объявлен клиентам, а не со сдвинутым временем или чужим кортом
+	protocol::BookingOpen booking_open;
+	if (settings_->CurrentBookingOpen(booking_open))
+	{
+		arbiter_->OpenSlot(booking_open);
+	}
+	registry_->Open(registry_dir.isEmpty()
+		? QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QString::fromUtf8("/registry")
+		: registry_dir);
+
+	if (worker_count <= 0)
+	{
+		worker_count = qMax(1, QThread::idealThreadCount());
+	}
+	metrics_.reset(new ServerMetrics(worker_count));
+
+	for (int i = 0; i < worker_count; ++i)
+	{
+		QThread* thread = new QThread(this);
+		thread->setObjectName(QString::fromUtf8("connection_worker_%1").arg(i));
+
+		// Без родителя: объект с родителем нельзя перенести в другой поток
+		ConnectionWorker* worker = new ConnectionWorker(i, settings_, registry_, metrics_, arbiter_);
+		worker->moveToThread(thread);
+
+		bool connection = true;
+		connection = connect(thread, &QThread::finished, worker, &QObject::deleteLater); Q_ASSERT(connection);
+		connection = connect(worker, &ConnectionWorker::ClientConnected, this, &ThreadedServer::OnClientConnected); Q_ASSERT(connection);
+		connection = connect(worker, &ConnectionWorker::ClientDisconnected, this, &ThreadedServer::OnClientDisconnected); Q_ASSERT(connection);
+		connection = connect(worker, &ConnectionWorker::BroadcastDone, this, &ThreadedServer::OnBroadcastDone); Q_ASSERT(connection);
+
+		thread->start();
+		threads_.append(thread);
+		workers_.append(worker);
+	}
+}
+
+ThreadedServer::~ThreadedServer()
+{
+	close();
+
+	// Обработчики и их сессии удаляются в своих потоках по finished
+	for (QThread* thread : threads_)
+	{
+		thread->quit();
+	}
+	for (QThread* thread : threads_)
+	{
+		thread->wait();
+	}
+}
+
+int ThreadedServer::WorkerCount() const
+{
+	return workers_.size();
+}
+
+int ThreadedServer::ConnectionCount() const
+{
+	return connection_count_;
+}
+
+const QSharedPointer<SharedSettings>& ThreadedServer::Settings() const
+{
+	return settings_;
+}
+
+const QSharedPointer<UserRegistry>& ThreadedServer::Registry() const
+{
+	return registry_;
+}
+
+const QSharedPointer<ServerMetrics>& ThreadedServer::Metrics() const
+{
+	return metrics_;
+}
+
+const QSharedPointer<ClaimArbiter>& ThreadedServer::Arbiter() const
+{
+	return arbiter_;
+}
+
+quint64 ThreadedServer::Broadcast(const QByteArray& frame)
+{
+	const quint64 sequence = next_broadcast_++;
+	Fanout& fanout = fanouts_[sequence];
+	fanout.workers_left = workers_.size();
+	metrics_->SetPendingBroadcasts(fanouts_.size());
+
+	// Копия QByteArray - только счетчик ссылок, данные кадра у всех обработчиков и сокетов общие
+	const qint64 enqueued_ns = MonotonicNs();
+	for (ConnectionWorker* worker : workers_)
+	{
+		QMetaObject::invokeMethod(worker, [worker, frame, sequence, enqueued_ns]() {
+			worker->Broadcast(frame, sequence, enqueued_ns);
+			}, Qt::QueuedConnection);
+	}
+	return sequence;
+}
+
+void ThreadedServer::PublishSettings(const QVector<QPair<QString, QString>>& values)
+{
+	const protocol::SettingsDelta delta = settings_->Update(values);
+	if (delta.values.isEmpty())
+	{
+		return;
+	}
+	Broadcast(protocol::Encode(delta));
+}
+
+void ThreadedServer::PublishBookingOpen(const protocol::BookingOpen& booking_open, bool persist)
+{
+	settings_->SetBookingOpen(booking_open, persist);
+	// Слот открывается до рассылки: заявка, отправленная по объявлению, уже найдет его
+	arbiter_->OpenSlot(booking_open);
+	Broadcast(protocol::Encode(booking_open));
+}
+
+void ThreadedServer::PublishTemplatePack(const QByteArray& pack, quint32 version)
+{
+	protocol::TemplatePackInfo info;
+	info.version = version;
+	info.size = static_cast<quint32>(pack.size());
+	info.sha256 = QCryptographicHash::hash(pack, QCryptographicHash::Sha256);
+	settings_->SetTemplatePack(pack, info);
+	Broadcast(protocol::Encode(info));
+}
+
+quint64 ThreadedServer::BroadcastProbe()
+{
+	protocol::Heartbeat probe;
+	probe.sequence = protocol::kProbeSequenceFlag | next_broadcast_;
+	probe.sent_ns = MonotonicNs();
+	return Broadcast(protocol::Encode(probe));
+}
+
+void ThreadedServer::OnBroadcastDone(quint64 sequence, int clients, qint64 elapsed_ns)
+{
+	auto it = fanouts_.find(sequence);
+	if (it == fanouts_.end())
+	{
+		return;
+	}
+
+	it->clients += clients;
+	it->max_ns = qMax(it->max_ns, elapsed_ns);
+	if (--it->workers_left > 0)
+	{
+		return;
+	}
+
+	const Fanout fanout = *it;
+	fanouts_.erase(it);
+	metrics_->SetPendingBroadcasts(fanouts_.size());
+	metrics_->RecordBroadcast(fanout.clients, fanout.max_ns);
+	qDebug() << QString::fromUtf8("Broadcast %1 : %2 clients in %3 us")
+		.arg(sequence).arg(fanout.clients).arg(fanout.max_ns / 1000.0, 0, 'f', 1);
+	emit BroadcastFinished(sequence, fanout.clients, fanout.max_ns);
+}
+
+ConnectionWorker* ThreadedServer::PickWorker() const
+{
+	ConnectionWorker* best = workers_.first();
+	for (ConnectionWorker* worker : workers_)
+	{
+		if (worker->ConnectionCount() < best->ConnectionCount())
+		{
+			best = worker;
+		}
+	}
+	return best;
+}
+
+void ThreadedServer::incomingConnection(qintptr socket_descriptor)
+{
+	// Сокет создается уже в потоке обработчика по дескриптору: QTcpSocket нельзя перенести между потоками с открытым соединением
+	ConnectionWorker* worker = PickWorker();
+	worker->ReserveConnection();
+	metrics_->AddAccepted();
+	const quint32 client_id = next_client_id_++;
+	QMetaObject::invokeMethod(worker, [worker, socket_descriptor, client_id]() {
+		worker->AddConnection(socket_descriptor, client_id);
+		}, Qt::QueuedConnection);
+}
+
+void ThreadedServer::OnClientConnected(quint32 client_id)
+{
+	Q_UNUSED(client_id);
+	emit ConnectionCountChanged(++connection_count_);
+}
+
+void ThreadedServer::OnClientDisconnected(quint32 client_id)
+{
+	Q_UNUSED(client_id);
+	emit ConnectionCountChanged(--connection_count_);
+}
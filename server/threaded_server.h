@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QTcpServer>
+#include <QVector>
+
+#include "protocol.h"
+
+class ClaimArbiter;
+class ConnectionWorker;
+class ServerMetrics;
+class SharedSettings;
+class UserRegistry;
+class QThread;
+
+// Принимает соединения и раздает их обработчикам в пуле потоков, каждый со своим циклом событий.
+// Поток сервера только принимает сокеты, разбор и ответы идут в потоках обработчиков
+class ThreadedServer final
+	: public QTcpServer
+{
+	Q_OBJECT
+
+public:
+	// worker_count <= 0 - по числу ядер. Пустой registry_dir - каталог registry в данных приложения
+	explicit ThreadedServer(int worker_count = 0, const QString& registry_dir = QString(), QObject* parent = nullptr);
+	~ThreadedServer() override;
+
+	int WorkerCount() const;
+
+	// Текущее число соединений по всем обработчикам
+	int ConnectionCount() const;
+
+	const QSharedPointer<SharedSettings>& Settings() const;
+
+	const QSharedPointer<UserRegistry>& Registry() const;
+
+	const QSharedPointer<ServerMetrics>& Metrics() const;
+
+	const QSharedPointer<ClaimArbiter>& Arbiter() const;
+
+	// Кадр сериализован один раз и до записи в сокеты раздается обработчикам и очередям соединений как общий
+	// неизменяемый QByteArray; копию получает только буфер записи каждого сокета. Возвращает номер рассылки
+	quint64 Broadcast(const QByteArray& frame);
+
+	// Рассылает только изменившиеся значения
+	void PublishSettings(const QVector<QPair<QString, QString>>& values);
+
+	// Объявленный слот сразу принимает заявки клиентов (BookingClaim). persist = false - объявление не сохраняется
+	// в настройках сервера и после перезапуска не восстанавливается
+	void PublishBookingOpen(const protocol::BookingOpen& booking_open, bool persist = true);
+
+	// Новый пакет шаблонов: клиентам рассылается только его описание, файл каждый забирает сам, если его нет в кэше
+	void PublishTemplatePack(const QByteArray& pack, quint32 version);
+
+	// Замерный heartbeat всем клиентам (protocol::kProbeSequenceFlag) для нагрузочных прогонов
+	quint64 BroadcastProbe();
+
+Q_SIGNALS:
+
+	void ConnectionCountChanged(int connection_count);
+
+	// Все обработчики записали кадр в сокеты своих клиентов. fanout_ns - от постановки в очередь до последнего сокета
+	void BroadcastFinished(quint64 sequence, int clients, qint64 fanout_ns);
+
+protected:
+
+	void incomingConnection(qintptr socket_descriptor) override;
+
+private Q_SLOTS:
+
+	void OnClientConnected(quint32 client_id);
+
+	void OnClientDisconnected(quint32 client_id);
+
+	void OnBroadcastDone(quint64 sequence, int clients, qint64 elapsed_ns);
+
+private:
+	// Обработчик с наименьшим числом соединений
+	ConnectionWorker* PickWorker() const;
+
+private:
+	// Рассылка, по которой ждем отчеты обработчиков
+	struct Fanout
+	{
+		int workers_left = 0;
+		int clients = 0;
+		qint64 max_ns = 0;
+	};
+
+	QSharedPointer<SharedSettings> settings_;
+	QSharedPointer<UserRegistry> registry_;
+	QSharedPointer<ServerMetrics> metrics_;
+	QSharedPointer<ClaimArbiter> arbiter_;
+	QVector<QThread*> threads_;
+	QVector<ConnectionWorker*> workers_;
+	quint32 next_client_id_ = 1;
+	int connection_count_ = 0;
+	quint64 next_broadcast_ = 1;
+	QHash<quint64, Fanout> fanouts_;
+};
@@ -0,0 +1,467 @@
+#include "user_registry.h"
+#include "registry_format.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QSaveFile>
+#include <QElapsedTimer>
+#include <array>
+
+#include "frame_auth.h"
+#include <cstring>
+
+namespace
+{
+	// Журнал сворачивается в снимок после стольких записей
+	const int kCompactAfterEntries = 4096;
+
+	const QDataStream::Version kStreamVersion = QDataStream::Qt_5_12;
+
+	quint32 Crc32(const char* data, int size)
+	{
+		static const std::array<quint32, 256> table = []() {
+			std::array<quint32, 256> values = {};
+			for (quint32 i = 0; i < 256; ++i)
+			{
+				quint32 crc = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+				}
+				values[i] = crc;
+			}
+			return values;
+		}();
+
+		quint32 crc = 0xFFFFFFFFu;
+		const uchar* bytes = reinterpret_cast<const uchar*>(data);
+		for (int i = 0; i < size; ++i)
+		{
+			crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return crc ^ 0xFFFFFFFFu;
+	}
+
+	QByteArray Serialize(const UserRecord& record)
+	{
+		QByteArray data;
+		QDataStream stream(&data, QIODevice::WriteOnly);
+		stream.setVersion(kStreamVersion);
+		stream << record.name << record.key << record.license_until_ms << record.enabled << record.settings;
+		return data;
+	}
+
+	// data - прямо в отображенном файле, QByteArray::fromRawData его не копирует.
+	// В файлах версии kSecretVersion на месте ключа секрет: ключ вычисляется из него
+	bool Deserialize(const char* data, int size, quint32 version, UserRecord& record)
+	{
+		const QByteArray raw = QByteArray::fromRawData(data, size);
+		QDataStream stream(raw);
+		stream.setVersion(kStreamVersion);
+		stream >> record.name >> record.key >> record.license_until_ms >> record.enabled >> record.settings;
+		if (stream.status() != QDataStream::Ok || record.name.isEmpty())
+		{
+			return false;
+		}
+
+		if (version == registry_format::kSecretVersion)
+		{
+			record.key = FrameAuthenticator::DeriveUserKey(record.name, record.key);
+		}
+		return true;
+	}
+
+	registry_format::FileHeader MakeFileHeader(const char (&magic)[4])
+	{
+		registry_format::FileHeader header = {};
+		std::memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = registry_format::kVersion;
+		header.header_size = sizeof(registry_format::FileHeader);
+		return header;
+	}
+
+	bool IsValidHeader(const uchar* data, qint64 size, const char (&magic)[4], quint32& version)
+	{
+		if (size < static_cast<qint64>(sizeof(registry_format::FileHeader)))
+		{
+			return false;
+		}
+
+		const registry_format::FileHeader* header = reinterpret_cast<const registry_format::FileHeader*>(data);
+		version = header->version;
+		return std::memcmp(header->magic, magic, sizeof(magic)) == 0
+			&& (header->version == registry_format::kVersion || header->version == registry_format::kSecretVersion)
+			&& header->header_size == sizeof(registry_format::FileHeader);
+	}
+
+	// Проверенная запись по смещению offset. false - конец данных или порча
+	bool NextEntry(const uchar* data, qint64 size, qint64& offset, const registry_format::EntryHeader*& entry)
+	{
+		using namespace registry_format;
+
+		if (offset + static_cast<qint64>(sizeof(EntryHeader)) > size)
+		{
+			return false;
+		}
+
+		entry = reinterpret_cast<const EntryHeader*>(data + offset);
+		const qint64 data_offset = offset + sizeof(EntryHeader);
+		if (entry->size > kMaxEntrySize || data_offset + entry->size > size
+			|| Crc32(reinterpret_cast<const char*>(data + data_offset), static_cast<int>(entry->size)) != entry->crc)
+		{
+			return false;
+		}
+
+		offset = data_offset + entry->size;
+		return true;
+	}
+}
+
+UserRegistry::~UserRegistry()
+{
+	Close();
+}
+
+bool UserRegistry::Open(const QString& directory)
+{
+	Close();
+
+	if (!QDir().mkpath(directory))
+	{
+		qWarning() << QString::fromUtf8("Unable to create registry directory : ") << directory;
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	snapshot_path_ = QDir(directory).filePath(QString::fromUtf8("users.snapshot"));
+	log_path_ = QDir(directory).filePath(QString::fromUtf8("users.log"));
+
+	QWriteLocker locker(&lock_);
+	users_.clear();
+	secret_format_ = false;
+	if (!LoadSnapshot(snapshot_path_) || !ReplayLog(log_path_))
+	{
+		users_.clear();
+		return false;
+	}
+
+	qDebug() << QString::fromUtf8("User registry loaded : %1 users, %2 log entries, %3 ms")
+		.arg(users_.size()).arg(log_entries_).arg(timer.elapsed());
+
+	// Секреты не должны оставаться на диске, и новые записи нельзя дописывать в журнал старого формата
+	const bool convert = secret_format_;
+	locker.unlock();
+	if (convert && !Compact())
+	{
+		qWarning() << QString::fromUtf8("Unable to convert registry secrets to keys : ") << directory;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void UserRegistry::Close()
+{
+	QWriteLocker locker(&lock_);
+	log_.close();
+	users_.clear();
+	log_entries_ = 0;
+}
+
+bool UserRegistry::IsOpen() const
+{
+	QReadLocker locker(&lock_);
+	return log_.isOpen();
+}
+
+bool UserRegistry::LoadSnapshot(const QString& path)
+{
+	using namespace registry_format;
+
+	QFile file(path);
+	if (!file.exists())
+	{
+		return true;
+	}
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to open registry snapshot : ") << path << file.errorString();
+		return false;
+	}
+
+	const qint64 size = file.size();
+	const uchar* data = file.map(0, size);
+	if (!data)
+	{
+		qWarning() << QString::fromUtf8("Unable to map registry snapshot : ") << file.errorString();
+		return false;
+	}
+
+	// Снимок пишется атомарно (QSaveFile), поэтому порча в нем - ошибка, а не оборванная запись
+	quint32 version = 0;
+	bool ok = IsValidHeader(data, size, kSnapshotMagic, version)
+		&& size >= static_cast<qint64>(sizeof(FileHeader) + sizeof(SnapshotHeader));
+	secret_format_ = secret_format_ || (ok && version == kSecretVersion);
+	if (ok)
+	{
+		const SnapshotHeader* snapshot = reinterpret_cast<const SnapshotHeader*>(data + sizeof(FileHeader));
+		users_.reserve(static_cast<int>(qMin<quint64>(snapshot->count, size / sizeof(EntryHeader))));
+
+		qint64 offset = sizeof(FileHeader) + sizeof(SnapshotHeader);
+		const EntryHeader* entry = nullptr;
+		for (quint64 i = 0; ok && i < snapshot->count; ++i)
+		{
+			ok = NextEntry(data, size, offset, entry) && entry->operation == static_cast<quint8>(Operation::Put);
+			if (ok)
+			{
+				UserRecord record;
+				ok = Deserialize(reinterpret_cast<const char*>(entry + 1), static_cast<int>(entry->size), version, record);
+				users_.insert(record.name, record);
+			}
+		}
+	}
+
+	file.unmap(const_cast<uchar*>(data));
+	if (!ok)
+	{
+		qWarning() << QString::fromUtf8("Registry snapshot is corrupted : ") << path;
+	}
+	return ok;
+}
+
+bool UserRegistry::ReplayLog(const QString& path)
+{
+	using namespace registry_format;
+
+	QFile file(path);
+	if (!file.exists() || file.size() == 0)
+	{
+		return OpenLogForAppend(true);
+	}
+
+	if (!file.open(QIODevice::ReadWrite))
+	{
+		qWarning() << QString::fromUtf8("Unable to open registry log : ") << path << file.errorString();
+		return false;
+	}
+
+	const qint64 size = file.size();
+	const uchar* data = file.map(0, size);
+	if (!data)
+	{
+		qWarning() << QString::fromUtf8("Unable to map registry log : ") << file.errorString();
+		return false;
+	}
+
+	quint32 version = 0;
+	if (!IsValidHeader(data, size, kLogMagic, version))
+	{
+		file.unmap(const_cast<uchar*>(data));
+		qWarning() << QString::fromUtf8("Unknown registry log format : ") << path;
+		return false;
+	}
+
+	qint64 offset = sizeof(FileHeader);
+	const EntryHeader* entry = nullptr;
+	while (NextEntry(data, size, offset, entry))
+	{
+		Apply(entry->operation, reinterpret_cast<const char*>(entry + 1), static_cast<int>(entry->size), version);
+		++log_entries_;
+	}
+	file.unmap(const_cast<uchar*>(data));
+	secret_format_ = secret_format_ || version == kSecretVersion;
+
+	// Запись, оборванная при падении, отбрасывается: следующие пишутся после последней целой
+	if (offset < size)
+	{
+		qWarning() << QString::fromUtf8("Registry log tail is truncated : ") << size - offset << QString::fromUtf8("bytes");
+		if (!file.resize(offset))
+		{
+			qWarning() << QString::fromUtf8("Unable to truncate registry log : ") << file.errorString();
+			return false;
+		}
+	}
+	file.close();
+
+	return OpenLogForAppend(false);
+}
+
+bool UserRegistry::OpenLogForAppend(bool truncate)
+{
+	log_.close();
+	log_.setFileName(log_path_);
+	if (!log_.open(truncate ? QIODevice::WriteOnly | QIODevice::Truncate : QIODevice::WriteOnly | QIODevice::Append))
+	{
+		qWarning() << QString::fromUtf8("Unable to open registry log : ") << log_path_ << log_.errorString();
+		return false;
+	}
+
+	if (truncate)
+	{
+		const registry_format::FileHeader header = MakeFileHeader(registry_format::kLogMagic);
+		if (log_.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header) || !log_.flush())
+		{
+			qWarning() << QString::fromUtf8("Write registry log header error : ") << log_.errorString();
+			log_.close();
+			return false;
+		}
+		log_entries_ = 0;
+	}
+	return true;
+}
+
+bool UserRegistry::AppendEntry(quint8 operation, const QByteArray& data)
+{
+	registry_format::EntryHeader entry = {};
+	entry.size = static_cast<quint32>(data.size());
+	entry.crc = Crc32(data.constData(), data.size());
+	entry.operation = operation;
+
+	// Данные уходят в ОС сразу: падение процесса их не теряет, а оборванную запись отбросит проверка crc
+	if (!log_.isOpen()
+		|| log_.write(reinterpret_cast<const char*>(&entry), sizeof(entry)) != sizeof(entry)
+		|| log_.write(data) != data.size()
+		|| !log_.flush())
+	{
+		qWarning() << QString::fromUtf8("Write registry log error : ") << log_.errorString();
+		return false;
+	}
+
+	++log_entries_;
+	return true;
+}
+
+void UserRegistry::Apply(quint8 operation, const char* data, int size, quint32 version)
+{
+	if (operation == static_cast<quint8>(registry_format::Operation::Put))
+	{
+		UserRecord record;
+		if (Deserialize(data, size, version, record))
+		{
+			users_.insert(record.name, record);
+		}
+	}
+	else if (operation == static_cast<quint8>(registry_format::Operation::Remove))
+	{
+		users_.remove(QString::fromUtf8(data, size));
+	}
+}
+
+bool UserRegistry::Find(const QString& name, UserRecord& record) const
+{
+	QReadLocker locker(&lock_);
+	const auto it = users_.constFind(name);
+	if (it == users_.cend())
+	{
+		return false;
+	}
+
+	record = it.value();
+	return true;
+}
+
+int UserRegistry::Count() const
+{
+	QReadLocker locker(&lock_);
+	return users_.size();
+}
+
+bool UserRegistry::Put(const UserRecord& record)
+{
+	if (record.name.isEmpty())
+	{
+		return false;
+	}
+
+	QWriteLocker locker(&lock_);
+	if (!AppendEntry(static_cast<quint8>(registry_format::Operation::Put), Serialize(record)))
+	{
+		return false;
+	}
+	users_.insert(record.name, record);
+
+	const bool compact = log_entries_ >= kCompactAfterEntries;
+	locker.unlock();
+	if (compact)
+	{
+		Compact();
+	}
+	return true;
+}
+
+bool UserRegistry::Remove(const QString& name)
+{
+	QWriteLocker locker(&lock_);
+	if (!users_.contains(name))
+	{
+		return false;
+	}
+
+	if (!AppendEntry(static_cast<quint8>(registry_format::Operation::Remove), name.toUtf8()))
+	{
+		return false;
+	}
+	users_.remove(name);
+
+	const bool compact = log_entries_ >= kCompactAfterEntries;
+	locker.unlock();
+	if (compact)
+	{
+		Compact();
+	}
+	return true;
+}
+
+bool UserRegistry::Compact()
+{
+	using namespace registry_format;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Под блокировкой: запись, попавшая в журнал во время сворачивания, иначе потерялась бы при его очистке
+	QWriteLocker locker(&lock_);
+
+	QSaveFile file(snapshot_path_);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		qWarning() << QString::fromUtf8("Unable to write registry snapshot : ") << snapshot_path_ << file.errorString();
+		return false;
+	}
+
+	const FileHeader header = MakeFileHeader(kSnapshotMagic);
+	SnapshotHeader snapshot = {};
+	snapshot.count = static_cast<quint64>(users_.size());
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&snapshot), sizeof(snapshot));
+	for (const UserRecord& record : users_)
+	{
+		const QByteArray data = Serialize(record);
+		EntryHeader entry = {};
+		entry.size = static_cast<quint32>(data.size());
+		entry.crc = Crc32(data.constData(), data.size());
+		entry.operation = static_cast<quint8>(Operation::Put);
+		file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		file.write(data);
+	}
+
+	// Снимок заменяется атомарно. Если упасть до очистки журнала, его записи повторно применятся
+	// поверх снимка с тем же результатом: каждая запись - пользователь целиком или удаление
+	if (!file.commit())
+	{
+		qWarning() << QString::fromUtf8("Unable to write registry snapshot : ") << file.errorString();
+		return false;
+	}
+
+	if (!OpenLogForAppend(true))
+	{
+		return false;
+	}
+
+	qDebug() << QString::fromUtf8("User registry compacted : %1 users, %2 ms").arg(users_.size()).arg(timer.elapsed());
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QReadWriteLock>
+#include <QString>
+
+// Пользователь сервера: ключ для проверки подлинности, лицензия и собственные настройки
+struct UserRecord
+{
+	QString name;
+	// FrameAuthenticator::DeriveUserKey от секрета пользователя, сам секрет не хранится. Пустой - без ключа
+	QByteArray key;
+	qint64 license_until_ms = 0; // UTC, мс от эпохи. 0 - без ограничения
+	bool enabled = true;
+	QMap<QString, QString> settings; // поверх общих настроек клиента
+
+	bool IsLicensed(qint64 now_ms) const
+	{
+		return enabled && (license_until_ms == 0 || now_ms < license_until_ms);
+	}
+};
+
+// Реестр пользователей: хэш-индекс в памяти для поиска на каждом сообщении, изменения дописываются в журнал
+// с контрольными суммами, журнал периодически сворачивается в снимок. При запуске снимок читается через
+// отображение в память и поверх него проигрывается журнал. Потокобезопасен
+class UserRegistry final
+{
+public:
+	UserRegistry() = default;
+	~UserRegistry();
+
+	// Каталог с users.snapshot и users.log, создается при необходимости
+	bool Open(const QString& directory);
+	void Close();
+
+	// Файлы реестра открыты и прочитаны
+	bool IsOpen() const;
+
+	bool Find(const QString& name, UserRecord& record) const;
+
+	int Count() const;
+
+	// Добавляет или заменяет пользователя целиком
+	bool Put(const UserRecord& record);
+
+	bool Remove(const QString& name);
+
+	// Снимок всех пользователей и пустой журнал
+	bool Compact();
+
+private:
+	bool LoadSnapshot(const QString& path);
+	bool ReplayLog(const QString& path);
+	bool OpenLogForAppend(bool truncate);
+	bool AppendEntry(quint8 operation, const QByteArray& data);
+
+	void Apply(quint8 operation, const char* data, int size, quint32 version);
+
+private:
+	mutable QReadWriteLock lock_;
+	QHash<QString, UserRecord> users_;
+
+	QString snapshot_path_;
+	QString log_path_;
+	QFile log_;
+	int log_entries_ = 0;
+	// Прочитан файл в формате с секретами (registry_format::kSecretVersion): после загрузки реестр переписывается
+	bool secret_format_ = false;
+};
@@ -0,0 +1,164 @@
+#include <QSet>
+#include <QtTest>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "claim_arbiter.h"
+
+namespace
+{
+	const qint64 kOpenTimeMs = 1790000000000;
+	const qint64 kNsInMs = 1000000;
+	const qint64 kAfterOpenNs = kOpenTimeMs * kNsInMs + 1;
+
+	protocol::BookingOpen MakeBookingOpen(quint32 court_id, qint64 open_time_ms = kOpenTimeMs)
+	{
+		protocol::BookingOpen booking_open;
+		booking_open.court_id = court_id;
+		booking_open.open_time_ms = open_time_ms;
+		return booking_open;
+	}
+}
+
+class ClaimArbiterTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+
+	void ClaimantIdIsStable()
+	{
+		const quint32 alice = ClaimArbiter::ClaimantId(QStringLiteral("alice"));
+		QVERIFY(alice != 0);
+		QCOMPARE(ClaimArbiter::ClaimantId(QStringLiteral("alice")), alice);
+		QVERIFY(ClaimArbiter::ClaimantId(QStringLiteral("bob")) != alice);
+	}
+
+	void RejectsUnknownAndEarlyClaims()
+	{
+		ClaimArbiter arbiter;
+		const quint32 alice = ClaimArbiter::ClaimantId(QStringLiteral("alice"));
+		QVERIFY(arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs).outcome == protocol::ClaimOutcome::NotOpen);
+
+		arbiter.OpenSlot(MakeBookingOpen(1));
+		QVERIFY(arbiter.Claim(1, kOpenTimeMs + 1, alice, kAfterOpenNs).outcome == protocol::ClaimOutcome::NotOpen);
+		QVERIFY(arbiter.Claim(1, kOpenTimeMs, alice, kOpenTimeMs * kNsInMs - 1).outcome == protocol::ClaimOutcome::TooEarly);
+
+		// Ранняя заявка не учитывается и не занимает слот
+		const ClaimArbiter::Decision decision = arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Won);
+		QCOMPARE(decision.claim_number, 1u);
+	}
+
+	// Слот - первому пользователю; повторные заявки считаются, победитель не меняется
+	void FirstClaimWins()
+	{
+		ClaimArbiter arbiter;
+		arbiter.OpenSlot(MakeBookingOpen(1));
+		const quint32 alice = ClaimArbiter::ClaimantId(QStringLiteral("alice"));
+		const quint32 bob = ClaimArbiter::ClaimantId(QStringLiteral("bob"));
+
+		ClaimArbiter::Decision decision = arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Won);
+		QCOMPARE(decision.winner_id, alice);
+
+		decision = arbiter.Claim(1, kOpenTimeMs, bob, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Lost);
+		QCOMPARE(decision.winner_id, alice);
+		QCOMPARE(decision.claim_number, 2u);
+
+		decision = arbiter.Claim(1, kOpenTimeMs, bob, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Lost);
+		QCOMPARE(decision.claim_number, 3u);
+
+		// Тот же пользователь с другого соединения - тот же участник
+		decision = arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Won);
+		QCOMPARE(decision.claim_number, 4u);
+
+		// Другой корт разбирается отдельно
+		arbiter.OpenSlot(MakeBookingOpen(2));
+		decision = arbiter.Claim(2, kOpenTimeMs, bob, kAfterOpenNs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Won);
+		QCOMPARE(decision.claim_number, 1u);
+	}
+
+	// Повторное объявление того же времени сохраняет результат, новое время - сбрасывает
+	void ReopenKeepsOrResetsSlot()
+	{
+		ClaimArbiter arbiter;
+		arbiter.OpenSlot(MakeBookingOpen(1));
+		const quint32 alice = ClaimArbiter::ClaimantId(QStringLiteral("alice"));
+		const quint32 bob = ClaimArbiter::ClaimantId(QStringLiteral("bob"));
+		QVERIFY(arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs).outcome == protocol::ClaimOutcome::Won);
+
+		arbiter.OpenSlot(MakeBookingOpen(1));
+		QCOMPARE(arbiter.Claim(1, kOpenTimeMs, bob, kAfterOpenNs).winner_id, alice);
+
+		const qint64 next_open_ms = kOpenTimeMs + 1000;
+		arbiter.OpenSlot(MakeBookingOpen(1, next_open_ms));
+		QVERIFY(arbiter.Claim(1, kOpenTimeMs, alice, kAfterOpenNs).outcome == protocol::ClaimOutcome::NotOpen);
+		const ClaimArbiter::Decision decision = arbiter.Claim(1, next_open_ms, bob, next_open_ms * kNsInMs);
+		QVERIFY(decision.outcome == protocol::ClaimOutcome::Won);
+		QCOMPARE(decision.claim_number, 1u);
+	}
+
+	// Одновременные заявки из многих потоков: ровно один победитель, номера заявок без пропусков и повторов
+	void ConcurrentClaimsHaveOneWinner()
+	{
+		const int kThreads = 8;
+		const int kClaimsPerThread = 1000;
+
+		ClaimArbiter arbiter;
+		arbiter.OpenSlot(MakeBookingOpen(1));
+
+		std::atomic<bool> start(false);
+		std::vector<QVector<ClaimArbiter::Decision>> decisions(kThreads);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < kThreads; ++t)
+		{
+			threads.emplace_back([&, t]() {
+				const quint32 claimant = ClaimArbiter::ClaimantId(QStringLiteral("user%1").arg(t));
+				while (!start.load())
+				{
+					std::this_thread::yield();
+				}
+				for (int i = 0; i < kClaimsPerThread; ++i)
+				{
+					decisions[t].append(arbiter.Claim(1, kOpenTimeMs, claimant, kAfterOpenNs));
+				}
+			});
+		}
+		start.store(true);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		QSet<quint32> winners;
+		QSet<quint32> claim_numbers;
+		int winning_threads = 0;
+		for (const QVector<ClaimArbiter::Decision>& thread_decisions : decisions)
+		{
+			bool won = false;
+			for (const ClaimArbiter::Decision& decision : thread_decisions)
+			{
+				winners.insert(decision.winner_id);
+				claim_numbers.insert(decision.claim_number);
+				won = won || decision.outcome == protocol::ClaimOutcome::Won;
+			}
+			winning_threads += won ? 1 : 0;
+		}
+
+		QCOMPARE(static_cast<int>(winners.size()), 1);
+		QCOMPARE(winning_threads, 1);
+		QCOMPARE(static_cast<int>(claim_numbers.size()), kThreads * kClaimsPerThread);
+		QVERIFY(claim_numbers.contains(1));
+		QVERIFY(claim_numbers.contains(kThreads * kClaimsPerThread));
+	}
+};
+
+QTEST_GUILESS_MAIN(ClaimArbiterTest)
+
+#include "tst_claim_arbiter.moc"
@@ -0,0 +1,74 @@
+#include <QtTest>
+
+#include "clock_sync.h"
+
+namespace
+{
+	const qint64 kNsInMs = 1000000;
+
+	// Обмен с часами сервера впереди на offset_ns и задержками в одну и другую сторону
+	void AddExchange(ClockSync& sync, qint64 t0, qint64 offset_ns, qint64 up_ns, qint64 down_ns)
+	{
+		const qint64 t1 = t0 + up_ns + offset_ns;
+		const qint64 t2 = t1 + 100;
+		const qint64 t3 = t2 - offset_ns + down_ns;
+		sync.AddSample(t0, t1, t2, t3);
+	}
+}
+
+class ClockSyncTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+
+	void SymmetricExchangeGivesExactOffset()
+	{
+		ClockSync sync;
+		const qint64 offset_ns = 250 * kNsInMs;
+		for (int i = 0; i < 3; ++i)
+		{
+			AddExchange(sync, i * kNsInMs, offset_ns, 2 * kNsInMs, 2 * kNsInMs);
+			QVERIFY(!sync.IsSynchronized());
+		}
+		AddExchange(sync, 3 * kNsInMs, offset_ns, 2 * kNsInMs, 2 * kNsInMs);
+		QVERIFY(sync.IsSynchronized());
+		QCOMPARE(sync.OffsetNs(), offset_ns);
+		QCOMPARE(sync.DelayNs(), 4 * kNsInMs);
+
+		const QDateTime server_time = QDateTime::fromMSecsSinceEpoch(1790000000000);
+		QCOMPARE(sync.ServerToLocal(server_time), server_time.addMSecs(-250));
+	}
+
+	// Берется обмен с наименьшей задержкой: у него погрешность сдвига меньше
+	void BestDelayWins()
+	{
+		ClockSync sync;
+		const qint64 offset_ns = -40 * kNsInMs;
+		AddExchange(sync, 0, offset_ns, 30 * kNsInMs, 1 * kNsInMs);
+		AddExchange(sync, 100 * kNsInMs, offset_ns, 1 * kNsInMs, 1 * kNsInMs);
+		AddExchange(sync, 200 * kNsInMs, offset_ns, 1 * kNsInMs, 20 * kNsInMs);
+		QCOMPARE(sync.OffsetNs(), offset_ns);
+		QCOMPARE(sync.DelayNs(), 2 * kNsInMs);
+	}
+
+	// Отрицательная задержка - часы клиента переставили во время обмена
+	void NegativeDelayIsIgnored()
+	{
+		ClockSync sync;
+		sync.AddSample(1000, 0, 0, 0);
+		QCOMPARE(sync.DelayNs(), qint64(0));
+		QCOMPARE(sync.OffsetNs(), qint64(0));
+
+		AddExchange(sync, 0, 5 * kNsInMs, kNsInMs, kNsInMs);
+		QCOMPARE(sync.OffsetNs(), 5 * kNsInMs);
+
+		sync.Reset();
+		QVERIFY(!sync.IsSynchronized());
+		QCOMPARE(sync.OffsetNs(), qint64(0));
+	}
+};
+
+QTEST_GUILESS_MAIN(ClockSyncTest)
+
+#include "tst_clock_sync.moc"
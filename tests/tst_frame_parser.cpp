@@ -0,0 +1,133 @@
+#include <QtEndian>
+#include <QtTest>
+
+#include "frame_parser.h"
+#include "protocol.h"
+
+class FrameParserTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+
+	// Кадры, пришедшие по байту, отдаются целыми, по порядку и разбираются в исходные сообщения
+	void RoundTripByteByByte()
+	{
+		protocol::Hello hello;
+		hello.user_name = QString::fromUtf8("игрок");
+		hello.client_nonce = QByteArray(16, '\x01');
+		hello.proof = QByteArray(32, '\x02');
+
+		protocol::BookingOpen booking_open;
+		booking_open.open_time_ms = 1790000000123;
+		booking_open.court_id = 7;
+
+		protocol::BookingClaimResult claim_result;
+		claim_result.sequence = 42;
+		claim_result.court_id = 7;
+		claim_result.open_time_ms = booking_open.open_time_ms;
+		claim_result.outcome = protocol::ClaimOutcome::Lost;
+		claim_result.claim_number = 3;
+		claim_result.winner_id = 0xDEADBEEF;
+		claim_result.server_receive_ns = -5;
+
+		const QByteArray stream = protocol::Encode(hello) + protocol::Encode(booking_open) + protocol::Encode(claim_result);
+
+		FrameParser parser;
+		QVector<protocol::MessageType> types;
+		protocol::Hello decoded_hello;
+		protocol::BookingOpen decoded_booking_open;
+		protocol::BookingClaimResult decoded_claim_result;
+		for (const char byte : stream)
+		{
+			parser.Append(&byte, 1);
+			protocol::FrameView frame;
+			FrameParser::Status status = FrameParser::Status::NeedMore;
+			while ((status = parser.Next(frame)) == FrameParser::Status::Frame)
+			{
+				types.append(frame.type);
+				QCOMPARE(frame.version, protocol::kVersion);
+				switch (frame.type)
+				{
+				case protocol::MessageType::Hello:
+					QVERIFY(protocol::Decode(frame, decoded_hello));
+					break;
+				case protocol::MessageType::BookingOpen:
+					QVERIFY(protocol::Decode(frame, decoded_booking_open));
+					// Сообщение другого типа не разбирается
+					QVERIFY(!protocol::Decode(frame, decoded_hello));
+					break;
+				case protocol::MessageType::BookingClaimResult:
+					QVERIFY(protocol::Decode(frame, decoded_claim_result));
+					break;
+				default:
+					QFAIL("unexpected frame type");
+				}
+			}
+			QVERIFY(status == FrameParser::Status::NeedMore);
+		}
+
+		QCOMPARE(static_cast<int>(types.size()), 3);
+		QVERIFY(types[0] == protocol::MessageType::Hello);
+		QVERIFY(types[1] == protocol::MessageType::BookingOpen);
+		QVERIFY(types[2] == protocol::MessageType::BookingClaimResult);
+		QCOMPARE(parser.Pending(), 0);
+
+		QCOMPARE(decoded_hello.user_name, hello.user_name);
+		QCOMPARE(decoded_hello.client_nonce, hello.client_nonce);
+		QCOMPARE(decoded_hello.proof, hello.proof);
+		QCOMPARE(decoded_booking_open.open_time_ms, booking_open.open_time_ms);
+		QCOMPARE(decoded_booking_open.court_id, booking_open.court_id);
+		QCOMPARE(decoded_claim_result.sequence, claim_result.sequence);
+		QVERIFY(decoded_claim_result.outcome == claim_result.outcome);
+		QCOMPARE(decoded_claim_result.claim_number, claim_result.claim_number);
+		QCOMPARE(decoded_claim_result.winner_id, claim_result.winner_id);
+		QCOMPARE(decoded_claim_result.server_receive_ns, claim_result.server_receive_ns);
+	}
+
+	// Нагрузка короче или длиннее сообщения - ошибка разбора, а не чтение за границей
+	void DecodeChecksPayloadSize()
+	{
+		protocol::BookingOpen booking_open;
+		QByteArray frame_data = protocol::Encode(booking_open);
+
+		protocol::FrameView frame;
+		frame.type = protocol::MessageType::BookingOpen;
+		frame.version = protocol::kVersion;
+		frame.payload = frame_data.constData() + protocol::kHeaderSize;
+		frame.payload_size = frame_data.size() - protocol::kHeaderSize - 1;
+		QVERIFY(!protocol::Decode(frame, booking_open));
+
+		frame_data.append('\0');
+		frame.payload = frame_data.constData() + protocol::kHeaderSize;
+		frame.payload_size = frame_data.size() - protocol::kHeaderSize;
+		QVERIFY(!protocol::Decode(frame, booking_open));
+	}
+
+	void RejectsOversizedFrame()
+	{
+		QByteArray header = protocol::Encode(protocol::BookingOpen()).left(protocol::kHeaderSize);
+		qToBigEndian<quint32>(protocol::kMaxPayloadSize + 1, header.data());
+
+		FrameParser parser;
+		parser.Append(header.constData(), header.size());
+		protocol::FrameView frame;
+		QVERIFY(parser.Next(frame) == FrameParser::Status::Error);
+		QVERIFY(!parser.ErrorString().isEmpty());
+	}
+
+	void RejectsOtherVersion()
+	{
+		QByteArray frame_data = protocol::Encode(protocol::BookingOpen());
+		frame_data[5] = static_cast<char>(protocol::kVersion - 1);
+
+		FrameParser parser;
+		parser.Append(frame_data.constData(), frame_data.size());
+		protocol::FrameView frame;
+		QVERIFY(parser.Next(frame) == FrameParser::Status::Error);
+	}
+};
+
+QTEST_GUILESS_MAIN(FrameParserTest)
+
+#include "tst_frame_parser.moc"
@@ -0,0 +1,62 @@
+#include <QtTest>
+
+#include "outbound_queue.h"
+
+class OutboundQueueTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+
+	// Кадр с ключом вытесняет неотправленный кадр с тем же ключом; остальные сохраняют порядок
+	void CoalescesSameKey()
+	{
+		OutboundQueue queue;
+		QVERIFY(!queue.Push(QByteArray("open-1"), OutboundQueue::Coalesce::BookingOpen));
+		QVERIFY(!queue.Push(QByteArray("claim"), OutboundQueue::Coalesce::None));
+		QVERIFY(!queue.Push(QByteArray("settings"), OutboundQueue::Coalesce::Settings));
+		QVERIFY(queue.Push(QByteArray("open-2"), OutboundQueue::Coalesce::BookingOpen));
+
+		QCOMPARE(queue.Size(), 3);
+		QCOMPARE(queue.Bytes(), qint64(5 + 8 + 6));
+		QCOMPARE(queue.Pop(), QByteArray("claim"));
+		QCOMPARE(queue.Pop(), QByteArray("settings"));
+		QCOMPARE(queue.Pop(), QByteArray("open-2"));
+		QVERIFY(queue.IsEmpty());
+		QCOMPARE(queue.Bytes(), qint64(0));
+	}
+
+	// Кадры без ключа отправляются все
+	void NeverCoalescesNone()
+	{
+		OutboundQueue queue;
+		for (int i = 0; i < 100; ++i)
+		{
+			QVERIFY(!queue.Push(QByteArray::number(i), OutboundQueue::Coalesce::None));
+		}
+		QCOMPARE(queue.Size(), 100);
+		for (int i = 0; i < 100; ++i)
+		{
+			QCOMPARE(queue.Pop(), QByteArray::number(i));
+		}
+		QVERIFY(queue.IsEmpty());
+	}
+
+	// Уже отправленный кадр не вытесняется: новый просто встает в очередь
+	void PoppedFrameIsNotSuperseded()
+	{
+		OutboundQueue queue;
+		queue.Push(QByteArray("pack-1"), OutboundQueue::Coalesce::TemplatePack);
+		QCOMPARE(queue.Pop(), QByteArray("pack-1"));
+		QVERIFY(!queue.Push(QByteArray("pack-2"), OutboundQueue::Coalesce::TemplatePack));
+		QCOMPARE(queue.Size(), 1);
+
+		queue.Clear();
+		QVERIFY(queue.IsEmpty());
+		QCOMPARE(queue.Bytes(), qint64(0));
+	}
+};
+
+QTEST_GUILESS_MAIN(OutboundQueueTest)
+
+#include "tst_outbound_queue.moc"
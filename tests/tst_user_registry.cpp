@@ -0,0 +1,249 @@
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <cstring>
+
+#include "frame_auth.h"
+#include "registry_format.h"
+#include "user_registry.h"
+
+namespace
+{
+	// Формат записи повторяет user_registry.cpp: тест пишет файлы старой версии сам
+	const QDataStream::Version kStreamVersion = QDataStream::Qt_5_12;
+
+	quint32 Crc32(const QByteArray& data)
+	{
+		quint32 crc = 0xFFFFFFFFu;
+		for (const char byte : data)
+		{
+			crc ^= static_cast<uchar>(byte);
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+			}
+		}
+		return crc ^ 0xFFFFFFFFu;
+	}
+
+	QByteArray SerializeRecord(const QString& name, const QByteArray& key)
+	{
+		QByteArray data;
+		QDataStream stream(&data, QIODevice::WriteOnly);
+		stream.setVersion(kStreamVersion);
+		stream << name << key << qint64(0) << true << QMap<QString, QString>();
+		return data;
+	}
+
+	UserRecord MakeUser(const QString& name)
+	{
+		UserRecord record;
+		record.name = name;
+		// Реестр хранит ключ как есть: дорогой вывод из секрета (PBKDF2) здесь не нужен
+		record.key = QCryptographicHash::hash(name.toUtf8(), QCryptographicHash::Sha256);
+		record.license_until_ms = 1000;
+		record.settings.insert(QStringLiteral("detect_area_x"), name);
+		return record;
+	}
+
+	QString LogPath(const QTemporaryDir& dir)
+	{
+		return dir.filePath(QStringLiteral("users.log"));
+	}
+
+	qint64 FileSize(const QString& path)
+	{
+		return QFileInfo(path).size();
+	}
+
+	bool Resize(const QString& path, qint64 size)
+	{
+		QFile file(path);
+		return file.open(QIODevice::ReadWrite) && file.resize(size);
+	}
+}
+
+class UserRegistryTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+
+	// Запись, оборванная посередине, отбрасывается; следующие дописываются после последней целой
+	void TornTailIsDropped()
+	{
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+
+		qint64 complete_size = 0;
+		qint64 torn_size = 0;
+		{
+			UserRegistry registry;
+			QVERIFY(registry.Open(dir.path()));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("alice"))));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("bob"))));
+			complete_size = FileSize(LogPath(dir));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("carol"))));
+			torn_size = complete_size + (FileSize(LogPath(dir)) - complete_size) / 2;
+		}
+		QVERIFY(Resize(LogPath(dir), torn_size));
+
+		{
+			UserRegistry registry;
+			QVERIFY(registry.Open(dir.path()));
+			QCOMPARE(registry.Count(), 2);
+			UserRecord record;
+			QVERIFY(registry.Find(QStringLiteral("alice"), record));
+			QCOMPARE(record.key, MakeUser(QStringLiteral("alice")).key);
+			QCOMPARE(record.license_until_ms, qint64(1000));
+			QCOMPARE(record.settings.value(QStringLiteral("detect_area_x")), QStringLiteral("alice"));
+			QVERIFY(registry.Find(QStringLiteral("bob"), record));
+			QVERIFY(!registry.Find(QStringLiteral("carol"), record));
+			QCOMPARE(FileSize(LogPath(dir)), complete_size);
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("dave"))));
+		}
+
+		UserRegistry registry;
+		QVERIFY(registry.Open(dir.path()));
+		QCOMPARE(registry.Count(), 3);
+		UserRecord record;
+		QVERIFY(registry.Find(QStringLiteral("dave"), record));
+	}
+
+	// Запись с неверной контрольной суммой и все после нее не применяются
+	void CrcMismatchStopsReplay()
+	{
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+
+		qint64 complete_size = 0;
+		{
+			UserRegistry registry;
+			QVERIFY(registry.Open(dir.path()));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("alice"))));
+			complete_size = FileSize(LogPath(dir));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("bob"))));
+			QVERIFY(registry.Remove(QStringLiteral("alice")));
+		}
+
+		{
+			// Первый байт данных записи bob
+			QFile file(LogPath(dir));
+			QVERIFY(file.open(QIODevice::ReadWrite));
+			const qint64 offset = complete_size + sizeof(registry_format::EntryHeader);
+			QVERIFY(file.seek(offset));
+			char byte = 0;
+			QVERIFY(file.getChar(&byte));
+			QVERIFY(file.seek(offset));
+			QVERIFY(file.putChar(static_cast<char>(byte ^ 0x5A)));
+		}
+
+		UserRegistry registry;
+		QVERIFY(registry.Open(dir.path()));
+		QCOMPARE(registry.Count(), 1);
+		UserRecord record;
+		QVERIFY(registry.Find(QStringLiteral("alice"), record));
+		QVERIFY(!registry.Find(QStringLiteral("bob"), record));
+		QCOMPARE(FileSize(LogPath(dir)), complete_size);
+	}
+
+	// Журнал версии 1 хранит секрет: при открытии он заменяется ключом и реестр переписывается в версии 2
+	void SecretVersionIsConverted()
+	{
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+
+		const QByteArray secret("alice-secret");
+		{
+			registry_format::FileHeader header = {};
+			std::memcpy(header.magic, registry_format::kLogMagic, sizeof(header.magic));
+			header.version = registry_format::kSecretVersion;
+			header.header_size = sizeof(header);
+
+			const QByteArray data = SerializeRecord(QStringLiteral("alice"), secret);
+			registry_format::EntryHeader entry = {};
+			entry.size = static_cast<quint32>(data.size());
+			entry.crc = Crc32(data);
+			entry.operation = static_cast<quint8>(registry_format::Operation::Put);
+
+			QFile file(LogPath(dir));
+			QVERIFY(file.open(QIODevice::WriteOnly));
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+			file.write(data);
+		}
+
+		const QByteArray key = FrameAuthenticator::DeriveUserKey(QStringLiteral("alice"), secret);
+		{
+			UserRegistry registry;
+			QVERIFY(registry.Open(dir.path()));
+			UserRecord record;
+			QVERIFY(registry.Find(QStringLiteral("alice"), record));
+			QCOMPARE(record.key, key);
+		}
+
+		// Секрета на диске больше нет, и ключ при повторном открытии не выводится второй раз
+		QFile file(LogPath(dir));
+		QVERIFY(file.open(QIODevice::ReadOnly));
+		registry_format::FileHeader header = {};
+		QCOMPARE(file.read(reinterpret_cast<char*>(&header), sizeof(header)), qint64(sizeof(header)));
+		QCOMPARE(header.version, registry_format::kVersion);
+		file.close();
+
+		QFile snapshot(dir.filePath(QStringLiteral("users.snapshot")));
+		QVERIFY(snapshot.open(QIODevice::ReadOnly));
+		QVERIFY(!snapshot.readAll().contains(secret));
+
+		UserRegistry registry;
+		QVERIFY(registry.Open(dir.path()));
+		UserRecord record;
+		QVERIFY(registry.Find(QStringLiteral("alice"), record));
+		QCOMPARE(record.key, key);
+	}
+
+	// Снимок и дописанный после него журнал вместе дают то же состояние
+	void CompactThenReopen()
+	{
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+
+		{
+			UserRegistry registry;
+			QVERIFY(registry.Open(dir.path()));
+			for (int i = 0; i < 100; ++i)
+			{
+				QVERIFY(registry.Put(MakeUser(QStringLiteral("user%1").arg(i))));
+			}
+			QVERIFY(registry.Remove(QStringLiteral("user7")));
+			QVERIFY(registry.Compact());
+			QCOMPARE(FileSize(LogPath(dir)), qint64(sizeof(registry_format::FileHeader)));
+
+			UserRecord changed = MakeUser(QStringLiteral("user8"));
+			changed.enabled = false;
+			QVERIFY(registry.Put(changed));
+			QVERIFY(registry.Remove(QStringLiteral("user9")));
+			QVERIFY(registry.Put(MakeUser(QStringLiteral("user100"))));
+		}
+
+		UserRegistry registry;
+		QVERIFY(registry.Open(dir.path()));
+		QCOMPARE(registry.Count(), 99);
+		UserRecord record;
+		QVERIFY(!registry.Find(QStringLiteral("user7"), record));
+		QVERIFY(!registry.Find(QStringLiteral("user9"), record));
+		QVERIFY(registry.Find(QStringLiteral("user100"), record));
+		QVERIFY(registry.Find(QStringLiteral("user8"), record));
+		QVERIFY(!record.enabled);
+		QVERIFY(registry.Find(QStringLiteral("user42"), record));
+		QCOMPARE(record.key, MakeUser(QStringLiteral("user42")).key);
+		QCOMPARE(record.settings.value(QStringLiteral("detect_area_x")), QStringLiteral("user42"));
+	}
+};
+
+QTEST_GUILESS_MAIN(UserRegistryTest)
+
+#include "tst_user_registry.moc"